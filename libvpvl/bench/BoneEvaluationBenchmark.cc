@@ -0,0 +1,83 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static double Measure(vpvl::BoneMotion *motion, int nSeeks, float maxFrame)
+{
+    const double start = bench::Now();
+    for (int i = 0; i < nSeeks; i++)
+        motion->seek(maxFrame * i / nSeeks);
+    return bench::Now() - start;
+}
+
+/* measures evaluating all tracks of a 300 bones dance one by one and in batch */
+int main(int /* argc */, char * /* argv */[])
+{
+    static const int kNBones = 300;
+    static const int kNKeyFramesPerBone = 200;
+    static const int kNSeeks = 2000;
+    std::vector<uint8_t> modelBytes, motionBytes;
+    bench::BuildModel(modelBytes, kNBones);
+    bench::BuildMotion(motionBytes, kNBones, kNKeyFramesPerBone);
+
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+    if (!model.load(&modelBytes[0], modelBytes.size()) || !motion.load(&motionBytes[0], motionBytes.size())) {
+        fprintf(stderr, "Failed to load the generated model or motion\n");
+        return EXIT_FAILURE;
+    }
+    motion.setEnableSmooth(false);
+    motion.attachModel(&model);
+
+    vpvl::BoneMotion *bone = motion.mutableBone();
+    const float maxFrame = bone->maxIndex();
+    const double tracks = static_cast<double>(kNBones) * kNSeeks;
+    bone->setEnableBatchEvaluation(false);
+    Measure(bone, kNSeeks / 10, maxFrame);
+    const double scalarTime = Measure(bone, kNSeeks, maxFrame);
+    bone->setEnableBatchEvaluation(true);
+    Measure(bone, kNSeeks / 10, maxFrame);
+    const double batchTime = Measure(bone, kNSeeks, maxFrame);
+
+    fprintf(stdout, "tracks: %d, seeks: %d\n", kNBones, kNSeeks);
+    fprintf(stdout, "scalar: %.2f ms (%.2f tracks/us)\n", scalarTime, tracks / (scalarTime * 1000.0));
+    fprintf(stdout, "batch:  %.2f ms (%.2f tracks/us)\n", batchTime, tracks / (batchTime * 1000.0));
+    fprintf(stdout, "speedup: %.2fx\n", scalarTime / batchTime);
+    return EXIT_SUCCESS;
+}
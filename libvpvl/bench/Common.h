@@ -0,0 +1,217 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#ifndef VPVL_BENCH_COMMON_H_
+#define VPVL_BENCH_COMMON_H_
+
+#include <vpvl/vpvl.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "../gtest/Common.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+/* helpers shared by the benchmark programs */
+namespace bench
+{
+
+inline double Now()
+{
+#ifdef WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return counter.QuadPart * 1000.0 / frequency.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+#endif
+}
+
+/* the bytes are appended by the same helpers as the tests */
+using test::Append;
+using test::AppendName;
+
+/* the rigid bodies are jointed into the chains hanging like hair */
+static const int kRigidBodyChainLength = 10;
+
+inline void AppendRigidBodies(std::vector<uint8_t> &bytes, int nBones, int nRigidBodies)
+{
+    char name[20];
+    Append(bytes, uint32_t(nRigidBodies));
+    for (int i = 0; i < nRigidBodies; i++) {
+        const int chain = i / kRigidBodyChainLength, link = i % kRigidBodyChainLength;
+        snprintf(name, sizeof(name), "body%d", i);
+        AppendName(bytes, name, 20);
+        Append(bytes, uint16_t(i % nBones));
+        // the neighbor links in the other group do not collide each other
+        Append(bytes, uint8_t(link % 2));
+        Append(bytes, uint16_t(0xffff & ~(1 << ((link + 1) % 2))));
+        Append(bytes, uint8_t(2));
+        Append(bytes, 0.2f);
+        Append(bytes, 0.6f);
+        Append(bytes, 0.0f);
+        Append(bytes, chain * 0.5f);
+        Append(bytes, 20.0f - link);
+        Append(bytes, 0.0f);
+        for (int j = 0; j < 3; j++)
+            Append(bytes, 0.0f);
+        Append(bytes, 1.0f);
+        Append(bytes, 0.5f);
+        Append(bytes, 0.5f);
+        Append(bytes, 0.0f);
+        Append(bytes, 0.5f);
+        // the root of the chain follows the bone and the rest are simulated
+        Append(bytes, uint8_t(link == 0 ? 0 : 1));
+    }
+    Append(bytes, uint32_t(nRigidBodies - (nRigidBodies + kRigidBodyChainLength - 1) / kRigidBodyChainLength));
+    for (int i = 0; i < nRigidBodies; i++) {
+        const int chain = i / kRigidBodyChainLength, link = i % kRigidBodyChainLength;
+        if (link == 0)
+            continue;
+        snprintf(name, sizeof(name), "joint%d", i);
+        AppendName(bytes, name, 20);
+        Append(bytes, uint32_t(i - 1));
+        Append(bytes, uint32_t(i));
+        Append(bytes, chain * 0.5f);
+        Append(bytes, 20.5f - link);
+        Append(bytes, 0.0f);
+        for (int j = 0; j < 9; j++)
+            Append(bytes, 0.0f);
+        for (int j = 0; j < 3; j++)
+            Append(bytes, -0.3f);
+        for (int j = 0; j < 3; j++)
+            Append(bytes, 0.3f);
+        for (int j = 0; j < 6; j++)
+            Append(bytes, 0.0f);
+    }
+}
+
+/* builds a PMD that has the vertices, the bones named "bone0", "bone1"... and the rigid bodies */
+inline void BuildModel(std::vector<uint8_t> &bytes, int nBones, int nVertices = 1, int nRigidBodies = 0)
+{
+    char name[20];
+    bytes.clear();
+    AppendName(bytes, "Pmd", 3);
+    Append(bytes, 1.0f);
+    AppendName(bytes, "bench", 20);
+    AppendName(bytes, "", 256);
+    Append(bytes, uint32_t(nVertices));
+    for (int i = 0; i < nVertices; i++) {
+        // blends two neighbor bones so that all vertices take the weighted path
+        Append(bytes, float(i % 100));
+        Append(bytes, float(i / 100));
+        Append(bytes, 0.0f);
+        Append(bytes, 0.0f);
+        Append(bytes, 0.0f);
+        Append(bytes, 1.0f);
+        Append(bytes, 0.0f);
+        Append(bytes, 0.0f);
+        Append(bytes, uint16_t(i % nBones));
+        Append(bytes, uint16_t((i + 1) % nBones));
+        Append(bytes, uint8_t(50));
+        Append(bytes, uint8_t(0));
+    }
+    Append(bytes, uint32_t(3));
+    for (int i = 0; i < 3; i++)
+        Append(bytes, uint16_t(0));
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint16_t(nBones));
+    for (int i = 0; i < nBones; i++) {
+        snprintf(name, sizeof(name), "bone%d", i);
+        AppendName(bytes, name, 20);
+        Append(bytes, uint16_t(i == 0 ? 0xffff : i - 1));
+        Append(bytes, uint16_t(0));
+        Append(bytes, uint8_t(1));
+        Append(bytes, uint16_t(0));
+        for (int j = 0; j < 3; j++)
+            Append(bytes, 0.0f);
+    }
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint8_t(0));
+    AppendName(bytes, "", 1000);
+    if (nRigidBodies > 0)
+        AppendRigidBodies(bytes, nBones, nRigidBodies);
+}
+
+/* builds a VMD of the bones named "bone0", "bone1"... with curved interpolation */
+inline void BuildMotion(std::vector<uint8_t> &bytes, int nBones, int nKeyFramesPerBone)
+{
+    char name[16];
+    bytes.clear();
+    AppendName(bytes, "Vocaloid Motion Data 0002", 30);
+    AppendName(bytes, "bench", 20);
+    Append(bytes, uint32_t(nBones * nKeyFramesPerBone));
+    for (int i = 0; i < nKeyFramesPerBone; i++) {
+        for (int j = 0; j < nBones; j++) {
+            const float t = i * 0.1f + j;
+            const btQuaternion rotation(btVector3(0.0f, 1.0f, 0.0f), t);
+            snprintf(name, sizeof(name), "bone%d", j);
+            AppendName(bytes, name, 15);
+            Append(bytes, uint32_t(i * 2));
+            Append(bytes, float(sinf(t)));
+            Append(bytes, float(cosf(t)));
+            Append(bytes, 0.0f);
+            Append(bytes, float(rotation.x()));
+            Append(bytes, float(rotation.y()));
+            Append(bytes, float(rotation.z()));
+            Append(bytes, float(rotation.w()));
+            for (int k = 0; k < 64; k++) {
+                // x1, y1, x2, y2 of each channel are different so that all tables are built
+                static const int8_t kCurve[] = { 32, 8, 96, 120 };
+                Append(bytes, int8_t(k < 16 ? kCurve[k / 4] : 0));
+            }
+        }
+    }
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint32_t(0));
+}
+
+}
+
+#endif
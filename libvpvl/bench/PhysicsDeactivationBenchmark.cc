@@ -0,0 +1,91 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static double Measure(vpvl::Scene *scene, int nUpdates)
+{
+    const double start = bench::Now();
+    for (int i = 0; i < nUpdates; i++)
+        scene->update(1.0f);
+    return bench::Now() - start;
+}
+
+/* measures simulating N idle models of the jointed rigid bodies with and without deactivation */
+int main(int argc, char *argv[])
+{
+    static const int kNBones = 30;
+    static const int kNRigidBodies = 100;
+    static const int kNSettlingUpdates = 300;
+    static const int kNUpdates = 300;
+    static const int kFPS = 30;
+    const int nModels = argc > 1 ? atoi(argv[1]) : 4;
+    std::vector<uint8_t> modelBytes;
+    bench::BuildModel(modelBytes, kNBones, 1, kNRigidBodies);
+
+    double times[2];
+    int nActiveBodies[2], nSleepingBodies[2];
+    fprintf(stdout, "models: %d, rigid bodies: %d, settling updates: %d, updates: %d\n", nModels,
+            kNRigidBodies, kNSettlingUpdates, kNUpdates);
+    for (int i = 0; i < 2; i++) {
+        vpvl::World world(kFPS, 1);
+        vpvl::PMDModel *models = new vpvl::PMDModel[nModels];
+        vpvl::Scene *scene = new vpvl::Scene(640, 480, kFPS);
+        scene->setWorld(world.mutableWorld());
+        for (int j = 0; j < nModels; j++) {
+            if (!models[j].load(&modelBytes[0], modelBytes.size())) {
+                fprintf(stderr, "Failed to load the generated model\n");
+                return EXIT_FAILURE;
+            }
+            models[j].setEnableDeactivation(i == 1);
+            scene->addModel(&models[j]);
+        }
+        // the bones stay still, so the chains settle and fall asleep if enabled
+        Measure(scene, kNSettlingUpdates);
+        times[i] = Measure(scene, kNUpdates);
+        nActiveBodies[i] = scene->countActiveRigidBodies();
+        nSleepingBodies[i] = scene->countSleepingRigidBodies();
+        delete scene;
+        delete[] models;
+    }
+    fprintf(stdout, "always active: %8.2f ms (active: %d, sleeping: %d)\n", times[0], nActiveBodies[0], nSleepingBodies[0]);
+    fprintf(stdout, "deactivation:  %8.2f ms (active: %d, sleeping: %d)\n", times[1], nActiveBodies[1], nSleepingBodies[1]);
+    fprintf(stdout, "speedup: %.2fx\n", times[0] / times[1]);
+    return EXIT_SUCCESS;
+}
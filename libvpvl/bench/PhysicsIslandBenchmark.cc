@@ -0,0 +1,109 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static double Measure(vpvl::Scene *scene, int nUpdates)
+{
+    const double start = bench::Now();
+    for (int i = 0; i < nUpdates; i++)
+        scene->update(1.0f);
+    return bench::Now() - start;
+}
+
+/* measures simulating N models in the shared world and in the island world of each model */
+int main(int argc, char *argv[])
+{
+    static const int kNBones = 30;
+    static const int kNRigidBodies = 100;
+    static const int kNKeyFramesPerBone = 100;
+    static const int kNUpdates = 300;
+    static const int kFPS = 30;
+    const int nModels = argc > 1 ? atoi(argv[1]) : 10;
+    std::vector<uint8_t> modelBytes, motionBytes;
+    bench::BuildModel(modelBytes, kNBones, 1, kNRigidBodies);
+    bench::BuildMotion(motionBytes, kNBones, kNKeyFramesPerBone);
+
+    vpvl::ThreadPool pool;
+    vpvl::World shared(kFPS, 1);
+    vpvl::World **islands = new vpvl::World *[nModels];
+    for (int i = 0; i < nModels; i++)
+        islands[i] = new vpvl::World(kFPS, 1);
+    fprintf(stdout, "threads: %d, models: %d, rigid bodies: %d, updates: %d\n",
+            pool.countThreads() + 1, nModels, kNRigidBodies, kNUpdates);
+    // shared world, islands stepped serially and islands stepped on the pool
+    double times[3];
+    int nConcurrentWorlds = 0;
+    for (int i = 0; i < 3; i++) {
+        vpvl::PMDModel *models = new vpvl::PMDModel[nModels];
+        vpvl::VMDMotion *motions = new vpvl::VMDMotion[nModels];
+        vpvl::Scene *scene = new vpvl::Scene(640, 480, kFPS);
+        scene->setWorld(shared.mutableWorld());
+        if (i == 2)
+            scene->setThreadPool(&pool);
+        for (int j = 0; j < nModels; j++) {
+            if (!models[j].load(&modelBytes[0], modelBytes.size()) || !motions[j].load(&motionBytes[0], motionBytes.size())) {
+                fprintf(stderr, "Failed to load the generated model or motion\n");
+                return EXIT_FAILURE;
+            }
+            motions[j].setLoop(true);
+            models[j].addMotion(&motions[j]);
+            scene->addModel(&models[j]);
+            if (i > 0)
+                scene->setIslandWorld(&models[j], islands[j]->mutableWorld());
+        }
+        Measure(scene, kNUpdates / 10);
+        times[i] = Measure(scene, kNUpdates);
+        if (i == 2)
+            nConcurrentWorlds = scene->countConcurrentWorlds();
+        delete scene;
+        delete[] motions;
+        delete[] models;
+    }
+    fprintf(stdout, "shared: %8.2f ms, islands: %8.2f ms, parallel islands: %8.2f ms, speedup: %.2fx\n",
+            times[0], times[1], times[2], times[0] / times[2]);
+    if (nConcurrentWorlds > 0)
+        fprintf(stdout, "parallel islands: %d worlds stepped concurrently\n", nConcurrentWorlds);
+    else
+        fprintf(stdout, "parallel islands: stepped serially (VPVL_ENABLE_CONCURRENT_ISLAND_WORLDS is off)\n");
+    for (int i = 0; i < nModels; i++)
+        delete islands[i];
+    delete[] islands;
+    return EXIT_SUCCESS;
+}
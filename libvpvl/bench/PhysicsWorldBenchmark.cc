@@ -0,0 +1,92 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static double Measure(vpvl::Scene *scene, int nUpdates)
+{
+    const double start = bench::Now();
+    for (int i = 0; i < nUpdates; i++)
+        scene->update(1.0f);
+    return bench::Now() - start;
+}
+
+/* measures simulating N models of the jointed rigid bodies in the sequential and the multithreaded world */
+int main(int argc, char *argv[])
+{
+    static const int kNBones = 30;
+    static const int kNRigidBodies = 100;
+    static const int kNKeyFramesPerBone = 100;
+    static const int kNUpdates = 300;
+    static const int kFPS = 30;
+    const int nModels = argc > 1 ? atoi(argv[1]) : 4;
+    const int nThreads = argc > 2 ? atoi(argv[2]) : -1;
+    std::vector<uint8_t> modelBytes, motionBytes;
+    bench::BuildModel(modelBytes, kNBones, 1, kNRigidBodies);
+    bench::BuildMotion(motionBytes, kNBones, kNKeyFramesPerBone);
+
+    vpvl::World sequential(kFPS, 1), parallel(kFPS, nThreads);
+    vpvl::World *worlds[] = { &sequential, &parallel };
+    double times[2];
+    fprintf(stdout, "models: %d, rigid bodies: %d, joints: %d, updates: %d\n", nModels,
+            kNRigidBodies, kNRigidBodies - kNRigidBodies / bench::kRigidBodyChainLength, kNUpdates);
+    for (int i = 0; i < 2; i++) {
+        vpvl::PMDModel *models = new vpvl::PMDModel[nModels];
+        vpvl::VMDMotion *motions = new vpvl::VMDMotion[nModels];
+        vpvl::Scene *scene = new vpvl::Scene(640, 480, kFPS);
+        scene->setWorld(worlds[i]->mutableWorld());
+        for (int j = 0; j < nModels; j++) {
+            if (!models[j].load(&modelBytes[0], modelBytes.size()) || !motions[j].load(&motionBytes[0], motionBytes.size())) {
+                fprintf(stderr, "Failed to load the generated model or motion\n");
+                return EXIT_FAILURE;
+            }
+            motions[j].setLoop(true);
+            models[j].addMotion(&motions[j]);
+            scene->addModel(&models[j]);
+        }
+        Measure(scene, kNUpdates / 10);
+        times[i] = Measure(scene, kNUpdates);
+        delete scene;
+        delete[] motions;
+        delete[] models;
+    }
+    fprintf(stdout, "sequential: %8.2f ms, parallel (%d threads): %8.2f ms, speedup: %.2fx\n",
+            times[0], parallel.countThreads(), times[1], times[0] / times[1]);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static double MeasureUpdate(vpvl::PMDModel *model, int nUpdates)
+{
+    const double start = bench::Now();
+    for (int i = 0; i < nUpdates; i++)
+        model->updateMotion(1.0f);
+    return bench::Now() - start;
+}
+
+/* synchronizes the rigid bodies one by one through RigidBody as before */
+static double MeasurePerBody(const vpvl::PMDModel *model, int nUpdates)
+{
+    const vpvl::RigidBodyList &rigidBodies = model->rigidBodies();
+    const int nRigidBodies = rigidBodies.size();
+    const double start = bench::Now();
+    for (int i = 0; i < nUpdates; i++) {
+        for (int j = 0; j < nRigidBodies; j++) {
+            vpvl::RigidBody *rigidBody = rigidBodies[j];
+            if (rigidBody->type() == 0)
+                rigidBody->body()->setWorldTransform(rigidBody->bone()->localTransform() * rigidBody->transform());
+            else
+                rigidBody->transformBone();
+        }
+    }
+    return bench::Now() - start;
+}
+
+/* measures synchronizing a 300 rigid bodies model with its bones before and after stepping the world */
+int main(int /* argc */, char * /* argv */[])
+{
+    static const int kNBones = 100;
+    static const int kNRigidBodies = 300;
+    static const int kNKeyFramesPerBone = 100;
+    static const int kNUpdates = 2000;
+    static const int kFPS = 30;
+    std::vector<uint8_t> modelBytes, motionBytes;
+    bench::BuildModel(modelBytes, kNBones, 1, kNRigidBodies);
+    bench::BuildMotion(motionBytes, kNBones, kNKeyFramesPerBone);
+
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+    if (!model.load(&modelBytes[0], modelBytes.size()) || !motion.load(&motionBytes[0], motionBytes.size())) {
+        fprintf(stderr, "Failed to load the generated model or motion\n");
+        return EXIT_FAILURE;
+    }
+    motion.setLoop(true);
+    model.addMotion(&motion);
+
+    // the motion is evaluated in both cases, so the difference is the cost of the synchronization
+    vpvl::World world(kFPS, 1);
+    MeasureUpdate(&model, kNUpdates / 10);
+    const double motionTime = MeasureUpdate(&model, kNUpdates);
+    model.joinWorld(world.mutableWorld());
+    MeasureUpdate(&model, kNUpdates / 10);
+    const double simulatedTime = MeasureUpdate(&model, kNUpdates);
+    MeasurePerBody(&model, kNUpdates / 10);
+    const double perBodyTime = MeasurePerBody(&model, kNUpdates);
+    model.leaveWorld(world.mutableWorld());
+
+    const double batchTime = simulatedTime - motionTime;
+    fprintf(stdout, "rigid bodies: %d, kinematic: %d, updates: %d\n", kNRigidBodies,
+            kNRigidBodies / bench::kRigidBodyChainLength, kNUpdates);
+    fprintf(stdout, "motion only: %8.2f ms, with synchronization: %8.2f ms\n", motionTime, simulatedTime);
+    fprintf(stdout, "per body: %8.2f ms, batch: %8.2f ms (%.2f bodies/us)\n",
+            perBodyTime, batchTime, kNRigidBodies * double(kNUpdates) / (batchTime * 1000.0));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static double Measure(vpvl::Scene *scene, int nUpdates)
+{
+    const double start = bench::Now();
+    for (int i = 0; i < nUpdates; i++)
+        scene->update(1.0f);
+    return bench::Now() - start;
+}
+
+/* measures updating 1 to N models in a scene serially and on the thread pool */
+int main(int argc, char *argv[])
+{
+    static const int kNBones = 100;
+    static const int kNVertices = 20000;
+    static const int kNKeyFramesPerBone = 100;
+    static const int kNUpdates = 100;
+    const int maxModels = argc > 1 ? atoi(argv[1]) : 16;
+    std::vector<uint8_t> modelBytes, motionBytes;
+    bench::BuildModel(modelBytes, kNBones, kNVertices);
+    bench::BuildMotion(motionBytes, kNBones, kNKeyFramesPerBone);
+
+    vpvl::ThreadPool pool;
+    vpvl::PMDModel *models = new vpvl::PMDModel[maxModels];
+    vpvl::VMDMotion *motions = new vpvl::VMDMotion[maxModels];
+    for (int i = 0; i < maxModels; i++) {
+        if (!models[i].load(&modelBytes[0], modelBytes.size()) || !motions[i].load(&motionBytes[0], motionBytes.size())) {
+            fprintf(stderr, "Failed to load the generated model or motion\n");
+            return EXIT_FAILURE;
+        }
+        motions[i].setLoop(true);
+        models[i].addMotion(&motions[i]);
+    }
+
+    fprintf(stdout, "threads: %d, bones: %d, vertices: %d, updates: %d\n",
+            pool.countThreads() + 1, kNBones, kNVertices, kNUpdates);
+    for (int nModels = 1; nModels <= maxModels; nModels *= 2) {
+        vpvl::Scene scene(640, 480, 30);
+        for (int i = 0; i < nModels; i++)
+            scene.addModel(&models[i]);
+        Measure(&scene, kNUpdates / 10);
+        const double serialTime = Measure(&scene, kNUpdates);
+        scene.setThreadPool(&pool);
+        Measure(&scene, kNUpdates / 10);
+        const double parallelTime = Measure(&scene, kNUpdates);
+        fprintf(stdout, "models: %2d, serial: %8.2f ms, parallel: %8.2f ms, speedup: %.2fx\n",
+                nModels, serialTime, parallelTime, serialTime / parallelTime);
+    }
+    delete[] motions;
+    delete[] models;
+    return EXIT_SUCCESS;
+}
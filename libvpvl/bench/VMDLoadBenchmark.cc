@@ -0,0 +1,78 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "Common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* measures loading a generated motion of 500k bone key frames with and without ThreadPool */
+int main(int argc, char *argv[])
+{
+    static const int kNBones = 100;
+    static const int kNKeyFramesPerBone = 5000;
+    const int nThreads = argc > 1 ? atoi(argv[1]) : -1;
+    std::vector<uint8_t> bytes;
+    bench::BuildMotion(bytes, kNBones, kNKeyFramesPerBone);
+
+    vpvl::VMDMotion serial;
+    double start = bench::Now();
+    if (!serial.load(&bytes[0], bytes.size())) {
+        fprintf(stderr, "Failed to load the generated motion: %d\n", serial.error());
+        return EXIT_FAILURE;
+    }
+    const double serialTime = bench::Now() - start;
+
+    vpvl::ThreadPool pool(nThreads);
+    vpvl::VMDMotion parallel;
+    parallel.setThreadPool(&pool);
+    start = bench::Now();
+    parallel.load(&bytes[0], bytes.size());
+    const double parallelTime = bench::Now() - start;
+
+    // The results must be the same byte by byte
+    const size_t size = serial.estimateSize();
+    std::vector<uint8_t> serialBytes(size), parallelBytes(parallel.estimateSize());
+    serial.save(&serialBytes[0]);
+    parallel.save(&parallelBytes[0]);
+    const bool identical = serialBytes == parallelBytes;
+
+    fprintf(stdout, "key frames: %d\n", serial.bone().frames().size());
+    fprintf(stdout, "serial:     %.2f ms\n", serialTime);
+    fprintf(stdout, "parallel:   %.2f ms (%d workers and the caller)\n", parallelTime, pool.countThreads());
+    fprintf(stdout, "speedup:    %.2fx\n", serialTime / parallelTime);
+    fprintf(stdout, "identical:  %s\n", identical ? "yes" : "NO");
+    return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -36,6 +36,8 @@
 /* POSSIBILITY OF SUCH DAMAGE.                                       */
 /* ----------------------------------------------------------------- */
 
+#include <stddef.h>
+#include <string.h>
 #include <vpvl/vpvl.h>
 #include <vpvl/gl/Renderer.h>
 
@@ -44,37 +46,812 @@ namespace vpvl
 
 enum __vpvlVertexBufferObjectType {
     kModelVertices,
-    kModelNormals,
-    kModelColors,
-    kModelTexCoords,
-    kModelToonTexCoords,
-    kEdgeVertices,
+    kModelSkinningVertices,
     kEdgeIndices,
     kShadowIndices,
     kVertexBufferObjectMax
 };
 
+enum __vpvlSkinningAttributeType {
+    kSkinningPositionAttribute,
+    kSkinningNormalAttribute,
+    kSkinningTextureCoordAttribute,
+    kSkinningBoneAttribute,
+    kSkinningFaceIndexAttribute,
+    kSkinningAttributeMax
+};
+
+enum __vpvlSkinningPassType {
+    kSkinningModelPass,
+    kSkinningEdgePass,
+    kSkinningShadowPass
+};
+
+struct __vpvlSkinningVertex {
+    float position[3];
+    float normal[3];
+    float textureCoord[2];
+    float bone[4];
+    float faceIndex;
+};
+
+enum __vpvlClientStateType {
+    kVertexArray,
+    kNormalArray,
+    kTextureCoordArray,
+    kToonTextureCoordArray,
+    kClientStateMax
+};
+
+/* the primary texture, the toon texture and the second sphere map */
+enum __vpvlMaterialTextureType {
+    kPrimaryTexture,
+    kToonTexture,
+    kSecondTexture,
+    kMaterialTextureMax
+};
+
+/* a material of a model to draw and the states it needs, the texture of ID 0 is disabled */
+struct __vpvlDrawCommand {
+    const vpvl::PMDModel *model;
+    const vpvl::Material *material;
+    GLuint textureIDs[kMaterialTextureMax];
+    GLint textureModes[kMaterialTextureMax];
+    bool enableSphereMaps[kMaterialTextureMax];
+    bool enableCullFace;
+    bool isTranslucent;
+    bool isSkinning;
+    uint32_t offset;
+    uint32_t nIndices;
+};
+
+/* the states last set while drawing the commands, -1 and kUnknownTextureID are not known yet */
+struct __vpvlDrawState {
+    const vpvl::PMDModel *model;
+    const vpvl::Material *material;
+    btVector4 color;
+    GLuint textureIDs[kMaterialTextureMax];
+    GLint textureModes[kMaterialTextureMax];
+    int enableTextures[kMaterialTextureMax];
+    int enableSphereMaps[kMaterialTextureMax];
+    int enableSphereMapUniforms[kMaterialTextureMax];
+    int enableClientStates[kClientStateMax];
+    int activeTexture;
+    int clientActiveTexture;
+    int enableCullFace;
+    int enableLighting;
+    int hasColor;
+    int isSkinning;
+    int pass;
+    GLint cullFace;
+    int nDrawCalls;
+    int nStateChanges;
+};
+
+/* the handles are the textures requested to the texture cache and -1 if not requested */
 struct __vpvlPMDModelMaterialPrivate {
     GLuint primaryTextureID;
     GLuint secondTextureID;
+    int primaryTextureHandle;
+    int secondTextureHandle;
 };
 
 struct PMDModelUserData {
     GLuint toonTextureID[vpvl::PMDModel::kSystemTextureMax];
+    int toonTextureHandles[vpvl::PMDModel::kSystemTextureMax];
     GLuint vertexBufferObjects[kVertexBufferObjectMax];
+    GLsizeiptr vertexBufferSize;
+    GLintptr normalsOffset;
+    GLintptr textureCoordsOffset;
+    GLintptr toonTextureCoordsOffset;
+    GLintptr edgeVerticesOffset;
+    GLuint boneTextureID;
+    GLuint faceTextureID;
+    GLsizei faceTextureWidth;
+    GLsizei faceTextureHeight;
+    bool isSkinnableByShader;
     bool hasSingleSphereMap;
     bool hasMultipleSphereMap;
+    bool hasPendingTextures;
     __vpvlPMDModelMaterialPrivate *materials;
 };
 
+enum __vpvlXModelBufferType {
+    kXModelVertices,
+    kXModelIndices,
+    kXModelBufferMax
+};
+
+struct __vpvlXModelRangePrivate {
+    uint32_t materialIndex;
+    uint32_t offset;
+    uint32_t count;
+    GLuint textureID;
+    int textureHandle;
+};
+
 struct XModelUserData {
-    GLuint listID;
+    GLuint vertexBufferObjects[kXModelBufferMax];
+    btAlignedObjectArray<__vpvlXModelRangePrivate> ranges;
     btHashMap<btHashString, GLuint> textures;
+    bool hasNormals;
+    bool hasTextureCoords;
+    bool hasColors;
+    bool hasPendingTextures;
 };
 
 namespace gl
 {
 
+/* the vertices of the base face are laid out in the rows of the texture */
+static const GLsizei kFaceTextureWidth = 256;
+
+/*
+ * Skins the vertex by the matrices and the morphed vertices in the textures and
+ * computes the fixed function lighting, the sphere maps and the toon texture
+ * coordinates as the software skinning path, and the fragments are processed
+ * by the fixed function pipeline.
+ */
+static const char kSkinningShaderSource[] =
+        "#version 120\n"
+        "uniform sampler2D boneTexture;\n"
+        "uniform sampler2D faceTexture;\n"
+        "uniform vec2 boneTextureSize;\n"
+        "uniform vec2 faceTextureSize;\n"
+        "uniform vec3 lightDirection;\n"
+        "uniform float edgeOffset;\n"
+        "uniform int pass;\n"
+        "uniform bool enableSphereMap;\n"
+        "uniform bool enableSecondSphereMap;\n"
+        "attribute vec3 position;\n"
+        "attribute vec3 normal;\n"
+        "attribute vec2 textureCoord;\n"
+        "attribute vec4 bone;\n"
+        "attribute float faceIndex;\n"
+        "vec4 fetch(sampler2D texture, vec2 size, float index) {\n"
+        "    float y = floor(index / size.x);\n"
+        "    return texture2DLod(texture, (vec2(index - y * size.x, y) + 0.5) / size, 0.0);\n"
+        "}\n"
+        "void skin(float index, vec4 position, out vec3 skinnedPosition, out vec3 skinnedNormal) {\n"
+        "    vec4 row0 = fetch(boneTexture, boneTextureSize, index * 3.0);\n"
+        "    vec4 row1 = fetch(boneTexture, boneTextureSize, index * 3.0 + 1.0);\n"
+        "    vec4 row2 = fetch(boneTexture, boneTextureSize, index * 3.0 + 2.0);\n"
+        "    skinnedPosition = vec3(dot(row0, position), dot(row1, position), dot(row2, position));\n"
+        "    skinnedNormal = vec3(dot(row0.xyz, normal), dot(row1.xyz, normal), dot(row2.xyz, normal));\n"
+        "}\n"
+        "vec4 sphereMap(vec3 eyePosition, vec3 eyeNormal) {\n"
+        "    vec3 r = reflect(normalize(eyePosition), eyeNormal);\n"
+        "    float m = 2.0 * sqrt(r.x * r.x + r.y * r.y + (r.z + 1.0) * (r.z + 1.0));\n"
+        "    return vec4(r.x / m + 0.5, r.y / m + 0.5, 0.0, 1.0);\n"
+        "}\n"
+        "void main() {\n"
+        "    vec4 restPosition = vec4(faceIndex >= 0.0 ? fetch(faceTexture, faceTextureSize, faceIndex).xyz : position, 1.0);\n"
+        "    vec3 position1, normal1, position2, normal2;\n"
+        "    skin(bone.x, restPosition, position1, normal1);\n"
+        "    skin(bone.y, restPosition, position2, normal2);\n"
+        "    vec3 skinnedPosition = mix(position2, position1, bone.z);\n"
+        "    vec3 skinnedNormal = mix(normal2, normal1, bone.z);\n"
+        "    if (pass == 1)\n"
+        "        skinnedPosition += skinnedNormal * edgeOffset * bone.w;\n"
+        "    gl_Position = gl_ModelViewProjectionMatrix * vec4(skinnedPosition, 1.0);\n"
+        "    if (pass != 0) {\n"
+        "        gl_FrontColor = gl_Color;\n"
+        "        return;\n"
+        "    }\n"
+        "    vec3 eyePosition = (gl_ModelViewMatrix * vec4(skinnedPosition, 1.0)).xyz;\n"
+        "    vec3 eyeNormal = gl_NormalMatrix * skinnedNormal;\n"
+        "    vec3 light = normalize(gl_LightSource[0].position.xyz);\n"
+        "    float diffuse = max(dot(eyeNormal, light), 0.0);\n"
+        "    float specular = diffuse > 0.0 ? pow(max(dot(eyeNormal, gl_LightSource[0].halfVector.xyz), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+        "    vec4 color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient\n"
+        "            + gl_FrontLightProduct[0].diffuse * diffuse + gl_FrontLightProduct[0].specular * specular;\n"
+        "    gl_FrontColor = vec4(color.rgb, gl_FrontMaterial.diffuse.a);\n"
+        "    gl_TexCoord[0] = enableSphereMap ? sphereMap(eyePosition, eyeNormal) : vec4(textureCoord, 0.0, 1.0);\n"
+        "    gl_TexCoord[1] = vec4(0.0, (1.0 - dot(lightDirection, skinnedNormal)) * 0.5, 0.0, 1.0);\n"
+        "    gl_TexCoord[2] = enableSecondSphereMap ? sphereMap(eyePosition, eyeNormal) : gl_MultiTexCoord2;\n"
+        "}\n";
+
+static bool RendererIsShaderSkinningSupported()
+{
+    const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    const char *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    GLint nVertexTextureUnits = 0;
+    if (!version || version[0] < '2')
+        return false;
+    // the matrices and the morphed vertices are fetched from float textures
+    glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &nVertexTextureUnits);
+    if (nVertexTextureUnits < 2)
+        return false;
+    return version[0] >= '3' || (extensions && strstr(extensions, "GL_ARB_texture_float"));
+}
+
+static GLuint RendererCreateSkinningProgram()
+{
+    if (!RendererIsShaderSkinningSupported())
+        return 0;
+    const char *source = kSkinningShaderSource;
+    GLint compiled = 0, linked = 0;
+    GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(shader, 1, &source, 0);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        glDeleteShader(shader);
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glBindAttribLocation(program, kSkinningPositionAttribute, "position");
+    glBindAttribLocation(program, kSkinningNormalAttribute, "normal");
+    glBindAttribLocation(program, kSkinningTextureCoordAttribute, "textureCoord");
+    glBindAttribLocation(program, kSkinningBoneAttribute, "bone");
+    glBindAttribLocation(program, kSkinningFaceIndexAttribute, "faceIndex");
+    glLinkProgram(program);
+    // the program keeps the shader until it is deleted
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static GLuint RendererCreateSkinningTexture(GLsizei width, GLsizei height)
+{
+    GLuint textureID = 0;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return textureID;
+}
+
+static void RendererLoadSkinning(const vpvl::PMDModel *model, vpvl::PMDModelUserData *userData)
+{
+    const vpvl::VertexList &vertices = model->vertices();
+    const vpvl::Face *baseFace = model->baseFace();
+    const int nVertices = vertices.size(), nBones = model->bones().size();
+    const int nFaceVertices = baseFace ? baseFace->vertices().size() : 0;
+    const GLsizei width = btMax(1, btMin(nFaceVertices, static_cast<int>(kFaceTextureWidth)));
+    const GLsizei height = btMax(1, (nFaceVertices + width - 1) / width);
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (nVertices == 0 || nBones == 0 || nBones > maxTextureSize || height > maxTextureSize)
+        return;
+    __vpvlSkinningVertex *skinningVertices = new __vpvlSkinningVertex[nVertices];
+    for (int i = 0; i < nVertices; i++) {
+        const vpvl::Vertex *vertex = vertices[i];
+        const btVector3 &position = vertex->position(), &normal = vertex->normal();
+        __vpvlSkinningVertex &v = skinningVertices[i];
+        for (int j = 0; j < 3; j++) {
+            v.position[j] = position[j];
+            v.normal[j] = normal[j];
+        }
+        v.textureCoord[0] = vertex->u();
+        v.textureCoord[1] = vertex->v();
+        v.bone[0] = vertex->bone1();
+        v.bone[1] = vertex->bone2();
+        v.bone[2] = vertex->weight();
+        v.bone[3] = vertex->isEdgeEnabled() ? 1.0f : 0.0f;
+        v.faceIndex = -1.0f;
+    }
+    for (int i = 0; i < nFaceVertices; i++) {
+        const uint32_t id = baseFace->vertices()[i]->id;
+        if (id < static_cast<uint32_t>(nVertices))
+            skinningVertices[id].faceIndex = static_cast<float>(i);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelSkinningVertices]);
+    glBufferData(GL_ARRAY_BUFFER, nVertices * sizeof(__vpvlSkinningVertex), skinningVertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    delete[] skinningVertices;
+    userData->boneTextureID = RendererCreateSkinningTexture(3, nBones);
+    userData->faceTextureID = RendererCreateSkinningTexture(width, height);
+    userData->faceTextureWidth = width;
+    userData->faceTextureHeight = height;
+    userData->isSkinnableByShader = true;
+}
+
+static bool RendererIsSkinnedByShader(const vpvl::PMDModel *model)
+{
+    return !model->enableSoftwareSkinning() && model->userData()->isSkinnableByShader;
+}
+
+/* binds the static vertices, the textures and the uniforms of the model to the skinning program in use */
+static void RendererBindSkinningModel(GLuint program, const vpvl::PMDModel *model)
+{
+    const vpvl::PMDModelUserData *userData = model->userData();
+    const btVector3 &lightDirection = model->lightDirection();
+    const GLsizei stride = sizeof(__vpvlSkinningVertex);
+    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelSkinningVertices]);
+    glVertexAttribPointer(kSkinningPositionAttribute, 3, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const GLvoid *>(offsetof(__vpvlSkinningVertex, position)));
+    glVertexAttribPointer(kSkinningNormalAttribute, 3, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const GLvoid *>(offsetof(__vpvlSkinningVertex, normal)));
+    glVertexAttribPointer(kSkinningTextureCoordAttribute, 2, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const GLvoid *>(offsetof(__vpvlSkinningVertex, textureCoord)));
+    glVertexAttribPointer(kSkinningBoneAttribute, 4, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const GLvoid *>(offsetof(__vpvlSkinningVertex, bone)));
+    glVertexAttribPointer(kSkinningFaceIndexAttribute, 1, GL_FLOAT, GL_FALSE, stride,
+                          reinterpret_cast<const GLvoid *>(offsetof(__vpvlSkinningVertex, faceIndex)));
+    // the units after the ones of the primary texture, the toon texture and the second sphere map
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, userData->boneTextureID);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, userData->faceTextureID);
+    glActiveTexture(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(program, "boneTexture"), 3);
+    glUniform1i(glGetUniformLocation(program, "faceTexture"), 4);
+    glUniform2f(glGetUniformLocation(program, "boneTextureSize"), 3.0f, static_cast<float>(model->bones().size()));
+    glUniform2f(glGetUniformLocation(program, "faceTextureSize"),
+                static_cast<float>(userData->faceTextureWidth), static_cast<float>(userData->faceTextureHeight));
+    glUniform3f(glGetUniformLocation(program, "lightDirection"), lightDirection.x(), lightDirection.y(), lightDirection.z());
+    glUniform1f(glGetUniformLocation(program, "edgeOffset"), model->edgeOffset());
+}
+
+static void RendererBeginSkinning(GLuint program, const vpvl::PMDModel *model, __vpvlSkinningPassType pass)
+{
+    glUseProgram(program);
+    for (int i = 0; i < kSkinningAttributeMax; i++)
+        glEnableVertexAttribArray(i);
+    RendererBindSkinningModel(program, model);
+    glUniform1i(glGetUniformLocation(program, "pass"), pass);
+    glUniform1i(glGetUniformLocation(program, "enableSphereMap"), 0);
+    glUniform1i(glGetUniformLocation(program, "enableSecondSphereMap"), 0);
+}
+
+static void RendererEndSkinning()
+{
+    for (int i = 0; i < kSkinningAttributeMax; i++)
+        glDisableVertexAttribArray(i);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(0);
+}
+
+#ifdef VPVL_COORDINATE_OPENGL
+static const GLenum kModelCullFace = GL_BACK;
+static const GLenum kEdgeCullFace = GL_FRONT;
+#else
+static const GLenum kModelCullFace = GL_FRONT;
+static const GLenum kEdgeCullFace = GL_BACK;
+#endif
+static const GLuint kUnknownTextureID = ~0u;
+
+static bool RendererIsSameMaterial(const vpvl::Material *left, const vpvl::Material *right)
+{
+    return left->averageColor() == right->averageColor()
+            && left->specular() == right->specular()
+            && left->opacity() == right->opacity()
+            && left->shiness() == right->shiness();
+}
+
+static bool RendererIsSameDrawState(const __vpvlDrawCommand &left, const __vpvlDrawCommand &right)
+{
+    for (int i = 0; i < kMaterialTextureMax; i++) {
+        if (left.textureIDs[i] != right.textureIDs[i]
+                || left.textureModes[i] != right.textureModes[i]
+                || left.enableSphereMaps[i] != right.enableSphereMaps[i])
+            return false;
+    }
+    return left.enableCullFace == right.enableCullFace
+            && left.isTranslucent == right.isTranslucent
+            && left.isSkinning == right.isSkinning
+            && (left.material == right.material || RendererIsSameMaterial(left.material, right.material));
+}
+
+static void RendererAddDrawCommands(const vpvl::PMDModel *model, btAlignedObjectArray<__vpvlDrawCommand> &commands)
+{
+    const vpvl::PMDModelUserData *userData = model->userData();
+    const vpvl::MaterialList &materials = model->materials();
+    const uint32_t nMaterials = materials.size();
+    const bool isSkinning = RendererIsSkinnedByShader(model);
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < nMaterials; i++) {
+        const vpvl::Material *material = materials[i];
+        const __vpvlPMDModelMaterialPrivate &materialPrivate = userData->materials[i];
+        const GLuint primaryTextureID = materialPrivate.primaryTextureID;
+        const bool hasSecondTexture = userData->hasMultipleSphereMap && materialPrivate.secondTextureID > 0;
+        const bool enableSphereMap = userData->hasSingleSphereMap && primaryTextureID > 0
+                && (material->isSpherePrimary() || material->isSphereAuxPrimary());
+        __vpvlDrawCommand command;
+        command.model = model;
+        command.material = material;
+        command.textureIDs[kPrimaryTexture] = primaryTextureID;
+        command.textureModes[kPrimaryTexture] = enableSphereMap && material->isSphereAuxPrimary() ? GL_ADD : GL_MODULATE;
+        command.enableSphereMaps[kPrimaryTexture] = enableSphereMap;
+        command.textureIDs[kToonTexture] = userData->toonTextureID[material->toonID()];
+        command.textureModes[kToonTexture] = GL_MODULATE;
+        command.enableSphereMaps[kToonTexture] = false;
+        command.textureIDs[kSecondTexture] = hasSecondTexture ? materialPrivate.secondTextureID : 0;
+        command.textureModes[kSecondTexture] = hasSecondTexture && material->isSphereAuxSecond() ? GL_ADD : GL_MODULATE;
+        command.enableSphereMaps[kSecondTexture] = hasSecondTexture;
+        command.enableCullFace = material->opacity() >= 1.0f;
+        command.isTranslucent = material->opacity() < 1.0f;
+        command.isSkinning = isSkinning;
+        command.offset = offset;
+        command.nIndices = material->countIndices();
+        commands.push_back(command);
+        offset += (command.nIndices << 1);
+    }
+}
+
+static void RendererSetCapability(__vpvlDrawState &state, int &current, GLenum capability, bool value)
+{
+    if (current != static_cast<int>(value)) {
+        value ? glEnable(capability) : glDisable(capability);
+        current = value;
+        state.nStateChanges++;
+    }
+}
+
+static void RendererSetCullFace(__vpvlDrawState &state, GLenum value)
+{
+    if (state.cullFace != static_cast<GLint>(value)) {
+        glCullFace(value);
+        state.cullFace = value;
+        state.nStateChanges++;
+    }
+}
+
+static void RendererSetActiveTexture(__vpvlDrawState &state, int unit)
+{
+    if (state.activeTexture != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        state.activeTexture = unit;
+        state.nStateChanges++;
+    }
+}
+
+static void RendererSetClientActiveTexture(__vpvlDrawState &state, int unit)
+{
+    if (state.clientActiveTexture != unit) {
+        glClientActiveTexture(GL_TEXTURE0 + unit);
+        state.clientActiveTexture = unit;
+        state.nStateChanges++;
+    }
+}
+
+static void RendererSetClientState(__vpvlDrawState &state, __vpvlClientStateType type, bool value)
+{
+    static const GLenum kClientStates[] = {
+        GL_VERTEX_ARRAY, GL_NORMAL_ARRAY, GL_TEXTURE_COORD_ARRAY, GL_TEXTURE_COORD_ARRAY
+    };
+    if (state.enableClientStates[type] != static_cast<int>(value)) {
+        if (type == kTextureCoordArray || type == kToonTextureCoordArray)
+            RendererSetClientActiveTexture(state, type == kTextureCoordArray ? 0 : 1);
+        value ? glEnableClientState(kClientStates[type]) : glDisableClientState(kClientStates[type]);
+        state.enableClientStates[type] = value;
+        state.nStateChanges++;
+    }
+}
+
+/* the binding, the mode and the generation of the texture coordinates do not matter while the unit is disabled */
+static void RendererSetTexture(__vpvlDrawState &state, int unit, GLuint textureID, GLint mode, bool enableSphereMap)
+{
+    const bool enable = textureID > 0;
+    if (state.enableTextures[unit] != static_cast<int>(enable)) {
+        RendererSetActiveTexture(state, unit);
+        enable ? glEnable(GL_TEXTURE_2D) : glDisable(GL_TEXTURE_2D);
+        state.enableTextures[unit] = enable;
+        state.nStateChanges++;
+    }
+    if (!enable)
+        return;
+    if (state.textureIDs[unit] != textureID) {
+        RendererSetActiveTexture(state, unit);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        state.textureIDs[unit] = textureID;
+        state.nStateChanges++;
+    }
+    if (state.textureModes[unit] != mode) {
+        RendererSetActiveTexture(state, unit);
+        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+        state.textureModes[unit] = mode;
+        state.nStateChanges++;
+    }
+    if (state.enableSphereMaps[unit] != static_cast<int>(enableSphereMap)) {
+        RendererSetActiveTexture(state, unit);
+        enableSphereMap ? glEnable(GL_TEXTURE_GEN_S) : glDisable(GL_TEXTURE_GEN_S);
+        enableSphereMap ? glEnable(GL_TEXTURE_GEN_T) : glDisable(GL_TEXTURE_GEN_T);
+        state.enableSphereMaps[unit] = enableSphereMap;
+        state.nStateChanges++;
+    }
+}
+
+/* the texture coordinates of the sphere maps are generated by the shader if skinning in it */
+static void RendererSetSphereMapUniform(__vpvlDrawState &state, GLuint program, int unit, bool value)
+{
+    if (state.enableSphereMapUniforms[unit] != static_cast<int>(value)) {
+        const char *name = unit == kPrimaryTexture ? "enableSphereMap" : "enableSecondSphereMap";
+        glUniform1i(glGetUniformLocation(program, name), value);
+        state.enableSphereMapUniforms[unit] = value;
+        state.nStateChanges++;
+    }
+}
+
+static void RendererSetMaterial(__vpvlDrawState &state, const vpvl::Material *material)
+{
+    if (state.material == material || (state.material && RendererIsSameMaterial(state.material, material)))
+        return;
+    const float alpha = material->opacity();
+    btVector4 average = material->averageColor(), specular = material->specular();
+    average.setW(average.w() * alpha);
+    specular.setW(specular.w() * alpha);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, static_cast<const GLfloat *>(average));
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, static_cast<const GLfloat *>(specular));
+    glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shiness());
+    state.material = material;
+    state.nStateChanges++;
+}
+
+static void RendererSetColor(__vpvlDrawState &state, const btVector4 &color)
+{
+    if (!state.hasColor || state.color != color) {
+        glColor4fv(static_cast<const btScalar *>(color));
+        state.color = color;
+        state.hasColor = 1;
+        state.nStateChanges++;
+    }
+}
+
+/* binds the vertices and the indices of the model for the model or the edge pass */
+static void RendererSetVertexSource(__vpvlDrawState &state, GLuint program, const vpvl::PMDModel *model, __vpvlSkinningPassType pass)
+{
+    const vpvl::PMDModelUserData *userData = model->userData();
+    const bool isSkinning = RendererIsSkinnedByShader(model);
+    const bool isModelPass = pass == kSkinningModelPass;
+    if (state.isSkinning != static_cast<int>(isSkinning)) {
+        glUseProgram(isSkinning ? program : 0);
+        for (int i = 0; i < kSkinningAttributeMax; i++)
+            isSkinning ? glEnableVertexAttribArray(i) : glDisableVertexAttribArray(i);
+        state.isSkinning = isSkinning;
+        state.model = 0;
+        state.nStateChanges++;
+    }
+    RendererSetClientState(state, kVertexArray, !isSkinning);
+    RendererSetClientState(state, kNormalArray, !isSkinning && isModelPass);
+    RendererSetClientState(state, kTextureCoordArray, !isSkinning && isModelPass);
+    RendererSetClientState(state, kToonTextureCoordArray, !isSkinning && isModelPass);
+    if (state.model == model && state.pass == pass)
+        return;
+    if (isSkinning) {
+        if (state.model != model) {
+            RendererBindSkinningModel(program, model);
+            state.activeTexture = 0;
+            for (int i = 0; i < kMaterialTextureMax; i++)
+                state.enableSphereMapUniforms[i] = -1;
+        }
+        glUniform1i(glGetUniformLocation(program, "pass"), pass);
+    }
+    else {
+        const size_t stride = model->stride(isModelPass ? vpvl::PMDModel::kVerticesStride : vpvl::PMDModel::kEdgeVerticesStride);
+        glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelVertices]);
+        if (isModelPass) {
+            glVertexPointer(3, GL_FLOAT, stride, 0);
+            glNormalPointer(GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(userData->normalsOffset));
+            RendererSetClientActiveTexture(state, 0);
+            glTexCoordPointer(2, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(userData->textureCoordsOffset));
+            RendererSetClientActiveTexture(state, 1);
+            glTexCoordPointer(2, GL_FLOAT, model->stride(vpvl::PMDModel::kToonTextureStride),
+                              reinterpret_cast<const GLvoid *>(userData->toonTextureCoordsOffset));
+        }
+        else {
+            glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(userData->edgeVerticesOffset));
+        }
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vertexBufferObjects[isModelPass ? kShadowIndices : kEdgeIndices]);
+    state.model = model;
+    state.pass = pass;
+    state.nStateChanges++;
+}
+
+static btVector4 RendererEdgeColor(const vpvl::PMDModel *model, const vpvl::PMDModel *selected)
+{
+    return model == selected ? btVector4(1.0f, 0.0f, 0.0f, 1.0f) : btVector4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+static void RendererBeginDraw(__vpvlDrawState &state)
+{
+    state.model = 0;
+    state.material = 0;
+    state.color.setZero();
+    for (int i = 0; i < kMaterialTextureMax; i++) {
+        state.textureIDs[i] = kUnknownTextureID;
+        state.textureModes[i] = -1;
+        state.enableTextures[i] = -1;
+        state.enableSphereMaps[i] = -1;
+        state.enableSphereMapUniforms[i] = -1;
+    }
+    for (int i = 0; i < kClientStateMax; i++)
+        state.enableClientStates[i] = -1;
+    state.activeTexture = -1;
+    state.clientActiveTexture = -1;
+    state.enableCullFace = -1;
+    state.enableLighting = -1;
+    state.hasColor = 0;
+    // the skinning program is not in use out of the passes
+    state.isSkinning = 0;
+    state.pass = -1;
+    state.cullFace = -1;
+    state.nDrawCalls = 0;
+    state.nStateChanges = 0;
+#ifndef VPVL_COORDINATE_OPENGL
+    glPushMatrix();
+    glScalef(1.0f, 1.0f, -1.0f);
+#endif
+    // the texture coordinates are generated only while enabled by RendererSetTexture
+    static const int kSphereMapUnits[] = { kPrimaryTexture, kSecondTexture };
+    for (int i = 0; i < 2; i++) {
+        RendererSetActiveTexture(state, kSphereMapUnits[i]);
+        glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
+        glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
+        state.nStateChanges++;
+    }
+}
+
+static void RendererDrawCommands(__vpvlDrawState &state,
+                                 GLuint program,
+                                 const btAlignedObjectArray<__vpvlDrawCommand> &commands,
+                                 int from,
+                                 int to)
+{
+    for (int i = from; i < to; i++) {
+        const __vpvlDrawCommand &command = commands[i];
+        RendererSetVertexSource(state, program, command.model, kSkinningModelPass);
+        RendererSetCapability(state, state.enableLighting, GL_LIGHTING, true);
+        RendererSetCapability(state, state.enableCullFace, GL_CULL_FACE, command.enableCullFace);
+        RendererSetCullFace(state, kModelCullFace);
+        RendererSetMaterial(state, command.material);
+        for (int j = 0; j < kMaterialTextureMax; j++)
+            RendererSetTexture(state, j, command.textureIDs[j], command.textureModes[j], command.enableSphereMaps[j]);
+        if (command.isSkinning) {
+            RendererSetSphereMapUniform(state, program, kPrimaryTexture, command.enableSphereMaps[kPrimaryTexture]);
+            RendererSetSphereMapUniform(state, program, kSecondTexture, command.enableSphereMaps[kSecondTexture]);
+        }
+        // the following ranges of the indices of the model in the same states are drawn at once
+        uint32_t nIndices = command.nIndices;
+        while (i + 1 < to) {
+            const __vpvlDrawCommand &last = commands[i], &next = commands[i + 1];
+            if (next.model != last.model || next.offset != last.offset + (last.nIndices << 1)
+                    || !RendererIsSameDrawState(last, next))
+                break;
+            nIndices += next.nIndices;
+            i++;
+        }
+        glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_SHORT, reinterpret_cast<const GLvoid *>(command.offset));
+        state.nDrawCalls++;
+    }
+}
+
+static void RendererDrawEdge(__vpvlDrawState &state, GLuint program, const vpvl::PMDModel *model, const btVector4 &color)
+{
+    const uint32_t nIndices = model->edgeIndicesCount();
+    if (nIndices == 0)
+        return;
+    RendererSetVertexSource(state, program, model, kSkinningEdgePass);
+    RendererSetCapability(state, state.enableLighting, GL_LIGHTING, false);
+    RendererSetCapability(state, state.enableCullFace, GL_CULL_FACE, true);
+    RendererSetCullFace(state, kEdgeCullFace);
+    for (int i = 0; i < kMaterialTextureMax; i++)
+        RendererSetTexture(state, i, 0, GL_MODULATE, false);
+    RendererSetColor(state, color);
+    glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_SHORT, 0);
+    state.nDrawCalls++;
+}
+
+/* restores the states the other passes expect */
+static void RendererEndDraw(__vpvlDrawState &state)
+{
+    if (state.isSkinning == 1) {
+        RendererEndSkinning();
+        state.activeTexture = 0;
+        state.nStateChanges++;
+    }
+    for (int i = 0; i < kClientStateMax; i++)
+        RendererSetClientState(state, static_cast<__vpvlClientStateType>(i), false);
+    RendererSetClientActiveTexture(state, 0);
+    for (int i = kMaterialTextureMax - 1; i >= 0; i--) {
+        // the disabled units may still generate the coordinates or add the colors
+        if (state.enableSphereMaps[i] != 0 || state.textureModes[i] != GL_MODULATE) {
+            RendererSetActiveTexture(state, i);
+            glDisable(GL_TEXTURE_GEN_S);
+            glDisable(GL_TEXTURE_GEN_T);
+            glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+            state.enableSphereMaps[i] = 0;
+            state.textureModes[i] = GL_MODULATE;
+            state.nStateChanges++;
+        }
+        RendererSetTexture(state, i, 0, GL_MODULATE, false);
+    }
+    RendererSetActiveTexture(state, 0);
+    RendererSetCapability(state, state.enableLighting, GL_LIGHTING, true);
+    RendererSetCapability(state, state.enableCullFace, GL_CULL_FACE, true);
+    RendererSetCullFace(state, GL_BACK);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+#ifndef VPVL_COORDINATE_OPENGL
+    glPopMatrix();
+#endif
+}
+
+/* creates the textures decoded by the texture cache with the same parameters as the delegate */
+class __vpvlTextureUploader : public vpvl::ITextureUploader
+{
+public:
+    uint32_t upload(const vpvl::TextureImage &image, vpvl::TextureCache::TextureType type) {
+        if (image.pixels.size() == 0)
+            return 0;
+        const GLint wrap = type == vpvl::TextureCache::kToonTexture ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+        GLuint textureID = 0;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image.pixels[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return textureID;
+    }
+};
+
+static int RendererRequestTexture(vpvl::TextureCache *cache, const std::string &path, vpvl::TextureCache::TextureType type)
+{
+    return cache->request(path.c_str(), type);
+}
+
+static GLuint RendererResolveTexture(const vpvl::TextureCache *cache, int handle)
+{
+    return handle >= 0 ? cache->textureID(handle) : 0;
+}
+
+/* the texture of the handle is deleted by the last user of the texture cache */
+static void RendererDeleteTexture(vpvl::TextureCache *cache, int handle, GLuint textureID)
+{
+    if (handle >= 0)
+        textureID = cache ? cache->release(handle) : 0;
+    if (textureID > 0)
+        glDeleteTextures(1, &textureID);
+}
+
+/* takes the textures uploaded so far, the handles are resolved again while the cache has pending textures */
+static void RendererResolveModelTextures(const vpvl::TextureCache *cache, const vpvl::PMDModel *model, bool isPending)
+{
+    vpvl::PMDModelUserData *userData = model->userData();
+    if (!userData->hasPendingTextures)
+        return;
+    const uint32_t nMaterials = model->materials().size();
+    for (uint32_t i = 0; i < nMaterials; i++) {
+        __vpvlPMDModelMaterialPrivate &materialPrivate = userData->materials[i];
+        materialPrivate.primaryTextureID = RendererResolveTexture(cache, materialPrivate.primaryTextureHandle);
+        materialPrivate.secondTextureID = RendererResolveTexture(cache, materialPrivate.secondTextureHandle);
+    }
+    for (uint32_t i = 0; i < vpvl::PMDModel::kSystemTextureMax; i++)
+        userData->toonTextureID[i] = RendererResolveTexture(cache, userData->toonTextureHandles[i]);
+    userData->hasPendingTextures = isPending;
+}
+
+static void RendererResolveAssetTextures(const vpvl::TextureCache *cache, const vpvl::XModel *model, bool isPending)
+{
+    vpvl::XModelUserData *userData = model->userData();
+    if (!userData->hasPendingTextures)
+        return;
+    const uint32_t nRanges = userData->ranges.size();
+    for (uint32_t i = 0; i < nRanges; i++) {
+        __vpvlXModelRangePrivate &range = userData->ranges[i];
+        range.textureID = RendererResolveTexture(cache, range.textureHandle);
+    }
+    userData->hasPendingTextures = isPending;
+}
+
 bool Renderer::initializeGLEW(GLenum &err)
 {
 #ifndef VPVL_USE_ALLEGRO5
@@ -90,15 +867,31 @@ Renderer::Renderer(IDelegate *delegate, int width, int height, int fps)
     : m_scene(0),
       m_selected(0),
       m_delegate(delegate),
+      m_textureCache(0),
+      m_captureDelegate(0),
+      m_skinningProgram(0),
+      m_captureFramebuffer(0),
+      m_captureColorBuffer(0),
+      m_captureDepthBuffer(0),
+      m_enableShaderSkinning(false),
+      m_enableDrawBatching(true),
       m_displayBones(false),
       m_width(width),
-      m_height(height)
+      m_height(height),
+      m_textureUploadBudget(4 * 1024 * 1024),
+      m_nDrawCalls(0),
+      m_nStateChanges(0),
+      m_nCapturedFrames(0),
+      m_nReadingFrames(0)
 {
     m_scene = new vpvl::Scene(width, height, fps);
 }
 
 Renderer::~Renderer()
 {
+    endCapture();
+    if (m_skinningProgram)
+        glDeleteProgram(m_skinningProgram);
     delete m_scene;
 }
 
@@ -117,14 +910,131 @@ void Renderer::initializeSurface()
     glEnable(GL_LIGHT0);
     glEnable(GL_LIGHTING);
     setLighting();
+    if (!m_skinningProgram)
+        m_skinningProgram = RendererCreateSkinningProgram();
+}
+
+void Renderer::setEnableShaderSkinning(bool value)
+{
+    size_t size = 0;
+    vpvl::PMDModel **models = m_scene->getRenderingOrder(size);
+    m_enableShaderSkinning = value;
+    for (size_t i = 0; i < size; i++) {
+        vpvl::PMDModel *model = models[i];
+        model->setEnableSoftwareSkinning(!value || !model->userData()->isSkinnableByShader);
+    }
 }
 
 void Renderer::resize(int width, int height)
 {
+    // the frames of the previous size are delivered before recreating the framebuffer
+    const int nBuffers = m_capturePixelBuffers.size();
+    if (m_captureFramebuffer) {
+        while (m_nReadingFrames > 0)
+            deliverCapturedFrame();
+        deleteCaptureBuffers();
+    }
     m_width = width;
     m_height = height;
     m_scene->setWidth(width);
     m_scene->setHeight(height);
+    if (nBuffers > 0 && !createCaptureBuffers(nBuffers))
+        m_captureDelegate = 0;
+}
+
+bool Renderer::beginCapture(ICaptureDelegate *delegate, int nBuffers)
+{
+    endCapture();
+    m_nCapturedFrames = 0;
+    m_nReadingFrames = 0;
+    if (!createCaptureBuffers(btMax(nBuffers, 2)))
+        return false;
+    m_captureDelegate = delegate;
+    return true;
+}
+
+void Renderer::endCapture()
+{
+    if (!m_captureFramebuffer)
+        return;
+    while (m_nReadingFrames > 0)
+        deliverCapturedFrame();
+    deleteCaptureBuffers();
+    m_captureDelegate = 0;
+}
+
+bool Renderer::createCaptureBuffers(int nBuffers)
+{
+    glGenRenderbuffers(1, &m_captureColorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_captureColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+    // the stencil is used to draw the shadows
+    glGenRenderbuffers(1, &m_captureDepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_captureDepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &m_captureFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_captureFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_captureColorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_captureDepthBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_captureDepthBuffer);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        deleteCaptureBuffers();
+        return false;
+    }
+    m_capturePixelBuffers.resize(nBuffers);
+    glGenBuffers(nBuffers, &m_capturePixelBuffers[0]);
+    for (int i = 0; i < nBuffers; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_capturePixelBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, m_width * m_height * 4, 0, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+void Renderer::deleteCaptureBuffers()
+{
+    const int nBuffers = m_capturePixelBuffers.size();
+    if (nBuffers > 0)
+        glDeleteBuffers(nBuffers, &m_capturePixelBuffers[0]);
+    m_capturePixelBuffers.clear();
+    glDeleteFramebuffers(1, &m_captureFramebuffer);
+    glDeleteRenderbuffers(1, &m_captureColorBuffer);
+    glDeleteRenderbuffers(1, &m_captureDepthBuffer);
+    m_captureFramebuffer = 0;
+    m_captureColorBuffer = 0;
+    m_captureDepthBuffer = 0;
+}
+
+void Renderer::readCapturedFrame()
+{
+    // start reading the frame to the next buffer of the ring without waiting for it
+    const int nBuffers = m_capturePixelBuffers.size();
+    const int index = (m_nCapturedFrames + m_nReadingFrames) % nBuffers;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_capturePixelBuffers[index]);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_nReadingFrames++;
+    // the oldest frame has been read while rendering the frames after it
+    if (m_nReadingFrames == nBuffers)
+        deliverCapturedFrame();
+}
+
+void Renderer::deliverCapturedFrame()
+{
+    const int index = m_nCapturedFrames % m_capturePixelBuffers.size();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_capturePixelBuffers[index]);
+    const uint8_t *pixels = static_cast<const uint8_t *>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+    if (pixels) {
+        if (m_captureDelegate)
+            m_captureDelegate->captureFrame(m_nCapturedFrames, pixels, m_width, m_height);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_nCapturedFrames++;
+    m_nReadingFrames--;
 }
 
 void Renderer::pickBones(int px, int py, float approx, vpvl::BoneList &pickBones)
@@ -205,13 +1115,21 @@ void Renderer::loadModel(vpvl::PMDModel *model, const std::string &dir)
         __vpvlPMDModelMaterialPrivate &materialPrivate = materialPrivates[i];
         materialPrivate.primaryTextureID = 0;
         materialPrivate.secondTextureID = 0;
-        if (!primary.empty()) {
+        materialPrivate.primaryTextureHandle = -1;
+        materialPrivate.secondTextureHandle = -1;
+        if (m_textureCache) {
+            if (!primary.empty())
+                materialPrivate.primaryTextureHandle = RendererRequestTexture(m_textureCache, dir + "/" + primary, vpvl::TextureCache::kTexture);
+            if (!second.empty())
+                materialPrivate.secondTextureHandle = RendererRequestTexture(m_textureCache, dir + "/" + second, vpvl::TextureCache::kTexture);
+        }
+        else if (!primary.empty()) {
             if (m_delegate->loadTexture(dir + "/" + primary, textureID)) {
                 materialPrivate.primaryTextureID = textureID;
                 //qDebug("Binding the texture as a primary texture (ID=%d)", textureID);
             }
         }
-        if (!second.empty()) {
+        if (!m_textureCache && !second.empty()) {
             if (m_delegate->loadTexture(dir + "/" + second, textureID)) {
                 materialPrivate.secondTextureID = textureID;
                 //qDebug("Binding the texture as a secondary texture (ID=%d)", textureID);
@@ -233,23 +1151,61 @@ void Renderer::loadModel(vpvl::PMDModel *model, const std::string &dir)
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, model->indices().size() * model->stride(vpvl::PMDModel::kIndicesStride),
                  model->indicesPointer(), GL_STATIC_DRAW);
     //qDebug("Binding indices to the vertex buffer object (ID=%d)", userData->vertexBufferObjects[kShadowIndices]);
-    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelTexCoords]);
-    glBufferData(GL_ARRAY_BUFFER, model->vertices().size() * model->stride(vpvl::PMDModel::kTextureCoordsStride),
-                 model->textureCoordsPointer(), GL_STATIC_DRAW);
-    //qDebug("Binding texture coordinates to the vertex buffer object (ID=%d)", userData->vertexBufferObjects[kModelTexCoords]);
-    if (m_delegate->loadToonTexture("toon0.bmp", dir, textureID)) {
-        userData->toonTextureID[0] = textureID;
-        //qDebug("Binding the texture as a toon texture (ID=%d)", textureID);
-    }
-    for (uint32_t i = 0; i < vpvl::PMDModel::kSystemTextureMax - 1; i++) {
-        const uint8_t *name = model->toonTexture(i);
-        if (m_delegate->loadToonTexture(reinterpret_cast<const char *>(name), dir, textureID)) {
-            userData->toonTextureID[i + 1] = textureID;
+    // the skinned vertices, the toon texture coordinates and the edge vertices share one buffer streamed by uploadModel
+    const uint8_t *base = static_cast<const uint8_t *>(model->verticesPointer());
+    const size_t nVertices = model->vertices().size();
+    const GLsizeiptr verticesSize = nVertices * model->stride(vpvl::PMDModel::kVerticesStride);
+    const GLsizeiptr toonTextureCoordsSize = nVertices * model->stride(vpvl::PMDModel::kToonTextureStride);
+    userData->normalsOffset = static_cast<const uint8_t *>(model->normalsPointer()) - base;
+    userData->textureCoordsOffset = static_cast<const uint8_t *>(model->textureCoordsPointer()) - base;
+    userData->toonTextureCoordsOffset = verticesSize;
+    userData->edgeVerticesOffset = verticesSize + toonTextureCoordsSize;
+    userData->vertexBufferSize = userData->edgeVerticesOffset + nVertices * model->stride(vpvl::PMDModel::kEdgeVerticesStride);
+    userData->boneTextureID = 0;
+    userData->faceTextureID = 0;
+    userData->isSkinnableByShader = false;
+    if (m_skinningProgram)
+        RendererLoadSkinning(model, userData);
+    model->setEnableSoftwareSkinning(!m_enableShaderSkinning || !userData->isSkinnableByShader);
+    memset(userData->toonTextureID, 0, sizeof(userData->toonTextureID));
+    for (uint32_t i = 0; i < vpvl::PMDModel::kSystemTextureMax; i++)
+        userData->toonTextureHandles[i] = -1;
+    userData->materials = materialPrivates;
+    userData->hasPendingTextures = m_textureCache != 0;
+    model->setUserData(userData);
+    if (m_textureCache) {
+        // the decoder looks up the toon textures in the system directory if not found in the model directory
+        userData->toonTextureHandles[0] = RendererRequestTexture(m_textureCache, dir + "/toon0.bmp", vpvl::TextureCache::kToonTexture);
+        for (uint32_t i = 0; i < vpvl::PMDModel::kSystemTextureMax - 1; i++) {
+            const char *name = reinterpret_cast<const char *>(model->toonTexture(i));
+            if (*name)
+                userData->toonTextureHandles[i + 1] = RendererRequestTexture(m_textureCache, dir + "/" + name, vpvl::TextureCache::kToonTexture);
+        }
+        // the textures shared with the models loaded before are available now
+        RendererResolveModelTextures(m_textureCache, model, true);
+    }
+    else {
+        if (m_delegate->loadToonTexture("toon0.bmp", dir, textureID)) {
+            userData->toonTextureID[0] = textureID;
             //qDebug("Binding the texture as a toon texture (ID=%d)", textureID);
         }
+        for (uint32_t i = 0; i < vpvl::PMDModel::kSystemTextureMax - 1; i++) {
+            const uint8_t *name = model->toonTexture(i);
+            if (m_delegate->loadToonTexture(reinterpret_cast<const char *>(name), dir, textureID)) {
+                userData->toonTextureID[i + 1] = textureID;
+                //qDebug("Binding the texture as a toon texture (ID=%d)", textureID);
+            }
+        }
+        // the toon textures are clamped once here instead of at every bind while drawing
+        for (uint32_t i = 0; i < vpvl::PMDModel::kSystemTextureMax; i++) {
+            if (userData->toonTextureID[i] > 0) {
+                glBindTexture(GL_TEXTURE_2D, userData->toonTextureID[i]);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
-    userData->materials = materialPrivates;
-    model->setUserData(userData);
     //qDebug() << "Created the model:" << toUnicodeModelName(model);
 }
 
@@ -261,287 +1217,108 @@ void Renderer::unloadModel(const vpvl::PMDModel *model)
         vpvl::PMDModelUserData *userData = model->userData();
         for (uint32_t i = 0; i < nMaterials; i++) {
             __vpvlPMDModelMaterialPrivate &materialPrivate = userData->materials[i];
-            glDeleteTextures(1, &materialPrivate.primaryTextureID);
-            glDeleteTextures(1, &materialPrivate.secondTextureID);
+            RendererDeleteTexture(m_textureCache, materialPrivate.primaryTextureHandle, materialPrivate.primaryTextureID);
+            RendererDeleteTexture(m_textureCache, materialPrivate.secondTextureHandle, materialPrivate.secondTextureID);
         }
+        RendererDeleteTexture(m_textureCache, userData->toonTextureHandles[0], 0);
         for (uint32_t i = 1; i < vpvl::PMDModel::kSystemTextureMax; i++) {
-            glDeleteTextures(1, &userData->toonTextureID[i]);
+            RendererDeleteTexture(m_textureCache, userData->toonTextureHandles[i], userData->toonTextureID[i]);
         }
         glDeleteBuffers(kVertexBufferObjectMax, userData->vertexBufferObjects);
+        glDeleteTextures(1, &userData->boneTextureID);
+        glDeleteTextures(1, &userData->faceTextureID);
         delete[] userData->materials;
         delete userData;
         //qDebug() << "Destroyed the model:" << toUnicodeModelName(model);
     }
 }
 
-void Renderer::drawModel(const vpvl::PMDModel *model)
+void Renderer::uploadModel(const vpvl::PMDModel *model)
 {
-#ifndef VPVL_COORDINATE_OPENGL
-    glPushMatrix();
-    glScalef(1.0f, 1.0f, -1.0f);
-    glCullFace(GL_FRONT);
-#endif
-
     const vpvl::PMDModelUserData *userData = model->userData();
-    size_t stride = model->stride(vpvl::PMDModel::kNormalsStride), vsize = model->vertices().size();
-    glActiveTexture(GL_TEXTURE0);
-    glClientActiveTexture(GL_TEXTURE0);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelVertices]);
-    glVertexPointer(3, GL_FLOAT, model->stride(vpvl::PMDModel::kVerticesStride), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelNormals]);
-    glBufferData(GL_ARRAY_BUFFER, vsize * stride, model->normalsPointer(), GL_DYNAMIC_DRAW);
-    glNormalPointer(GL_FLOAT, stride, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelTexCoords]);
-    glTexCoordPointer(2, GL_FLOAT, model->stride(vpvl::PMDModel::kTextureCoordsStride), 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vertexBufferObjects[kShadowIndices]);
-
-    const bool enableToon = true;
-    // toon
-    if (enableToon) {
-        glActiveTexture(GL_TEXTURE1);
-        glEnable(GL_TEXTURE_2D);
-        glClientActiveTexture(GL_TEXTURE1);
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-        glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelToonTexCoords]);
-        // shadow map
-        stride = model->stride(vpvl::PMDModel::kToonTextureStride);
-        if (false)
-            glBufferData(GL_ARRAY_BUFFER, 0, 0, GL_DYNAMIC_DRAW);
-        else
-            glBufferData(GL_ARRAY_BUFFER, vsize * stride, model->toonTextureCoordsPointer(), GL_DYNAMIC_DRAW);
-        glTexCoordPointer(2, GL_FLOAT, stride, 0);
-        glActiveTexture(GL_TEXTURE0);
-        glClientActiveTexture(GL_TEXTURE0);
-    }
-    bool hasSingleSphereMap = false, hasMultipleSphereMap = false;
-    // first sphere map
-    if (userData->hasSingleSphereMap) {
-        glEnable(GL_TEXTURE_2D);
-        glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-        glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-        glDisable(GL_TEXTURE_2D);
-        hasSingleSphereMap = true;
-    }
-    // second sphere map
-    if (userData->hasMultipleSphereMap) {
-        glActiveTexture(GL_TEXTURE2);
-        glEnable(GL_TEXTURE_2D);
-        glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-        glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-        glDisable(GL_TEXTURE_2D);
-        glActiveTexture(GL_TEXTURE0);
-        hasMultipleSphereMap = true;
-    }
-
-    const vpvl::MaterialList materials = model->materials();
-    const __vpvlPMDModelMaterialPrivate *materialPrivates = userData->materials;
-    const uint32_t nMaterials = materials.size();
-    btVector4 average, ambient, diffuse, specular;
-    uint32_t offset = 0;
-    for (uint32_t i = 0; i < nMaterials; i++) {
-        const vpvl::Material *material = materials[i];
-        const __vpvlPMDModelMaterialPrivate &materialPrivate = materialPrivates[i];
-        // toon
-        const float alpha = material->opacity();
-        if (enableToon) {
-            average = material->averageColor();
-            average.setW(average.w() * alpha);
-            specular = material->specular();
-            specular.setW(specular.w() * alpha);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, static_cast<const GLfloat *>(average));
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, static_cast<const GLfloat *>(specular));
-        }
-        else {
-            ambient = material->ambient();
-            ambient.setW(ambient.w() * alpha);
-            diffuse = material->diffuse();
-            diffuse.setW(diffuse.w() * alpha);
-            specular = material->specular();
-            specular.setW(specular.w() * alpha);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, static_cast<const GLfloat *>(ambient));
-            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, static_cast<const GLfloat *>(diffuse));
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, static_cast<const GLfloat *>(specular));
-        }
-        glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shiness());
-        material->opacity() < 1.0f ? glDisable(GL_CULL_FACE) : glEnable(GL_CULL_FACE);
-        glActiveTexture(GL_TEXTURE0);
-        // has texture
-        if (materialPrivate.primaryTextureID > 0) {
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, materialPrivate.primaryTextureID);
-            if (hasSingleSphereMap) {
-                // is sphere map
-                if (material->isSpherePrimary() || material->isSphereAuxPrimary()) {
-                    // is second sphere map
-                    if (material->isSphereAuxPrimary())
-                        glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD);
-                    glEnable(GL_TEXTURE_GEN_S);
-                    glEnable(GL_TEXTURE_GEN_T);
-                }
-                else {
-                    glDisable(GL_TEXTURE_GEN_S);
-                    glDisable(GL_TEXTURE_GEN_T);
-                }
-            }
-        }
-        else {
-            glDisable(GL_TEXTURE_2D);
-        }
-        // toon
-        if (enableToon) {
-            const GLuint textureID = userData->toonTextureID[material->toonID()];
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    const size_t nVertices = model->vertices().size();
+    const GLsizeiptr verticesSize = nVertices * model->stride(vpvl::PMDModel::kVerticesStride);
+    const GLsizeiptr toonTextureCoordsSize = nVertices * model->stride(vpvl::PMDModel::kToonTextureStride);
+    const GLsizeiptr edgeVerticesSize = nVertices * model->stride(vpvl::PMDModel::kEdgeVerticesStride);
+    if (nVertices == 0)
+        return;
+    if (RendererIsSkinnedByShader(model)) {
+        const void *matrices = model->skinningMatricesPointer(), *faceVertices = model->faceVerticesPointer();
+        if (matrices) {
+            glBindTexture(GL_TEXTURE_2D, userData->boneTextureID);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 3, model->bones().size(), GL_RGBA, GL_FLOAT, matrices);
         }
-        if (hasMultipleSphereMap) {
-            // second sphere
-            glActiveTexture(GL_TEXTURE2);
-            glEnable(GL_TEXTURE_2D);
-            if (materialPrivate.secondTextureID > 0) {
-                // is second sphere
-                if (material->isSphereAuxSecond())
-                    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD);
-                else
-                    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-                glBindTexture(GL_TEXTURE_2D, materialPrivate.secondTextureID);
-                glEnable(GL_TEXTURE_GEN_S);
-                glEnable(GL_TEXTURE_GEN_T);
-            }
-            else {
-                glBindTexture(GL_TEXTURE_2D, 0);
-            }
-        }
-        // draw
-        const uint32_t nIndices = material->countIndices();
-        glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_SHORT, reinterpret_cast<GLvoid *>(offset));
-        offset += (nIndices << 1);
-        // is aux sphere map
-        if (material->isSphereAuxPrimary()) {
-            glActiveTexture(GL_TEXTURE0);
-            glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        if (faceVertices) {
+            const GLsizei width = userData->faceTextureWidth, nFaceVertices = model->baseFace()->vertices().size();
+            const GLsizei nRows = nFaceVertices / width, rest = nFaceVertices % width;
+            glBindTexture(GL_TEXTURE_2D, userData->faceTextureID);
+            if (nRows > 0)
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, nRows, GL_RGBA, GL_FLOAT, faceVertices);
+            if (rest > 0)
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, nRows, rest, 1, GL_RGBA, GL_FLOAT,
+                                static_cast<const btVector3 *>(faceVertices) + nRows * width);
         }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return;
     }
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    // toon
-    if (enableToon) {
-        glClientActiveTexture(GL_TEXTURE0);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-        // first sphere map
-        if (hasSingleSphereMap) {
-            glActiveTexture(GL_TEXTURE0);
-            glDisable(GL_TEXTURE_GEN_S);
-            glDisable(GL_TEXTURE_GEN_T);
-        }
-        glClientActiveTexture(GL_TEXTURE1);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-        // second sphere map
-        if (hasMultipleSphereMap) {
-            glActiveTexture(GL_TEXTURE2);
-            glDisable(GL_TEXTURE_GEN_S);
-            glDisable(GL_TEXTURE_GEN_T);
-        }
+    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kModelVertices]);
+    // orphan the storage of the previous frame so that the driver need not wait for the draws still using it
+    glBufferData(GL_ARRAY_BUFFER, userData->vertexBufferSize, 0, GL_STREAM_DRAW);
+    uint8_t *ptr = static_cast<uint8_t *>(glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY));
+    if (ptr) {
+        memcpy(ptr, model->verticesPointer(), verticesSize);
+        memcpy(ptr + userData->toonTextureCoordsOffset, model->toonTextureCoordsPointer(), toonTextureCoordsSize);
+        memcpy(ptr + userData->edgeVerticesOffset, model->edgeVerticesPointer(), edgeVerticesSize);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
     }
     else {
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-        // first sphere map
-        if (hasSingleSphereMap) {
-            glDisable(GL_TEXTURE_GEN_S);
-            glDisable(GL_TEXTURE_GEN_T);
-        }
-        // second sphere map
-        if (hasMultipleSphereMap) {
-            glActiveTexture(GL_TEXTURE2);
-            glDisable(GL_TEXTURE_GEN_S);
-            glDisable(GL_TEXTURE_GEN_T);
-        }
-    }
-    glActiveTexture(GL_TEXTURE0);
-    // first or second sphere map
-    if (hasSingleSphereMap || hasMultipleSphereMap) {
-        glDisable(GL_TEXTURE_GEN_S);
-        glDisable(GL_TEXTURE_GEN_T);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, verticesSize, model->verticesPointer());
+        glBufferSubData(GL_ARRAY_BUFFER, userData->toonTextureCoordsOffset, toonTextureCoordsSize, model->toonTextureCoordsPointer());
+        glBufferSubData(GL_ARRAY_BUFFER, userData->edgeVerticesOffset, edgeVerticesSize, model->edgeVerticesPointer());
     }
-    // toon
-    if (enableToon) {
-        glActiveTexture(GL_TEXTURE1);
-        glDisable(GL_TEXTURE_2D);
-    }
-    // second sphere map
-    if (hasMultipleSphereMap) {
-        glActiveTexture(GL_TEXTURE2);
-        glDisable(GL_TEXTURE_2D);
-    }
-    glActiveTexture(GL_TEXTURE0);
-    glDisable(GL_TEXTURE_2D);
-    glEnable(GL_CULL_FACE);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-#ifndef VPVL_COORDINATE_OPENGL
-    glPopMatrix();
-    glCullFace(GL_BACK);
-#endif
+void Renderer::drawModel(const vpvl::PMDModel *model)
+{
+    btAlignedObjectArray<__vpvlDrawCommand> commands;
+    __vpvlDrawState state;
+    RendererAddDrawCommands(model, commands);
+    RendererBeginDraw(state);
+    RendererDrawCommands(state, m_skinningProgram, commands, 0, commands.size());
+    RendererEndDraw(state);
+    m_nDrawCalls += state.nDrawCalls;
+    m_nStateChanges += state.nStateChanges;
 }
 
 void Renderer::drawModelEdge(const vpvl::PMDModel *model)
 {
-#ifdef VPVL_COORDINATE_OPENGL
-    glCullFace(GL_FRONT);
-#else
-    glPushMatrix();
-    glScalef(1.0f, 1.0f, -1.0f);
-    glCullFace(GL_BACK);
-#endif
-
-    const float alpha = 1.0f;
-    const size_t stride = model->stride(vpvl::PMDModel::kEdgeVerticesStride);
-    const vpvl::PMDModelUserData *modelPrivate = model->userData();
-    btVector4 color;
-
-    if (model == m_selected)
-        color.setValue(1.0f, 0.0f, 0.0f, alpha);
-    else
-        color.setValue(0.0f, 0.0f, 0.0f, alpha);
-
-    glDisable(GL_LIGHTING);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glBindBuffer(GL_ARRAY_BUFFER, modelPrivate->vertexBufferObjects[kEdgeVertices]);
-    glBufferData(GL_ARRAY_BUFFER, model->vertices().size() * stride, model->edgeVerticesPointer(), GL_DYNAMIC_DRAW);
-    glVertexPointer(3, GL_FLOAT, stride, 0);
-    glColor4fv(static_cast<const btScalar *>(color));
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, modelPrivate->vertexBufferObjects[kEdgeIndices]);
-    glDrawElements(GL_TRIANGLES, model->edgeIndicesCount(), GL_UNSIGNED_SHORT, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glEnable(GL_LIGHTING);
-
-#ifdef VPVL_COORDINATE_OPENGL
-    glCullFace(GL_BACK);
-#else
-    glPopMatrix();
-    glCullFace(GL_FRONT);
-#endif
+    __vpvlDrawState state;
+    RendererBeginDraw(state);
+    RendererDrawEdge(state, m_skinningProgram, model, RendererEdgeColor(model, m_selected));
+    RendererEndDraw(state);
+    m_nDrawCalls += state.nDrawCalls;
+    m_nStateChanges += state.nStateChanges;
 }
 
 void Renderer::drawModelShadow(const vpvl::PMDModel *model)
 {
     const size_t stride = model->stride(vpvl::PMDModel::kVerticesStride);
     const vpvl::PMDModelUserData *modelPrivate = model->userData();
+    const bool skinning = RendererIsSkinnedByShader(model);
     glDisable(GL_CULL_FACE);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glBindBuffer(GL_ARRAY_BUFFER, modelPrivate->vertexBufferObjects[kModelVertices]);
-    glBufferData(GL_ARRAY_BUFFER, model->vertices().size() * stride, model->verticesPointer(), GL_DYNAMIC_DRAW);
-    glVertexPointer(3, GL_FLOAT, stride, 0);
+    if (skinning) {
+        RendererBeginSkinning(m_skinningProgram, model, kSkinningShadowPass);
+    }
+    else {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glBindBuffer(GL_ARRAY_BUFFER, modelPrivate->vertexBufferObjects[kModelVertices]);
+        glVertexPointer(3, GL_FLOAT, stride, 0);
+    }
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, modelPrivate->vertexBufferObjects[kShadowIndices]);
     glDrawElements(GL_TRIANGLES, model->indices().size(), GL_UNSIGNED_SHORT, 0);
+    if (skinning)
+        RendererEndSkinning();
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glDisableClientState(GL_VERTEX_ARRAY);
@@ -562,7 +1339,8 @@ void Renderer::drawModelBones(const vpvl::PMDModel *model)
         vpvl::Bone::Type type = bone->type();
         if (type == vpvl::Bone::kIKTarget && parent && parent->isSimulated())
             continue;
-        const btTransform transform = bone->localTransform();
+        // the transforms are taken from the output of the model as the bones may be being updated
+        const btTransform &transform = model->boneTransform(i);
         transform.getOpenGLMatrix(matrix);
         glPushMatrix();
         glMultMatrixf(matrix);
@@ -666,7 +1444,7 @@ void Renderer::drawModelBones(const vpvl::PMDModel *model)
             glColor4f(0.5f, 0.6f, 1.0f, 1.0f);
         }
         glBegin(GL_LINES);
-        glVertex3fv(parent->localTransform().getOrigin());
+        glVertex3fv(model->boneTransform(parent->id()).getOrigin());
         glVertex3fv(transform.getOrigin());
         glEnd();
         glPopMatrix();
@@ -676,105 +1454,63 @@ void Renderer::drawModelBones(const vpvl::PMDModel *model)
     glEnable(GL_LIGHTING);
 }
 
-static void DrawAsset(const vpvl::XModel *model, const btVector4 &indices, int index)
-{
-    const btAlignedObjectArray<btVector3> &vertices = model->vertices();
-    const btAlignedObjectArray<btVector3> &textureCoords = model->textureCoords();
-    const btAlignedObjectArray<btVector3> &normals = model->normals();
-    const btAlignedObjectArray<btVector4> &colors = model->colors();
-    const btTransform transform = model->transform();
-    const int x = static_cast<const int>(indices[index]);
-    if (textureCoords.size() > x)
-        glTexCoord2fv(textureCoords[x]);
-    else if (textureCoords.size() > 0)
-        glTexCoord2f(0, 0);
-    if (colors.size() > x)
-        glColor4fv(colors[x]);
-    else if (colors.size() > 0)
-        glColor3f(0, 0, 0);
-    if (normals.size() > x)
-        glNormal3fv(transform.getBasis() * normals[x]);
-    else if (normals.size() > 0)
-        glNormal3f(0, 0, 0);
-    glVertex3fv(transform * vertices[x] * model->scale());
-}
-
 void Renderer::loadAsset(vpvl::XModel *model, const std::string &dir)
 {
     vpvl::XModelUserData *userData = new vpvl::XModelUserData;
-    userData->listID = glGenLists(1);
-    glNewList(userData->listID, GL_COMPILE);
-    // qDebug("Generated a OpenGL list (ID=%d)", userData->listID);
-#ifndef VPVL_COORDINATE_OPENGL
-    glPushMatrix();
-    glScalef(1.0f, 1.0f, -1.0f);
-    glCullFace(GL_FRONT);
-#endif
-    const btAlignedObjectArray<vpvl::XModelFaceIndex> &faces = model->faces();
+    vpvl::XModelIndexedMesh mesh;
+    model->buildIndexedMesh(mesh);
+    glGenBuffers(kXModelBufferMax, userData->vertexBufferObjects);
+    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kXModelVertices]);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(vpvl::XModelIndexedVertex),
+                 mesh.vertices.size() > 0 ? &mesh.vertices[0] : 0, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vertexBufferObjects[kXModelIndices]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(uint32_t),
+                 mesh.indices.size() > 0 ? &mesh.indices[0] : 0, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    //qDebug("Binding the asset to the vertex buffer object (ID=%d)", userData->vertexBufferObjects[kXModelVertices]);
     const bool hasMaterials = model->countMatreials() > 0;
-    uint32_t nFaces = faces.size();
-    uint32_t prevIndex = -1;
-    glEnable(GL_TEXTURE_2D);
-    for (uint32_t i = 0; i < nFaces; i++) {
-        const vpvl::XModelFaceIndex &face = faces[i];
-        const btVector4 &value = face.value;
-        const uint32_t count = face.count;
-        const uint32_t currentIndex = face.index;
-        if (hasMaterials && prevIndex != currentIndex) {
-            const vpvl::XMaterial *material = model->materialAt(currentIndex);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, static_cast<const GLfloat *>(material->color()));
-            glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, static_cast<const GLfloat *>(material->emmisive()));
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, static_cast<const GLfloat *>(material->specular()));
-            glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->power());
+    const uint32_t nRanges = mesh.ranges.size();
+    for (uint32_t i = 0; i < nRanges; i++) {
+        const vpvl::XModelIndexRange &range = mesh.ranges[i];
+        __vpvlXModelRangePrivate rangePrivate;
+        rangePrivate.materialIndex = range.materialIndex;
+        rangePrivate.offset = range.offset;
+        rangePrivate.count = range.count;
+        rangePrivate.textureID = 0;
+        rangePrivate.textureHandle = -1;
+        if (hasMaterials) {
+            const vpvl::XMaterial *material = model->materialAt(range.materialIndex);
             const std::string textureName = m_delegate->toUnicode(reinterpret_cast<const uint8_t *>(material->textureName()));
-            if (!textureName.empty()) {
+            if (m_textureCache) {
+                if (!textureName.empty())
+                    rangePrivate.textureHandle = RendererRequestTexture(m_textureCache, dir + "/" + textureName, vpvl::TextureCache::kTexture);
+            }
+            else if (!textureName.empty()) {
                 btHashString key(material->textureName());
                 GLuint *textureID = userData->textures[key];
                 if (!textureID) {
                     GLuint value;
                     if (m_delegate->loadTexture(dir + "/" + textureName, value)) {
                         userData->textures.insert(key, value);
-                        glBindTexture(GL_TEXTURE_2D, value);
+                        rangePrivate.textureID = value;
                         //qDebug("Binding the texture as a texture (ID=%d)", value);
                     }
                 }
                 else {
-                    glBindTexture(GL_TEXTURE_2D, *textureID);
+                    rangePrivate.textureID = *textureID;
                 }
             }
-            else {
-                glBindTexture(GL_TEXTURE_2D, 0);
-            }
-            prevIndex = currentIndex;
-        }
-        glBegin(GL_TRIANGLES);
-        switch (count) {
-        case 3:
-            DrawAsset(model, value, 1);
-            DrawAsset(model, value, 0);
-            DrawAsset(model, value, 2);
-            break;
-        case 4:
-            DrawAsset(model, value, 1);
-            DrawAsset(model, value, 0);
-            DrawAsset(model, value, 2);
-            DrawAsset(model, value, 3);
-            DrawAsset(model, value, 2);
-            DrawAsset(model, value, 0);
-            break;
-        default:
-            throw new std::bad_exception();
         }
-        glEnd();
+        userData->ranges.push_back(rangePrivate);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glDisable(GL_TEXTURE_2D);
-#ifndef VPVL_COORDINATE_OPENGL
-    glPopMatrix();
-    glCullFace(GL_BACK);
-#endif
-    glEndList();
+    userData->hasNormals = model->normals().size() > 0;
+    userData->hasTextureCoords = model->textureCoords().size() > 0;
+    userData->hasColors = model->colors().size() > 0;
+    userData->hasPendingTextures = m_textureCache != 0;
     model->setUserData(userData);
+    if (m_textureCache)
+        RendererResolveAssetTextures(m_textureCache, model, true);
     m_assets.push_back(model);
 }
 
@@ -783,7 +1519,11 @@ void Renderer::unloadAsset(const vpvl::XModel *model)
     if (model) {
         m_assets.remove(const_cast<vpvl::XModel *>(model));
         vpvl::XModelUserData *userData = model->userData();
-        glDeleteLists(userData->listID, 1);
+        glDeleteBuffers(kXModelBufferMax, userData->vertexBufferObjects);
+        // the textures loaded by the delegate are in the map and not in the ranges
+        const uint32_t nRanges = userData->ranges.size();
+        for (uint32_t i = 0; i < nRanges; i++)
+            RendererDeleteTexture(m_textureCache, userData->ranges[i].textureHandle, 0);
         btHashMap<btHashString, GLuint> &textures = userData->textures;
         uint32_t nTextures = textures.size();
         for (uint32_t i = 0; i < nTextures; i++)
@@ -795,13 +1535,71 @@ void Renderer::unloadAsset(const vpvl::XModel *model)
 
 void Renderer::drawAsset(const vpvl::XModel *model)
 {
-    if (model)
-        glCallList(model->userData()->listID);
+    if (!model)
+        return;
+#ifndef VPVL_COORDINATE_OPENGL
+    glPushMatrix();
+    glScalef(1.0f, 1.0f, -1.0f);
+    glCullFace(GL_FRONT);
+#endif
+    const vpvl::XModelUserData *userData = model->userData();
+    const GLsizei stride = sizeof(vpvl::XModelIndexedVertex);
+    const bool hasMaterials = model->countMatreials() > 0;
+    glActiveTexture(GL_TEXTURE0);
+    glClientActiveTexture(GL_TEXTURE0);
+    glBindBuffer(GL_ARRAY_BUFFER, userData->vertexBufferObjects[kXModelVertices]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, userData->vertexBufferObjects[kXModelIndices]);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(offsetof(vpvl::XModelIndexedVertex, position)));
+    // the attributes missing in the model are not specified as the faces were drawn one by one
+    if (userData->hasNormals) {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(offsetof(vpvl::XModelIndexedVertex, normal)));
+    }
+    if (userData->hasTextureCoords) {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(offsetof(vpvl::XModelIndexedVertex, textureCoord)));
+    }
+    if (userData->hasColors) {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(4, GL_FLOAT, stride, reinterpret_cast<const GLvoid *>(offsetof(vpvl::XModelIndexedVertex, color)));
+    }
+    glEnable(GL_TEXTURE_2D);
+    const uint32_t nRanges = userData->ranges.size();
+    for (uint32_t i = 0; i < nRanges; i++) {
+        const __vpvlXModelRangePrivate &range = userData->ranges[i];
+        if (hasMaterials) {
+            const vpvl::XMaterial *material = model->materialAt(range.materialIndex);
+            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, static_cast<const GLfloat *>(material->color()));
+            glMaterialfv(GL_FRONT_AND_BACK, GL_EMISSION, static_cast<const GLfloat *>(material->emmisive()));
+            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, static_cast<const GLfloat *>(material->specular()));
+            glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->power());
+            glBindTexture(GL_TEXTURE_2D, range.textureID);
+        }
+        glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_INT,
+                       reinterpret_cast<const GLvoid *>(range.offset * sizeof(uint32_t)));
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+#ifndef VPVL_COORDINATE_OPENGL
+    glPopMatrix();
+    glCullFace(GL_BACK);
+#endif
 }
 
 void Renderer::drawSurface()
 {
     float matrix[16];
+    m_nDrawCalls = 0;
+    m_nStateChanges = 0;
+    if (m_captureFramebuffer)
+        glBindFramebuffer(GL_FRAMEBUFFER, m_captureFramebuffer);
     glViewport(0, 0, m_width, m_height);
     glMatrixMode(GL_PROJECTION);
     m_scene->getProjectionMatrix(matrix);
@@ -818,9 +1616,24 @@ void Renderer::drawSurface()
     glDepthMask(0);
     glDisable(GL_DEPTH_TEST);
     glPushMatrix();
-    // render shadow before drawing models
+    // render shadow before drawing models (culled models are not skinned)
     size_t size = 0;
-    vpvl::PMDModel **models = m_scene->getRenderingOrder(size);
+    vpvl::PMDModel **models = m_scene->getVisibleRenderingOrder(size);
+    // finish the decoded textures within the budget and draw the others without the textures
+    if (m_textureCache) {
+        __vpvlTextureUploader uploader;
+        glActiveTexture(GL_TEXTURE0);
+        m_textureCache->upload(&uploader, m_textureUploadBudget);
+        const bool isPending = m_textureCache->countPendingTextures() > 0;
+        for (size_t i = 0; i < size; i++)
+            RendererResolveModelTextures(m_textureCache, models[i], isPending);
+        const uint32_t nAssets = m_assets.size();
+        for (uint32_t i = 0; i < nAssets; i++)
+            RendererResolveAssetTextures(m_textureCache, m_assets[i], isPending);
+    }
+    // stream the vertices of each model once and draw all passes from them
+    for (size_t i = 0; i < size; i++)
+        uploadModel(models[i]);
     for (size_t i = 0; i < size; i++) {
         vpvl::PMDModel *model = models[i];
         drawModelShadow(model);
@@ -839,10 +1652,29 @@ void Renderer::drawSurface()
         drawAsset(m_assets[i]);
     }
     // render model and edge
-    for (size_t i = 0; i < size; i++) {
-        vpvl::PMDModel *model = models[i];
-        drawModel(model);
-        drawModelEdge(model);
+    if (m_enableDrawBatching) {
+        // the materials and the edge of each model are drawn in order to blend them as drawn
+        // one by one and only the states differing from the previous model are set
+        btAlignedObjectArray<__vpvlDrawCommand> commands;
+        __vpvlDrawState state;
+        RendererBeginDraw(state);
+        for (size_t i = 0; i < size; i++) {
+            const vpvl::PMDModel *model = models[i];
+            commands.resize(0);
+            RendererAddDrawCommands(model, commands);
+            RendererDrawCommands(state, m_skinningProgram, commands, 0, commands.size());
+            RendererDrawEdge(state, m_skinningProgram, model, RendererEdgeColor(model, m_selected));
+        }
+        RendererEndDraw(state);
+        m_nDrawCalls += state.nDrawCalls;
+        m_nStateChanges += state.nStateChanges;
+    }
+    else {
+        for (size_t i = 0; i < size; i++) {
+            vpvl::PMDModel *model = models[i];
+            drawModel(model);
+            drawModelEdge(model);
+        }
     }
     // render bones if selecting bone is enabled
     if (m_displayBones) {
@@ -851,6 +1683,10 @@ void Renderer::drawSurface()
             drawModelBones(model);
         }
     }
+    if (m_captureFramebuffer) {
+        readCapturedFrame();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 }
 
 }
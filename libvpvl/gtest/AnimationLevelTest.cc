@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+namespace {
+
+/* a model moving and morphing linearly so that interpolated frames are exact */
+class LinearModel {
+public:
+    LinearModel() {
+        const char *boneNames[] = { "root", "arm" }, *faceNames[] = { "face" };
+        test::BuildModel(modelBytes, boneNames, 2, faceNames, 1);
+        model.load(&modelBytes[0], modelBytes.size());
+        test::MotionBuilder()
+                .bone("root", 0, btVector3(0.0f, 0.0f, 0.0f))
+                .bone("root", 40, btVector3(40.0f, 20.0f, 0.0f))
+                .bone("arm", 0, btVector3(0.0f, 0.0f, 0.0f))
+                .bone("arm", 40, btVector3(0.0f, 0.0f, 0.0f), btQuaternion(btVector3(0.0f, 1.0f, 0.0f), 1.0f))
+                .face("face", 0, 0.0f)
+                .face("face", 40, 1.0f)
+                .attach(motion, model);
+    }
+    const vpvl::Bone *bone(int index) const {
+        return model.bones()[index];
+    }
+    std::vector<uint8_t> modelBytes;
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+};
+
+void ExpectSamePose(const LinearModel &expected, const LinearModel &actual) {
+    for (int i = 0; i < 2; i++) {
+        const btTransform &e = expected.bone(i)->localTransform(), &a = actual.bone(i)->localTransform();
+        EXPECT_NEAR(0.0f, e.getOrigin().distance(a.getOrigin()), 0.0001f);
+        EXPECT_NEAR(1.0f, fabs(e.getRotation().dot(a.getRotation())), 0.0001f);
+    }
+    EXPECT_NEAR(expected.model.faces()[1]->weight(), actual.model.faces()[1]->weight(), 0.0001f);
+}
+
+}
+
+TEST(AnimationLevelTest, InterpolateSkippedFrames) {
+    const vpvl::PMDModel::AnimationLevel levels[] = {
+        vpvl::PMDModel::kHalfRateAnimation,
+        vpvl::PMDModel::kQuarterRateAnimation
+    };
+    for (int i = 0; i < 2; i++) {
+        LinearModel full, reduced;
+        reduced.model.setAnimationLevel(levels[i]);
+        EXPECT_EQ(vpvl::PMDModel::kFullAnimation, reduced.model.animationLevel());
+        for (int j = 0; j < 30; j++) {
+            const float delta = j % 3 == 0 ? 0.5f : 1.0f;
+            full.model.updateMotion(delta);
+            reduced.model.updateMotion(delta);
+            EXPECT_EQ(levels[i], reduced.model.animationLevel());
+            ExpectSamePose(full, reduced);
+        }
+    }
+}
+
+TEST(AnimationLevelTest, ChangeLevelAtNextEvaluation) {
+    LinearModel full, reduced;
+    reduced.model.setAnimationLevel(vpvl::PMDModel::kQuarterRateAnimation);
+    EXPECT_EQ(vpvl::PMDModel::kFullAnimation, reduced.model.animationLevel());
+    reduced.model.updateMotion(1.0f);
+    full.model.updateMotion(1.0f);
+    EXPECT_EQ(vpvl::PMDModel::kQuarterRateAnimation, reduced.model.animationLevel());
+    reduced.model.updateMotion(1.0f);
+    full.model.updateMotion(1.0f);
+    reduced.model.setAnimationLevel(vpvl::PMDModel::kFullAnimation);
+    // the motion was evaluated 4 frames ahead and is interpolated until then
+    for (int i = 0; i < 8; i++) {
+        reduced.model.updateMotion(1.0f);
+        full.model.updateMotion(1.0f);
+        EXPECT_EQ(i < 2 ? vpvl::PMDModel::kQuarterRateAnimation : vpvl::PMDModel::kFullAnimation,
+                  reduced.model.animationLevel());
+        ExpectSamePose(full, reduced);
+    }
+    // seeking changes the level immediately
+    reduced.model.setAnimationLevel(vpvl::PMDModel::kMinimumAnimation);
+    reduced.model.seekMotion(20.0f);
+    EXPECT_EQ(vpvl::PMDModel::kMinimumAnimation, reduced.model.animationLevel());
+}
+
+TEST(AnimationLevelTest, ChooseLevelByProjectedSize) {
+    LinearModel model;
+    vpvl::Scene scene(640, 480, 30);
+    scene.addModel(&model.model);
+    scene.setViewMove(0);
+    scene.setEnableAnimationLOD(true);
+    EXPECT_TRUE(scene.enableAnimationLOD());
+    const float distances[] = { 20.0f, 100.0f, 300.0f, 1000.0f };
+    const vpvl::PMDModel::AnimationLevel levels[] = {
+        vpvl::PMDModel::kFullAnimation,
+        vpvl::PMDModel::kHalfRateAnimation,
+        vpvl::PMDModel::kQuarterRateAnimation,
+        vpvl::PMDModel::kMinimumAnimation
+    };
+    for (int i = 0; i < 4; i++) {
+        scene.setCameraPerspective(btVector3(0.0f, 0.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 16.0f, distances[i]);
+        scene.updateModelView(0);
+        // the new level is used from the next evaluation of the motion
+        for (int j = 0; j < 5; j++)
+            scene.update(1.0f);
+        EXPECT_EQ(levels[i], model.model.animationLevel());
+    }
+    // the priority keeps the far model detailed
+    model.model.setAnimationPriority(10.0f);
+    EXPECT_EQ(10.0f, model.model.animationPriority());
+    for (int j = 0; j < 5; j++)
+        scene.update(1.0f);
+    EXPECT_EQ(vpvl::PMDModel::kHalfRateAnimation, model.model.animationLevel());
+    // the level is no longer changed by the scene after disabling
+    scene.setEnableAnimationLOD(false);
+    model.model.setAnimationLevel(vpvl::PMDModel::kFullAnimation);
+    for (int j = 0; j < 5; j++)
+        scene.update(1.0f);
+    EXPECT_EQ(vpvl::PMDModel::kFullAnimation, model.model.animationLevel());
+}
@@ -0,0 +1,52 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+static const int kNBones = 8;
+
+static void AddKeyFrames(vpvl::BoneMotion *motion, const char *const *names) {
+    for (int i = 0; i < kNBones; i++) {
+        for (int j = 0; j < 6; j++) {
+            vpvl::BoneKeyFrame *frame = new vpvl::BoneKeyFrame();
+            frame->setName(reinterpret_cast<const uint8_t *>(names[i]));
+            frame->setFrameIndex(j * 10.0f + i);
+            frame->setPosition(btVector3(i + j, j * 0.5f, -j));
+            frame->setRotation(btQuaternion(btVector3(i % 3, 1.0f, 0.5f), j * 0.7f + i));
+            frame->setDefaultInterpolationParameter();
+            // Mix curved and linear channels
+            if ((i + j) % 2 == 0) {
+                frame->setInterpolationParameter(vpvl::BoneKeyFrame::kX, 64, 0, 64, 127);
+                frame->setInterpolationParameter(vpvl::BoneKeyFrame::kRotation, 10, 90, 30, 120);
+            }
+            ASSERT_TRUE(motion->addKeyFrame(frame));
+        }
+    }
+}
+
+TEST(BoneMotionTest, BatchEvaluationMatchesScalar) {
+    const char *names[kNBones] = { "b0", "b1", "b2", "b3", "b4", "b5", "b6", "b7" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, names, kNBones, 0, 0);
+    vpvl::PMDModel batchModel, scalarModel;
+    ASSERT_TRUE(batchModel.load(&modelBytes[0], modelBytes.size()));
+    ASSERT_TRUE(scalarModel.load(&modelBytes[0], modelBytes.size()));
+    vpvl::BoneMotion batch, scalar;
+    AddKeyFrames(&batch, names);
+    AddKeyFrames(&scalar, names);
+    batch.attachModel(&batchModel);
+    scalar.attachModel(&scalarModel);
+    scalar.setEnableBatchEvaluation(false);
+    EXPECT_TRUE(batch.enableBatchEvaluation());
+    for (float frame = 0.0f; frame <= 60.0f; frame += 0.75f) {
+        batch.seek(frame);
+        scalar.seek(frame);
+        for (int i = 0; i < kNBones; i++) {
+            const uint8_t *name = reinterpret_cast<const uint8_t *>(names[i]);
+            const vpvl::Bone *b = batchModel.findBone(name), *s = scalarModel.findBone(name);
+            // Positions are the same, rotations are interpolated with polynomial approximations
+            EXPECT_EQ(s->position(), b->position()) << "bone " << i << " at " << frame;
+            for (int j = 0; j < 4; j++)
+                EXPECT_NEAR(s->rotation()[j], b->rotation()[j], 1e-5f) << "bone " << i << " at " << frame;
+        }
+    }
+}
@@ -0,0 +1,369 @@
+#ifndef VPVL_GTEST_COMMON_H_
+#define VPVL_GTEST_COMMON_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "vpvl/vpvl.h"
+
+/* helpers to build minimal PMD and VMD data in memory */
+namespace test
+{
+
+template<typename T>
+inline void Append(std::vector<uint8_t> &bytes, const T &value) {
+    const uint8_t *ptr = reinterpret_cast<const uint8_t *>(&value);
+    bytes.insert(bytes.end(), ptr, ptr + sizeof(value));
+}
+
+inline void AppendName(std::vector<uint8_t> &bytes, const char *name, size_t size) {
+    std::vector<uint8_t> buffer(size, 0);
+    memcpy(&buffer[0], name, strlen(name));
+    bytes.insert(bytes.end(), buffer.begin(), buffer.end());
+}
+
+/* builds a PMD that has a vertex, the bones and the faces with a base face */
+inline void BuildModel(std::vector<uint8_t> &bytes,
+                       const char *const *boneNames,
+                       int nBones,
+                       const char *const *faceNames,
+                       int nFaces) {
+    bytes.clear();
+    AppendName(bytes, "Pmd", 3);
+    Append(bytes, 1.0f);
+    AppendName(bytes, "model", 20);
+    AppendName(bytes, "", 256);
+    Append(bytes, uint32_t(1));
+    for (int i = 0; i < 8; i++)
+        Append(bytes, 0.0f);
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint8_t(100));
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint32_t(3));
+    for (int i = 0; i < 3; i++)
+        Append(bytes, uint16_t(0));
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint16_t(nBones));
+    for (int i = 0; i < nBones; i++) {
+        AppendName(bytes, boneNames[i], 20);
+        Append(bytes, uint16_t(i == 0 ? 0xffff : 0));
+        Append(bytes, uint16_t(0));
+        Append(bytes, uint8_t(1));
+        Append(bytes, uint16_t(0));
+        for (int j = 0; j < 3; j++)
+            Append(bytes, 0.0f);
+    }
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint16_t(nFaces > 0 ? nFaces + 1 : 0));
+    for (int i = 0; nFaces > 0 && i <= nFaces; i++) {
+        AppendName(bytes, i == 0 ? "base" : faceNames[i - 1], 20);
+        Append(bytes, uint32_t(1));
+        Append(bytes, uint8_t(i == 0 ? 0 : 1));
+        Append(bytes, uint32_t(0));
+        for (int j = 0; j < 3; j++)
+            Append(bytes, i == 0 ? 0.0f : 1.0f);
+    }
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint8_t(0));
+    AppendName(bytes, "", 1000);
+}
+
+/* builds a PMD of a quad per material skinned between the bones "root" and "arm" and morphed by the face "face" */
+inline void BuildMeshModel(std::vector<uint8_t> &bytes,
+                           const char *const *textureNames,
+                           const float *opacities,
+                           int nMaterials) {
+    static const float kCorners[4][2] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+    static const uint16_t kQuad[] = { 0, 1, 2, 0, 2, 3 };
+    bytes.clear();
+    AppendName(bytes, "Pmd", 3);
+    Append(bytes, 1.0f);
+    AppendName(bytes, "mesh", 20);
+    AppendName(bytes, "", 256);
+    Append(bytes, uint32_t(nMaterials * 4));
+    for (int i = 0; i < nMaterials; i++) {
+        for (int j = 0; j < 4; j++) {
+            Append(bytes, i * 2.0f + kCorners[j][0]);
+            Append(bytes, kCorners[j][1] * 2.0f);
+            Append(bytes, 0.0f);
+            Append(bytes, 0.0f);
+            Append(bytes, 0.0f);
+            Append(bytes, -1.0f);
+            Append(bytes, kCorners[j][0]);
+            Append(bytes, 1.0f - kCorners[j][1]);
+            Append(bytes, uint16_t(0));
+            Append(bytes, uint16_t(1));
+            Append(bytes, uint8_t(kCorners[j][1] > 0.0f ? 50 : 100));
+            Append(bytes, uint8_t(0));
+        }
+    }
+    Append(bytes, uint32_t(nMaterials * 6));
+    for (int i = 0; i < nMaterials; i++) {
+        for (int j = 0; j < 6; j++)
+            Append(bytes, uint16_t(i * 4 + kQuad[j]));
+    }
+    Append(bytes, uint32_t(nMaterials));
+    for (int i = 0; i < nMaterials; i++) {
+        for (int j = 0; j < 3; j++)
+            Append(bytes, 0.8f);
+        Append(bytes, opacities ? opacities[i] : 1.0f);
+        Append(bytes, 5.0f);
+        for (int j = 0; j < 6; j++)
+            Append(bytes, 0.2f);
+        Append(bytes, uint8_t(i % 2 == 0 ? 0xff : 0));
+        Append(bytes, uint8_t(1));
+        Append(bytes, uint32_t(6));
+        AppendName(bytes, textureNames && textureNames[i] ? textureNames[i] : "", 20);
+    }
+    Append(bytes, uint16_t(2));
+    AppendName(bytes, "root", 20);
+    Append(bytes, uint16_t(0xffff));
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint8_t(1));
+    Append(bytes, uint16_t(0));
+    for (int j = 0; j < 3; j++)
+        Append(bytes, 0.0f);
+    AppendName(bytes, "arm", 20);
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint8_t(1));
+    Append(bytes, uint16_t(0));
+    Append(bytes, 0.0f);
+    Append(bytes, 1.0f);
+    Append(bytes, 0.0f);
+    Append(bytes, uint16_t(0));
+    Append(bytes, uint16_t(2));
+    AppendName(bytes, "base", 20);
+    Append(bytes, uint32_t(1));
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint32_t(0));
+    for (int j = 0; j < 3; j++)
+        Append(bytes, 0.0f);
+    AppendName(bytes, "face", 20);
+    Append(bytes, uint32_t(1));
+    Append(bytes, uint8_t(1));
+    Append(bytes, uint32_t(0));
+    Append(bytes, 0.0f);
+    Append(bytes, 0.5f);
+    Append(bytes, 0.0f);
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint8_t(0));
+    Append(bytes, uint32_t(0));
+    Append(bytes, uint8_t(0));
+    AppendName(bytes, "", 1000);
+}
+
+/* appends a chain of the rigid bodies jointed under the first bone, the first one of rootType is on the first bone and the rest of linkType are on the bone of linkBoneID */
+inline void AppendRigidBodyChain(std::vector<uint8_t> &bytes, int nLinks, uint16_t linkBoneID = 0, uint8_t rootType = 0, uint8_t linkType = 1) {
+    char name[20];
+    Append(bytes, uint32_t(nLinks));
+    for (int i = 0; i < nLinks; i++) {
+        snprintf(name, sizeof(name), "body%d", i);
+        AppendName(bytes, name, 20);
+        Append(bytes, uint16_t(i == 0 ? 0 : linkBoneID));
+        Append(bytes, uint8_t(i % 2));
+        Append(bytes, uint16_t(1 << (i % 2)));
+        Append(bytes, uint8_t(2));
+        Append(bytes, 0.2f);
+        Append(bytes, 0.6f);
+        Append(bytes, 0.0f);
+        Append(bytes, 0.0f);
+        Append(bytes, 20.0f - i);
+        Append(bytes, 0.0f);
+        for (int j = 0; j < 3; j++)
+            Append(bytes, 0.0f);
+        Append(bytes, 1.0f);
+        Append(bytes, 0.5f);
+        Append(bytes, 0.5f);
+        Append(bytes, 0.0f);
+        Append(bytes, 0.5f);
+        Append(bytes, uint8_t(i == 0 ? rootType : linkType));
+    }
+    Append(bytes, uint32_t(nLinks - 1));
+    for (int i = 1; i < nLinks; i++) {
+        snprintf(name, sizeof(name), "joint%d", i);
+        AppendName(bytes, name, 20);
+        Append(bytes, uint32_t(i - 1));
+        Append(bytes, uint32_t(i));
+        Append(bytes, 0.0f);
+        Append(bytes, 20.5f - i);
+        Append(bytes, 0.0f);
+        for (int j = 0; j < 9; j++)
+            Append(bytes, 0.0f);
+        for (int j = 0; j < 3; j++)
+            Append(bytes, -0.5f);
+        for (int j = 0; j < 3; j++)
+            Append(bytes, 0.5f);
+        for (int j = 0; j < 6; j++)
+            Append(bytes, 0.0f);
+    }
+}
+
+/* builds a text X of a grid of the quads having their own corners, the quads of the row i use the material i % nMaterials */
+inline void BuildGridAsset(std::vector<uint8_t> &bytes,
+                           int nColumns,
+                           int nRows,
+                           const char *const *textureNames,
+                           int nMaterials) {
+    static const int kCorners[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+    const int nQuads = nColumns * nRows;
+    char line[128];
+    std::string text = "xof 0302txt 0064\nHeader {\n 1;\n 0;\n 1;\n}\nMesh {\n";
+    snprintf(line, sizeof(line), " %d;\n", nQuads * 4);
+    text += line;
+    for (int i = 0; i < nQuads; i++) {
+        for (int j = 0; j < 4; j++) {
+            snprintf(line, sizeof(line), " %d.0;%d.0;0.0;,\n", i % nColumns + kCorners[j][0], i / nColumns + kCorners[j][1]);
+            text += line;
+        }
+    }
+    snprintf(line, sizeof(line), " %d;\n", nQuads);
+    text += line;
+    for (int i = 0; i < nQuads; i++) {
+        snprintf(line, sizeof(line), " 4;%d,%d,%d,%d;,\n", i * 4, i * 4 + 1, i * 4 + 2, i * 4 + 3);
+        text += line;
+    }
+    snprintf(line, sizeof(line), " MeshNormals {\n %d;\n", nQuads * 4);
+    text += line;
+    for (int i = 0; i < nQuads * 4; i++)
+        text += " 0.0;0.0;-1.0;,\n";
+    snprintf(line, sizeof(line), " %d;\n", nQuads);
+    text += line;
+    for (int i = 0; i < nQuads; i++) {
+        snprintf(line, sizeof(line), " 4;%d,%d,%d,%d;,\n", i * 4, i * 4 + 1, i * 4 + 2, i * 4 + 3);
+        text += line;
+    }
+    snprintf(line, sizeof(line), " }\n MeshTextureCoords {\n %d;\n", nQuads * 4);
+    text += line;
+    for (int i = 0; i < nQuads; i++) {
+        for (int j = 0; j < 4; j++) {
+            snprintf(line, sizeof(line), " %f;%f;,\n",
+                     float(i % nColumns + kCorners[j][0]) / nColumns, float(i / nColumns + kCorners[j][1]) / nRows);
+            text += line;
+        }
+    }
+    snprintf(line, sizeof(line), " }\n MeshMaterialList {\n %d;\n %d;\n", nMaterials, nQuads);
+    text += line;
+    for (int i = 0; i < nQuads; i++) {
+        snprintf(line, sizeof(line), " %d,\n", (i / nColumns) % nMaterials);
+        text += line;
+    }
+    for (int i = 0; i < nMaterials; i++) {
+        snprintf(line, sizeof(line), " Material {\n 0.8;0.8;0.8;1.0;;\n 5.0;\n 0.1;0.1;0.1;;\n 0.0;0.0;0.0;;\n");
+        text += line;
+        if (textureNames && textureNames[i]) {
+            snprintf(line, sizeof(line), " TextureFilename {\n \"%s\";\n }\n", textureNames[i]);
+            text += line;
+        }
+        text += " }\n";
+    }
+    text += " }\n}\n";
+    bytes.assign(text.begin(), text.end());
+}
+
+inline void AppendMotionHeader(std::vector<uint8_t> &bytes) {
+    bytes.clear();
+    AppendName(bytes, "Vocaloid Motion Data 0002", 30);
+    AppendName(bytes, "motion", 20);
+}
+
+/* appends a bone key frame with linear interpolation */
+inline void AppendBoneKeyFrame(std::vector<uint8_t> &bytes,
+                               const char *name,
+                               uint32_t frameIndex,
+                               const btVector3 &position,
+                               const btQuaternion &rotation) {
+    static const int8_t kLinear[] = { 20, 20, 107, 107 };
+    AppendName(bytes, name, 15);
+    Append(bytes, frameIndex);
+    for (int i = 0; i < 3; i++)
+        Append(bytes, float(position[i]));
+    Append(bytes, float(rotation.x()));
+    Append(bytes, float(rotation.y()));
+    Append(bytes, float(rotation.z()));
+    Append(bytes, float(rotation.w()));
+    for (int i = 0; i < 16; i++)
+        Append(bytes, kLinear[i / 4]);
+    for (int i = 0; i < 48; i++)
+        Append(bytes, int8_t(0));
+}
+
+inline void AppendFaceKeyFrame(std::vector<uint8_t> &bytes, const char *name, uint32_t frameIndex, float weight) {
+    AppendName(bytes, name, 15);
+    Append(bytes, frameIndex);
+    Append(bytes, weight);
+}
+
+inline void AppendCameraKeyFrame(std::vector<uint8_t> &bytes, uint32_t frameIndex, float distance, const btVector3 &position) {
+    static const int8_t kLinear[] = { 20, 107, 20, 107 };
+    Append(bytes, frameIndex);
+    Append(bytes, distance);
+    for (int i = 0; i < 3; i++)
+        Append(bytes, float(position[i]));
+    for (int i = 0; i < 3; i++)
+        Append(bytes, 0.0f);
+    for (int i = 0; i < 24; i++)
+        Append(bytes, kLinear[i % 4]);
+    Append(bytes, uint32_t(45));
+    Append(bytes, uint8_t(0));
+}
+
+/* builds a VMD of the bone and face key frames in the added order without camera, light and self shadow key frames */
+class MotionBuilder
+{
+public:
+    MotionBuilder() : m_nBoneKeyFrames(0), m_nFaceKeyFrames(0) {}
+
+    MotionBuilder &bone(const char *name, uint32_t frameIndex, const btVector3 &position) {
+        return bone(name, frameIndex, position, btQuaternion(0.0f, 0.0f, 0.0f, 1.0f));
+    }
+    MotionBuilder &bone(const char *name, uint32_t frameIndex, const btVector3 &position, const btQuaternion &rotation) {
+        AppendBoneKeyFrame(m_boneBytes, name, frameIndex, position, rotation);
+        m_nBoneKeyFrames++;
+        return *this;
+    }
+    MotionBuilder &face(const char *name, uint32_t frameIndex, float weight) {
+        AppendFaceKeyFrame(m_faceBytes, name, frameIndex, weight);
+        m_nFaceKeyFrames++;
+        return *this;
+    }
+    void build(std::vector<uint8_t> &bytes) const {
+        AppendMotionHeader(bytes);
+        Append(bytes, m_nBoneKeyFrames);
+        bytes.insert(bytes.end(), m_boneBytes.begin(), m_boneBytes.end());
+        Append(bytes, m_nFaceKeyFrames);
+        bytes.insert(bytes.end(), m_faceBytes.begin(), m_faceBytes.end());
+        for (int i = 0; i < 3; i++)
+            Append(bytes, uint32_t(0));
+    }
+    /* loads the motion without smoothing so that the interpolated frames are exact */
+    bool load(vpvl::VMDMotion &motion) const {
+        std::vector<uint8_t> bytes;
+        build(bytes);
+        if (!motion.load(&bytes[0], bytes.size()))
+            return false;
+        motion.setEnableSmooth(false);
+        return true;
+    }
+    /* loads the motion and adds it to the model */
+    bool attach(vpvl::VMDMotion &motion, vpvl::PMDModel &model) const {
+        if (!load(motion))
+            return false;
+        model.addMotion(&motion);
+        return true;
+    }
+
+private:
+    std::vector<uint8_t> m_boneBytes;
+    std::vector<uint8_t> m_faceBytes;
+    uint32_t m_nBoneKeyFrames;
+    uint32_t m_nFaceKeyFrames;
+};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+static const uint8_t *Name(const char *name) {
+    return reinterpret_cast<const uint8_t *>(name);
+}
+
+static vpvl::BoneKeyFrame *NewBoneKeyFrame(const char *name, float frameIndex, float x) {
+    vpvl::BoneKeyFrame *frame = new vpvl::BoneKeyFrame();
+    frame->setName(Name(name));
+    frame->setFrameIndex(frameIndex);
+    frame->setPosition(btVector3(x, 0.0f, 0.0f));
+    frame->setDefaultInterpolationParameter();
+    return frame;
+}
+
+static vpvl::FaceKeyFrame *NewFaceKeyFrame(const char *name, float frameIndex, float weight) {
+    vpvl::FaceKeyFrame *frame = new vpvl::FaceKeyFrame();
+    frame->setName(Name(name));
+    frame->setFrameIndex(frameIndex);
+    frame->setWeight(weight);
+    return frame;
+}
+
+static vpvl::CameraKeyFrame *NewCameraKeyFrame(float frameIndex, float distance) {
+    vpvl::CameraKeyFrame *frame = new vpvl::CameraKeyFrame();
+    frame->setFrameIndex(frameIndex);
+    frame->setDistance(distance);
+    frame->setDefaultInterpolationParameter();
+    return frame;
+}
+
+static bool LoadMotion(vpvl::VMDMotion &motion) {
+    return test::MotionBuilder()
+            .bone("bone", 0, btVector3(0.0f, 0.0f, 0.0f))
+            .bone("bone", 20, btVector3(20.0f, 0.0f, 0.0f))
+            .face("face", 0, 0.0f)
+            .face("face", 20, 1.0f)
+            .load(motion);
+}
+
+TEST(MotionEditTest, EditBoneKeyFramesWhileAttached) {
+    const char *boneNames[] = { "bone", "other" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 2, faceNames, 1);
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    ASSERT_TRUE(LoadMotion(motion));
+    motion.attachModel(&model);
+    vpvl::BoneMotion &bm = *motion.mutableBone();
+    const vpvl::Bone *bone = model.findBone(Name("bone"));
+    bm.seek(15.0f);
+    EXPECT_FLOAT_EQ(15.0f, bone->position().x());
+
+    // insert between the existing key frames
+    EXPECT_TRUE(bm.addKeyFrame(NewBoneKeyFrame("bone", 10, 0.0f)));
+    vpvl::BoneKeyFrame *duplicated = NewBoneKeyFrame("bone", 10, 1.0f);
+    EXPECT_FALSE(bm.addKeyFrame(duplicated));
+    delete duplicated;
+    bm.seek(15.0f);
+    EXPECT_FLOAT_EQ(10.0f, bone->position().x());
+    EXPECT_EQ(3, bm.frames().size());
+
+    // modify in place
+    vpvl::BoneKeyFrame *frame = bm.mutableKeyFrame(Name("bone"), 10);
+    ASSERT_TRUE(frame);
+    frame->setPosition(btVector3(10.0f, 0.0f, 0.0f));
+    bm.seek(15.0f);
+    EXPECT_FLOAT_EQ(15.0f, bone->position().x());
+    EXPECT_FALSE(bm.findKeyFrame(Name("bone"), 11));
+
+    // extend and shrink the motion
+    EXPECT_TRUE(bm.addKeyFrame(NewBoneKeyFrame("bone", 40, 40.0f)));
+    EXPECT_EQ(40.0f, bm.maxIndex());
+    EXPECT_TRUE(bm.moveKeyFrame(Name("bone"), 40, 30));
+    EXPECT_FALSE(bm.moveKeyFrame(Name("bone"), 30, 20));
+    EXPECT_EQ(30.0f, bm.maxIndex());
+    bm.seek(25.0f);
+    EXPECT_FLOAT_EQ(30.0f, bone->position().x());
+    EXPECT_TRUE(bm.removeKeyFrame(Name("bone"), 30));
+    EXPECT_FALSE(bm.removeKeyFrame(Name("bone"), 30));
+    EXPECT_EQ(20.0f, bm.maxIndex());
+    bm.seek(25.0f);
+    EXPECT_FLOAT_EQ(20.0f, bone->position().x());
+
+    // a new track is bound to the attached model
+    EXPECT_TRUE(bm.addKeyFrame(NewBoneKeyFrame("other", 0, 5.0f)));
+    bm.seek(0.0f);
+    EXPECT_FLOAT_EQ(5.0f, model.findBone(Name("other"))->position().x());
+    EXPECT_EQ(4, bm.frames().size());
+
+    // remove all key frames of the track
+    EXPECT_TRUE(bm.removeKeyFrame(Name("other"), 0));
+    bm.seek(10.0f);
+    EXPECT_FLOAT_EQ(10.0f, bone->position().x());
+    EXPECT_EQ(3, bm.frames().size());
+}
+
+TEST(MotionEditTest, EditFaceKeyFrames) {
+    const char *boneNames[] = { "bone" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    ASSERT_TRUE(LoadMotion(motion));
+    motion.attachModel(&model);
+    vpvl::FaceMotion &fm = *motion.mutableFace();
+    const vpvl::Face *face = model.findFace(Name("face"));
+    EXPECT_TRUE(fm.addKeyFrame(NewFaceKeyFrame("face", 10, 1.0f)));
+    fm.seek(5.0f);
+    EXPECT_FLOAT_EQ(0.5f, face->weight());
+    EXPECT_TRUE(fm.moveKeyFrame(Name("face"), 10, 15));
+    fm.seek(5.0f);
+    EXPECT_FLOAT_EQ(1.0f / 3.0f, face->weight());
+    fm.mutableKeyFrame(Name("face"), 15)->setWeight(0.0f);
+    fm.seek(5.0f);
+    EXPECT_FLOAT_EQ(0.0f, face->weight());
+    EXPECT_TRUE(fm.removeKeyFrame(Name("face"), 15));
+    fm.seek(5.0f);
+    EXPECT_FLOAT_EQ(0.25f, face->weight());
+}
+
+TEST(MotionEditTest, EditCameraKeyFrames) {
+    vpvl::CameraMotion motion;
+    EXPECT_TRUE(motion.addKeyFrame(NewCameraKeyFrame(20, 20.0f)));
+    EXPECT_TRUE(motion.addKeyFrame(NewCameraKeyFrame(0, 0.0f)));
+    EXPECT_TRUE(motion.addKeyFrame(NewCameraKeyFrame(10, 0.0f)));
+    EXPECT_EQ(20.0f, motion.maxIndex());
+    motion.seek(15.0f);
+    EXPECT_FLOAT_EQ(10.0f, motion.distance());
+    EXPECT_TRUE(motion.removeKeyFrame(10));
+    EXPECT_TRUE(motion.moveKeyFrame(20, 40));
+    EXPECT_EQ(40.0f, motion.maxIndex());
+    motion.seek(10.0f);
+    EXPECT_FLOAT_EQ(5.0f, motion.distance());
+    EXPECT_EQ(0.0f, motion.findKeyFrame(0)->distance());
+    EXPECT_FALSE(motion.findKeyFrame(10));
+    vpvl::CameraMotion shared;
+    shared.share(&motion);
+    EXPECT_FALSE(shared.removeKeyFrame(0));
+}
+
+TEST(MotionEditTest, CountEditsFromPreviousKeyFrame) {
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(LoadMotion(motion));
+    vpvl::BoneMotion &bm = *motion.mutableBone();
+    const uint32_t revision = bm.revision();
+    // the curve from the previous key frame is changed
+    EXPECT_TRUE(bm.addKeyFrame(NewBoneKeyFrame("bone", 10, 0.0f)));
+    EXPECT_EQ(revision + 1, bm.revision());
+    EXPECT_EQ(0.0f, bm.editedFrame());
+    EXPECT_TRUE(bm.moveKeyFrame(Name("bone"), 20, 30));
+    EXPECT_EQ(10.0f, bm.editedFrame());
+    // a lookup is not an edit
+    EXPECT_TRUE(bm.findKeyFrame(Name("bone"), 0));
+    EXPECT_EQ(revision + 2, bm.revision());
+    EXPECT_TRUE(bm.mutableKeyFrame(Name("bone"), 30));
+    EXPECT_EQ(10.0f, bm.editedFrame());
+    EXPECT_FALSE(bm.removeKeyFrame(Name("bone"), 20));
+    EXPECT_EQ(revision + 3, bm.revision());
+    // the shared motion follows the edits of the source
+    vpvl::BoneMotion shared;
+    shared.share(&bm);
+    EXPECT_EQ(bm.revision(), shared.revision());
+    EXPECT_TRUE(shared.findKeyFrame(Name("bone"), 10));
+    EXPECT_FALSE(shared.mutableKeyFrame(Name("bone"), 10));
+    EXPECT_TRUE(bm.removeKeyFrame(Name("bone"), 30));
+    EXPECT_EQ(bm.revision(), shared.revision());
+    EXPECT_EQ(10.0f, shared.editedFrame());
+    vpvl::FaceMotion &fm = *motion.mutableFace();
+    EXPECT_TRUE(fm.addKeyFrame(NewFaceKeyFrame("face", 30, 0.0f)));
+    EXPECT_EQ(20.0f, fm.editedFrame());
+    fm.mutableFrames();
+    EXPECT_EQ(0.0f, fm.editedFrame());
+}
+
+TEST(MotionEditTest, FindKeyFramesOfConstMotion) {
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(LoadMotion(motion));
+    vpvl::BoneMotion &bm = *motion.mutableBone();
+    const vpvl::BoneMotion &constBone = motion.bone();
+    // the key frames edited by mutableFrames are found before they are grouped again
+    bm.mutableFrames()->push_back(NewBoneKeyFrame("bone", 10, 10.0f));
+    const uint32_t revision = constBone.revision();
+    ASSERT_TRUE(constBone.findKeyFrame(Name("bone"), 10));
+    EXPECT_FLOAT_EQ(10.0f, constBone.findKeyFrame(Name("bone"), 10)->position().x());
+    EXPECT_FALSE(constBone.findKeyFrame(Name("bone"), 15));
+    EXPECT_EQ(revision, constBone.revision());
+    // the edits by the tracks are reflected to the list of all key frames
+    EXPECT_TRUE(bm.addKeyFrame(NewBoneKeyFrame("bone", 30, 30.0f)));
+    EXPECT_TRUE(constBone.findKeyFrame(Name("bone"), 30));
+    EXPECT_EQ(4, constBone.frames().size());
+    EXPECT_TRUE(bm.removeKeyFrame(Name("bone"), 0));
+    EXPECT_FALSE(constBone.findKeyFrame(Name("bone"), 0));
+    EXPECT_EQ(3, constBone.frames().size());
+    const vpvl::FaceMotion &constFace = motion.face();
+    EXPECT_TRUE(motion.mutableFace()->removeKeyFrame(Name("face"), 20));
+    EXPECT_FALSE(constFace.findKeyFrame(Name("face"), 20));
+    EXPECT_EQ(1, constFace.frames().size());
+}
@@ -0,0 +1,95 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+#include <math.h>
+
+static const char kBoneName[] = "bone";
+static const char kFaceName[] = "face";
+static const int kNFrames = 120;
+
+static btVector3 SourcePosition(int frame) {
+    const float t = frame / static_cast<float>(kNFrames);
+    return btVector3(10.0f * sinf(t * 3.0f), 5.0f * t * t, frame < 60 ? 0.0f : (frame - 60) * 0.1f);
+}
+
+static btQuaternion SourceRotation(int frame) {
+    const float t = frame / static_cast<float>(kNFrames);
+    return btQuaternion(btVector3(0.0f, 1.0f, 0.0f), 1.5f * sinf(t * 2.0f));
+}
+
+static float SourceWeight(int frame) {
+    return frame < 40 ? frame / 40.0f : 1.0f;
+}
+
+/* builds a captured VMD that has key frames at every frame */
+static void BuildMotion(std::vector<uint8_t> &bytes) {
+    test::MotionBuilder builder;
+    for (int i = 0; i <= kNFrames; i++)
+        builder.bone(kBoneName, i, SourcePosition(i), SourceRotation(i));
+    for (int i = 0; i <= kNFrames; i++)
+        builder.face(kFaceName, i, SourceWeight(i));
+    builder.build(bytes);
+}
+
+TEST(MotionReducerTest, ReduceCapturedMotion) {
+    std::vector<uint8_t> modelBytes, motionBytes;
+    const char *boneNames[] = { kBoneName }, *faceNames[] = { kFaceName };
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    BuildMotion(motionBytes);
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(motion.load(&motionBytes[0], motionBytes.size()));
+    vpvl::MotionReducer reducer;
+    ASSERT_TRUE(reducer.reduce(&motion));
+    EXPECT_EQ(uint32_t((kNFrames + 1) * 2), reducer.countSourceKeyFrames());
+    EXPECT_LT(reducer.countReducedKeyFrames(), reducer.countSourceKeyFrames() / 4);
+    EXPECT_GT(reducer.reductionRatio(), 0.75f);
+    EXPECT_EQ(3, motion.face().frames().size());
+
+    std::vector<uint8_t> reducedBytes(motion.estimateSize());
+    motion.save(&reducedBytes[0]);
+    vpvl::VMDMotion reduced;
+    ASSERT_TRUE(reduced.load(&reducedBytes[0], reducedBytes.size()));
+    EXPECT_EQ(motion.bone().frames().size(), reduced.bone().frames().size());
+    reduced.setEnableSmooth(false);
+    vpvl::PMDModel model;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    reduced.attachModel(&model);
+    vpvl::Bone *bone = model.findBone(reinterpret_cast<const uint8_t *>(kBoneName));
+    vpvl::Face *face = model.findFace(reinterpret_cast<const uint8_t *>(kFaceName));
+    ASSERT_TRUE(bone != 0);
+    ASSERT_TRUE(face != 0);
+    const float rotationTolerance = vpvl::MotionReducer::kDefaultRotationTolerance * SIMD_RADS_PER_DEG;
+    for (int i = 0; i <= kNFrames; i++) {
+        reduced.seek(static_cast<float>(i));
+        const btVector3 &position = SourcePosition(i);
+        for (int j = 0; j < 3; j++)
+            EXPECT_NEAR(position[j], bone->position()[j], vpvl::MotionReducer::kDefaultPositionTolerance + 0.0001f);
+        const float angle = 2.0f * acosf(btMin(1.0f, btFabs(SourceRotation(i).dot(bone->rotation()))));
+        EXPECT_LE(angle, rotationTolerance + 0.001f);
+        EXPECT_NEAR(SourceWeight(i), face->weight(), vpvl::MotionReducer::kDefaultFaceWeightTolerance + 0.0001f);
+    }
+}
+
+TEST(MotionReducerTest, KeepInterpolationParameters) {
+    vpvl::BoneKeyFrame frame;
+    frame.setDefaultInterpolationParameter();
+    frame.setInterpolationParameter(vpvl::BoneKeyFrame::kRotation, 0, 127, 64, 32);
+    int8_t x1, y1, x2, y2;
+    frame.getInterpolationParameter(vpvl::BoneKeyFrame::kRotation, x1, y1, x2, y2);
+    EXPECT_EQ(0, x1);
+    EXPECT_EQ(127, y1);
+    EXPECT_EQ(64, x2);
+    EXPECT_EQ(32, y2);
+    EXPECT_TRUE(frame.linear()[vpvl::BoneKeyFrame::kX]);
+    EXPECT_FALSE(frame.linear()[vpvl::BoneKeyFrame::kRotation]);
+    uint8_t data[111];
+    frame.write(data);
+    vpvl::BoneKeyFrame frame2;
+    frame2.read(data);
+    frame2.getInterpolationParameter(vpvl::BoneKeyFrame::kRotation, x1, y1, x2, y2);
+    EXPECT_EQ(0, x1);
+    EXPECT_EQ(127, y1);
+    EXPECT_EQ(64, x2);
+    EXPECT_EQ(32, y2);
+    EXPECT_EQ(0, memcmp(data + 48, data + 63, 15));
+}
@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+static bool LoadMotion(vpvl::VMDMotion &motion) {
+    return test::MotionBuilder()
+            .bone("bone", 30, btVector3(30.0f, 0.0f, 0.0f))
+            .bone("bone", 0, btVector3(0.0f, 0.0f, 0.0f))
+            .bone("missing", 0, btVector3(0.0f, 0.0f, 0.0f))
+            .bone("missing", 30, btVector3(0.0f, 0.0f, 0.0f))
+            .face("face", 0, 0.0f)
+            .face("face", 30, 1.0f)
+            .load(motion);
+}
+
+TEST(MotionShareTest, DriveManyModels) {
+    static const int kNModels = 3;
+    const char *boneNames[] = { "bone" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    vpvl::VMDMotion source;
+    ASSERT_TRUE(LoadMotion(source));
+    vpvl::PMDModel models[kNModels];
+    vpvl::VMDMotion motions[kNModels];
+    for (int i = 0; i < kNModels; i++) {
+        ASSERT_TRUE(models[i].load(&modelBytes[0], modelBytes.size()));
+        motions[i].share(&source);
+        motions[i].setEnableSmooth(false);
+        motions[i].attachModel(&models[i]);
+        EXPECT_TRUE(motions[i].bone().isShared());
+        EXPECT_EQ(&source.bone().frames(), &motions[i].bone().frames());
+        EXPECT_EQ(&source.face().frames(), &motions[i].face().frames());
+        EXPECT_EQ(30.0f, motions[i].bone().maxIndex());
+    }
+    for (int i = 0; i < kNModels; i++)
+        motions[i].seek(i * 10.0f);
+    for (int i = 0; i < kNModels; i++) {
+        const vpvl::Bone *bone = models[i].findBone(reinterpret_cast<const uint8_t *>("bone"));
+        const vpvl::Face *face = models[i].findFace(reinterpret_cast<const uint8_t *>("face"));
+        EXPECT_FLOAT_EQ(i * 10.0f, bone->position().x());
+        EXPECT_FLOAT_EQ(i / 3.0f, face->weight());
+    }
+    EXPECT_EQ(source.estimateSize(), motions[0].estimateSize());
+}
+
+TEST(MotionShareTest, EditFramesWhileAttached) {
+    static const int kNModels = 3;
+    const char *boneNames[] = { "bone" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    vpvl::VMDMotion source;
+    ASSERT_TRUE(LoadMotion(source));
+    vpvl::PMDModel models[kNModels];
+    vpvl::VMDMotion motions[kNModels];
+    for (int i = 0; i < kNModels; i++) {
+        ASSERT_TRUE(models[i].load(&modelBytes[0], modelBytes.size()));
+        motions[i].share(&source);
+        motions[i].setEnableSmooth(false);
+    }
+    motions[0].attachModel(&models[0]);
+    motions[1].attachModel(&models[1]);
+    // the edited key frames are grouped again when the next model is attached
+    vpvl::BoneKeyFrameList *boneFrames = source.mutableBone()->mutableFrames();
+    for (int i = 0; i < boneFrames->size(); i++) {
+        vpvl::BoneKeyFrame *frame = (*boneFrames)[i];
+        if (frame->frameIndex() == 30.0f)
+            frame->setPosition(btVector3(60.0f, 0.0f, 0.0f));
+    }
+    vpvl::FaceKeyFrameList *faceFrames = source.mutableFace()->mutableFrames();
+    for (int i = 0; i < faceFrames->size(); i++) {
+        vpvl::FaceKeyFrame *frame = (*faceFrames)[i];
+        if (frame->frameIndex() == 30.0f)
+            frame->setWeight(0.5f);
+    }
+    motions[2].attachModel(&models[2]);
+    for (int i = 0; i < kNModels; i++)
+        motions[i].seek(15.0f);
+    for (int i = 0; i < kNModels; i++) {
+        const vpvl::Bone *bone = models[i].findBone(reinterpret_cast<const uint8_t *>("bone"));
+        const vpvl::Face *face = models[i].findFace(reinterpret_cast<const uint8_t *>("face"));
+        EXPECT_FLOAT_EQ(30.0f, bone->position().x());
+        EXPECT_FLOAT_EQ(0.25f, face->weight());
+    }
+}
+
+TEST(MotionShareTest, SeekAfterReplacingFrames) {
+    static const int kNModels = 3;
+    const char *boneNames[] = { "bone" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    vpvl::VMDMotion source;
+    ASSERT_TRUE(LoadMotion(source));
+    vpvl::PMDModel models[kNModels];
+    vpvl::VMDMotion motions[kNModels - 1];
+    for (int i = 0; i < kNModels; i++)
+        ASSERT_TRUE(models[i].load(&modelBytes[0], modelBytes.size()));
+    source.attachModel(&models[0]);
+    for (int i = 1; i < kNModels; i++) {
+        motions[i - 1].share(&source);
+        motions[i - 1].setEnableSmooth(false);
+        motions[i - 1].attachModel(&models[i]);
+    }
+    // the deleted key frames are not referred by the next seek as the reducer does
+    vpvl::BoneKeyFrameList *boneFrames = source.mutableBone()->mutableFrames();
+    for (int i = boneFrames->size() - 1; i >= 0; i--) {
+        vpvl::BoneKeyFrame *frame = (*boneFrames)[i];
+        if (frame->frameIndex() == 30.0f) {
+            delete frame;
+            boneFrames->remove(frame);
+        }
+    }
+    vpvl::BoneKeyFrame *frame = new vpvl::BoneKeyFrame();
+    frame->setName(reinterpret_cast<const uint8_t *>("bone"));
+    frame->setFrameIndex(60.0f);
+    frame->setPosition(btVector3(120.0f, 0.0f, 0.0f));
+    frame->setDefaultInterpolationParameter();
+    boneFrames->push_back(frame);
+    vpvl::FaceKeyFrameList *faceFrames = source.mutableFace()->mutableFrames();
+    delete (*faceFrames)[1];
+    faceFrames->pop_back();
+    source.seek(15.0f);
+    for (int i = 0; i < kNModels - 1; i++)
+        motions[i].seek(15.0f);
+    for (int i = 0; i < kNModels; i++) {
+        const vpvl::Bone *bone = models[i].findBone(reinterpret_cast<const uint8_t *>("bone"));
+        const vpvl::Face *face = models[i].findFace(reinterpret_cast<const uint8_t *>("face"));
+        EXPECT_FLOAT_EQ(30.0f, bone->position().x());
+        EXPECT_FLOAT_EQ(0.0f, face->weight());
+    }
+    EXPECT_EQ(60.0f, source.bone().maxIndex());
+    EXPECT_EQ(60.0f, motions[0].bone().maxIndex());
+}
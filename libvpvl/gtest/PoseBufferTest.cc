@@ -0,0 +1,74 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+static bool LoadMotion(vpvl::VMDMotion &motion, float value) {
+    const btVector3 position(value, 0.0f, 0.0f);
+    return test::MotionBuilder()
+            .bone("upper", 0, position)
+            .bone("upper", 10, position)
+            .bone("lower", 0, position)
+            .bone("lower", 10, position)
+            .load(motion);
+}
+
+TEST(PoseBufferTest, BlendLayersWithMask) {
+    const char *boneNames[] = { "upper", "lower", "static" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 3, 0, 0);
+    vpvl::PMDModel model;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    vpvl::VMDMotion base, gesture, half;
+    ASSERT_TRUE(LoadMotion(base, 10.0f));
+    ASSERT_TRUE(LoadMotion(gesture, 20.0f));
+    ASSERT_TRUE(LoadMotion(half, 30.0f));
+    /* added in reverse order, blended by priority */
+    half.setPriority(2.0f);
+    gesture.setPriority(1.0f);
+    model.addMotion(&half);
+    model.addMotion(&gesture);
+    model.addMotion(&base);
+    gesture.mutableBone()->setBoneMask(reinterpret_cast<const uint8_t *>("lower"), 0.0f);
+    half.mutableBone()->setBoneMask(reinterpret_cast<const uint8_t *>("upper"), 0.0f);
+    half.mutableBone()->setBlendRate(0.5f);
+    model.updateMotion(0.0f);
+    const vpvl::Bone *upper = model.findBone(reinterpret_cast<const uint8_t *>("upper"));
+    const vpvl::Bone *lower = model.findBone(reinterpret_cast<const uint8_t *>("lower"));
+    const vpvl::Bone *fixed = model.findBone(reinterpret_cast<const uint8_t *>("static"));
+    EXPECT_FLOAT_EQ(20.0f, upper->position().x());
+    EXPECT_FLOAT_EQ(20.0f, lower->position().x());
+    EXPECT_FLOAT_EQ(0.0f, fixed->position().x());
+    EXPECT_EQ(2U, model.poseBuffer().countBlendedBones());
+    model.removeMotion(&gesture);
+    EXPECT_TRUE(gesture.bone().poseBuffer() == 0);
+    model.updateMotion(0.0f);
+    EXPECT_FLOAT_EQ(10.0f, upper->position().x());
+    EXPECT_FLOAT_EQ(20.0f, lower->position().x());
+}
+
+TEST(PoseBufferTest, BlendLayersInPriorityOrder) {
+    const char *boneNames[] = { "upper", "lower" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 2, 0, 0);
+    vpvl::PMDModel model;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    vpvl::VMDMotion first, second, third;
+    ASSERT_TRUE(LoadMotion(first, 10.0f));
+    ASSERT_TRUE(LoadMotion(second, 20.0f));
+    ASSERT_TRUE(LoadMotion(third, 30.0f));
+    /* the lowest priority is blended first and the same priorities are blended in the added order */
+    first.setPriority(1.0f);
+    second.setPriority(0.0f);
+    third.setPriority(1.0f);
+    model.addMotion(&first);
+    model.addMotion(&second);
+    model.addMotion(&third);
+    first.mutableBone()->setBlendRate(0.5f);
+    third.mutableBone()->setBlendRate(0.5f);
+    model.updateMotion(0.0f);
+    const vpvl::Bone *upper = model.findBone(reinterpret_cast<const uint8_t *>("upper"));
+    EXPECT_FLOAT_EQ(22.5f, upper->position().x());
+    model.removeMotion(&third);
+    model.updateMotion(0.0f);
+    EXPECT_FLOAT_EQ(15.0f, upper->position().x());
+}
@@ -0,0 +1,290 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+namespace {
+
+static const int kNModels = 6;
+
+/* a scene of the models that each one plays its own motion */
+class SceneFixture {
+public:
+    SceneFixture() : scene(640, 480, 30) {
+        const char *boneNames[] = { "root", "arm", "hand" }, *faceNames[] = { "face" };
+        std::vector<uint8_t> modelBytes;
+        test::BuildModel(modelBytes, boneNames, 3, faceNames, 1);
+        for (int i = 0; i < kNModels; i++) {
+            const btQuaternion rotation(btVector3(0.0f, 1.0f, 0.0f), 0.1f * (i + 1));
+            models[i].load(&modelBytes[0], modelBytes.size());
+            test::MotionBuilder()
+                    .bone("root", 0, btVector3(0.0f, 0.0f, 0.0f))
+                    .bone("root", 30, btVector3(i, 1.0f, -i), rotation)
+                    .bone("arm", 0, btVector3(0.0f, 0.0f, 0.0f), rotation)
+                    .bone("arm", 20, btVector3(0.0f, i, 0.0f))
+                    .face("face", 0, 0.0f)
+                    .face("face", 30, 1.0f)
+                    .attach(motions[i], models[i]);
+            scene.addModel(&models[i]);
+        }
+    }
+    vpvl::Scene scene;
+    vpvl::PMDModel models[kNModels];
+    vpvl::VMDMotion motions[kNModels];
+};
+
+void AssertSameModels(const SceneFixture &expected, const SceneFixture &actual) {
+    for (int i = 0; i < kNModels; i++) {
+        const vpvl::BoneList &expectedBones = expected.models[i].bones();
+        const vpvl::BoneList &actualBones = actual.models[i].bones();
+        ASSERT_EQ(expectedBones.size(), actualBones.size());
+        for (int j = 0; j < expectedBones.size(); j++) {
+            const btTransform &e = expectedBones[j]->localTransform(), &a = actualBones[j]->localTransform();
+            for (int k = 0; k < 3; k++) {
+                EXPECT_EQ(e.getOrigin()[k], a.getOrigin()[k]);
+                EXPECT_EQ(e.getBasis()[k], a.getBasis()[k]);
+            }
+        }
+        EXPECT_EQ(expected.models[i].faces()[1]->weight(), actual.models[i].faces()[1]->weight());
+        const size_t size = expected.models[i].stride(vpvl::PMDModel::kVerticesStride) * expected.models[i].vertices().size();
+        EXPECT_EQ(0, memcmp(expected.models[i].verticesPointer(), actual.models[i].verticesPointer(), size));
+    }
+}
+
+static const int kNTicks = 60;
+
+const btVector3 &VertexPosition(const vpvl::PMDModel &model) {
+    return *static_cast<const btVector3 *>(model.verticesPointer());
+}
+
+const btVector3 &EdgeVertexPosition(const vpvl::PMDModel &model) {
+    return *static_cast<const btVector3 *>(model.edgeVerticesPointer());
+}
+
+/* moves the camera to tell the tick from the output */
+void UpdateTick(SceneFixture &fixture, int tick) {
+    vpvl::Scene &scene = fixture.scene;
+    scene.setCameraPerspective(btVector3(0.0f, 0.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 16.0f, 100.0f + tick);
+    scene.updateModelView(0);
+    scene.update(0.5f);
+}
+
+/* updates and publishes the ticks on a worker thread */
+class UpdateTask : public vpvl::IThreadPoolTask {
+public:
+    UpdateTask(SceneFixture *f) : fixture(f) {}
+    void run() {
+        for (int i = 0; i < kNTicks; i++) {
+            UpdateTick(*fixture, i);
+            fixture->scene.publishOutput();
+        }
+    }
+    SceneFixture *fixture;
+};
+
+}
+
+TEST(SceneTest, UpdateModelsConcurrently) {
+    SceneFixture serial, parallel;
+    vpvl::ThreadPool pool(3);
+    parallel.scene.setThreadPool(&pool);
+    EXPECT_EQ(&pool, parallel.scene.threadPool());
+    for (int i = 0; i < 40; i++) {
+        serial.scene.update(0.5f + (i % 3) * 0.25f);
+        parallel.scene.update(0.5f + (i % 3) * 0.25f);
+        AssertSameModels(serial, parallel);
+    }
+}
+
+TEST(SceneTest, SeekModelsConcurrently) {
+    SceneFixture serial, parallel;
+    vpvl::ThreadPool pool(3);
+    parallel.scene.setThreadPool(&pool);
+    static const float kFrames[] = { 0.0f, 12.5f, 30.0f, 5.0f, 45.0f, 21.0f };
+    for (size_t i = 0; i < sizeof(kFrames) / sizeof(kFrames[0]); i++) {
+        serial.scene.seek(kFrames[i]);
+        parallel.scene.seek(kFrames[i]);
+        AssertSameModels(serial, parallel);
+    }
+}
+
+TEST(SceneTest, AdvanceInFixedSteps) {
+    SceneFixture stepped, fixed;
+    EXPECT_EQ(int(vpvl::Scene::kDefaultMaxCatchUpSteps), fixed.scene.maxCatchUpSteps());
+    // 30 FPS steps of one frame each and the rest is carried over
+    EXPECT_EQ(0, fixed.scene.advance(0.5f / 30.0f));
+    EXPECT_EQ(1, fixed.scene.advance(0.75f / 30.0f));
+    stepped.scene.update(1.0f);
+    AssertSameModels(stepped, fixed);
+    EXPECT_EQ(2, fixed.scene.advance(1.8f / 30.0f));
+    stepped.scene.update(1.0f);
+    stepped.scene.update(1.0f);
+    AssertSameModels(stepped, fixed);
+    // a long stall does not spend more than the max catch-up steps
+    fixed.scene.setMaxCatchUpSteps(3);
+    EXPECT_EQ(3, fixed.scene.advance(1.0f));
+    for (int i = 0; i < 3; i++)
+        stepped.scene.update(1.0f);
+    AssertSameModels(stepped, fixed);
+    // the dropped time is not caught up later
+    EXPECT_GE(1, fixed.scene.advance(1.0f / 30.0f));
+}
+
+TEST(SceneTest, UpdateAndRenderConcurrently) {
+    SceneFixture serial, buffered;
+    btVector3 expected[kNTicks][kNModels], expectedBones[kNTicks][kNModels];
+    serial.scene.setViewMove(0);
+    for (int i = 0; i < kNTicks; i++) {
+        UpdateTick(serial, i);
+        for (int j = 0; j < kNModels; j++) {
+            expected[i][j] = VertexPosition(serial.models[j]);
+            expectedBones[i][j] = serial.models[j].boneTransform(2).getOrigin();
+        }
+    }
+    buffered.scene.setViewMove(0);
+    buffered.scene.setEnableBufferedOutput(true);
+    EXPECT_TRUE(buffered.scene.enableBufferedOutput());
+    EXPECT_FALSE(buffered.scene.acquireOutput());
+    UpdateTask task(&buffered);
+    int lastTick = -1, nAcquired = 0;
+    {
+        vpvl::ThreadPool pool(1);
+        pool.enqueue(&task);
+        // reads the output as a renderer does while the worker updates the scene
+        while (lastTick < kNTicks - 1) {
+            if (!buffered.scene.acquireOutput())
+                continue;
+            float matrix[16];
+            size_t nModels = 0;
+            buffered.scene.getModelViewMatrix(matrix);
+            const int tick = static_cast<int>(-matrix[14] - 100.0f + 0.5f);
+            ASSERT_LE(0, tick);
+            ASSERT_GT(kNTicks, tick);
+            EXPECT_LT(lastTick, tick);
+            vpvl::PMDModel **models = buffered.scene.getRenderingOrder(nModels);
+            ASSERT_EQ(size_t(kNModels), nModels);
+            for (int j = 0; j < kNModels; j++) {
+                const vpvl::PMDModel *model = &buffered.models[j];
+                EXPECT_TRUE(models[0] == model || models[1] == model || models[2] == model
+                            || models[3] == model || models[4] == model || models[5] == model);
+                EXPECT_EQ(expected[tick][j], VertexPosition(*model));
+                EXPECT_EQ(expected[tick][j], EdgeVertexPosition(*model));
+                EXPECT_EQ(expectedBones[tick][j], model->boneTransform(2).getOrigin());
+            }
+            lastTick = tick;
+            nAcquired++;
+        }
+    }
+    EXPECT_LT(0, nAcquired);
+    // the models keep the latest output after disabling
+    buffered.scene.setEnableBufferedOutput(false);
+    EXPECT_FALSE(buffered.scene.enableBufferedOutput());
+    for (int j = 0; j < kNModels; j++)
+        EXPECT_EQ(expected[kNTicks - 1][j], VertexPosition(buffered.models[j]));
+}
+
+TEST(SceneTest, CullModelsOutsideFrustum) {
+    static const int kNCullingModels = 4;
+    const char *boneNames[] = { "root" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    vpvl::Scene scene(640, 480, 30);
+    vpvl::PMDModel models[kNCullingModels];
+    vpvl::VMDMotion motions[kNCullingModels];
+    for (int i = 0; i < kNCullingModels; i++) {
+        // puts the models far away from each other along X axis
+        const btVector3 position(i * 1000.0f, 0.0f, 0.0f);
+        ASSERT_TRUE(models[i].load(&modelBytes[0], modelBytes.size()));
+        ASSERT_TRUE(test::MotionBuilder().bone("root", 0, position).bone("root", 30, position).face("face", 0, 1.0f)
+                    .attach(motions[i], models[i]));
+        scene.addModel(&models[i]);
+    }
+    size_t nModels = 0;
+    scene.setViewMove(0);
+    scene.setCameraPerspective(btVector3(0.0f, 0.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 16.0f, 100.0f);
+    scene.updateModelView(0);
+    scene.setEnableFrustumCulling(true);
+    EXPECT_TRUE(scene.enableFrustumCulling());
+    scene.update(0.5f);
+    EXPECT_EQ(1, scene.countVisibleModels());
+    EXPECT_EQ(kNCullingModels - 1, scene.countCulledModels());
+    vpvl::PMDModel **visibleModels = scene.getVisibleRenderingOrder(nModels);
+    ASSERT_EQ(size_t(1), nModels);
+    EXPECT_EQ(&models[0], visibleModels[0]);
+    EXPECT_EQ(btVector3(1.0f, 1.0f, 1.0f), VertexPosition(models[0]));
+    // the bounding box contains the morphed vertex
+    btVector3 min, max;
+    models[0].getBoundingBox(min, max);
+    EXPECT_GE(1.0f, min.x());
+    EXPECT_LE(1.0f, max.x());
+    EXPECT_GE(1.0f, min.y());
+    EXPECT_LE(1.0f, max.y());
+    EXPECT_LE(1.0f, max.z());
+    // the bones of the culled models keep updating
+    EXPECT_EQ(2000.0f, models[2].bones()[0]->localTransform().getOrigin().x());
+
+    // the deferred skinning is done when the model comes into view
+    scene.setCameraPerspective(btVector3(2000.0f, 0.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 16.0f, 100.0f);
+    scene.updateModelView(0);
+    scene.update(0.5f);
+    EXPECT_EQ(1, scene.countVisibleModels());
+    visibleModels = scene.getVisibleRenderingOrder(nModels);
+    ASSERT_EQ(size_t(1), nModels);
+    EXPECT_EQ(&models[2], visibleModels[0]);
+    EXPECT_NEAR(0.0f, btVector3(2001.0f, 1.0f, 1.0f).distance(VertexPosition(models[2])), 0.001f);
+
+    // all models are drawn without culling
+    scene.setEnableFrustumCulling(false);
+    scene.seek(0.0f);
+    EXPECT_EQ(kNCullingModels, scene.countVisibleModels());
+    EXPECT_EQ(0, scene.countCulledModels());
+    scene.getVisibleRenderingOrder(nModels);
+    EXPECT_EQ(size_t(kNCullingModels), nModels);
+    EXPECT_NEAR(0.0f, btVector3(3001.0f, 1.0f, 1.0f).distance(VertexPosition(models[3])), 0.001f);
+}
+
+TEST(SceneTest, KeepRenderingOrderByDepth) {
+    static const int kNOrderedModels = 5;
+    static const float kDepths[kNOrderedModels] = { 10.0f, -30.0f, 0.0f, 30.0f, -10.0f };
+    const char *boneNames[] = { "root" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    vpvl::Scene scene(640, 480, 30);
+    vpvl::PMDModel models[kNOrderedModels];
+    vpvl::VMDMotion motions[kNOrderedModels];
+    for (int i = 0; i < kNOrderedModels; i++) {
+        const btVector3 position(0.0f, 0.0f, kDepths[i]);
+        ASSERT_TRUE(models[i].load(&modelBytes[0], modelBytes.size()));
+        ASSERT_TRUE(test::MotionBuilder().bone("root", 0, position).bone("root", 30, position).attach(motions[i], models[i]));
+        scene.addModel(&models[i]);
+    }
+    scene.setViewMove(0);
+    size_t nModels = 0;
+    // the models are ordered from the back to the front
+    scene.update(0.5f);
+    scene.update(0.5f);
+    vpvl::PMDModel **order = scene.getRenderingOrder(nModels);
+    ASSERT_EQ(size_t(kNOrderedModels), nModels);
+    const vpvl::PMDModel *expected[] = { &models[1], &models[4], &models[2], &models[0], &models[3] };
+    for (int i = 0; i < kNOrderedModels; i++)
+        EXPECT_EQ(expected[i], order[i]);
+    // turning the camera around reverses the order
+    scene.setCameraPerspective(btVector3(0.0f, 10.0f, 0.0f), btVector3(0.0f, 180.0f, 0.0f), 16.0f, 100.0f);
+    scene.updateModelView(0);
+    scene.update(0.5f);
+    order = scene.getRenderingOrder(nModels);
+    for (int i = 0; i < kNOrderedModels; i++)
+        EXPECT_EQ(expected[kNOrderedModels - i - 1], order[i]);
+    // removing and adding keep the order
+    scene.removeModel(&models[2]);
+    order = scene.getRenderingOrder(nModels);
+    ASSERT_EQ(size_t(kNOrderedModels - 1), nModels);
+    EXPECT_EQ(&models[3], order[0]);
+    EXPECT_EQ(&models[0], order[1]);
+    EXPECT_EQ(&models[4], order[2]);
+    EXPECT_EQ(&models[1], order[3]);
+    scene.addModel(&models[2]);
+    order = scene.getRenderingOrder(nModels);
+    ASSERT_EQ(size_t(kNOrderedModels), nModels);
+    for (int i = 0; i < kNOrderedModels; i++)
+        EXPECT_EQ(expected[kNOrderedModels - i - 1], order[i]);
+}
@@ -0,0 +1,252 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/* reads the path itself as the content, the paths after '#' have the same content */
+class Decoder : public vpvl::ITextureDecoder {
+public:
+    Decoder(int sleepMilliseconds = 0)
+        : nReads(0),
+          nDecodes(0),
+          nRunning(0),
+          maxRunning(0),
+          m_sleepMilliseconds(sleepMilliseconds)
+    {
+#ifdef WIN32
+        InitializeCriticalSection(&m_mutex);
+#else
+        pthread_mutex_init(&m_mutex, 0);
+#endif
+    }
+    ~Decoder() {
+#ifdef WIN32
+        DeleteCriticalSection(&m_mutex);
+#else
+        pthread_mutex_destroy(&m_mutex);
+#endif
+    }
+
+    bool read(const char *path, vpvl::TextureCache::TextureType type, btAlignedObjectArray<uint8_t> &bytes) {
+        (void) type;
+        lock();
+        nReads++;
+        unlock();
+        if (strncmp(path, "missing", 7) == 0)
+            return false;
+        const char *content = strchr(path, '#');
+        content = content ? content + 1 : path;
+        const size_t size = strlen(content);
+        bytes.resize(size);
+        memcpy(&bytes[0], content, size);
+        return true;
+    }
+    bool decode(const btAlignedObjectArray<uint8_t> &bytes, vpvl::TextureImage &image) {
+        lock();
+        nDecodes++;
+        nRunning++;
+        if (maxRunning < nRunning)
+            maxRunning = nRunning;
+        unlock();
+        sleep();
+        image.width = bytes.size();
+        image.height = 1;
+        image.pixels.resize(image.width * 4);
+        for (int i = 0; i < image.pixels.size(); i++)
+            image.pixels[i] = bytes[i / 4];
+        lock();
+        nRunning--;
+        unlock();
+        return true;
+    }
+
+    int nReads;
+    int nDecodes;
+    int nRunning;
+    int maxRunning;
+
+private:
+    void lock() {
+#ifdef WIN32
+        EnterCriticalSection(&m_mutex);
+#else
+        pthread_mutex_lock(&m_mutex);
+#endif
+    }
+    void unlock() {
+#ifdef WIN32
+        LeaveCriticalSection(&m_mutex);
+#else
+        pthread_mutex_unlock(&m_mutex);
+#endif
+    }
+    void sleep() {
+        if (m_sleepMilliseconds <= 0)
+            return;
+#ifdef WIN32
+        Sleep(m_sleepMilliseconds);
+#else
+        usleep(m_sleepMilliseconds * 1000);
+#endif
+    }
+
+#ifdef WIN32
+    CRITICAL_SECTION m_mutex;
+#else
+    pthread_mutex_t m_mutex;
+#endif
+    int m_sleepMilliseconds;
+};
+
+/* gives the textures the serial numbers from 1 and records the types */
+class Uploader : public vpvl::ITextureUploader {
+public:
+    Uploader() : nUploads(0), nToonTextures(0) {}
+
+    uint32_t upload(const vpvl::TextureImage &image, vpvl::TextureCache::TextureType type) {
+        (void) image;
+        if (type == vpvl::TextureCache::kToonTexture)
+            nToonTextures++;
+        return ++nUploads;
+    }
+
+    int nUploads;
+    int nToonTextures;
+};
+
+void WaitForDecoding(vpvl::TextureCache &cache, Uploader &uploader)
+{
+    while (cache.countPendingTextures() > 0)
+        cache.upload(&uploader, ~static_cast<size_t>(0));
+}
+
+}
+
+TEST(TextureCacheTest, SharePaths) {
+    Decoder decoder;
+    Uploader uploader;
+    vpvl::TextureCache cache(&decoder);
+    int a = cache.request("a.bmp", vpvl::TextureCache::kTexture);
+    int b = cache.request("b.bmp", vpvl::TextureCache::kTexture);
+    EXPECT_EQ(a, cache.request("a.bmp", vpvl::TextureCache::kTexture));
+    EXPECT_NE(a, b);
+    EXPECT_EQ(0u, cache.textureID(a));
+    EXPECT_EQ(2, cache.upload(&uploader, ~static_cast<size_t>(0)));
+    EXPECT_EQ(2, decoder.nReads);
+    EXPECT_EQ(2, decoder.nDecodes);
+    EXPECT_EQ(0, cache.countPendingTextures());
+    EXPECT_NE(0u, cache.textureID(a));
+    EXPECT_NE(cache.textureID(a), cache.textureID(b));
+    // a hit of the uploaded texture does not read the file again
+    EXPECT_EQ(a, cache.request("a.bmp", vpvl::TextureCache::kTexture));
+    EXPECT_EQ(2, decoder.nReads);
+    // the texture is deleted when the last handle of the texture is released
+    uint32_t textureID = cache.textureID(a);
+    EXPECT_EQ(0u, cache.release(a));
+    EXPECT_EQ(0u, cache.release(a));
+    EXPECT_EQ(textureID, cache.release(a));
+    EXPECT_EQ(0u, cache.textureID(a));
+    EXPECT_NE(0u, cache.textureID(b));
+    // the released path is read again
+    int c = cache.request("a.bmp", vpvl::TextureCache::kTexture);
+    EXPECT_NE(a, c);
+    WaitForDecoding(cache, uploader);
+    EXPECT_EQ(3, decoder.nReads);
+    EXPECT_NE(0u, cache.textureID(c));
+    EXPECT_NE(0u, cache.release(b));
+    EXPECT_NE(0u, cache.release(c));
+}
+
+TEST(TextureCacheTest, ShareContents) {
+    Decoder decoder;
+    Uploader uploader;
+    vpvl::TextureCache cache(&decoder);
+    int a = cache.request("model1/toon01.bmp#toon", vpvl::TextureCache::kToonTexture);
+    int b = cache.request("model2/toon01.bmp#toon", vpvl::TextureCache::kToonTexture);
+    int c = cache.request("model2/texture.bmp#toon", vpvl::TextureCache::kTexture);
+    int d = cache.request("missing.bmp", vpvl::TextureCache::kTexture);
+    WaitForDecoding(cache, uploader);
+    // the same content of the different paths is decoded once but not shared with another type
+    EXPECT_EQ(4, decoder.nReads);
+    EXPECT_EQ(2, decoder.nDecodes);
+    EXPECT_EQ(2, cache.countDecodedTextures());
+    EXPECT_EQ(2, uploader.nUploads);
+    EXPECT_EQ(1, uploader.nToonTextures);
+    EXPECT_NE(0u, cache.textureID(a));
+    EXPECT_EQ(cache.textureID(a), cache.textureID(b));
+    EXPECT_NE(cache.textureID(a), cache.textureID(c));
+    EXPECT_EQ(0u, cache.textureID(d));
+    // the shared texture is deleted after releasing the both paths
+    uint32_t textureID = cache.textureID(a);
+    EXPECT_EQ(0u, cache.release(a));
+    EXPECT_EQ(textureID, cache.textureID(b));
+    EXPECT_EQ(textureID, cache.release(b));
+    EXPECT_NE(0u, cache.release(c));
+    EXPECT_EQ(0u, cache.release(d));
+}
+
+TEST(TextureCacheTest, UploadWithinBudget) {
+    Decoder decoder;
+    Uploader uploader;
+    vpvl::TextureCache cache(&decoder);
+    int handles[4];
+    handles[0] = cache.request("abcd", vpvl::TextureCache::kTexture);
+    handles[1] = cache.request("efgh", vpvl::TextureCache::kTexture);
+    handles[2] = cache.request("ijkl", vpvl::TextureCache::kTexture);
+    handles[3] = cache.request("mnop", vpvl::TextureCache::kTexture);
+    // each texture has 4x1 pixels of 16 bytes and at least one texture is uploaded in a call
+    EXPECT_EQ(1, cache.upload(&uploader, 0));
+    EXPECT_EQ(2, cache.upload(&uploader, 32));
+    EXPECT_EQ(1, cache.countPendingTextures());
+    EXPECT_EQ(0u, cache.textureID(handles[3]));
+    EXPECT_EQ(1, cache.upload(&uploader, 32));
+    EXPECT_EQ(0, cache.upload(&uploader, 32));
+    EXPECT_EQ(4, uploader.nUploads);
+    for (int i = 0; i < 4; i++)
+        EXPECT_NE(0u, cache.textureID(handles[i]));
+    // the texture released before uploading is not uploaded
+    int e = cache.request("qrst", vpvl::TextureCache::kTexture);
+    EXPECT_EQ(0u, cache.release(e));
+    EXPECT_EQ(0, cache.upload(&uploader, 32));
+    EXPECT_EQ(4, uploader.nUploads);
+    for (int i = 0; i < 4; i++)
+        EXPECT_NE(0u, cache.release(handles[i]));
+}
+
+TEST(TextureCacheTest, DecodeConcurrently) {
+    static const int kNTextures = 16;
+    vpvl::ThreadPool pool(4);
+    Decoder decoder(20);
+    Uploader uploader;
+    vpvl::TextureCache cache(&decoder);
+    cache.setThreadPool(&pool);
+    int handles[kNTextures];
+    char path[16];
+    for (int i = 0; i < kNTextures; i++) {
+        // the half of the textures have the same content as the other half
+        snprintf(path, sizeof(path), "%d.bmp#%d", i, i % (kNTextures / 2));
+        handles[i] = cache.request(path, vpvl::TextureCache::kTexture);
+    }
+    // the textures are decoded in the workers without blocking the requests
+    EXPECT_GT(cache.countPendingTextures(), 0);
+    WaitForDecoding(cache, uploader);
+    if (pool.countThreads() > 1)
+        EXPECT_GT(decoder.maxRunning, 1);
+    EXPECT_EQ(kNTextures, decoder.nReads);
+    EXPECT_EQ(kNTextures / 2, decoder.nDecodes);
+    EXPECT_EQ(kNTextures / 2, uploader.nUploads);
+    for (int i = 0; i < kNTextures; i++) {
+        EXPECT_NE(0u, cache.textureID(handles[i]));
+        EXPECT_EQ(cache.textureID(handles[i]), cache.textureID(handles[i % (kNTextures / 2)]));
+    }
+    for (int i = 0; i < kNTextures; i++)
+        cache.release(handles[i]);
+}
@@ -0,0 +1,121 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+namespace {
+
+class CountTask : public vpvl::IThreadPoolTask {
+public:
+    CountTask() : count(0) {}
+    void run() { count++; }
+    int count;
+};
+
+/* runs the child tasks on the same pool from a task */
+class NestedTask : public vpvl::IThreadPoolTask {
+public:
+    NestedTask() : pool(0) {}
+    void run() {
+        vpvl::IThreadPoolTask *ptrs[kNChildren];
+        for (int i = 0; i < kNChildren; i++)
+            ptrs[i] = &children[i];
+        pool->run(ptrs, kNChildren);
+    }
+    static const int kNChildren = 8;
+    vpvl::ThreadPool *pool;
+    CountTask children[kNChildren];
+};
+
+}
+
+TEST(ThreadPoolTest, RunTasks) {
+    static const int kNTasks = 64;
+    for (int nThreads = 0; nThreads < 4; nThreads++) {
+        vpvl::ThreadPool pool(nThreads);
+        EXPECT_EQ(nThreads, pool.countThreads());
+        CountTask tasks[kNTasks];
+        vpvl::IThreadPoolTask *ptrs[kNTasks];
+        for (int i = 0; i < kNTasks; i++)
+            ptrs[i] = &tasks[i];
+        pool.run(ptrs, kNTasks);
+        pool.run(ptrs, kNTasks);
+        for (int i = 0; i < kNTasks; i++)
+            EXPECT_EQ(2, tasks[i].count);
+    }
+}
+
+TEST(ThreadPoolTest, RunNestedTasks) {
+    static const int kNTasks = 16;
+    vpvl::ThreadPool pool(2);
+    NestedTask tasks[kNTasks];
+    vpvl::IThreadPoolTask *ptrs[kNTasks];
+    for (int i = 0; i < kNTasks; i++) {
+        tasks[i].pool = &pool;
+        ptrs[i] = &tasks[i];
+    }
+    pool.run(ptrs, kNTasks);
+    for (int i = 0; i < kNTasks; i++) {
+        for (int j = 0; j < NestedTask::kNChildren; j++)
+            EXPECT_EQ(1, tasks[i].children[j].count);
+    }
+}
+
+TEST(ThreadPoolTest, FinishQueuedTasksOnDestruction) {
+    static const int kNTasks = 32;
+    CountTask tasks[kNTasks];
+    {
+        vpvl::ThreadPool pool(3);
+        for (int i = 0; i < kNTasks; i++)
+            pool.enqueue(&tasks[i]);
+    }
+    for (int i = 0; i < kNTasks; i++)
+        EXPECT_EQ(1, tasks[i].count);
+}
+
+TEST(ThreadPoolTest, LoadMotionConcurrently) {
+    static const int kNKeyFrames = 10000;
+    const btQuaternion identity(0.0f, 0.0f, 0.0f, 1.0f);
+    const char *boneNames[] = { "bone0", "bone2" };
+    std::vector<uint8_t> modelBytes, motionBytes;
+    test::BuildModel(modelBytes, boneNames, 2, 0, 0);
+    test::AppendMotionHeader(motionBytes);
+    test::Append(motionBytes, uint32_t(kNKeyFrames));
+    for (int i = 0; i < kNKeyFrames; i++) {
+        const char *name = i % 3 == 0 ? "bone0" : i % 3 == 1 ? "bone1" : "bone2";
+        test::AppendBoneKeyFrame(motionBytes, name, i / 3, btVector3(i, 0.0f, 0.0f), identity);
+    }
+    test::Append(motionBytes, uint32_t(2));
+    test::AppendFaceKeyFrame(motionBytes, "face", 0, 0.0f);
+    test::AppendFaceKeyFrame(motionBytes, "face", 10, 1.0f);
+    test::Append(motionBytes, uint32_t(2));
+    test::AppendCameraKeyFrame(motionBytes, 10, 10.0f, btVector3(0.0f, 10.0f, 0.0f));
+    test::AppendCameraKeyFrame(motionBytes, 0, 0.0f, btVector3(0.0f, 0.0f, 0.0f));
+    test::Append(motionBytes, uint32_t(0));
+    test::Append(motionBytes, uint32_t(0));
+    vpvl::PMDModel model;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    vpvl::ThreadPool pool(3);
+    for (int filter = 0; filter < 2; filter++) {
+        const vpvl::PMDModel *m = filter ? &model : 0;
+        vpvl::VMDMotion serial, parallel;
+        parallel.setThreadPool(&pool);
+        ASSERT_TRUE(serial.load(&motionBytes[0], motionBytes.size(), m));
+        ASSERT_TRUE(parallel.load(&motionBytes[0], motionBytes.size(), m));
+        EXPECT_EQ(serial.bone().countSkippedKeyFrames(), parallel.bone().countSkippedKeyFrames());
+        const vpvl::BoneKeyFrameList &serialFrames = serial.bone().frames();
+        const vpvl::BoneKeyFrameList &parallelFrames = parallel.bone().frames();
+        ASSERT_EQ(serialFrames.size(), parallelFrames.size());
+        for (int i = 0; i < serialFrames.size(); i++) {
+            EXPECT_STREQ(reinterpret_cast<const char *>(serialFrames[i]->name()),
+                         reinterpret_cast<const char *>(parallelFrames[i]->name()));
+            EXPECT_EQ(serialFrames[i]->frameIndex(), parallelFrames[i]->frameIndex());
+            EXPECT_EQ(serialFrames[i]->position(), parallelFrames[i]->position());
+        }
+        EXPECT_EQ(serial.face().frames().size(), parallel.face().frames().size());
+        EXPECT_EQ(10.0f, parallel.camera().maxIndex());
+        std::vector<uint8_t> serialBytes(serial.estimateSize()), parallelBytes(parallel.estimateSize());
+        serial.save(&serialBytes[0]);
+        parallel.save(&parallelBytes[0]);
+        EXPECT_TRUE(serialBytes == parallelBytes);
+    }
+}
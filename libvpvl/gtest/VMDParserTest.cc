@@ -1,5 +1,6 @@
 #include "gtest/gtest.h"
 #include "vpvl/vpvl.h"
+#include "Common.h"
 
 static void FileSlurp(const char *path, uint8_t *&data, size_t &size) {
     FILE *fp = fopen(path, "rb");
@@ -85,3 +86,69 @@ TEST(VMDMotionTest, ParseCameraVMD) {
     EXPECT_EQ(vpvl::VMDMotion::kNoError, motion.error());
     delete[] data;
 }
+
+TEST(VMDMotionTest, ParseMotionFilteredByModel) {
+    const char *boneNames[] = { "bone" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes, motionBytes;
+    test::BuildModel(modelBytes, boneNames, 1, faceNames, 1);
+    vpvl::PMDModel model;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    test::MotionBuilder()
+            .bone("bone", 0, btVector3(0.0f, 0.0f, 0.0f))
+            .bone("missing", 0, btVector3(0.0f, 0.0f, 0.0f))
+            .bone("bone", 10, btVector3(1.0f, 0.0f, 0.0f))
+            .face("missing", 0, 1.0f)
+            .face("face", 0, 1.0f)
+            .build(motionBytes);
+    vpvl::VMDMotion motion;
+    EXPECT_TRUE(motion.load(&motionBytes[0], motionBytes.size(), &model));
+    EXPECT_EQ(2, motion.bone().frames().size());
+    EXPECT_EQ(1U, motion.bone().countSkippedKeyFrames());
+    EXPECT_EQ(1, motion.face().frames().size());
+    EXPECT_EQ(1U, motion.face().countSkippedKeyFrames());
+    EXPECT_EQ(10.0f, motion.bone().frames()[1]->frameIndex());
+    EXPECT_EQ(vpvl::VMDMotion::kNoError, motion.error());
+}
+
+class VectorSink : public vpvl::IVMDMotionSink
+{
+public:
+    VectorSink() : maxChunkSize(0), nChunks(0) {}
+    bool write(const uint8_t *data, size_t size) {
+        bytes.insert(bytes.end(), data, data + size);
+        if (size > maxChunkSize)
+            maxChunkSize = size;
+        nChunks++;
+        return true;
+    }
+    std::vector<uint8_t> bytes;
+    size_t maxChunkSize;
+    int nChunks;
+};
+
+TEST(VMDMotionTest, SaveMotionToSink) {
+    const btQuaternion rotation(btVector3(0.0f, 1.0f, 0.0f), 0.5f);
+    std::vector<uint8_t> motionBytes;
+    test::AppendMotionHeader(motionBytes);
+    test::Append(motionBytes, uint32_t(1000));
+    for (int i = 0; i < 1000; i++)
+        test::AppendBoneKeyFrame(motionBytes, i % 2 ? "left" : "right", i, btVector3(i, -i, i * 0.5f), rotation);
+    test::Append(motionBytes, uint32_t(100));
+    for (int i = 0; i < 100; i++)
+        test::AppendFaceKeyFrame(motionBytes, "face", i, i / 100.0f);
+    test::Append(motionBytes, uint32_t(10));
+    for (int i = 0; i < 10; i++)
+        test::AppendCameraKeyFrame(motionBytes, i * 10, -50.0f + i, btVector3(0.0f, 10.0f, i));
+    test::Append(motionBytes, uint32_t(0));
+    test::Append(motionBytes, uint32_t(0));
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(motion.load(&motionBytes[0], motionBytes.size()));
+    std::vector<uint8_t> expected(motion.estimateSize());
+    motion.save(&expected[0]);
+    EXPECT_TRUE(expected == motionBytes);
+    VectorSink sink;
+    EXPECT_TRUE(motion.save(&sink));
+    EXPECT_TRUE(expected == sink.bytes);
+    EXPECT_GT(sink.nChunks, 1);
+    EXPECT_LT(sink.maxChunkSize, expected.size());
+}
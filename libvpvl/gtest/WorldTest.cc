@@ -0,0 +1,281 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+namespace {
+
+static const int kNLinks = 8;
+
+/* a model swinging the chain of the rigid bodies */
+class ChainModel {
+public:
+    ChainModel() {
+        const char *boneNames[] = { "root", "hair" }, *faceNames[] = { "face" };
+        test::BuildModel(modelBytes, boneNames, 2, faceNames, 1);
+        test::AppendRigidBodyChain(modelBytes, kNLinks, 1);
+        model.load(&modelBytes[0], modelBytes.size());
+        test::MotionBuilder()
+                .bone("root", 0, btVector3(0.0f, 0.0f, 0.0f))
+                .bone("root", 15, btVector3(5.0f, 0.0f, 0.0f))
+                .bone("root", 30, btVector3(0.0f, 0.0f, 0.0f))
+                .attach(motion, model);
+        // the motion is blended out after the last key frame instead of being deleted at once
+        motion.setEnableSmooth(true);
+    }
+    const btVector3 &linkPosition(int index) const {
+        return model.rigidBodies()[index]->body()->getCenterOfMassTransform().getOrigin();
+    }
+    std::vector<uint8_t> modelBytes;
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+};
+
+/* a scene of the chain model simulated in the world */
+class ChainScene {
+public:
+    ChainScene(vpvl::World *world) : scene(640, 480, 30) {
+        scene.setWorld(world->mutableWorld());
+        scene.addModel(&chain.model);
+    }
+    ChainModel chain;
+    vpvl::Scene scene;
+};
+
+}
+
+TEST(WorldTest, CreateSequentialWorld) {
+    vpvl::World world(30, 1);
+    EXPECT_EQ(1, world.countThreads());
+    ASSERT_TRUE(world.mutableWorld());
+    EXPECT_EQ(20, world.mutableWorld()->getSolverInfo().m_numIterations);
+}
+
+#ifdef VPVL_ENABLE_MULTITHREADED_PHYSICS
+TEST(WorldTest, SimulateJointsStably) {
+    vpvl::World sequential(30, 1), parallel(30, 4);
+    // the world falls back to the sequential solver without the multithreaded dispatcher
+    ASSERT_GT(parallel.countThreads(), 1);
+    ChainScene expected(&sequential), actual(&parallel);
+    ASSERT_EQ(kNLinks, actual.chain.model.rigidBodies().size());
+    ASSERT_EQ(kNLinks - 1, actual.chain.model.constraints().size());
+    for (int i = 0; i < 90; i++) {
+        expected.scene.update(1.0f);
+        actual.scene.update(1.0f);
+        for (int j = 1; j < kNLinks; j++) {
+            // the links keep hanging within the length of the chain
+            const btVector3 &position = actual.chain.linkPosition(j);
+            ASSERT_GT(BT_LARGE_FLOAT, position.length2());
+            EXPECT_GT(kNLinks + 1.0f, position.distance(actual.chain.linkPosition(0)));
+        }
+    }
+    // the solvers may solve in the different order but settle in the same pose
+    for (int i = 1; i < kNLinks; i++)
+        EXPECT_GT(0.2f, actual.chain.linkPosition(i).distance(expected.chain.linkPosition(i)));
+}
+#endif
+
+TEST(WorldTest, StepIslandWorldsConcurrently) {
+    static const int kNIslands = 3;
+    vpvl::World *worlds[kNIslands], *islands[kNIslands];
+    ChainScene *expected[kNIslands];
+    ChainModel actual[kNIslands];
+    vpvl::World shared(30, 1);
+    vpvl::ThreadPool pool(2);
+    vpvl::Scene scene(640, 480, 30);
+    scene.setThreadPool(&pool);
+    scene.setWorld(shared.mutableWorld());
+    for (int i = 0; i < kNIslands; i++) {
+        worlds[i] = new vpvl::World(30, 1);
+        islands[i] = new vpvl::World(30, 1);
+        expected[i] = new ChainScene(worlds[i]);
+        scene.addModel(&actual[i].model);
+        EXPECT_EQ(shared.mutableWorld(), actual[i].model.world());
+        scene.setIslandWorld(&actual[i].model, islands[i]->mutableWorld());
+        EXPECT_EQ(islands[i]->mutableWorld(), actual[i].model.world());
+    }
+    EXPECT_EQ(kNIslands, scene.countIslandWorlds());
+    // each island is simulated as the model is alone in its own world
+    for (int i = 0; i < 60; i++) {
+        scene.update(1.0f);
+        for (int j = 0; j < kNIslands; j++) {
+            expected[j]->scene.update(1.0f);
+            for (int k = 0; k < kNLinks; k++)
+                EXPECT_EQ(expected[j]->chain.linkPosition(k), actual[j].linkPosition(k));
+        }
+    }
+#ifdef VPVL_ENABLE_CONCURRENT_ISLAND_WORLDS
+    // the islands and the shared world are stepped on the pool
+    EXPECT_EQ(kNIslands + 1, scene.countConcurrentWorlds());
+#else
+    EXPECT_EQ(0, scene.countConcurrentWorlds());
+#endif
+    // the models in the same island collide each other
+    scene.setIslandWorld(&actual[1].model, islands[0]->mutableWorld());
+    EXPECT_EQ(kNIslands - 1, scene.countIslandWorlds());
+    scene.setIslandWorld(&actual[2].model, 0);
+    EXPECT_EQ(shared.mutableWorld(), actual[2].model.world());
+    EXPECT_EQ(1, scene.countIslandWorlds());
+    scene.removeModel(&actual[0].model);
+    EXPECT_FALSE(actual[0].model.world());
+    EXPECT_EQ(1, scene.countIslandWorlds());
+    scene.removeModel(&actual[1].model);
+    EXPECT_EQ(0, scene.countIslandWorlds());
+    for (int i = 0; i < kNIslands; i++) {
+        delete expected[i];
+        delete islands[i];
+        delete worlds[i];
+    }
+}
+
+TEST(WorldTest, ResumeSimulationFromCheckpoint) {
+    vpvl::World world(30, 1);
+    ChainScene chain(&world);
+    chain.scene.setCheckpointInterval(10.0f);
+    EXPECT_EQ(10.0f, chain.scene.checkpointInterval());
+    btVector3 expected[kNLinks];
+    for (int i = 1; i <= 60; i++) {
+        chain.scene.update(1.0f);
+        if (i == 35) {
+            for (int j = 0; j < kNLinks; j++)
+                expected[j] = chain.chain.linkPosition(j);
+        }
+    }
+    EXPECT_EQ(60.0f, chain.scene.currentFrame());
+    // recorded at the frames 1, 11, 21, 31, 41 and 51
+    EXPECT_EQ(6, chain.scene.countCheckpoints());
+    // the frame 31 is restored and the rest of 4 frames are simulated
+    chain.scene.seek(35.0f);
+    EXPECT_EQ(35.0f, chain.scene.currentFrame());
+    EXPECT_EQ(6, chain.scene.countCheckpoints());
+    for (int i = 0; i < kNLinks; i++)
+        EXPECT_GT(0.05f, chain.chain.linkPosition(i).distance(expected[i]));
+    // simulating beyond the last checkpoint records the new checkpoints
+    chain.scene.seek(75.0f);
+    EXPECT_EQ(8, chain.scene.countCheckpoints());
+    chain.scene.setCheckpointInterval(0.0f);
+    EXPECT_EQ(0, chain.scene.countCheckpoints());
+}
+
+TEST(WorldTest, RemoveCheckpointsAfterEditedFrame) {
+    const uint8_t *name = reinterpret_cast<const uint8_t *>("root");
+    vpvl::World world(30, 1), editedWorld(30, 1);
+    ChainScene chain(&world), edited(&editedWorld);
+    // the motions are not blended with the pose before seeking
+    chain.chain.motion.setEnableSmooth(false);
+    edited.chain.motion.setEnableSmooth(false);
+    // simulated with the edited motion from the frame 11 as the seek below should do
+    edited.chain.motion.mutableBone()->mutableKeyFrame(name, 30)->setPosition(btVector3(0.0f, 0.0f, 5.0f));
+    edited.scene.setCheckpointInterval(10.0f);
+    for (int i = 0; i < 11; i++)
+        edited.scene.update(1.0f);
+    edited.scene.seek(35.0f);
+    chain.scene.setCheckpointInterval(10.0f);
+    for (int i = 0; i < 60; i++)
+        chain.scene.update(1.0f);
+    EXPECT_EQ(6, chain.scene.countCheckpoints());
+    // the curve from the frame 15 is changed so the frames 1 and 11 are kept
+    chain.chain.motion.mutableBone()->mutableKeyFrame(name, 30)->setPosition(btVector3(0.0f, 0.0f, 5.0f));
+    chain.scene.seek(35.0f);
+    // the frames 21 and 31 are recorded again while simulating to the frame
+    EXPECT_EQ(4, chain.scene.countCheckpoints());
+    for (int i = 0; i < kNLinks; i++)
+        EXPECT_EQ(edited.chain.linkPosition(i), chain.chain.linkPosition(i));
+    // the motion changes all frames
+    chain.chain.model.removeMotion(&chain.chain.motion);
+    chain.scene.update(1.0f);
+    EXPECT_EQ(0, chain.scene.countCheckpoints());
+    // the simulation is not recorded until seeking as it is done with the previous motion
+    for (int i = 0; i < 20; i++)
+        chain.scene.update(1.0f);
+    EXPECT_EQ(0, chain.scene.countCheckpoints());
+}
+
+TEST(WorldTest, LimitCheckpoints) {
+    vpvl::World world(30, 1);
+    ChainScene chain(&world);
+    EXPECT_EQ(static_cast<int>(vpvl::Scene::kDefaultMaxCheckpoints), chain.scene.maxCheckpoints());
+    chain.scene.setCheckpointInterval(1.0f);
+    chain.scene.setMaxCheckpoints(8);
+    for (int i = 0; i < 60; i++)
+        chain.scene.update(1.0f);
+    EXPECT_EQ(8, chain.scene.countCheckpoints());
+    // the checkpoints are spread over the frames instead of keeping the latest ones
+    chain.scene.seek(2.0f);
+    EXPECT_EQ(8, chain.scene.countCheckpoints());
+    chain.scene.setMaxCheckpoints(4);
+    EXPECT_EQ(4, chain.scene.countCheckpoints());
+}
+
+TEST(WorldTest, SleepUntilKinematicBodyMoves) {
+    vpvl::World world(30, 1);
+    ChainScene chain(&world);
+    vpvl::PMDModel &model = chain.chain.model;
+    const vpvl::RigidBodyList &rigidBodies = model.rigidBodies();
+    // all bodies are kept active by default
+    for (int i = 0; i < 120; i++)
+        chain.scene.update(1.0f);
+    EXPECT_EQ(kNLinks - 1, chain.scene.countActiveRigidBodies());
+    EXPECT_EQ(0, chain.scene.countSleepingRigidBodies());
+    model.setEnableDeactivation(true);
+    EXPECT_TRUE(model.enableDeactivation());
+    // the settled bodies are deactivated by the world and keep sleeping after the motion ends
+    for (int i = 0; i < 600 && chain.scene.countSleepingRigidBodies() < kNLinks - 1; i++)
+        chain.scene.update(1.0f);
+    ASSERT_EQ(0, chain.scene.countActiveRigidBodies());
+    ASSERT_EQ(kNLinks - 1, chain.scene.countSleepingRigidBodies());
+    chain.scene.update(1.0f);
+    EXPECT_EQ(kNLinks - 1, chain.scene.countSleepingRigidBodies());
+    // moving the kinematic body by the bone wakes up the jointed bodies
+    chain.scene.seek(10.0f);
+    EXPECT_EQ(kNLinks - 1, model.countActiveRigidBodies());
+    EXPECT_EQ(0, model.countSleepingRigidBodies());
+    // the bodies never sleep if disabled
+    model.setEnableDeactivation(false);
+    for (int i = 0; i < 600; i++)
+        chain.scene.update(1.0f);
+    EXPECT_EQ(0, model.countSleepingRigidBodies());
+    for (int i = 1; i < kNLinks; i++)
+        EXPECT_TRUE(rigidBodies[i]->body()->isActive());
+}
+
+TEST(WorldTest, WakeAlignedBodiesByBone) {
+    const char *boneNames[] = { "root", "hair" }, *faceNames[] = { "face" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildModel(modelBytes, boneNames, 2, faceNames, 1);
+    // no body follows the bone as a kinematic body
+    test::AppendRigidBodyChain(modelBytes, 2, 1, 2, 2);
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    ASSERT_TRUE(test::MotionBuilder()
+                .bone("root", 0, btVector3(0.0f, 0.0f, 0.0f))
+                .bone("root", 30, btVector3(5.0f, 0.0f, 0.0f))
+                .attach(motion, model));
+    vpvl::World world(30, 1);
+    vpvl::Scene scene(640, 480, 30);
+    scene.setWorld(world.mutableWorld());
+    scene.addModel(&model);
+    model.setEnableDeactivation(true);
+    for (int i = 0; i < 600 && scene.countSleepingRigidBodies() < 2; i++)
+        scene.update(1.0f);
+    ASSERT_EQ(2, scene.countSleepingRigidBodies());
+    // the aligned bodies follow the bone again when it is moved
+    scene.seek(10.0f);
+    EXPECT_EQ(2, model.countActiveRigidBodies());
+    EXPECT_EQ(0, model.countSleepingRigidBodies());
+}
+
+TEST(WorldTest, MoveKinematicBodyWithoutSimulation) {
+    vpvl::World world(30, 1);
+    ChainScene chain(&world);
+    vpvl::PMDModel &model = chain.chain.model;
+    const vpvl::Bone *root = model.findBone(reinterpret_cast<const uint8_t *>("root"));
+    const btVector3 offset = chain.chain.linkPosition(0) - root->localTransform().getOrigin();
+    // the bones are not driven by the bodies but the kinematic body still follows its bone
+    model.setEnableSimulation(false);
+    EXPECT_FALSE(model.isSimulationEnabled());
+    for (int i = 0; i < 10; i++)
+        chain.scene.update(1.0f);
+    EXPECT_LT(1.0f, root->localTransform().getOrigin().x());
+    EXPECT_GT(0.001f, chain.chain.linkPosition(0).distance(root->localTransform().getOrigin() + offset));
+}
@@ -0,0 +1,64 @@
+#include "gtest/gtest.h"
+#include "vpvl/vpvl.h"
+#include "Common.h"
+
+TEST(XModelTest, BuildIndexedMeshSharingCorners) {
+    const int nColumns = 8, nRows = 6, nMaterials = 3;
+    const char *textureNames[] = { "a.bmp", 0, "b.bmp" };
+    std::vector<uint8_t> bytes;
+    test::BuildGridAsset(bytes, nColumns, nRows, textureNames, nMaterials);
+    vpvl::XModel model;
+    ASSERT_TRUE(model.load(&bytes[0], bytes.size()));
+    ASSERT_EQ(nColumns * nRows * 4, model.vertices().size());
+    vpvl::XModelIndexedMesh mesh;
+    model.buildIndexedMesh(mesh);
+    // the corners shared by the quads are merged into a vertex
+    EXPECT_EQ((nColumns + 1) * (nRows + 1), mesh.vertices.size());
+    EXPECT_EQ(nColumns * nRows * 6, mesh.indices.size());
+    ASSERT_EQ(nMaterials, mesh.ranges.size());
+    uint32_t offset = 0;
+    for (int i = 0; i < nMaterials; i++) {
+        const vpvl::XModelIndexRange &range = mesh.ranges[i];
+        EXPECT_EQ(uint32_t(i), range.materialIndex);
+        EXPECT_EQ(offset, range.offset);
+        EXPECT_EQ(uint32_t(nColumns * 6 * (nRows / nMaterials)), range.count);
+        // the triangles of the range belong to the rows of the material
+        for (uint32_t j = range.offset; j < range.offset + range.count; j++) {
+            const vpvl::XModelIndexedVertex &vertex = mesh.vertices[mesh.indices[j]];
+            const int row = int(vertex.position[1]);
+            EXPECT_TRUE(row % nMaterials == i || (row - 1) % nMaterials == i);
+        }
+        offset += range.count;
+    }
+    // a vertex keeps the attributes of the corners merged into it
+    for (int i = 0; i < mesh.vertices.size(); i++) {
+        const vpvl::XModelIndexedVertex &vertex = mesh.vertices[i];
+        EXPECT_NEAR(vertex.position[0] / nColumns, vertex.textureCoord[0], 1e-5f);
+        EXPECT_NEAR(vertex.position[1] / nRows, vertex.textureCoord[1], 1e-5f);
+        EXPECT_FLOAT_EQ(1.0f, btFabs(vertex.normal[2]));
+    }
+}
+
+TEST(XModelTest, BuildIndexedMeshInTransform) {
+    std::vector<uint8_t> bytes;
+    test::BuildGridAsset(bytes, 1, 1, 0, 1);
+    vpvl::XModel model;
+    ASSERT_TRUE(model.load(&bytes[0], bytes.size()));
+    model.setPosition(btVector3(1.0f, 2.0f, 3.0f));
+    model.setScale(2.0f);
+    vpvl::XModelIndexedMesh mesh;
+    model.buildIndexedMesh(mesh);
+    ASSERT_EQ(4, mesh.vertices.size());
+    ASSERT_EQ(6, mesh.indices.size());
+    // the triangles of a quad are (1, 0, 2) and (3, 2, 0) of the corners
+    const btVector3 corners[] = {
+        btVector3(0.0f, 1.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), btVector3(1.0f, 1.0f, 0.0f),
+        btVector3(1.0f, 0.0f, 0.0f), btVector3(1.0f, 1.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f)
+    };
+    for (int i = 0; i < 6; i++) {
+        const vpvl::XModelIndexedVertex &vertex = mesh.vertices[mesh.indices[i]];
+        const btVector3 expected = (corners[i] + btVector3(1.0f, 2.0f, 3.0f)) * 2.0f;
+        for (int j = 0; j < 3; j++)
+            EXPECT_FLOAT_EQ(expected[j], vertex.position[j]);
+    }
+}
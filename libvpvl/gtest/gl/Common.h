@@ -0,0 +1,119 @@
+#ifndef VPVL_GTEST_GL_COMMON_H_
+#define VPVL_GTEST_GL_COMMON_H_
+
+#include <string>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "vpvl/vpvl.h"
+#include "vpvl/gl/Renderer.h"
+
+/* helpers to render with a software OpenGL context such as Mesa llvmpipe without any window */
+namespace test
+{
+
+class Context
+{
+public:
+    Context(int width, int height)
+        : m_display(EGL_NO_DISPLAY),
+          m_surface(EGL_NO_SURFACE),
+          m_context(EGL_NO_CONTEXT)
+    {
+        static const EGLint kConfigAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_STENCIL_SIZE, 8,
+            EGL_NONE
+        };
+        const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        EGLConfig config;
+        EGLint nConfigs = 0;
+        if (getPlatformDisplay)
+            m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+        if (m_display == EGL_NO_DISPLAY)
+            m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (!eglInitialize(m_display, 0, 0)
+                || !eglChooseConfig(m_display, kConfigAttributes, &config, 1, &nConfigs)
+                || nConfigs == 0
+                || !eglBindAPI(EGL_OPENGL_API))
+            return;
+        m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttributes);
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, 0);
+        if (m_surface == EGL_NO_SURFACE || m_context == EGL_NO_CONTEXT
+                || !eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+            release();
+            return;
+        }
+        glewExperimental = GL_TRUE;
+        if (glewContextInit() != GLEW_OK)
+            release();
+    }
+    ~Context() {
+        release();
+    }
+
+    bool isValid() const {
+        return m_context != EGL_NO_CONTEXT;
+    }
+
+private:
+    void release() {
+        if (m_display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (m_context != EGL_NO_CONTEXT)
+            eglDestroyContext(m_display, m_context);
+        if (m_surface != EGL_NO_SURFACE)
+            eglDestroySurface(m_display, m_surface);
+        eglTerminate(m_display);
+        m_display = EGL_NO_DISPLAY;
+        m_surface = EGL_NO_SURFACE;
+        m_context = EGL_NO_CONTEXT;
+    }
+
+    EGLDisplay m_display;
+    EGLSurface m_surface;
+    EGLContext m_context;
+};
+
+/* creates a 2x2 texture of different colors for every texture and counts the requests */
+class Delegate : public vpvl::gl::IDelegate
+{
+public:
+    Delegate() : nTextures(0) {}
+
+    bool loadTexture(const std::string &path, GLuint &textureID) {
+        static const GLubyte kPixels[] = {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0x80, 0x40, 0xff,
+            0x40, 0xff, 0x80, 0xff, 0x80, 0x40, 0xff, 0xff
+        };
+        (void) path;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, kPixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        nTextures++;
+        return true;
+    }
+    bool loadToonTexture(const std::string &name, const std::string &dir, GLuint &textureID) {
+        return loadTexture(dir + "/" + name, textureID);
+    }
+    const std::string toUnicode(const uint8_t *value) {
+        return value ? reinterpret_cast<const char *>(value) : "";
+    }
+
+    int nTextures;
+};
+
+}
+
+#endif
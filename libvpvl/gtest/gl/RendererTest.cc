@@ -0,0 +1,532 @@
+#include "gtest/gtest.h"
+#include <stdlib.h>
+#include "../Common.h"
+#include "Common.h"
+
+namespace {
+
+PFNGLBUFFERDATAPROC g_bufferData = 0;
+PFNGLBUFFERSUBDATAPROC g_bufferSubData = 0;
+int g_nBufferData = 0, g_nBufferSubData = 0;
+
+void GLAPIENTRY CountBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {
+    g_nBufferData++;
+    g_bufferData(target, size, data, usage);
+}
+
+void GLAPIENTRY CountBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) {
+    g_nBufferSubData++;
+    g_bufferSubData(target, offset, size, data);
+}
+
+/* counts the buffer specification calls while alive */
+class BufferCounter
+{
+public:
+    BufferCounter() {
+        g_bufferData = __glewBufferData;
+        g_bufferSubData = __glewBufferSubData;
+        __glewBufferData = CountBufferData;
+        __glewBufferSubData = CountBufferSubData;
+        g_nBufferData = g_nBufferSubData = 0;
+    }
+    ~BufferCounter() {
+        __glewBufferData = g_bufferData;
+        __glewBufferSubData = g_bufferSubData;
+    }
+    int count() const {
+        return g_nBufferData + g_nBufferSubData;
+    }
+};
+
+/* decodes the file name as the content, the same names in the different directories have the same content */
+class Decoder : public vpvl::ITextureDecoder
+{
+public:
+    bool read(const char *path, vpvl::TextureCache::TextureType type, btAlignedObjectArray<uint8_t> &bytes) {
+        (void) type;
+        const char *name = strrchr(path, '/');
+        name = name ? name + 1 : path;
+        const size_t size = strlen(name);
+        bytes.resize(size);
+        memcpy(&bytes[0], name, size);
+        return size > 0;
+    }
+    bool decode(const btAlignedObjectArray<uint8_t> &bytes, vpvl::TextureImage &image) {
+        image.width = 2;
+        image.height = 2;
+        image.pixels.resize(16);
+        for (int i = 0; i < 16; i++)
+            image.pixels[i] = i % 4 == 3 ? 0xff : bytes[i % bytes.size()];
+        return true;
+    }
+};
+
+/* records the frames captured offscreen */
+class CaptureDelegate : public vpvl::gl::ICaptureDelegate
+{
+public:
+    void captureFrame(int index, const uint8_t *pixels, int width, int height) {
+        indices.push_back(index);
+        widths.push_back(width);
+        frames.push_back(std::vector<GLubyte>(pixels, pixels + width * height * 4));
+    }
+
+    std::vector<int> indices;
+    std::vector<int> widths;
+    std::vector<std::vector<GLubyte> > frames;
+};
+
+/* creates the half translucent textures to blend the materials in the drawing order */
+class TranslucentDelegate : public test::Delegate
+{
+public:
+    bool loadTexture(const std::string &path, GLuint &textureID) {
+        static const GLubyte kPixels[] = {
+            0xff, 0x20, 0x20, 0x80, 0x20, 0xff, 0x20, 0x40,
+            0x20, 0x20, 0xff, 0xc0, 0xff, 0xff, 0x20, 0x80
+        };
+        (void) path;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, kPixels);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        nTextures++;
+        return true;
+    }
+};
+
+void RenderSurface(vpvl::gl::Renderer &renderer, std::vector<GLubyte> &pixels, int width, int height) {
+    pixels.resize(width * height * 4);
+    renderer.scene()->seek(0.0f);
+    renderer.drawSurface();
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+}
+
+}
+
+TEST(RendererTest, UploadVerticesOncePerFrame) {
+    test::Context context(64, 64);
+    if (!context.isValid()) {
+        fprintf(stderr, "Skipped because no software OpenGL context is available\n");
+        return;
+    }
+    const char *textureNames[] = { "a.bmp", 0, "b.bmp*c.sph" };
+    std::vector<uint8_t> bytes;
+    test::BuildMeshModel(bytes, textureNames, 0, 3);
+    vpvl::PMDModel first, second;
+    ASSERT_TRUE(first.load(&bytes[0], bytes.size()));
+    ASSERT_TRUE(second.load(&bytes[0], bytes.size()));
+    test::Delegate delegate;
+    vpvl::gl::Renderer renderer(&delegate, 64, 64, 30);
+    renderer.initializeSurface();
+    renderer.loadModel(&first, "");
+    renderer.loadModel(&second, "");
+    vpvl::Scene *scene = renderer.scene();
+    scene->addModel(&first);
+    scene->addModel(&second);
+    scene->update(1.0f);
+    const int nFrames = 4;
+    {
+        BufferCounter counter;
+        for (int i = 0; i < nFrames; i++)
+            renderer.drawSurface();
+        // the shadow, the model and the edge passes share one upload of each model
+        EXPECT_EQ(nFrames * 2, counter.count());
+    }
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+
+    // the streamed buffer holds the skinned vertices, the toon texture coordinates and the edge vertices
+    const size_t nVertices = first.vertices().size();
+    const size_t verticesSize = nVertices * first.stride(vpvl::PMDModel::kVerticesStride);
+    const size_t toonTextureCoordsSize = nVertices * first.stride(vpvl::PMDModel::kToonTextureStride);
+    const size_t edgeVerticesSize = nVertices * first.stride(vpvl::PMDModel::kEdgeVerticesStride);
+    std::vector<uint8_t> uploaded(verticesSize + toonTextureCoordsSize + edgeVerticesSize);
+    renderer.uploadModel(&first);
+    for (GLuint id = 1; id < 64; id++) {
+        GLint size = 0;
+        if (!glIsBuffer(id))
+            continue;
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+        if (size_t(size) != uploaded.size())
+            continue;
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, size, &uploaded[0]);
+        if (memcmp(&uploaded[0], first.verticesPointer(), verticesSize) == 0)
+            break;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    EXPECT_EQ(0, memcmp(&uploaded[0], first.verticesPointer(), verticesSize));
+    EXPECT_EQ(0, memcmp(&uploaded[verticesSize], first.toonTextureCoordsPointer(), toonTextureCoordsSize));
+    EXPECT_EQ(0, memcmp(&uploaded[verticesSize + toonTextureCoordsSize], first.edgeVerticesPointer(), edgeVerticesSize));
+
+    scene->removeModel(&first);
+    scene->removeModel(&second);
+    renderer.unloadModel(&first);
+    renderer.unloadModel(&second);
+}
+
+TEST(RendererTest, SkinInShaderAsSoftware) {
+    const int width = 64, height = 64;
+    test::Context context(width, height);
+    if (!context.isValid()) {
+        fprintf(stderr, "Skipped because no software OpenGL context is available\n");
+        return;
+    }
+    const char *textureNames[] = { "a.sph", 0, "b.bmp*c.sph" };
+    std::vector<uint8_t> modelBytes;
+    test::BuildMeshModel(modelBytes, textureNames, 0, 3);
+    vpvl::PMDModel model;
+    vpvl::VMDMotion motion;
+    ASSERT_TRUE(model.load(&modelBytes[0], modelBytes.size()));
+    const btQuaternion rotation(btVector3(0.0f, 0.0f, 1.0f), 0.4f);
+    ASSERT_TRUE(test::MotionBuilder()
+                .bone("arm", 0, btVector3(0.0f, 0.5f, 0.0f), rotation)
+                .bone("arm", 30, btVector3(0.0f, 0.5f, 0.0f), rotation)
+                .face("face", 0, 1.0f)
+                .face("face", 30, 1.0f)
+                .attach(motion, model));
+    test::Delegate delegate;
+    vpvl::gl::Renderer renderer(&delegate, width, height, 30);
+    renderer.initializeSurface();
+    ASSERT_TRUE(renderer.isShaderSkinningAvailable());
+    renderer.loadModel(&model, "");
+    vpvl::Scene *scene = renderer.scene();
+    scene->addModel(&model);
+    scene->setViewMove(0);
+    scene->setCameraPerspective(btVector3(3.0f, 1.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 45.0f, 8.0f);
+    scene->updateModelView(0);
+    scene->updateProjection(0);
+    glClearColor(0.2f, 0.4f, 0.6f, 1.0f);
+
+    // the shader path is rendered first so that the software path has never skinned the pose
+    std::vector<GLubyte> software, shader;
+    EXPECT_TRUE(model.enableSoftwareSkinning());
+    renderer.setEnableShaderSkinning(true);
+    EXPECT_FALSE(model.enableSoftwareSkinning());
+    {
+        // only the skinning matrices and the morphed vertices are uploaded as textures
+        BufferCounter counter;
+        RenderSurface(renderer, shader, width, height);
+        EXPECT_EQ(0, counter.count());
+    }
+    renderer.setEnableShaderSkinning(false);
+    EXPECT_TRUE(model.enableSoftwareSkinning());
+    RenderSurface(renderer, software, width, height);
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+    int nCovered = 0, maxDifference = 0;
+    for (int i = 0; i < width * height; i++) {
+        const GLubyte *s = &software[i * 4], *h = &shader[i * 4];
+        if (s[0] != 51 || s[1] != 102 || s[2] != 153)
+            nCovered++;
+        for (int j = 0; j < 3; j++)
+            maxDifference = btMax(maxDifference, abs(int(s[j]) - int(h[j])));
+    }
+    // the model covers a part of the surface and both paths render it the same
+    EXPECT_LT(width * height / 20, nCovered);
+    EXPECT_LT(nCovered, width * height);
+    EXPECT_GE(2, maxDifference);
+
+    scene->removeModel(&model);
+    renderer.unloadModel(&model);
+}
+
+TEST(RendererTest, BatchDrawsAcrossModels) {
+    const int width = 64, height = 64, nModels = 3;
+    test::Context context(width, height);
+    if (!context.isValid()) {
+        fprintf(stderr, "Skipped because no software OpenGL context is available\n");
+        return;
+    }
+    const char *textureNames[] = { 0, "a.sph", 0, "b.bmp*c.spa" };
+    const float opacities[] = { 1.0f, 1.0f, 0.5f, 1.0f };
+    std::vector<uint8_t> bytes;
+    test::BuildMeshModel(bytes, textureNames, opacities, 4);
+    vpvl::PMDModel models[nModels];
+    test::Delegate delegate;
+    vpvl::gl::Renderer renderer(&delegate, width, height, 30);
+    vpvl::Scene *scene = renderer.scene();
+    renderer.initializeSurface();
+    for (int i = 0; i < nModels; i++) {
+        ASSERT_TRUE(models[i].load(&bytes[0], bytes.size()));
+        renderer.loadModel(&models[i], "");
+        scene->addModel(&models[i]);
+    }
+    scene->setViewMove(0);
+    scene->setCameraPerspective(btVector3(4.0f, 1.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 45.0f, 10.0f);
+    scene->updateModelView(0);
+    scene->updateProjection(0);
+    glClearColor(0.2f, 0.4f, 0.6f, 1.0f);
+
+    std::vector<GLubyte> unbatched, batched;
+    EXPECT_TRUE(renderer.enableDrawBatching());
+    renderer.setEnableDrawBatching(false);
+    RenderSurface(renderer, unbatched, width, height);
+    const int nUnbatchedDrawCalls = renderer.countDrawCalls(), nUnbatchedStateChanges = renderer.countStateChanges();
+    renderer.setEnableDrawBatching(true);
+    RenderSurface(renderer, batched, width, height);
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+    // a draw of each material and each edge at most, and the states shared by the models are set once
+    EXPECT_EQ(nModels * 5, nUnbatchedDrawCalls);
+    EXPECT_GE(nUnbatchedDrawCalls, renderer.countDrawCalls());
+    EXPECT_LT(renderer.countStateChanges(), nUnbatchedStateChanges);
+    // the models are drawn as if one by one
+    int nCovered = 0, maxDifference = 0;
+    for (int i = 0; i < width * height; i++) {
+        const GLubyte *u = &unbatched[i * 4], *b = &batched[i * 4];
+        if (u[0] != 51 || u[1] != 102 || u[2] != 153)
+            nCovered++;
+        for (int j = 0; j < 3; j++)
+            maxDifference = btMax(maxDifference, abs(int(u[j]) - int(b[j])));
+    }
+    EXPECT_LT(width * height / 20, nCovered);
+    EXPECT_EQ(0, maxDifference);
+
+    for (int i = 0; i < nModels; i++) {
+        scene->removeModel(&models[i]);
+        renderer.unloadModel(&models[i]);
+    }
+}
+
+TEST(RendererTest, BatchDrawsInModelOrder) {
+    const int width = 64, height = 64, nModels = 2;
+    test::Context context(width, height);
+    if (!context.isValid()) {
+        fprintf(stderr, "Skipped because no software OpenGL context is available\n");
+        return;
+    }
+    // the opaque materials of the models overlap with the different translucent textures
+    const char *textureNames[nModels][3] = { { "a.bmp", 0, "b.bmp" }, { 0, "c.bmp", "a.bmp" } };
+    vpvl::PMDModel models[nModels];
+    TranslucentDelegate delegate;
+    vpvl::gl::Renderer renderer(&delegate, width, height, 30);
+    vpvl::Scene *scene = renderer.scene();
+    renderer.initializeSurface();
+    for (int i = 0; i < nModels; i++) {
+        std::vector<uint8_t> bytes;
+        test::BuildMeshModel(bytes, textureNames[i], 0, 3);
+        ASSERT_TRUE(models[i].load(&bytes[0], bytes.size()));
+        renderer.loadModel(&models[i], "");
+        scene->addModel(&models[i]);
+    }
+    scene->setViewMove(0);
+    scene->setCameraPerspective(btVector3(4.0f, 1.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 45.0f, 10.0f);
+    scene->updateModelView(0);
+    scene->updateProjection(0);
+    glClearColor(0.2f, 0.4f, 0.6f, 1.0f);
+
+    std::vector<GLubyte> unbatched, batched;
+    renderer.setEnableDrawBatching(false);
+    RenderSurface(renderer, unbatched, width, height);
+    renderer.setEnableDrawBatching(true);
+    RenderSurface(renderer, batched, width, height);
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+    // the textures are blended in the same order as drawing the models one by one
+    int nCovered = 0, maxDifference = 0;
+    for (int i = 0; i < width * height; i++) {
+        const GLubyte *u = &unbatched[i * 4], *b = &batched[i * 4];
+        if (u[0] != 51 || u[1] != 102 || u[2] != 153)
+            nCovered++;
+        for (int j = 0; j < 3; j++)
+            maxDifference = btMax(maxDifference, abs(int(u[j]) - int(b[j])));
+    }
+    EXPECT_LT(width * height / 20, nCovered);
+    EXPECT_EQ(0, maxDifference);
+
+    for (int i = 0; i < nModels; i++) {
+        scene->removeModel(&models[i]);
+        renderer.unloadModel(&models[i]);
+    }
+}
+
+TEST(RendererTest, DrawAssetFromStaticBuffers) {
+    const int width = 64, height = 64;
+    test::Context context(width, height);
+    if (!context.isValid()) {
+        fprintf(stderr, "Skipped because no software OpenGL context is available\n");
+        return;
+    }
+    const char *textureNames[] = { "a.bmp", 0, "b.bmp" };
+    std::vector<uint8_t> bytes;
+    test::BuildGridAsset(bytes, 8, 6, textureNames, 3);
+    vpvl::XModel asset;
+    ASSERT_TRUE(asset.load(&bytes[0], bytes.size()));
+    test::Delegate delegate;
+    vpvl::gl::Renderer renderer(&delegate, width, height, 30);
+    vpvl::Scene *scene = renderer.scene();
+    renderer.initializeSurface();
+    renderer.loadAsset(&asset, "");
+    // the textures are shared by the ranges of a material
+    EXPECT_EQ(2, delegate.nTextures);
+    scene->setViewMove(0);
+    scene->setCameraPerspective(btVector3(4.0f, 3.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 45.0f, 12.0f);
+    scene->updateModelView(0);
+    scene->updateProjection(0);
+    glClearColor(0.2f, 0.4f, 0.6f, 1.0f);
+    std::vector<GLubyte> pixels;
+    {
+        BufferCounter counter;
+        RenderSurface(renderer, pixels, width, height);
+        EXPECT_EQ(0, counter.count());
+    }
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+    int nCovered = 0;
+    for (int i = 0; i < width * height; i++) {
+        const GLubyte *p = &pixels[i * 4];
+        if (p[0] != 51 || p[1] != 102 || p[2] != 153)
+            nCovered++;
+    }
+    EXPECT_LT(width * height / 4, nCovered);
+    renderer.unloadAsset(&asset);
+}
+
+TEST(RendererTest, ShareTexturesInCache) {
+    const int width = 64, height = 64, nModels = 2;
+    test::Context context(width, height);
+    if (!context.isValid()) {
+        fprintf(stderr, "Skipped because no software OpenGL context is available\n");
+        return;
+    }
+    const char *textureNames[] = { 0, "a.sph", 0, "b.bmp*c.spa" };
+    const char *dirs[] = { "x", "y" };
+    std::vector<uint8_t> bytes;
+    test::BuildMeshModel(bytes, textureNames, 0, 4);
+    vpvl::PMDModel models[nModels];
+    vpvl::ThreadPool pool(2);
+    Decoder decoder;
+    vpvl::TextureCache cache(&decoder);
+    cache.setThreadPool(&pool);
+    test::Delegate delegate;
+    vpvl::gl::Renderer renderer(&delegate, width, height, 30);
+    vpvl::Scene *scene = renderer.scene();
+    renderer.initializeSurface();
+    renderer.setTextureCache(&cache);
+    renderer.setTextureUploadBudget(0);
+    for (int i = 0; i < nModels; i++) {
+        ASSERT_TRUE(models[i].load(&bytes[0], bytes.size()));
+        renderer.loadModel(&models[i], dirs[i]);
+        scene->addModel(&models[i]);
+    }
+    // the textures are not loaded by the delegate
+    EXPECT_EQ(0, delegate.nTextures);
+    scene->setViewMove(0);
+    scene->setCameraPerspective(btVector3(4.0f, 1.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 45.0f, 10.0f);
+    scene->updateModelView(0);
+    scene->updateProjection(0);
+    glClearColor(0.2f, 0.4f, 0.6f, 1.0f);
+    // a texture is uploaded in a frame and the models are drawn while decoding
+    std::vector<GLubyte> pixels;
+    int nFrames = 0;
+    while (cache.countPendingTextures() > 0) {
+        RenderSurface(renderer, pixels, width, height);
+        nFrames++;
+    }
+    RenderSurface(renderer, pixels, width, height);
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+    // a.sph, b.bmp, c.spa and toon0.bmp of the both directories
+    EXPECT_EQ(4, cache.countDecodedTextures());
+    EXPECT_LE(4, nFrames);
+    int nCovered = 0;
+    for (int i = 0; i < width * height; i++) {
+        const GLubyte *p = &pixels[i * 4];
+        if (p[0] != 51 || p[1] != 102 || p[2] != 153)
+            nCovered++;
+    }
+    EXPECT_LT(width * height / 20, nCovered);
+    // the models share the texture of the same content until both are unloaded
+    int x = cache.request("x/a.sph", vpvl::TextureCache::kTexture);
+    int y = cache.request("y/a.sph", vpvl::TextureCache::kTexture);
+    GLuint textureID = cache.textureID(x);
+    EXPECT_NE(0u, textureID);
+    EXPECT_EQ(textureID, cache.textureID(y));
+    EXPECT_EQ(0u, cache.release(x));
+    EXPECT_EQ(0u, cache.release(y));
+    scene->removeModel(&models[0]);
+    renderer.unloadModel(&models[0]);
+    EXPECT_TRUE(glIsTexture(textureID));
+    scene->removeModel(&models[1]);
+    renderer.unloadModel(&models[1]);
+    EXPECT_FALSE(glIsTexture(textureID));
+}
+
+TEST(RendererTest, CaptureFramesOffscreen) {
+    const int width = 64, height = 64, nFrames = 5, nBuffers = 3;
+    test::Context context(width, height);
+    if (!context.isValid()) {
+        fprintf(stderr, "Skipped because no software OpenGL context is available\n");
+        return;
+    }
+    const char *textureNames[] = { 0, "a.sph", 0, "b.bmp*c.spa" };
+    std::vector<uint8_t> bytes;
+    test::BuildMeshModel(bytes, textureNames, 0, 4);
+    vpvl::PMDModel model;
+    ASSERT_TRUE(model.load(&bytes[0], bytes.size()));
+    test::Delegate delegate;
+    vpvl::gl::Renderer renderer(&delegate, width, height, 30);
+    vpvl::Scene *scene = renderer.scene();
+    renderer.initializeSurface();
+    renderer.loadModel(&model, "");
+    scene->addModel(&model);
+    scene->setViewMove(0);
+    scene->setCameraPerspective(btVector3(4.0f, 1.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 45.0f, 10.0f);
+    scene->updateModelView(0);
+    scene->updateProjection(0);
+    std::vector<GLubyte> expected;
+    glClearColor(0.0f, 0.4f, 0.6f, 1.0f);
+    RenderSurface(renderer, expected, width, height);
+
+    CaptureDelegate capture;
+    EXPECT_FALSE(renderer.isCapturing());
+    ASSERT_TRUE(renderer.beginCapture(&capture, nBuffers));
+    EXPECT_TRUE(renderer.isCapturing());
+    for (int i = 0; i < nFrames; i++) {
+        // the background tells the frame
+        glClearColor(i / 255.0f, 0.4f, 0.6f, 1.0f);
+        scene->seek(0.0f);
+        renderer.drawSurface();
+        // the frames are delivered behind the rendering as many as the buffers minus one
+        EXPECT_EQ(btMax(0, i + 2 - nBuffers), int(capture.indices.size()));
+    }
+    std::vector<GLubyte> window(width * height * 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &window[0]);
+    renderer.endCapture();
+    EXPECT_FALSE(renderer.isCapturing());
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+    // the window is not drawn while capturing
+    EXPECT_TRUE(window == expected);
+    ASSERT_EQ(nFrames, int(capture.indices.size()));
+    for (int i = 0; i < nFrames; i++) {
+        const std::vector<GLubyte> &frame = capture.frames[i];
+        EXPECT_EQ(i, capture.indices[i]);
+        EXPECT_EQ(width, capture.widths[i]);
+        EXPECT_EQ(i, frame[0]);
+    }
+    // the frame drawn offscreen is the same as the window
+    int maxDifference = 0;
+    for (int i = 0; i < width * height; i++) {
+        const GLubyte *e = &expected[i * 4], *c = &capture.frames[0][i * 4];
+        for (int j = 0; j < 3; j++)
+            maxDifference = btMax(maxDifference, abs(int(e[j]) - int(c[j])));
+    }
+    EXPECT_EQ(0, maxDifference);
+
+    // resizing delivers the frames of the previous size and captures the next frames in the new size
+    capture.widths.clear();
+    ASSERT_TRUE(renderer.beginCapture(&capture, 2));
+    scene->seek(0.0f);
+    renderer.drawSurface();
+    renderer.resize(width / 2, height / 2);
+    EXPECT_TRUE(renderer.isCapturing());
+    scene->seek(0.0f);
+    renderer.drawSurface();
+    renderer.endCapture();
+    ASSERT_EQ(2u, capture.widths.size());
+    EXPECT_EQ(width, capture.widths[0]);
+    EXPECT_EQ(width / 2, capture.widths[1]);
+    EXPECT_EQ(GLenum(GL_NO_ERROR), glGetError());
+
+    scene->removeModel(&model);
+    renderer.unloadModel(&model);
+}
@@ -53,6 +53,18 @@ class Bone;
 class VPVL_EXPORT BoneKeyFrame
 {
 public:
+    /**
+     * Type of interpolation parameter.
+     */
+    enum InterpolationType
+    {
+        kX,
+        kY,
+        kZ,
+        kRotation,
+        kMax
+    };
+
     BoneKeyFrame();
     ~BoneKeyFrame();
 
@@ -63,6 +75,9 @@ public:
 
     void read(const uint8_t *data);
     void write(uint8_t *data);
+    void setDefaultInterpolationParameter();
+    void getInterpolationParameter(InterpolationType type, int8_t &x1, int8_t &y1, int8_t &x2, int8_t &y2) const;
+    void setInterpolationParameter(InterpolationType type, int8_t x1, int8_t y1, int8_t x2, int8_t y2);
 
     const uint8_t *name() const {
         return m_name;
@@ -98,13 +113,15 @@ public:
 
 private:
     void setInterpolationTable(const int8_t *table);
+    void setInterpolationTableAt(int at);
 
     uint8_t m_name[kNameSize];
     float m_frameIndex;
     btVector3 m_position;
     btQuaternion m_rotation;
-    bool m_linear[4];
-    float *m_interpolationTable[4];
+    bool m_linear[kMax];
+    float *m_interpolationTable[kMax];
+    int8_t m_rawInterpolationTable[kTableSize];
 
     VPVL_DISABLE_COPY_AND_ASSIGN(BoneKeyFrame)
 };
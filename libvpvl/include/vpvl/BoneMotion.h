@@ -48,7 +48,11 @@ namespace vpvl
 class Bone;
 class BoneKeyFrame;
 class PMDModel;
+class PoseBuffer;
+class ThreadPool;
+typedef struct BoneMotionBatch BoneMotionBatch;
 typedef struct BoneMotionInternal BoneMotionInternal;
+typedef struct BoneMotionTrack BoneMotionTrack;
 typedef btAlignedObjectArray<BoneKeyFrame *> BoneKeyFrameList;
 
 /**
@@ -71,14 +75,90 @@ public:
     static const float kStartingMarginFrame;
 
     void read(const uint8_t *data, uint32_t size);
+
+    /**
+     * Read the key frames of the bones the model has only.
+     *
+     * @param The buffer to read and parse
+     * @param Count of key frames in the buffer
+     * @param A model to filter key frames
+     */
+    void read(const uint8_t *data, uint32_t size, const PMDModel *model);
+    void read(const uint8_t *data, uint32_t size, const PMDModel *model, ThreadPool *pool);
     void seek(float frameAt);
     void takeSnap(const btVector3 &center);
     void attachModel(PMDModel *model);
     void reset();
 
+    /**
+     * Share the key frames of the motion, which must outlive this.
+     *
+     * @param A motion to share key frames
+     */
+    void share(BoneMotion *motion);
+    void setBoneMask(const uint8_t *name, float weight);
+
+    /**
+     * Insert the key frame and take the ownership of it.
+     *
+     * @param A key frame to insert
+     * @return false if the motion is shared or a key frame already exists at the same frame
+     */
+    bool addKeyFrame(BoneKeyFrame *frame);
+    bool removeKeyFrame(const uint8_t *name, float frameIndex);
+    bool moveKeyFrame(const uint8_t *name, float from, float to);
+    const BoneKeyFrame *findKeyFrame(const uint8_t *name, float frameIndex) const;
+
+    /**
+     * Find the key frame of the bone at the frame to modify it in place.
+     *
+     * @param A name of the bone
+     * @param A frame index of the key frame
+     * @return A key frame or null if the motion is shared or the key frame is not found
+     */
+    BoneKeyFrame *mutableKeyFrame(const uint8_t *name, float frameIndex);
+
     const BoneKeyFrameList &frames() const {
-        return m_frames;
+        return m_source ? m_source->m_frames : m_frames;
+    }
+    BoneKeyFrameList *mutableFrames();
+    bool isShared() const {
+        return m_source != 0;
+    }
+
+    /**
+     * Get the count of the edits of the key frames of the motion or its source if shared.
+     *
+     * @return The count of the edits
+     */
+    uint32_t revision() const {
+        return m_source ? m_source->m_revision : m_revision;
+    }
+    float editedFrame() const {
+        return m_source ? m_source->m_editedFrame : m_editedFrame;
     }
+    uint32_t countSkippedKeyFrames() const {
+        return m_nSkippedKeyFrames;
+    }
+    PoseBuffer *poseBuffer() const {
+        return m_pose;
+    }
+    void setPoseBuffer(PoseBuffer *value) {
+        m_pose = value;
+    }
+    bool enableBatchEvaluation() const {
+        return m_enableBatchEvaluation;
+    }
+
+    /**
+     * Enable or disable interpolating all tracks together while seeking.
+     *
+     * @param Enable the batch evaluation if true
+     */
+    void setEnableBatchEvaluation(bool value) {
+        m_enableBatchEvaluation = value;
+    }
+
     bool hasCenterBoneMotion() const {
         return m_hasCenterBoneMotion;
     }
@@ -96,12 +176,34 @@ private:
                             float w,
                             uint32_t at,
                             float &value);
+    static void searchKeyFrames(float frameAt,
+                                BoneMotionInternal *node,
+                                float &currentFrame,
+                                uint32_t &k1,
+                                uint32_t &k2);
+    void buildTracks();
+    void refreshTracks();
+    void attachTrack(const BoneKeyFrameList &frames, PMDModel *model);
+    void updateMaxFrame();
+    void markEdited(float frameIndex);
     void calculateFrames(float frameAt, BoneMotionInternal *node);
+    void calculateFramesInBatch(float frameAt);
 
     BoneKeyFrameList m_frames;
+    btHashMap<btHashString, BoneMotionTrack *> m_name2track;
     btHashMap<btHashString, BoneMotionInternal *> m_name2node;
+    btHashMap<btHashString, float> m_name2mask;
+    BoneMotion *m_source;
+    PoseBuffer *m_pose;
     PMDModel *m_model;
+    BoneMotionBatch *m_batch;
+    uint32_t m_nSkippedKeyFrames;
+    uint32_t m_revision;
+    uint32_t m_boundRevision;
+    float m_editedFrame;
     bool m_hasCenterBoneMotion;
+    bool m_dirty;
+    bool m_enableBatchEvaluation;
 
     VPVL_DISABLE_COPY_AND_ASSIGN(BoneMotion)
 };
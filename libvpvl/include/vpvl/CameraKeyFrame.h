@@ -60,6 +60,11 @@ public:
     void read(const uint8_t *data);
     void write(uint8_t *data);
 
+    /**
+     * Set linear interpolation to all parameters of the key frame.
+     */
+    void setDefaultInterpolationParameter();
+
     float frameIndex() const {
         return m_frameIndex;
     }
@@ -109,6 +114,7 @@ private:
     bool m_noPerspective;
     bool m_linear[6];
     float *m_interpolationTable[6];
+    int8_t m_rawInterpolationTable[kTableSize];
 
     VPVL_DISABLE_COPY_AND_ASSIGN(CameraKeyFrame)
 };
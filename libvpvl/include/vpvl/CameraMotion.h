@@ -69,8 +69,55 @@ public:
     void takeSnap(const btVector3 &center);
     void reset();
 
+    /**
+     * Share key frames of the given motion instead of reading them.
+     *
+     * The given motion must outlive this.
+     *
+     * @param A motion to share key frames
+     */
+    void share(CameraMotion *motion);
+
+    /**
+     * Insert the key frame keeping the key frames sorted.
+     *
+     * The motion takes ownership of the key frame.
+     *
+     * @param A key frame to insert
+     * @return false if the motion is shared or a key frame already exists at the same frame
+     */
+    bool addKeyFrame(CameraKeyFrame *frame);
+
+    /**
+     * Remove and delete the key frame at the frame.
+     *
+     * @param A frame index of the key frame
+     * @return false if the motion is shared or the key frame is not found
+     */
+    bool removeKeyFrame(float frameIndex);
+
+    /**
+     * Move the key frame to the another frame.
+     *
+     * @param A frame index of the key frame
+     * @param A frame index to move
+     * @return false if the motion is shared, the key frame is not found or the destination is occupied
+     */
+    bool moveKeyFrame(float from, float to);
+
+    /**
+     * Find the key frame at the frame.
+     *
+     * @param A frame index of the key frame
+     * @return A key frame or null if not found
+     */
+    CameraKeyFrame *findKeyFrame(float frameIndex) const;
+
     const CameraKeyFrameList &frames() const {
-        return m_frames;
+        return m_source ? m_source->m_frames : m_frames;
+    }
+    bool isShared() const {
+        return m_source != 0;
     }
     const btVector3 &position() const {
         return m_position;
@@ -95,12 +142,14 @@ private:
                             float w,
                             uint32_t at,
                             float &value);
+    void updateMaxFrame();
 
     CameraKeyFrameList m_frames;
     btVector3 m_position;
     btVector3 m_angle;
     float m_distance;
     float m_fovy;
+    CameraMotion *m_source;
     uint32_t m_lastIndex;
 
     VPVL_DISABLE_COPY_AND_ASSIGN(CameraMotion)
@@ -105,6 +105,9 @@ public:
     float weight() const {
         return m_weight;
     }
+    const btAlignedObjectArray<FaceVertex *> &vertices() const {
+        return m_vertices;
+    }
 
     void setName(const uint8_t *value) {
         copyBytesSafe(m_name, value, sizeof(m_name));
@@ -49,6 +49,7 @@ class Face;
 class FaceKeyFrame;
 class PMDModel;
 typedef struct FaceMotionInternal FaceMotionInternal;
+typedef struct FaceMotionTrack FaceMotionTrack;
 typedef btAlignedObjectArray<FaceKeyFrame *> FaceKeyFrameList;
 
 /**
@@ -71,24 +72,91 @@ public:
     static const float kStartingMarginFrame;
 
     void read(const uint8_t *data, uint32_t size);
+
+    /**
+     * Read the key frames of the faces the model has only.
+     *
+     * @param The buffer to read and parse
+     * @param Count of key frames in the buffer
+     * @param A model to filter key frames
+     */
+    void read(const uint8_t *data, uint32_t size, const PMDModel *model);
     void seek(float frameAt);
     void takeSnap(const btVector3 &center);
     void attachModel(PMDModel *model);
     void reset();
 
+    /**
+     * Share the key frames of the motion, which must outlive this.
+     *
+     * @param A motion to share key frames
+     */
+    void share(FaceMotion *motion);
+
+    /**
+     * Insert the key frame and take the ownership of it.
+     *
+     * @param A key frame to insert
+     * @return false if the motion is shared or a key frame already exists at the same frame
+     */
+    bool addKeyFrame(FaceKeyFrame *frame);
+    bool removeKeyFrame(const uint8_t *name, float frameIndex);
+    bool moveKeyFrame(const uint8_t *name, float from, float to);
+    const FaceKeyFrame *findKeyFrame(const uint8_t *name, float frameIndex) const;
+
+    /**
+     * Find the key frame of the face at the frame to modify it in place.
+     *
+     * @param A name of the face
+     * @param A frame index of the key frame
+     * @return A key frame or null if the motion is shared or the key frame is not found
+     */
+    FaceKeyFrame *mutableKeyFrame(const uint8_t *name, float frameIndex);
+
     const FaceKeyFrameList &frames() const {
-        return m_frames;
+        return m_source ? m_source->m_frames : m_frames;
+    }
+    FaceKeyFrameList *mutableFrames();
+    bool isShared() const {
+        return m_source != 0;
+    }
+
+    /**
+     * Get the count of the edits of the key frames of the motion or its source if shared.
+     *
+     * @return The count of the edits
+     */
+    uint32_t revision() const {
+        return m_source ? m_source->m_revision : m_revision;
+    }
+    float editedFrame() const {
+        return m_source ? m_source->m_editedFrame : m_editedFrame;
+    }
+    uint32_t countSkippedKeyFrames() const {
+        return m_nSkippedKeyFrames;
     }
     PMDModel *attachedModel() const {
         return m_model;
     }
 
 private:
+    void buildTracks();
+    void refreshTracks();
+    void attachTrack(const FaceKeyFrameList &frames, PMDModel *model);
+    void updateMaxFrame();
+    void markEdited(float frameIndex);
     void calculateFrames(float frameAt, FaceMotionInternal *node);
 
     FaceKeyFrameList m_frames;
+    btHashMap<btHashString, FaceMotionTrack *> m_name2track;
     btHashMap<btHashString, FaceMotionInternal *> m_name2node;
+    FaceMotion *m_source;
     PMDModel *m_model;
+    uint32_t m_nSkippedKeyFrames;
+    uint32_t m_revision;
+    uint32_t m_boundRevision;
+    float m_editedFrame;
+    bool m_dirty;
 
     VPVL_DISABLE_COPY_AND_ASSIGN(FaceMotion)
 };
@@ -0,0 +1,127 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#ifndef VPVL_MOTIONREDUCER_H_
+#define VPVL_MOTIONREDUCER_H_
+
+#include <LinearMath/btAlignedObjectArray.h>
+#include "vpvl/common.h"
+
+namespace vpvl
+{
+
+class BoneMotion;
+class FaceMotion;
+class VMDMotion;
+typedef struct MotionReducerCandidate MotionReducerCandidate;
+
+/**
+ * @file
+ * @author hkrn
+ *
+ * @section DESCRIPTION
+ *
+ * MotionReducer removes redundant key frames from a motion such as captured data
+ * that has a key frame at every frame. Bone key frames are replaced with the fewest
+ * key frames whose interpolation parameters reproduce the source within tolerances,
+ * face key frames are reduced using linear interpolation.
+ *
+ * The motion must not be attached to any models.
+ */
+
+class VPVL_EXPORT MotionReducer
+{
+public:
+    static const float kDefaultPositionTolerance;
+    static const float kDefaultRotationTolerance;
+    static const float kDefaultFaceWeightTolerance;
+
+    MotionReducer();
+    ~MotionReducer();
+
+    bool reduce(VMDMotion *motion);
+
+    float positionTolerance() const {
+        return m_positionTolerance;
+    }
+    float rotationTolerance() const {
+        return m_rotationTolerance;
+    }
+    float faceWeightTolerance() const {
+        return m_faceWeightTolerance;
+    }
+    uint32_t countSourceKeyFrames() const {
+        return m_nSourceKeyFrames;
+    }
+    uint32_t countReducedKeyFrames() const {
+        return m_nReducedKeyFrames;
+    }
+    float reductionRatio() const {
+        return m_nSourceKeyFrames > 0 ? 1.0f - static_cast<float>(m_nReducedKeyFrames) / m_nSourceKeyFrames : 0.0f;
+    }
+
+    void setPositionTolerance(float value) {
+        m_positionTolerance = value;
+    }
+    /**
+     * Set tolerance of rotation in degree.
+     */
+    void setRotationTolerance(float value) {
+        m_rotationTolerance = value;
+    }
+    void setFaceWeightTolerance(float value) {
+        m_faceWeightTolerance = value;
+    }
+
+private:
+    void buildCandidates();
+    void reduceBoneKeyFrames(BoneMotion *motion);
+    void reduceFaceKeyFrames(FaceMotion *motion);
+
+    btAlignedObjectArray<MotionReducerCandidate *> m_candidates;
+    float m_positionTolerance;
+    float m_rotationTolerance;
+    float m_faceWeightTolerance;
+    uint32_t m_nSourceKeyFrames;
+    uint32_t m_nReducedKeyFrames;
+
+    VPVL_DISABLE_COPY_AND_ASSIGN(MotionReducer)
+};
+
+} /* namespace vpvl */
+
+#endif
+
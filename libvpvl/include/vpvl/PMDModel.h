@@ -46,6 +46,7 @@
 #include "vpvl/Face.h"
 #include "vpvl/IK.h"
 #include "vpvl/Material.h"
+#include "vpvl/PoseBuffer.h"
 #include "vpvl/RigidBody.h"
 #include "vpvl/Vertex.h"
 
@@ -109,6 +110,18 @@ public:
         kMaxErrors
     };
 
+    /**
+      * Level of detail of the animation, lower is more detailed.
+      */
+    enum AnimationLevel
+    {
+        kFullAnimation,
+        kHalfRateAnimation,
+        kQuarterRateAnimation,
+        kMinimumAnimation,
+        kMaxAnimationLevels
+    };
+
     /**
       * Type of stride to get stride length.
       */
@@ -165,19 +178,32 @@ public:
     static const uint32_t kBoundingSpherePointsMax = 20;
     static const uint32_t kBoundingSpherePointsMin = 5;
     static const uint32_t kSystemTextureMax = 11;
+    static const int kMaxOutputBuffers = 3;
     static const float kMinBoneWeight;
     static const float kMinFaceWeight;
+    static const float kMinKinematicMoveDiff;
 
     void addMotion(VMDMotion *motion);
     void joinWorld(::btDiscreteDynamicsWorld *world);
     void leaveWorld(::btDiscreteDynamicsWorld *world);
     void removeMotion(VMDMotion *motion);
+
+    /**
+     * Get the earliest frame changed by the motions since the last call.
+     *
+     * @return A frame index or a negative value if nothing is changed
+     */
+    float takeEditedMotionFrame();
+
+    void saveSimulation(btAlignedObjectArray<RigidBodyState> &states) const;
+    void restoreSimulation(const RigidBodyState *states);
     void seekMotion(float frameIndex);
     void updateRootBone();
     void updateMotion(float deltaFrame);
     void updateSkins();
     void updateImmediate();
     float boundingSphereRange(btVector3 &center);
+    void getBoundingBox(btVector3 &min, btVector3 &max) const;
     void smearAllBonesToDefault(float rate);
     void discardState(State *&state) const;
     State *saveState() const;
@@ -189,6 +215,48 @@ public:
     const void *textureCoordsPointer() const;
     const void *toonTextureCoordsPointer() const;
     const void *edgeVerticesPointer() const;
+    const void *skinningMatricesPointer() const;
+    const void *faceVerticesPointer() const;
+
+    /**
+     * Get the transform of the bone skinned by the last updateSkins.
+     *
+     * @param The index of the bone
+     * @return The transform read from the buffered output if enabled
+     */
+    const btTransform &boneTransform(int index) const;
+
+    /**
+     * Enable or disable skinning on the CPU.
+     *
+     * updateSkins writes only the skinning matrices and the morphed base face if disabled.
+     *
+     * @param Enable the software skinning if true
+     */
+    void setEnableSoftwareSkinning(bool value) {
+        m_enableSoftwareSkinning = value;
+    }
+
+    void setEnableBufferedOutput(bool value);
+
+    /**
+     * Set the level of detail of the animation from the next evaluation of the motions.
+     *
+     * @param The level of detail
+     */
+    void setAnimationLevel(AnimationLevel value);
+
+    /**
+     * Enable or disable putting the settled rigid bodies to sleep.
+     *
+     * The sleeping bodies wake up when their kinematic body moves.
+     *
+     * @param Enable deactivation if true
+     */
+    void setEnableDeactivation(bool value);
+
+    int countActiveRigidBodies() const;
+    int countSleepingRigidBodies() const;
 
     bool preparse(const uint8_t *data, size_t size, DataInfo &info);
     bool load(const uint8_t *data, size_t size);
@@ -249,6 +317,27 @@ public:
     bool isSimulationEnabled() const {
         return m_enableSimulation;
     }
+    bool enableBufferedOutput() const {
+        return m_enableBufferedOutput;
+    }
+    bool enableDeactivation() const {
+        return m_enableDeactivation;
+    }
+    bool enableSoftwareSkinning() const {
+        return m_enableSoftwareSkinning;
+    }
+    const Face *baseFace() const {
+        return m_baseFace;
+    }
+    ::btDiscreteDynamicsWorld *world() const {
+        return m_world;
+    }
+    AnimationLevel animationLevel() const {
+        return m_animationLevel;
+    }
+    float animationPriority() const {
+        return m_animationPriority;
+    }
     const btVector3 &lightDirection() const {
         return m_lightDirection;
     }
@@ -266,6 +355,9 @@ public:
     Error error() const {
         return m_error;
     }
+    const PoseBuffer &poseBuffer() const {
+        return m_pose;
+    }
 
     const uint16_t *indicesPointer() const {
         return m_indicesPointer;
@@ -308,6 +400,15 @@ public:
     void setUserData(PMDModelUserData *value) {
         m_userData = value;
     }
+    void setAnimationPriority(float value) {
+        m_animationPriority = value;
+    }
+    void setWriteOutputBuffer(int value) {
+        m_writeOutput = m_enableBufferedOutput ? value : 0;
+    }
+    void setReadOutputBuffer(int value) {
+        m_readOutput = m_enableBufferedOutput ? value : 0;
+    }
 
 private:
     void parseHeader(const DataInfo &info);
@@ -327,12 +428,23 @@ private:
     void release();
     void sortBones();
     void updateAllBones();
+    void saveAnimation(btAlignedObjectArray<btVector3> &positions,
+                       btAlignedObjectArray<btQuaternion> &rotations,
+                       btAlignedObjectArray<float> &weights) const;
+    void interpolateAnimation(float rate);
     void updateBoneFromSimulation();
+    void updateSimulationFromBone();
+    void activateWakingGroups();
     void updateAllFaces();
     void updateShadowTextureCoords(float coef);
     void updateSkinVertices();
     void updateToon(const btVector3 &lightDirection);
+    void updateSkinningMatrices();
+    void updateBoneTransforms(btAlignedObjectArray<btTransform> &transforms);
     void updateIndices();
+    void updateBoundingRadius();
+    void allocateOutputBuffer(int index);
+    void releaseOutputBuffer(int index);
 
     uint8_t m_name[20];
     uint8_t m_comment[256];
@@ -352,14 +464,40 @@ private:
     btHashMap<btHashString, Bone *> m_name2bone;
     btHashMap<btHashString, Face *> m_name2face;
     btAlignedObjectArray<VMDMotion *> m_motions;
+    btAlignedObjectArray<uint32_t> m_motionRevisions;
+    PoseBuffer m_pose;
     btAlignedObjectArray<btTransform> m_skinningTransform;
-    btAlignedObjectArray<btVector3> m_edgeVertices;
-    btAlignedObjectArray<btVector3> m_toonTextureCoords;
+    btAlignedObjectArray<btVector3> m_edgeVertices[kMaxOutputBuffers];
+    btAlignedObjectArray<btVector3> m_toonTextureCoords[kMaxOutputBuffers];
+    btAlignedObjectArray<btVector4> m_skinningMatrices[kMaxOutputBuffers];
+    btAlignedObjectArray<btVector3> m_faceVertices[kMaxOutputBuffers];
+    btAlignedObjectArray<btTransform> m_boneTransforms[kMaxOutputBuffers];
     btAlignedObjectArray<btVector3> m_shadowTextureCoords;
+    btAlignedObjectArray<float> m_boneSkinRadius;
+    btAlignedObjectArray<float> m_boneFaceRadius;
+    btAlignedObjectArray<btVector3> m_fromPositions;
+    btAlignedObjectArray<btVector3> m_toPositions;
+    btAlignedObjectArray<btQuaternion> m_fromRotations;
+    btAlignedObjectArray<btQuaternion> m_toRotations;
+    btAlignedObjectArray<float> m_fromWeights;
+    btAlignedObjectArray<float> m_toWeights;
     BoneList m_rotatedBones;
     Bone **m_orderedBones;
     btAlignedObjectArray<bool> m_isIKSimulated;
-    SkinVertex *m_skinnedVertices;
+    btAlignedObjectArray<btRigidBody *> m_kinematicBodies;
+    btAlignedObjectArray<Bone *> m_kinematicBones;
+    btAlignedObjectArray<btTransform> m_kinematicTransforms;
+    btAlignedObjectArray<btRigidBody *> m_simulatedBodies;
+    btAlignedObjectArray<Bone *> m_simulatedBones;
+    btAlignedObjectArray<btTransform> m_simulatedTransforms;
+    btAlignedObjectArray<int> m_kinematicGroups;
+    btAlignedObjectArray<Bone *> m_alignedBones;
+    btAlignedObjectArray<btVector3> m_alignedOrigins;
+    btAlignedObjectArray<int> m_alignedGroups;
+    btAlignedObjectArray<btRigidBody *> m_dynamicBodies;
+    btAlignedObjectArray<int> m_dynamicGroups;
+    btAlignedObjectArray<bool> m_wakingGroups;
+    SkinVertex *m_skinnedVertices[kMaxOutputBuffers];
     ::btDiscreteDynamicsWorld *m_world;
     PMDModelUserData *m_userData;
     uint16_t *m_indicesPointer;
@@ -370,7 +508,20 @@ private:
     uint32_t m_boundingSphereStep;
     float m_edgeOffset;
     float m_selfShadowDensityCoef;
+    float m_animationPriority;
+    float m_animationElapsed;
+    float m_animationSpan;
+    float m_animationLead;
+    float m_animationDelta;
+    float m_editedMotionFrame;
+    AnimationLevel m_animationLevel;
+    AnimationLevel m_nextAnimationLevel;
+    int m_writeOutput;
+    int m_readOutput;
     bool m_enableSimulation;
+    bool m_enableBufferedOutput;
+    bool m_enableDeactivation;
+    bool m_enableSoftwareSkinning;
 
     VPVL_DISABLE_COPY_AND_ASSIGN(PMDModel)
 };
@@ -0,0 +1,107 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#ifndef VPVL_POSEBUFFER_H_
+#define VPVL_POSEBUFFER_H_
+
+#include <LinearMath/btAlignedObjectArray.h>
+#include <LinearMath/btQuaternion.h>
+#include <LinearMath/btVector3.h>
+#include "vpvl/Bone.h"
+
+namespace vpvl
+{
+
+/**
+ * @file
+ * @author hkrn
+ *
+ * @section DESCRIPTION
+ *
+ * PoseBuffer class accumulates bone positions and rotations evaluated by motion
+ * layers, and writes the blended result to the bones once.
+ *
+ * A layer is blended over the result of the previous layers, so the bones
+ * not blended by any layers keep their current values.
+ */
+
+class VPVL_EXPORT PoseBuffer
+{
+public:
+    PoseBuffer();
+    ~PoseBuffer();
+
+    /**
+     * Discard the blended result of the previous frame.
+     *
+     * @param Count of bones of the model
+     */
+    void reset(uint32_t nBones);
+
+    /**
+     * Blend a position and rotation of the bone over the result of the previous layers.
+     *
+     * @param A bone to blend
+     * @param A position to blend
+     * @param A rotation to blend
+     * @param Weight of the layer, 1.0 replaces the previous result
+     */
+    void blend(const Bone *bone, const btVector3 &position, const btQuaternion &rotation, float weight);
+
+    /**
+     * Write the blended result to the bones.
+     *
+     * @param Bones of the model
+     */
+    void apply(BoneList *bones) const;
+
+    uint32_t countBlendedBones() const {
+        return m_blendedIndices.size();
+    }
+
+private:
+    btAlignedObjectArray<btVector3> m_positions;
+    btAlignedObjectArray<btQuaternion> m_rotations;
+    btAlignedObjectArray<bool> m_blended;
+    btAlignedObjectArray<int> m_blendedIndices;
+
+    VPVL_DISABLE_COPY_AND_ASSIGN(PoseBuffer)
+};
+
+} /* namespace vpvl */
+
+#endif
+
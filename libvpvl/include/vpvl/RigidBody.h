@@ -47,6 +47,17 @@
 namespace vpvl
 {
 
+/**
+ * The simulated state of a rigid body saved to restore the simulation later.
+ */
+struct RigidBodyState
+{
+    btVector3 position;
+    btQuaternion rotation;
+    btVector3 linearVelocity;
+    btVector3 angularVelocity;
+};
+
 /**
  * @file
  * @author Nagoya Institute of Technology Department of Computer Science
@@ -71,12 +82,44 @@ public:
     void transformBone();
     void setKinematic(bool value);
 
+    /**
+     * Save the transform and the velocities of the body.
+     *
+     * @param The state to save to
+     */
+    void saveState(RigidBodyState &state) const;
+
+    /**
+     * Restore the transform and the velocities of the body saved by saveState.
+     *
+     * The forces applied to the body are cleared and the motion state of
+     * the dynamic body is moved to the restored transform.
+     *
+     * @param The saved state
+     */
+    void restoreState(const RigidBodyState &state);
+
     const uint8_t *name() const {
         return m_name;
     }
     btRigidBody *body() const {
         return m_body;
     }
+    Bone *bone() const {
+        return m_bone;
+    }
+    const btTransform &transform() const {
+        return m_transform;
+    }
+    const btTransform &invertedTransform() const {
+        return m_invertedTransform;
+    }
+    uint8_t type() const {
+        return m_type;
+    }
+    bool isNoBone() const {
+        return m_noBone;
+    }
     uint16_t groupID() const {
         return m_groupID;
     }
@@ -50,7 +50,10 @@ namespace vpvl
 {
 
 class PMDModel;
+class ThreadPool;
 class VMDMotion;
+typedef struct SceneOutputBuffer SceneOutputBuffer;
+typedef struct SceneCheckpoint SceneCheckpoint;
 
 /**
  * @file
@@ -66,6 +69,8 @@ class VPVL_EXPORT Scene
 {
 public:
     static const int kFPS = 30;
+    static const int kDefaultMaxCatchUpSteps = 4;
+    static const int kDefaultMaxCheckpoints = 128;
     static const float kFrustumNear;
     static const float kFrustumFar;
     static const float kMinMoveDiff;
@@ -76,20 +81,83 @@ public:
     static const float kDistanceSpeedRate;
     static const float kMinFovyDiff;
     static const float kFovySpeedRate;
+    static const float kMinDepthDiff;
+    static const float kHalfRateAnimationSize;
+    static const float kQuarterRateAnimationSize;
+    static const float kMinimumAnimationSize;
 
     Scene(int width, int height, int fps);
     ~Scene();
 
     void addModel(PMDModel *model);
+
+    /**
+     * Advance the scene by the elapsed time in fixed steps of the current FPS.
+     *
+     * The time shorter than a step is carried over and the time beyond
+     * the max catch-up steps is dropped.
+     *
+     * @param The elapsed time in seconds
+     * @return The number of the steps
+     */
+    int advance(float seconds);
+
+    /**
+     * Publish the output of the last update or seek from the updating thread.
+     */
+    void publishOutput();
+
+    /**
+     * Take the latest published output from the rendering thread.
+     *
+     * @return true if a newer output is taken
+     */
+    bool acquireOutput();
+
+    /**
+     * Remove all checkpoints, call this after changing the physics parameters.
+     */
+    void clearCheckpoints();
+
     PMDModel **getRenderingOrder(size_t &size);
+    PMDModel **getVisibleRenderingOrder(size_t &size);
     void getModelViewMatrix(float matrix[16]) const;
     void getProjectionMatrix(float matrix[16]) const;
     void removeModel(PMDModel *model);
     void resetCamera();
     void seek(float frameIndex);
+
+    /**
+     * Set the interval of the frames to record the physics.
+     *
+     * seek simulates only the frames from the nearest checkpoint before the frame.
+     *
+     * @param The interval in frames or 0 to disable
+     */
+    void setCheckpointInterval(float value);
+
+    void setMaxCheckpoints(int value);
     void setCameraPerspective(const btVector3 &position, const btVector3 &angle, float fovy, float distance);
     void setCameraMotion(VMDMotion *motion);
     void setLight(const btVector4 &color, const btVector4 &direction);
+    void setThreadPool(ThreadPool *pool);
+    void setEnableBufferedOutput(bool value);
+    void setEnableFrustumCulling(bool value);
+    void setEnableAnimationLOD(bool value);
+    void setMaxCatchUpSteps(int value);
+
+    /**
+     * Move the rigid bodies and the joints of the model to the island world.
+     *
+     * The island worlds are stepped concurrently only if built with
+     * VPVL_ENABLE_CONCURRENT_ISLAND_WORLDS and Bullet Physics with BT_NO_PROFILE,
+     * and the Bullet counters such as gNumAlignedAllocs are not accurate then.
+     *
+     * @param The model of the scene
+     * @param The island world or null to move back to the world of the scene
+     */
+    void setIslandWorld(PMDModel *model, ::btDiscreteDynamicsWorld *world);
+
     void setViewMove(int viewMoveTime);
     void setWorld(::btDiscreteDynamicsWorld *world);
     void update(float deltaFrame);
@@ -123,6 +191,51 @@ public:
     int currentFPS() const {
         return m_currentFPS;
     }
+    ThreadPool *threadPool() const {
+        return m_pool;
+    }
+    bool enableBufferedOutput() const {
+        return m_output != 0;
+    }
+    bool enableFrustumCulling() const {
+        return m_enableFrustumCulling;
+    }
+    bool enableAnimationLOD() const {
+        return m_enableAnimationLOD;
+    }
+    int maxCatchUpSteps() const {
+        return m_maxCatchUpSteps;
+    }
+    int countIslandWorlds() const {
+        return m_islandWorlds.size();
+    }
+    float checkpointInterval() const {
+        return m_checkpointInterval;
+    }
+    int countCheckpoints() const {
+        return m_checkpoints.size();
+    }
+    int maxCheckpoints() const {
+        return m_maxCheckpoints;
+    }
+    float currentFrame() const {
+        return m_currentFrame;
+    }
+    int countActiveRigidBodies() const {
+        return m_activeRigidBodies;
+    }
+    int countSleepingRigidBodies() const {
+        return m_sleepingRigidBodies;
+    }
+    int countConcurrentWorlds() const {
+        return m_concurrentWorlds;
+    }
+    int countVisibleModels() const {
+        return m_visibleModels.size();
+    }
+    int countCulledModels() const {
+        return m_models.size() - m_visibleModels.size();
+    }
 
     void setWidth(int value) {
         m_width = value;
@@ -138,6 +251,16 @@ public:
 
 private:
     void sortRenderingOrder();
+    void updateSimulation(float deltaFrame, bool skin);
+    void invalidateCheckpoints();
+    void recordCheckpoint();
+    void removeCheckpoint(int index);
+    void restoreCheckpoint(const SceneCheckpoint *checkpoint);
+    void updateModels(float frameIndex, bool seek, bool skin);
+    void updateIslandWorlds();
+    void stepWorlds(float deltaFrame);
+    void updateFrustumPlanes();
+    void updateAnimationLevels();
     void updateModelViewMatrix();
     void updateProjectionMatrix();
     void updateRotationFromAngle();
@@ -145,7 +268,13 @@ private:
     bool updateFovy(int ellapsedTimeForMove);
 
     ::btDiscreteDynamicsWorld *m_world;
+    ThreadPool *m_pool;
+    SceneOutputBuffer *m_output;
     btAlignedObjectArray<PMDModel *> m_models;
+    btAlignedObjectArray<PMDModel *> m_visibleModels;
+    btAlignedObjectArray<float> m_modelDepths;
+    btAlignedObjectArray<btDiscreteDynamicsWorld *> m_islandWorlds;
+    btAlignedObjectArray<SceneCheckpoint *> m_checkpoints;
     VMDMotion *m_cameraMotion;
     btTransform m_modelview;
     btQuaternion m_currentRotation;
@@ -160,14 +289,26 @@ private:
     btVector3 m_currentDistance;
     btVector3 m_viewMoveDistance;
     float m_projection[16];
+    float m_frustumPlanes[6][4];
     float m_distance;
     float m_currentFovy;
     float m_fovy;
     float m_viewMoveFovy;
     int m_viewMoveTime;
     int m_currentFPS;
+    int m_maxCatchUpSteps;
+    float m_accumulatedTime;
+    float m_currentFrame;
+    float m_checkpointInterval;
+    int m_maxCheckpoints;
+    int m_activeRigidBodies;
+    int m_sleepingRigidBodies;
+    int m_concurrentWorlds;
     int m_width;
     int m_height;
+    bool m_enableFrustumCulling;
+    bool m_enableAnimationLOD;
+    bool m_staleSimulation;
 
     VPVL_DISABLE_COPY_AND_ASSIGN(Scene)
 };
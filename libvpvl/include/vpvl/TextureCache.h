@@ -0,0 +1,217 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+
+#ifndef VPVL_TEXTURECACHE_H_
+#define VPVL_TEXTURECACHE_H_
+
+#include <LinearMath/btAlignedObjectArray.h>
+#include "vpvl/common.h"
+
+namespace vpvl
+{
+
+class ITextureDecoder;
+class ITextureUploader;
+class ThreadPool;
+
+typedef struct TextureCachePrivate TextureCachePrivate;
+
+/**
+ * A decoded texture image of 8bit RGBA pixels from the top left.
+ */
+struct TextureImage
+{
+    int width;
+    int height;
+    btAlignedObjectArray<uint8_t> pixels;
+};
+
+/**
+ * @file
+ * @author hkrn
+ *
+ * @section DESCRIPTION
+ *
+ * TextureCache class decodes the textures of all models and assets on the
+ * worker threads and shares them by the path and the content.
+ *
+ * request returns a handle of the texture at once and the texture is read
+ * and decoded by ITextureDecoder in the thread pool. The same path is read
+ * only once and the same content of the different paths is decoded only
+ * once. upload finishes the decoded textures by ITextureUploader within
+ * the budget of a frame and textureID returns the uploaded texture.
+ *
+ * All functions except the decoder must be called from the rendering thread.
+ */
+
+class VPVL_EXPORT TextureCache
+{
+public:
+    enum TextureType
+    {
+        kTexture,
+        kToonTexture,
+        kTextureTypeMax
+    };
+
+    explicit TextureCache(ITextureDecoder *decoder);
+
+    /**
+     * Wait for the decoding textures and destroy the cache.
+     *
+     * The uploaded textures are not deleted, release all handles before.
+     */
+    ~TextureCache();
+
+    /**
+     * Set the thread pool to decode the textures.
+     *
+     * The textures are decoded in request if the pool is not set.
+     *
+     * @param The thread pool not owned by the cache
+     */
+    void setThreadPool(ThreadPool *pool);
+
+    /**
+     * Request the texture of the path and start decoding it if not requested yet.
+     *
+     * @param The path of the texture
+     * @param The type of the texture
+     * @return A handle of the texture
+     */
+    int request(const char *path, TextureType type);
+
+    /**
+     * Release the handle returned from request.
+     *
+     * @param A handle of the texture
+     * @return The texture to delete if no handle uses it any more, otherwise zero
+     */
+    uint32_t release(int handle);
+
+    /**
+     * Get the texture of the handle.
+     *
+     * @param A handle of the texture
+     * @return The texture, zero if not uploaded yet or failed to read or decode
+     */
+    uint32_t textureID(int handle) const;
+
+    /**
+     * Upload the decoded textures until the size of the uploaded pixels reaches the budget.
+     *
+     * At least a texture is uploaded if decoded regardless of the budget.
+     *
+     * @param The uploader of the textures
+     * @param The budget in bytes
+     * @return The number of the textures resolved by this call
+     */
+    int upload(ITextureUploader *uploader, size_t budget);
+
+    /**
+     * Get the number of the requested textures not uploaded yet.
+     *
+     * @return The number of the pending textures
+     */
+    int countPendingTextures() const;
+
+    /**
+     * Get the number of the textures read and decoded.
+     *
+     * @return The number of the decoded textures
+     */
+    int countDecodedTextures() const;
+
+private:
+    void enqueue(int handle);
+    void drop(int owner);
+
+    TextureCachePrivate *m_private;
+    ITextureDecoder *m_decoder;
+    ThreadPool *m_pool;
+
+    VPVL_DISABLE_COPY_AND_ASSIGN(TextureCache)
+};
+
+class VPVL_EXPORT ITextureDecoder
+{
+public:
+    virtual ~ITextureDecoder() {}
+
+    /**
+     * Read the whole file of the texture on a worker thread.
+     *
+     * This is called concurrently. A decoder may look up the toon texture in
+     * the system directory if not found.
+     *
+     * @param The path of the texture
+     * @param The type of the texture
+     * @param The bytes of the file
+     * @return True if read
+     */
+    virtual bool read(const char *path, TextureCache::TextureType type, btAlignedObjectArray<uint8_t> &bytes) = 0;
+
+    /**
+     * Decode the bytes of the file to RGBA pixels on a worker thread.
+     *
+     * This is called concurrently.
+     *
+     * @param The bytes of the file
+     * @param The decoded image
+     * @return True if decoded
+     */
+    virtual bool decode(const btAlignedObjectArray<uint8_t> &bytes, TextureImage &image) = 0;
+};
+
+class VPVL_EXPORT ITextureUploader
+{
+public:
+    virtual ~ITextureUploader() {}
+
+    /**
+     * Create a texture from the decoded image on the rendering thread.
+     *
+     * @param The decoded image
+     * @param The type of the texture
+     * @return The texture, zero if failed
+     */
+    virtual uint32_t upload(const TextureImage &image, TextureCache::TextureType type) = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#ifndef VPVL_THREADPOOL_H_
+#define VPVL_THREADPOOL_H_
+
+#include "vpvl/common.h"
+
+namespace vpvl
+{
+
+typedef struct ThreadPoolPrivate ThreadPoolPrivate;
+
+class VPVL_EXPORT IThreadPoolTask
+{
+public:
+    virtual ~IThreadPoolTask() {}
+
+    /**
+     * Do the work of the task on a worker thread or the waiting thread.
+     */
+    virtual void run() = 0;
+};
+
+/**
+ * @file
+ * @author hkrn
+ *
+ * @section DESCRIPTION
+ *
+ * ThreadPool class runs tasks on a fixed number of worker threads.
+ *
+ * The thread waiting for its tasks runs queued tasks too, so a task can
+ * run and wait another tasks of the same pool without deadlocks. Tasks
+ * are not owned by the pool.
+ */
+
+class VPVL_EXPORT ThreadPool
+{
+public:
+
+    /**
+     * Create a pool with the worker threads.
+     *
+     * @param Count of worker threads, the count of processors minus one if negative
+     */
+    explicit ThreadPool(int nThreads = -1);
+    ~ThreadPool();
+
+    /**
+     * Get the number of the processors available to this process.
+     *
+     * @return Count of processors at least one
+     */
+    static int countProcessors();
+
+    /**
+     * Run the tasks and wait for all of them to finish.
+     *
+     * The tasks are run in the calling thread if the pool has no workers.
+     *
+     * @param Tasks to run
+     * @param Count of the tasks
+     */
+    void run(IThreadPoolTask *const *tasks, int nTasks);
+
+    /**
+     * Queue the task without waiting for it.
+     *
+     * The task must signal its completion by itself. The queued tasks are
+     * finished before the pool is destroyed.
+     *
+     * @param A task to queue
+     */
+    void enqueue(IThreadPoolTask *task);
+
+    int countThreads() const {
+        return m_nThreads;
+    }
+
+private:
+    ThreadPoolPrivate *m_private;
+    int m_nThreads;
+
+    VPVL_DISABLE_COPY_AND_ASSIGN(ThreadPool)
+};
+
+}
+
+#endif
@@ -49,6 +49,8 @@ class PMDModel;
 namespace vpvl
 {
 
+class ThreadPool;
+
 struct VMDMotionDataInfo
 {
     const uint8_t *basePtr;
@@ -65,6 +67,31 @@ struct VMDMotionDataInfo
     size_t selfShadowKeyFrameCount;
 };
 
+/**
+ * @file
+ * @author hkrn
+ *
+ * @section DESCRIPTION
+ *
+ * IVMDMotionSink class is an interface to receive serialized data of
+ * VMDMotion incrementally.
+ */
+
+class VPVL_EXPORT IVMDMotionSink
+{
+public:
+    virtual ~IVMDMotionSink() {}
+
+    /**
+     * Write a part of the serialized motion.
+     *
+     * @param The serialized data
+     * @param Size of the data
+     * @return false to stop saving
+     */
+    virtual bool write(const uint8_t *data, size_t size) = 0;
+};
+
 /**
  * @file
  * @author Nagoya Institute of Technology Department of Computer Science
@@ -114,8 +141,26 @@ public:
 
     bool preparse(const uint8_t *data, size_t size, VMDMotionDataInfo &info);
     bool load(const uint8_t *data, size_t size);
+
+    /**
+     * Load the key frames of the bones and the faces the model has only.
+     *
+     * @param The buffer to load
+     * @param Size of the buffer
+     * @param A model to filter key frames
+     */
+    bool load(const uint8_t *data, size_t size, const PMDModel *model);
     size_t estimateSize();
     void save(uint8_t *data);
+    bool save(IVMDMotionSink *sink);
+
+    /**
+     * Share the key frames of the loaded motion, which must outlive this.
+     *
+     * @param A loaded motion to share key frames
+     */
+    void share(VMDMotion *motion);
+
     void attachModel(PMDModel *model);
     void seek(float frameIndex);
     void update(float deltaFrame);
@@ -144,9 +189,18 @@ public:
     const VMDMotionDataInfo &result() const {
         return m_result;
     }
+    BoneMotion *mutableBone() {
+        return &m_boneMotion;
+    }
     CameraMotion *mutableCamera() {
         return &m_cameraMotion;
     }
+    FaceMotion *mutableFace() {
+        return &m_faceMotion;
+    }
+    ThreadPool *threadPool() const {
+        return m_pool;
+    }
     float loopAt() const {
         return m_loopAt;
     }
@@ -168,6 +222,21 @@ public:
     void setFull(bool value) {
         m_ignoreStatic = !value;
     }
+
+    /**
+     * Set the priority of the motion before adding it to the model.
+     *
+     * A motion with higher priority is blended over the lower ones.
+     *
+     * @param The priority value
+     */
+    void setPriority(float value) {
+        m_priority = value;
+    }
+
+    void setThreadPool(ThreadPool *value) {
+        m_pool = value;
+    }
     void setEnableSmooth(bool value) {
         m_enableSmooth = value;
     }
@@ -177,8 +246,8 @@ public:
 
 private:
     void parseHeader(const VMDMotionDataInfo &info);
-    void parseBoneFrames(const VMDMotionDataInfo &info);
-    void parseFaceFrames(const VMDMotionDataInfo &info);
+    void parseBoneFrames(const VMDMotionDataInfo &info, const PMDModel *model);
+    void parseFaceFrames(const VMDMotionDataInfo &info, const PMDModel *model);
     void parseCameraFrames(const VMDMotionDataInfo &info);
     void parseLightFrames(const VMDMotionDataInfo &info);
     void parseSelfShadowFrames(const VMDMotionDataInfo &info);
@@ -186,6 +255,7 @@ private:
 
     uint8_t m_name[20];
     PMDModel *m_model;
+    ThreadPool *m_pool;
     VMDMotionDataInfo m_result;
     BoneMotion m_boneMotion;
     CameraMotion m_cameraMotion;
@@ -0,0 +1,95 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#ifndef VPVL_WORLD_H_
+#define VPVL_WORLD_H_
+
+#include "vpvl/common.h"
+
+class btDiscreteDynamicsWorld;
+
+namespace vpvl
+{
+
+typedef struct WorldPrivate WorldPrivate;
+
+/**
+ * @file
+ * @author hkrn
+ *
+ * @section DESCRIPTION
+ *
+ * World class creates and owns a dynamics world configured for the rigid
+ * bodies and the joints of PMD models.
+ *
+ * If built with VPVL_ENABLE_MULTITHREADED_PHYSICS, the narrowphase and
+ * the constraint solver of the world run on the threads of
+ * BulletMultiThreaded. Otherwise the world is the sequential one.
+ */
+
+class VPVL_EXPORT World
+{
+public:
+    static const float kWorldExtent;
+    static const float kGravityFactor;
+
+    /**
+     * Create a world simulating in steps of the FPS.
+     *
+     * @param FPS of the simulation
+     * @param Count of threads, the count of processors if negative and sequential if less than 2
+     */
+    explicit World(int fps, int nThreads = -1);
+    ~World();
+
+    ::btDiscreteDynamicsWorld *mutableWorld() const {
+        return m_world;
+    }
+    int countThreads() const {
+        return m_nThreads;
+    }
+
+private:
+    WorldPrivate *m_private;
+    ::btDiscreteDynamicsWorld *m_world;
+    int m_nThreads;
+
+    VPVL_DISABLE_COPY_AND_ASSIGN(World)
+};
+
+}
+
+#endif
@@ -53,6 +53,28 @@ struct XModelFaceIndex {
     btVector4 value;
 };
 
+/* a vertex of XModelIndexedMesh transformed by the model */
+struct XModelIndexedVertex {
+    float position[3];
+    float normal[3];
+    float textureCoord[2];
+    float color[4];
+};
+
+/* the triangles of a material in XModelIndexedMesh */
+struct XModelIndexRange {
+    uint32_t materialIndex;
+    uint32_t offset;
+    uint32_t count;
+};
+
+/* the deduplicated vertices of XModel and the indices of their triangles grouped by the materials */
+struct XModelIndexedMesh {
+    btAlignedObjectArray<XModelIndexedVertex> vertices;
+    btAlignedObjectArray<uint32_t> indices;
+    btAlignedObjectArray<XModelIndexRange> ranges;
+};
+
 typedef struct XModelUserData XModelUserData;
 typedef btAlignedObjectArray<uint16_t> XModelIndexList;
 
@@ -105,6 +127,16 @@ public:
     bool preparse(const uint8_t *data, size_t size);
     bool load(const uint8_t *data, size_t size);
 
+    /**
+     * Build the mesh of the triangles of the faces sharing the vertices of the same attributes.
+     *
+     * The vertices are transformed by the transform and the scale of the model, and the
+     * triangles of a material are laid out in a range in the order of the materials.
+     *
+     * @param The mesh to build
+     */
+    void buildIndexedMesh(XModelIndexedMesh &mesh) const;
+
     size_t stride(StrideType type) const;
     const void *verticesPointer() const;
     const void *normalsPointer() const;
@@ -56,6 +56,7 @@ namespace vpvl
 
 class PMDModel;
 class Scene;
+class TextureCache;
 class XModel;
 
 namespace gl
@@ -69,6 +70,22 @@ public:
     virtual const std::string toUnicode(const uint8_t *value) = 0;
 };
 
+class VPVL_EXPORT ICaptureDelegate
+{
+public:
+    virtual ~ICaptureDelegate() {}
+
+    /**
+     * Receive a frame rendered offscreen, the pixels are valid only in this call.
+     *
+     * @param The index of the frame from zero since beginCapture
+     * @param The RGBA pixels of the frame from the bottom left
+     * @param The width of the frame
+     * @param The height of the frame
+     */
+    virtual void captureFrame(int index, const uint8_t *pixels, int width, int height) = 0;
+};
+
 /**
  * @file
  * @author Nagoya Institute of Technology Department of Computer Science
@@ -102,7 +119,68 @@ public:
     void toggleDisplayBones() {
         m_displayBones = !m_displayBones;
     }
+    bool enableShaderSkinning() const {
+        return m_enableShaderSkinning;
+    }
+    bool isShaderSkinningAvailable() const {
+        return m_skinningProgram != 0;
+    }
+    bool enableDrawBatching() const {
+        return m_enableDrawBatching;
+    }
+    vpvl::TextureCache *textureCache() const {
+        return m_textureCache;
+    }
+    size_t textureUploadBudget() const {
+        return m_textureUploadBudget;
+    }
+    bool isCapturing() const {
+        return m_captureFramebuffer != 0;
+    }
+    int countDrawCalls() const {
+        return m_nDrawCalls;
+    }
+    int countStateChanges() const {
+        return m_nStateChanges;
+    }
 
+    /**
+     * Enable or disable keeping the draw states of the previous model while drawing the models.
+     *
+     * @param Share the draw states if true
+     */
+    void setEnableDrawBatching(bool value) {
+        m_enableDrawBatching = value;
+    }
+
+    /**
+     * Enable or disable skinning the models in a vertex shader if available.
+     *
+     * @param Enable skinning in the shader if true
+     */
+    void setEnableShaderSkinning(bool value);
+
+    /**
+     * Set the cache to decode the textures of the models and the assets loaded after this.
+     *
+     * @param The texture cache not owned by the renderer
+     */
+    void setTextureCache(vpvl::TextureCache *value) {
+        m_textureCache = value;
+    }
+    void setTextureUploadBudget(size_t value) {
+        m_textureUploadBudget = value;
+    }
+
+    /**
+     * Render into an offscreen framebuffer and deliver the frames read asynchronously.
+     *
+     * @param The delegate receiving the frames not owned by the renderer
+     * @param Count of the pixel buffers, at least two
+     * @return true if the framebuffer is created
+     */
+    bool beginCapture(ICaptureDelegate *delegate, int nBuffers = 2);
+    void endCapture();
     void initializeSurface();
     void resize(int width, int height);
     void pickBones(int px, int py, float approx, vpvl::BoneList &pickBones);
@@ -110,6 +188,13 @@ public:
     void setLighting();
     void loadModel(vpvl::PMDModel *model, const std::string &dir);
     void unloadModel(const vpvl::PMDModel *model);
+
+    /**
+     * Stream the skinned vertices of the model to draw it in this frame.
+     *
+     * @param The model to upload
+     */
+    void uploadModel(const vpvl::PMDModel *model);
     void drawModel(const vpvl::PMDModel *model);
     void drawModelEdge(const vpvl::PMDModel *model);
     void drawModelShadow(const vpvl::PMDModel *model);
@@ -120,13 +205,32 @@ public:
     void drawSurface();
 
 private:
+    bool createCaptureBuffers(int nBuffers);
+    void deleteCaptureBuffers();
+    void readCapturedFrame();
+    void deliverCapturedFrame();
+
     vpvl::Scene *m_scene;
     vpvl::PMDModel *m_selected;
     vpvl::gl::IDelegate *m_delegate;
+    vpvl::TextureCache *m_textureCache;
+    vpvl::gl::ICaptureDelegate *m_captureDelegate;
     btAlignedObjectArray<vpvl::XModel *> m_assets;
+    GLuint m_skinningProgram;
+    GLuint m_captureFramebuffer;
+    GLuint m_captureColorBuffer;
+    GLuint m_captureDepthBuffer;
+    btAlignedObjectArray<GLuint> m_capturePixelBuffers;
+    bool m_enableShaderSkinning;
+    bool m_enableDrawBatching;
     bool m_displayBones;
     int m_width;
     int m_height;
+    size_t m_textureUploadBudget;
+    int m_nDrawCalls;
+    int m_nStateChanges;
+    int m_nCapturedFrames;
+    int m_nReadingFrames;
 
     VPVL_DISABLE_COPY_AND_ASSIGN(Renderer)
 };
@@ -192,6 +192,41 @@ inline void zerofill(void *ptr, size_t size)
 #endif
 }
 
+template<typename T>
+inline void insertAt(btAlignedObjectArray<T> &a, int index, const T &value)
+{
+    assert(index >= 0 && index <= a.size());
+    a.push_back(value);
+    for (int i = a.size() - 1; i > index; i--)
+        a[i] = a[i - 1];
+    a[index] = value;
+}
+
+template<typename T>
+inline void removeAt(btAlignedObjectArray<T> &a, int index)
+{
+    assert(index >= 0 && index < a.size());
+    const int size = a.size() - 1;
+    for (int i = index; i < size; i++)
+        a[i] = a[i + 1];
+    a.pop_back();
+}
+
+template<typename T>
+inline int findKeyFrameIndex(const btAlignedObjectArray<T*> &a, float frameIndex)
+{
+    // Returns the first index of the key frame placed at or after the frame index
+    int low = 0, high = a.size();
+    while (low < high) {
+        const int middle = low + ((high - low) >> 1);
+        if (a[middle]->frameIndex() < frameIndex)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
 template<typename T>
 inline void clearAll(btAlignedObjectArray<T*> &a)
 {
@@ -50,12 +50,17 @@
 #include "vpvl/FaceMotion.h"
 #include "vpvl/IK.h"
 #include "vpvl/Material.h"
+#include "vpvl/MotionReducer.h"
 #include "vpvl/PMDModel.h"
+#include "vpvl/PoseBuffer.h"
 #include "vpvl/RigidBody.h"
 #include "vpvl/Scene.h"
+#include "vpvl/TextureCache.h"
+#include "vpvl/ThreadPool.h"
 #include "vpvl/Vertex.h"
 #include "vpvl/VMDMotion.h"
 #include "vpvl/VPDPose.h"
+#include "vpvl/World.h"
 #include "vpvl/XModel.h"
 
 #endif /* vpvl_vpvl_H_ */
@@ -161,7 +161,14 @@ static Uint32 UpdateTimer(Uint32 internal, void *data)
     vpvl::Scene *scene = renderer->scene();
     scene->updateModelView(0);
     scene->updateProjection(0);
-    scene->update(0.5);
+    // advance in the fixed steps by the time elapsed since the last call
+    static Uint32 lastTicks = SDL_GetTicks();
+    const Uint32 ticks = SDL_GetTicks();
+    const int nSteps = scene->advance((ticks - lastTicks) / 1000.0f);
+    lastTicks = ticks;
+    // hand the result to the main thread drawing the previous one
+    if (nSteps > 0)
+        scene->publishOutput();
     return internal;
 }
 
@@ -170,9 +177,7 @@ class UI
 public:
     UI(int argc, char **argv)
         : m_surface(0),
-          m_world(0),
-          m_dispatcher(&m_config),
-          m_broadphase(btVector3(-400.0f, -400.0f, -400.0f), btVector3(400.0f, 400.0f, 400.0f), 1024),
+          m_world(internal::kFPS),
           m_delegate(internal::kSystemDir),
           m_renderer(&m_delegate, internal::kWidth, internal::kHeight, internal::kFPS),
           m_model(0),
@@ -183,9 +188,6 @@ public:
           m_argc(argc),
           m_argv(argv)
     {
-        m_world = new btDiscreteDynamicsWorld(&m_dispatcher, &m_broadphase, &m_solver, &m_config);
-        m_world->setGravity(btVector3(0.0f, -9.8f * 2.0f, 0.0f));
-        m_world->getSolverInfo().m_numIterations = static_cast<int>(10.0f * 60.0f / internal::kFPS);
     }
     ~UI() {
         m_renderer.unloadModel(m_model);
@@ -193,7 +195,6 @@ public:
         // m_renderer.unloadAsset(&m_stage);
 #endif
         delete m_model;
-        delete m_world;
         delete[] m_modelData;
         delete[] m_motionData;
         delete[] m_cameraData;
@@ -244,6 +245,7 @@ public:
 
 protected:
     virtual void draw() {
+        m_renderer.scene()->acquireOutput();
         m_renderer.initializeSurface();
         m_renderer.drawSurface();
     }
@@ -314,7 +316,10 @@ private:
         }
         //scene.setCamera(btVector3(0.0f, 50.0f, 0.0f), btVector3(0.0f, 0.0f, 0.0f), 60.0f, 50.0f);
         scene->setCameraMotion(&m_camera);
-        scene->setWorld(m_world);
+        scene->setWorld(m_world.mutableWorld());
+        // the timer thread updates the scene while the main thread draws it
+        scene->setEnableBufferedOutput(true);
+        scene->setEnableFrustumCulling(true);
 
         return true;
     }
@@ -338,11 +343,7 @@ private:
     }
 
     SDL_Surface *m_surface;
-    btDiscreteDynamicsWorld *m_world;
-    btDefaultCollisionConfiguration m_config;
-    btCollisionDispatcher m_dispatcher;
-    btAxisSweep3 m_broadphase;
-    btSequentialImpulseConstraintSolver m_solver;
+    vpvl::World m_world;
     internal::Delegate m_delegate;
     vpvl::gl::Renderer m_renderer;
     vpvl::PMDModel *m_model; /* for destruction order problem with btDiscreteDynamicsWorld */
@@ -62,16 +62,18 @@ BoneKeyFrame::BoneKeyFrame()
     internal::zerofill(m_name, sizeof(m_name));
     internal::zerofill(m_linear, sizeof(m_linear));
     internal::zerofill(m_interpolationTable, sizeof(m_interpolationTable));
+    internal::zerofill(m_rawInterpolationTable, sizeof(m_rawInterpolationTable));
 }
 
 BoneKeyFrame::~BoneKeyFrame() {
     m_position.setZero();
     m_rotation.setValue(0.0f, 0.0f, 0.0f, 1.0f);
-    for (int i = 0; i < 4; i++)
+    for (int i = 0; i < kMax; i++)
         delete[] m_interpolationTable[i];
     internal::zerofill(m_name, sizeof(m_name));
     internal::zerofill(m_linear, sizeof(m_linear));
     internal::zerofill(m_interpolationTable, sizeof(m_interpolationTable));
+    internal::zerofill(m_rawInterpolationTable, sizeof(m_rawInterpolationTable));
 }
 
 size_t BoneKeyFrame::stride() {
@@ -115,26 +117,67 @@ void BoneKeyFrame::write(uint8_t *data)
     chunk.position[2] = m_position.z();
 #endif
     internal::copyBytes(reinterpret_cast<uint8_t *>(chunk.interpolationTable),
-                        reinterpret_cast<uint8_t *>(m_interpolationTable),
+                        reinterpret_cast<const uint8_t *>(m_rawInterpolationTable),
                         sizeof(chunk.interpolationTable));
     internal::copyBytes(data, reinterpret_cast<const uint8_t *>(&chunk), sizeof(chunk));
 }
 
-void BoneKeyFrame::setInterpolationTable(const int8_t *table) {
-    for (int i = 0; i < 4; i++)
-        m_linear[i] = (table[0 + i] == table[4 + i] && table[8 + i] == table[12 + i]) ? true : false;
-    for (int i = 0; i < 4; i++) {
-        if (m_linear[i]) {
-            m_interpolationTable[i] = 0;
-            continue;
-        }
-        m_interpolationTable[i] = new float[kTableSize + 1];
-        float x1 = table[i]      / 127.0f;
-        float y1 = table[i +  4] / 127.0f;
-        float x2 = table[i +  8] / 127.0f;
-        float y2 = table[i + 12] / 127.0f;
-        internal::buildInterpolationTable(x1, x2, y1, y2, kTableSize, m_interpolationTable[i]);
+void BoneKeyFrame::setDefaultInterpolationParameter()
+{
+    for (int i = 0; i < kMax; i++)
+        setInterpolationParameter(static_cast<InterpolationType>(i), 20, 20, 107, 107);
+}
+
+void BoneKeyFrame::getInterpolationParameter(InterpolationType type, int8_t &x1, int8_t &y1, int8_t &x2, int8_t &y2) const
+{
+    int at = static_cast<int>(type);
+    x1 = m_rawInterpolationTable[at];
+    y1 = m_rawInterpolationTable[at +  4];
+    x2 = m_rawInterpolationTable[at +  8];
+    y2 = m_rawInterpolationTable[at + 12];
+}
+
+void BoneKeyFrame::setInterpolationParameter(InterpolationType type, int8_t x1, int8_t y1, int8_t x2, int8_t y2)
+{
+    int at = static_cast<int>(type);
+    int8_t *table = m_rawInterpolationTable;
+    table[at] = x1;
+    table[at +  4] = y1;
+    table[at +  8] = x2;
+    table[at + 12] = y2;
+    // MMD stores the first row and three rows shifted by one byte each
+    static const int8_t kRowTail[] = { 1, 0, 0 };
+    for (int row = 1; row < 4; row++) {
+        int8_t *dest = table + row * 16;
+        for (int i = 0; i < 16 - row; i++)
+            dest[i] = table[row + i];
+        for (int i = 0; i < row; i++)
+            dest[16 - row + i] = kRowTail[i];
     }
+    setInterpolationTableAt(at);
+}
+
+void BoneKeyFrame::setInterpolationTable(const int8_t *table) {
+    internal::copyBytes(reinterpret_cast<uint8_t *>(m_rawInterpolationTable),
+                        reinterpret_cast<const uint8_t *>(table),
+                        sizeof(m_rawInterpolationTable));
+    for (int i = 0; i < kMax; i++)
+        setInterpolationTableAt(i);
+}
+
+void BoneKeyFrame::setInterpolationTableAt(int at) {
+    const int8_t *table = m_rawInterpolationTable;
+    delete[] m_interpolationTable[at];
+    m_interpolationTable[at] = 0;
+    m_linear[at] = (table[0 + at] == table[4 + at] && table[8 + at] == table[12 + at]) ? true : false;
+    if (m_linear[at])
+        return;
+    m_interpolationTable[at] = new float[kTableSize + 1];
+    float x1 = table[at]      / 127.0f;
+    float y1 = table[at +  4] / 127.0f;
+    float x2 = table[at +  8] / 127.0f;
+    float y2 = table[at + 12] / 127.0f;
+    internal::buildInterpolationTable(x1, x2, y1, y2, kTableSize, m_interpolationTable[at]);
 }
 
 }
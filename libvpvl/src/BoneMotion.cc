@@ -38,21 +38,154 @@
 
 #include "vpvl/vpvl.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define VPVL_BONEMOTION_USE_SSE
+#include <xmmintrin.h>
+#endif
+
 namespace vpvl
 {
 
 const float BoneMotion::kStartingMarginFrame = 20.0f;
 
+/* count of key frames decoded by a task, large enough to hide the cost of dispatching */
+static const int kDecodeChunkSize = 4096;
+
+struct BoneMotionTrack {
+    BoneKeyFrameList keyFrames;
+};
+
+/* the curve from the previous key frame is changed by editing the key frame at the index */
+static float BoneMotionPreviousFrameIndex(const BoneKeyFrameList &kframes, int index)
+{
+    return index > 0 ? kframes[index - 1]->frameIndex() : 0.0f;
+}
+
+/* the index of the key frame of the track at the frame or -1 if not found */
+static int BoneMotionFindKeyFrame(const BoneMotionTrack *const *ptr, float frameIndex)
+{
+    if (!ptr)
+        return -1;
+    const BoneKeyFrameList &kframes = (*ptr)->keyFrames;
+    const int index = internal::findKeyFrameIndex(kframes, frameIndex);
+    return index < kframes.size() && kframes[index]->frameIndex() == frameIndex ? index : -1;
+}
+
 struct BoneMotionInternal {
     Bone *bone;
-    BoneKeyFrameList keyFrames;
+    const BoneKeyFrameList *keyFrames;
     btVector3 position;
     btVector3 snapPosition;
     btQuaternion rotation;
     btQuaternion snapRotation;
+    float mask;
     uint32_t lastIndex;
 };
 
+/*
+ * Polynomial approximations used by the batch evaluation instead of libm calls that
+ * prevent vectorization. acos is from Abramowitz and Stegun 4.4.46 (error 2e-8) and
+ * sin is the Taylor series folded into [0, pi / 2] (error 1e-9), it keeps the relative
+ * precision of small angles between close key frames.
+ */
+static inline float BoneMotionAcos(float x)
+{
+    const float a = x < 0.0f ? 0.0f - x : x;
+    const float p = 1.5707963050f + a * (-0.2145988016f + a * (0.0889789874f + a * (-0.0501743046f
+                    + a * (0.0308918810f + a * (-0.0170881256f + a * (0.0066700901f + a * -0.0012624911f))))));
+    const float r = btSqrt(1.0f - a) * p;
+    return x < 0.0f ? kPI - r : r;
+}
+
+static inline float BoneMotionSin(float x)
+{
+    const float y = x > kPI * 0.5f ? kPI - x : x, y2 = y * y;
+    return y * (1.0f + y2 * (-1.0f / 6.0f + y2 * (1.0f / 120.0f + y2 * (-1.0f / 5040.0f + y2 * (1.0f / 362880.0f
+                + y2 * (-1.0f / 39916800.0f + y2 * (1.0f / 6227020800.0f)))))));
+}
+
+#ifdef VPVL_BONEMOTION_USE_SSE
+/* same operations as above in the same order, so the results are the same */
+static inline __m128 BoneMotionSelect(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 BoneMotionPolynomial(__m128 x, const float *coefficients, int size)
+{
+    __m128 p = _mm_set1_ps(coefficients[size - 1]);
+    for (int i = size - 2; i >= 0; i--)
+        p = _mm_add_ps(_mm_set1_ps(coefficients[i]), _mm_mul_ps(x, p));
+    return p;
+}
+
+static inline __m128 BoneMotionAcos(__m128 x)
+{
+    static const float kCoefficients[] = {
+        1.5707963050f, -0.2145988016f, 0.0889789874f, -0.0501743046f,
+        0.0308918810f, -0.0170881256f, 0.0066700901f, -0.0012624911f
+    };
+    const __m128 zero = _mm_setzero_ps(), negative = _mm_cmplt_ps(x, zero);
+    const __m128 a = BoneMotionSelect(negative, _mm_sub_ps(zero, x), x);
+    const __m128 p = BoneMotionPolynomial(a, kCoefficients, 8);
+    const __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), p);
+    return BoneMotionSelect(negative, _mm_sub_ps(_mm_set1_ps(kPI), r), r);
+}
+
+static inline __m128 BoneMotionSin(__m128 x)
+{
+    static const float kCoefficients[] = {
+        1.0f, -1.0f / 6.0f, 1.0f / 120.0f, -1.0f / 5040.0f, 1.0f / 362880.0f, -1.0f / 39916800.0f, 1.0f / 6227020800.0f
+    };
+    const __m128 pi = _mm_set1_ps(kPI);
+    const __m128 y = BoneMotionSelect(_mm_cmpgt_ps(x, _mm_set1_ps(kPI * 0.5f)), _mm_sub_ps(pi, x), x);
+    return _mm_mul_ps(y, BoneMotionPolynomial(_mm_mul_ps(y, y), kCoefficients, 7));
+}
+#endif
+
+/* key frame pairs of the tracks being interpolated in structure of arrays */
+struct BoneMotionBatch {
+    enum Channel {
+        kPositionX,
+        kPositionY,
+        kPositionZ,
+        kRotationX,
+        kRotationY,
+        kRotationZ,
+        kRotationW,
+        kNValues,
+        kWeightX = kNValues * 3,
+        kWeightY,
+        kWeightZ,
+        kWeightRotation,
+        kNChannels
+    };
+
+    void reserve(int size) {
+        if (capacity < size) {
+            capacity = size;
+            values.resize(capacity * kNChannels);
+        }
+        nodes.resize(0);
+    }
+    float *from(int at) {
+        return &values[at * capacity];
+    }
+    float *to(int at) {
+        return &values[(kNValues + at) * capacity];
+    }
+    float *result(int at) {
+        return &values[(kNValues * 2 + at) * capacity];
+    }
+    float *weight(int at) {
+        return &values[(kWeightX + at) * capacity];
+    }
+
+    btAlignedObjectArray<BoneMotionInternal *> nodes;
+    btAlignedObjectArray<float> values;
+    int capacity;
+};
+
 class BoneMotionKeyFramePredication
 {
 public:
@@ -61,6 +194,40 @@ public:
     }
 };
 
+class BoneMotionDecodeTask : public IThreadPoolTask
+{
+public:
+    BoneMotionDecodeTask()
+        : m_frames(0),
+          m_records(0),
+          m_size(0)
+    {
+    }
+    ~BoneMotionDecodeTask() {
+        m_frames = 0;
+        m_records = 0;
+        m_size = 0;
+    }
+
+    void set(BoneKeyFrame **frames, const uint8_t *const *records, int size) {
+        m_frames = frames;
+        m_records = records;
+        m_size = size;
+    }
+    void run() {
+        for (int i = 0; i < m_size; i++) {
+            BoneKeyFrame *frame = new BoneKeyFrame();
+            frame->read(m_records[i]);
+            m_frames[i] = frame;
+        }
+    }
+
+private:
+    BoneKeyFrame **m_frames;
+    const uint8_t *const *m_records;
+    int m_size;
+};
+
 float BoneMotion::weightValue(const BoneKeyFrame *keyFrame, float w, uint32_t at)
 {
     const uint16_t index = static_cast<int16_t>(w * BoneKeyFrame::kTableSize);
@@ -88,47 +255,128 @@ void BoneMotion::lerpVector3(const BoneKeyFrame *keyFrame,
 
 BoneMotion::BoneMotion()
     : BaseMotion(kStartingMarginFrame),
+      m_source(0),
+      m_pose(0),
       m_model(0),
-      m_hasCenterBoneMotion(false)
+      m_batch(0),
+      m_nSkippedKeyFrames(0),
+      m_revision(0),
+      m_boundRevision(0),
+      m_editedFrame(0.0f),
+      m_hasCenterBoneMotion(false),
+      m_dirty(false),
+      m_enableBatchEvaluation(true)
 {
+    m_batch = new BoneMotionBatch();
+    m_batch->capacity = 0;
 }
 
 BoneMotion::~BoneMotion()
 {
     internal::clearAll(m_frames);
+    internal::clearAll(m_name2track);
     internal::clearAll(m_name2node);
+    m_name2mask.clear();
+    delete m_batch;
+    m_batch = 0;
+    m_source = 0;
+    m_pose = 0;
     m_model = 0;
+    m_nSkippedKeyFrames = 0;
+    m_revision = 0;
+    m_boundRevision = 0;
+    m_editedFrame = 0.0f;
     m_hasCenterBoneMotion = false;
+    m_dirty = false;
 }
 
 void BoneMotion::read(const uint8_t *data, uint32_t size)
 {
+    read(data, size, 0);
+}
+
+void BoneMotion::read(const uint8_t *data, uint32_t size, const PMDModel *model)
+{
+    read(data, size, model, 0);
+}
+
+void BoneMotion::read(const uint8_t *data, uint32_t size, const PMDModel *model, ThreadPool *pool)
+{
+    uint8_t name[BoneKeyFrame::kNameSize];
+    btAlignedObjectArray<const uint8_t *> records;
+    m_dirty = true;
+    markEdited(0.0f);
     uint8_t *ptr = const_cast<uint8_t *>(data);
-    m_frames.reserve(size);
+    if (!model)
+        m_frames.reserve(size);
+    if (pool)
+        records.reserve(size);
     for (uint32_t i = 0; i < size; i++) {
-        BoneKeyFrame *frame = new BoneKeyFrame();
-        frame->read(ptr);
+        // The name is placed at the head of the chunk
+        if (model) {
+            copyBytesSafe(name, ptr, sizeof(name));
+            if (!model->findBone(name)) {
+                ptr += BoneKeyFrame::stride();
+                m_nSkippedKeyFrames++;
+                continue;
+            }
+        }
+        if (pool) {
+            records.push_back(ptr);
+        }
+        else {
+            BoneKeyFrame *frame = new BoneKeyFrame();
+            frame->read(ptr);
+            m_frames.push_back(frame);
+        }
         ptr += BoneKeyFrame::stride();
-        m_frames.push_back(frame);
+    }
+
+    const int nRecords = records.size();
+    if (nRecords > 0) {
+        // Building interpolation tables dominates, so chunks are decoded into the preallocated slots
+        const int offset = m_frames.size();
+        const int nTasks = (nRecords + kDecodeChunkSize - 1) / kDecodeChunkSize;
+        BoneMotionDecodeTask *tasks = new BoneMotionDecodeTask[nTasks];
+        IThreadPoolTask **taskPtrs = new IThreadPoolTask *[nTasks];
+        m_frames.resize(offset + nRecords, 0);
+        for (int i = 0; i < nTasks; i++) {
+            const int from = i * kDecodeChunkSize;
+            const int count = btMin(kDecodeChunkSize, nRecords - from);
+            tasks[i].set(&m_frames[offset + from], &records[from], count);
+            taskPtrs[i] = &tasks[i];
+        }
+        pool->run(taskPtrs, nTasks);
+        delete[] taskPtrs;
+        delete[] tasks;
     }
 }
 
 void BoneMotion::seek(float frameAt)
 {
+    refreshTracks();
     const uint32_t nNodes = m_name2node.size();
+    if (m_enableBatchEvaluation)
+        calculateFramesInBatch(frameAt);
     for (uint32_t i = 0; i < nNodes; i++) {
         BoneMotionInternal *node = *m_name2node.getAtIndex(i);
-        if (m_ignoreSingleMotion && node->keyFrames.size() <= 1)
+        const int nFrames = node->keyFrames->size();
+        if (nFrames == 0 || (m_ignoreSingleMotion && nFrames <= 1))
             continue;
-        calculateFrames(frameAt, node);
+        if (!m_enableBatchEvaluation)
+            calculateFrames(frameAt, node);
         Bone *bone = node->bone;
-        if (m_blendRate == 1.0f) {
+        if (m_pose) {
+            m_pose->blend(bone, node->position, node->rotation, m_blendRate * node->mask);
+        }
+        else if (m_blendRate == 1.0f && node->mask == 1.0f) {
             bone->setPosition(node->position);
             bone->setRotation(node->rotation);
         }
         else {
-            bone->setPosition(bone->position().lerp(node->position, m_blendRate));
-            bone->setRotation(bone->rotation().slerp(node->rotation, m_blendRate));
+            const float weight = m_blendRate * node->mask;
+            bone->setPosition(bone->position().lerp(node->position, weight));
+            bone->setRotation(bone->rotation().slerp(node->rotation, weight));
         }
     }
 }
@@ -151,56 +399,289 @@ void BoneMotion::attachModel(PMDModel *model)
     if (m_model)
         return;
 
+    BoneMotion *motion = m_source ? m_source : this;
+    motion->buildTracks();
+    const btHashMap<btHashString, BoneMotionTrack *> &tracks = motion->m_name2track;
+    const uint32_t nTracks = tracks.size();
+    for (uint32_t i = 0; i < nTracks; i++) {
+        const BoneKeyFrameList &frames = (*tracks.getAtIndex(i))->keyFrames;
+        if (frames.size() > 0)
+            attachTrack(frames, model);
+    }
+
+    m_model = model;
+    m_boundRevision = motion->m_revision;
+}
+
+void BoneMotion::attachTrack(const BoneKeyFrameList &frames, PMDModel *model)
+{
+    const uint8_t *name = frames[0]->name();
+    Bone *bone = model->findBone(name);
+    if (bone) {
+        const uint8_t *centerBoneName = Bone::centerBoneName();
+        const size_t len = strlen(reinterpret_cast<const char *>(centerBoneName));
+        BoneMotionInternal *node = new BoneMotionInternal();
+        node->keyFrames = &frames;
+        node->bone = bone;
+        node->lastIndex = 0;
+        node->position.setZero();
+        node->rotation.setValue(0.0f, 0.0f, 0.0f, 1.0f);
+        node->snapPosition.setZero();
+        node->snapRotation.setValue(0.0f, 0.0f, 0.0f, 1.0f);
+        const btHashString key(reinterpret_cast<const char *>(name));
+        const float *mask = m_name2mask.find(key);
+        node->mask = mask ? *mask : 1.0f;
+        m_name2node.insert(key, node);
+        btSetMax(m_maxFrame, frames[frames.size() - 1]->frameIndex());
+        if (internal::stringEquals(name, centerBoneName, len))
+            m_hasCenterBoneMotion = true;
+    }
+}
+
+bool BoneMotion::addKeyFrame(BoneKeyFrame *frame)
+{
+    if (m_source || !frame)
+        return false;
+
+    buildTracks();
+    const btHashString key(reinterpret_cast<const char *>(frame->name()));
+    BoneMotionTrack **ptr = m_name2track.find(key), *track;
+    if (ptr) {
+        track = *ptr;
+    }
+    else {
+        track = new BoneMotionTrack();
+        m_name2track.insert(key, track);
+    }
+
+    BoneKeyFrameList &kframes = track->keyFrames;
+    const float frameIndex = frame->frameIndex();
+    const int index = internal::findKeyFrameIndex(kframes, frameIndex);
+    if (index < kframes.size() && kframes[index]->frameIndex() == frameIndex)
+        return false;
+    internal::insertAt(kframes, index, frame);
+    m_frames.push_back(frame);
+    markEdited(BoneMotionPreviousFrameIndex(kframes, index));
+
+    if (m_model) {
+        if (!m_name2node.find(key))
+            attachTrack(kframes, m_model);
+        else
+            btSetMax(m_maxFrame, frameIndex);
+    }
+    return true;
+}
+
+bool BoneMotion::removeKeyFrame(const uint8_t *name, float frameIndex)
+{
+    if (m_source)
+        return false;
+
+    buildTracks();
+    BoneMotionTrack **ptr = m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    if (!ptr)
+        return false;
+
+    // The empty track is kept because the nodes of the shared motions refer it
+    BoneKeyFrameList &kframes = (*ptr)->keyFrames;
+    const int index = internal::findKeyFrameIndex(kframes, frameIndex);
+    if (index >= kframes.size() || kframes[index]->frameIndex() != frameIndex)
+        return false;
+    markEdited(BoneMotionPreviousFrameIndex(kframes, index));
+    m_frames.remove(kframes[index]);
+    delete kframes[index];
+    internal::removeAt(kframes, index);
+
+    if (m_model && frameIndex >= m_maxFrame)
+        updateMaxFrame();
+    return true;
+}
+
+bool BoneMotion::moveKeyFrame(const uint8_t *name, float from, float to)
+{
+    if (m_source)
+        return false;
+
+    buildTracks();
+    BoneMotionTrack **ptr = m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    if (!ptr)
+        return false;
+
+    BoneKeyFrameList &kframes = (*ptr)->keyFrames;
+    const int index = internal::findKeyFrameIndex(kframes, from);
+    if (index >= kframes.size() || kframes[index]->frameIndex() != from)
+        return false;
+    const int destination = internal::findKeyFrameIndex(kframes, to);
+    if (destination < kframes.size() && kframes[destination]->frameIndex() == to)
+        return false;
+
+    BoneKeyFrame *frame = kframes[index];
+    const float previous = BoneMotionPreviousFrameIndex(kframes, index);
+    internal::removeAt(kframes, index);
+    frame->setFrameIndex(to);
+    const int inserted = internal::findKeyFrameIndex(kframes, to);
+    internal::insertAt(kframes, inserted, frame);
+    markEdited(btMin(previous, BoneMotionPreviousFrameIndex(kframes, inserted)));
+
+    if (m_model) {
+        if (to > m_maxFrame)
+            m_maxFrame = to;
+        else if (from >= m_maxFrame)
+            updateMaxFrame();
+    }
+    return true;
+}
+
+const BoneKeyFrame *BoneMotion::findKeyFrame(const uint8_t *name, float frameIndex) const
+{
+    const BoneMotion *motion = m_source ? m_source : this;
+    // The key frames edited by mutableFrames are searched as they are not grouped until the next edit or seek
+    if (motion->m_dirty) {
+        const BoneKeyFrameList &frames = motion->m_frames;
+        const int nFrames = frames.size();
+        for (int i = 0; i < nFrames; i++) {
+            const BoneKeyFrame *frame = frames[i];
+            if (frame->frameIndex() == frameIndex && internal::stringEquals(frame->name(), name, BoneKeyFrame::kNameSize))
+                return frame;
+        }
+        return 0;
+    }
+    const BoneMotionTrack *const *ptr = motion->m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    const int index = BoneMotionFindKeyFrame(ptr, frameIndex);
+    return index >= 0 ? (*ptr)->keyFrames[index] : 0;
+}
+
+BoneKeyFrame *BoneMotion::mutableKeyFrame(const uint8_t *name, float frameIndex)
+{
+    if (m_source)
+        return 0;
+
+    buildTracks();
+    BoneMotionTrack **ptr = m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    const int index = BoneMotionFindKeyFrame(ptr, frameIndex);
+    if (index < 0)
+        return 0;
+    // The returned key frame may be modified in place
+    const BoneKeyFrameList &kframes = (*ptr)->keyFrames;
+    markEdited(BoneMotionPreviousFrameIndex(kframes, index));
+    return kframes[index];
+}
+
+BoneKeyFrameList *BoneMotion::mutableFrames()
+{
+    m_dirty = true;
+    markEdited(0.0f);
+    return &m_frames;
+}
+
+void BoneMotion::share(BoneMotion *motion)
+{
+    if (m_model)
+        return;
+    internal::clearAll(m_frames);
+    internal::clearAll(m_name2track);
+    m_source = motion->m_source ? motion->m_source : motion;
+}
+
+void BoneMotion::setBoneMask(const uint8_t *name, float weight)
+{
+    const btHashString key(reinterpret_cast<const char *>(name));
+    m_name2mask.insert(key, weight);
+    BoneMotionInternal **node = m_name2node.find(key);
+    if (node)
+        (*node)->mask = weight;
+}
+
+void BoneMotion::buildTracks()
+{
+    if (!m_dirty)
+        return;
+
+    // Group the key frames by the bone name and sort them once, tracks are shared by all attached models
+    // The tracks are refilled in place because the nodes of the attached models and the shared motions refer them
+    const uint32_t nOldTracks = m_name2track.size();
+    for (uint32_t i = 0; i < nOldTracks; i++)
+        (*m_name2track.getAtIndex(i))->keyFrames.clear();
     const uint32_t nFrames = m_frames.size();
-    const uint8_t *centerBoneName = Bone::centerBoneName();
-    const size_t len = strlen(reinterpret_cast<const char *>(centerBoneName));
     for (uint32_t i = 0; i < nFrames; i++) {
         BoneKeyFrame *frame = m_frames.at(i);
         btHashString name(reinterpret_cast<const char *>(frame->name()));
-        BoneMotionInternal **ptr = m_name2node.find(name), *node;
+        BoneMotionTrack **ptr = m_name2track.find(name), *track;
         if (ptr) {
-            node = *ptr;
-            node->keyFrames.push_back(frame);
-            if (internal::stringEquals(frame->name(), centerBoneName, len))
-                m_hasCenterBoneMotion = true;
+            track = *ptr;
         }
         else {
-            Bone *bone = model->findBone(frame->name());
-            if (bone) {
-                node = new BoneMotionInternal();
-                node->keyFrames.push_back(frame);
-                node->bone = bone;
-                node->lastIndex = 0;
-                node->position.setZero();
-                node->rotation.setValue(0.0f, 0.0f, 0.0f, 1.0f);
-                node->snapPosition.setZero();
-                node->snapRotation.setValue(0.0f, 0.0f, 0.0f, 1.0f);
-                m_name2node.insert(name, node);
-            }
+            track = new BoneMotionTrack();
+            m_name2track.insert(name, track);
         }
+        track->keyFrames.push_back(frame);
     }
 
+    const uint32_t nTracks = m_name2track.size();
+    for (uint32_t i = 0; i < nTracks; i++) {
+        BoneMotionTrack *track = *m_name2track.getAtIndex(i);
+        track->keyFrames.quickSort(BoneMotionKeyFramePredication());
+    }
+
+    m_dirty = false;
+}
+
+void BoneMotion::refreshTracks()
+{
+    // The key frames edited by mutableFrames are grouped again before evaluating them,
+    // the tracks are refilled in place so only the tracks of the new bones are bound
+    BoneMotion *motion = m_source ? m_source : this;
+    motion->buildTracks();
+    if (!m_model || m_boundRevision == motion->m_revision)
+        return;
+    const btHashMap<btHashString, BoneMotionTrack *> &tracks = motion->m_name2track;
+    const uint32_t nTracks = tracks.size();
+    for (uint32_t i = 0; i < nTracks; i++) {
+        const BoneKeyFrameList &frames = (*tracks.getAtIndex(i))->keyFrames;
+        if (frames.size() > 0 && !m_name2node.find(btHashString(reinterpret_cast<const char *>(frames[0]->name()))))
+            attachTrack(frames, m_model);
+    }
+    updateMaxFrame();
+    m_boundRevision = motion->m_revision;
+}
+
+void BoneMotion::markEdited(float frameIndex)
+{
+    m_revision++;
+    m_editedFrame = frameIndex;
+}
+
+void BoneMotion::updateMaxFrame()
+{
+    m_maxFrame = 0.0f;
     const uint32_t nNodes = m_name2node.size();
     for (uint32_t i = 0; i < nNodes; i++) {
-        BoneMotionInternal *node = *m_name2node.getAtIndex(i);
-        BoneKeyFrameList &frames = node->keyFrames;
-        frames.quickSort(BoneMotionKeyFramePredication());
-        btSetMax(m_maxFrame, frames[frames.size() - 1]->frameIndex());
+        const BoneKeyFrameList &kframes = *(*m_name2node.getAtIndex(i))->keyFrames;
+        const int nFrames = kframes.size();
+        if (nFrames > 0)
+            btSetMax(m_maxFrame, kframes[nFrames - 1]->frameIndex());
     }
-
-    m_model = model;
 }
 
-void BoneMotion::calculateFrames(float frameAt, BoneMotionInternal *node)
+void BoneMotion::searchKeyFrames(float frameAt,
+                                 BoneMotionInternal *node,
+                                 float &currentFrame,
+                                 uint32_t &k1,
+                                 uint32_t &k2)
 {
-    BoneKeyFrameList &kframes = node->keyFrames;
+    const BoneKeyFrameList &kframes = *node->keyFrames;
     const uint32_t nFrames = kframes.size();
     BoneKeyFrame *lastKeyFrame = kframes[nFrames - 1];
-    float currentFrame = frameAt;
+    currentFrame = frameAt;
     if (currentFrame > lastKeyFrame->frameIndex())
         currentFrame = lastKeyFrame->frameIndex();
 
-    uint32_t k1 = 0, k2 = 0, lastIndex = node->lastIndex;
+    uint32_t lastIndex = node->lastIndex;
+    k1 = 0;
+    k2 = 0;
+    // Key frames may be removed after the last seek
+    if (lastIndex >= nFrames)
+        lastIndex = nFrames - 1;
     if (currentFrame >= kframes[lastIndex]->frameIndex()) {
         for (uint32_t i = lastIndex; i < nFrames; i++) {
             if (currentFrame <= kframes[i]->frameIndex()) {
@@ -222,6 +703,15 @@ void BoneMotion::calculateFrames(float frameAt, BoneMotionInternal *node)
         k2 = nFrames - 1;
     k1 = k2 <= 1 ? 0 : k2 - 1;
     node->lastIndex = k1;
+}
+
+void BoneMotion::calculateFrames(float frameAt, BoneMotionInternal *node)
+{
+    const BoneKeyFrameList &kframes = *node->keyFrames;
+    const uint32_t nFrames = kframes.size();
+    float currentFrame = 0.0f;
+    uint32_t k1 = 0, k2 = 0;
+    searchKeyFrames(frameAt, node, currentFrame, k1, k2);
 
     const BoneKeyFrame *keyFrameFrom = kframes.at(k1), *keyFrameTo = kframes.at(k2);
     float frameIndexFrom = keyFrameFrom->frameIndex(), frameIndexTo = keyFrameTo->frameIndex();
@@ -297,6 +787,130 @@ void BoneMotion::calculateFrames(float frameAt, BoneMotionInternal *node)
     }
 }
 
+void BoneMotion::calculateFramesInBatch(float frameAt)
+{
+    const int nNodes = m_name2node.size();
+    if (nNodes == 0)
+        return;
+    BoneMotionBatch *batch = m_batch;
+    batch->reserve(nNodes);
+
+    // Gather the key frame pairs and interpolation weights, tracks not between two key frames are resolved here
+    float *from[BoneMotionBatch::kNValues], *to[BoneMotionBatch::kNValues], *result[BoneMotionBatch::kNValues];
+    for (int i = 0; i < BoneMotionBatch::kNValues; i++) {
+        from[i] = batch->from(i);
+        to[i] = batch->to(i);
+        result[i] = batch->result(i);
+    }
+    float *weights[4];
+    for (int i = 0; i < 4; i++)
+        weights[i] = batch->weight(i);
+    int size = 0;
+    for (int i = 0; i < nNodes; i++) {
+        BoneMotionInternal *node = *m_name2node.getAtIndex(i);
+        const BoneKeyFrameList &kframes = *node->keyFrames;
+        const int nFrames = kframes.size();
+        if (nFrames == 0 || (m_ignoreSingleMotion && nFrames <= 1))
+            continue;
+        float currentFrame = 0.0f;
+        uint32_t k1 = 0, k2 = 0;
+        searchKeyFrames(frameAt, node, currentFrame, k1, k2);
+        const BoneKeyFrame *keyFrameFrom = kframes[k1], *keyFrameTo = kframes[k2];
+        const float frameIndexFrom = keyFrameFrom->frameIndex(), frameIndexTo = keyFrameTo->frameIndex();
+        if (m_overrideFirst && (k1 == 0 || frameIndexFrom <= m_lastLoopStartIndex)) {
+            // Blending from the snapshot is rare, so it is left to the scalar path
+            calculateFrames(frameAt, node);
+        }
+        else if (frameIndexFrom == frameIndexTo || currentFrame <= frameIndexFrom) {
+            node->position = keyFrameFrom->position();
+            node->rotation = keyFrameFrom->rotation();
+        }
+        else if (currentFrame >= frameIndexTo) {
+            node->position = keyFrameTo->position();
+            node->rotation = keyFrameTo->rotation();
+        }
+        else {
+            const float w = (currentFrame - frameIndexFrom) / (frameIndexTo - frameIndexFrom);
+            const btVector3 &positionFrom = keyFrameFrom->position(), &positionTo = keyFrameTo->position();
+            const btQuaternion &rotationFrom = keyFrameFrom->rotation(), &rotationTo = keyFrameTo->rotation();
+            const bool *linear = keyFrameTo->linear();
+            for (int j = 0; j < 3; j++) {
+                from[BoneMotionBatch::kPositionX + j][size] = positionFrom[j];
+                to[BoneMotionBatch::kPositionX + j][size] = positionTo[j];
+            }
+            for (int j = 0; j < 4; j++) {
+                from[BoneMotionBatch::kRotationX + j][size] = rotationFrom[j];
+                to[BoneMotionBatch::kRotationX + j][size] = rotationTo[j];
+                weights[j][size] = linear[j] ? w : weightValue(keyFrameTo, w, j);
+            }
+            batch->nodes.push_back(node);
+            size++;
+        }
+    }
+
+    // Interpolate positions, each loop is independent per track
+    for (int i = 0; i < 3; i++) {
+        const float *f = from[i], *t = to[i], *w = weights[i];
+        float *r = result[i];
+        for (int j = 0; j < size; j++)
+            r[j] = internal::lerp(f[j], t[j], w[j]);
+    }
+
+    // Spherical interpolation of rotations in the same manner as btQuaternion::slerp without branches
+    const float *ax = from[BoneMotionBatch::kRotationX], *ay = from[BoneMotionBatch::kRotationY];
+    const float *az = from[BoneMotionBatch::kRotationZ], *aw = from[BoneMotionBatch::kRotationW];
+    const float *bx = to[BoneMotionBatch::kRotationX], *by = to[BoneMotionBatch::kRotationY];
+    const float *bz = to[BoneMotionBatch::kRotationZ], *bw = to[BoneMotionBatch::kRotationW];
+    const float *wr = weights[3];
+    float *rx = result[BoneMotionBatch::kRotationX], *ry = result[BoneMotionBatch::kRotationY];
+    float *rz = result[BoneMotionBatch::kRotationZ], *rw = result[BoneMotionBatch::kRotationW];
+    int i = 0;
+#ifdef VPVL_BONEMOTION_USE_SSE
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+    for (; i + 4 <= size; i += 4) {
+        const __m128 x1 = _mm_loadu_ps(ax + i), y1 = _mm_loadu_ps(ay + i), z1 = _mm_loadu_ps(az + i), w1 = _mm_loadu_ps(aw + i);
+        const __m128 x2 = _mm_loadu_ps(bx + i), y2 = _mm_loadu_ps(by + i), z2 = _mm_loadu_ps(bz + i), w2 = _mm_loadu_ps(bw + i);
+        const __m128 w = _mm_loadu_ps(wr + i);
+        const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x1, x2), _mm_mul_ps(y1, y2)), _mm_mul_ps(z1, z2)), _mm_mul_ps(w1, w2));
+        const __m128 la = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x1, x1), _mm_mul_ps(y1, y1)), _mm_mul_ps(z1, z1)), _mm_mul_ps(w1, w1));
+        const __m128 lb = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x2, x2), _mm_mul_ps(y2, y2)), _mm_mul_ps(z2, z2)), _mm_mul_ps(w2, w2));
+        const __m128 cosine = _mm_div_ps(dot, _mm_sqrt_ps(_mm_mul_ps(la, lb)));
+        const __m128 theta = BoneMotionAcos(_mm_min_ps(_mm_max_ps(cosine, minusOne), one));
+        const __m128 interpolate = _mm_cmpneq_ps(theta, zero);
+        const __m128 d = _mm_div_ps(one, BoneMotionSelect(interpolate, BoneMotionSin(theta), one));
+        const __m128 s0 = BoneMotionSelect(interpolate, BoneMotionSin(_mm_mul_ps(_mm_sub_ps(one, w), theta)), one);
+        const __m128 sign = BoneMotionSelect(_mm_cmplt_ps(dot, zero), minusOne, one);
+        const __m128 s1 = BoneMotionSelect(interpolate, _mm_mul_ps(BoneMotionSin(_mm_mul_ps(w, theta)), sign), zero);
+        _mm_storeu_ps(rx + i, BoneMotionSelect(interpolate, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(x1, s0), _mm_mul_ps(x2, s1)), d), x1));
+        _mm_storeu_ps(ry + i, BoneMotionSelect(interpolate, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(y1, s0), _mm_mul_ps(y2, s1)), d), y1));
+        _mm_storeu_ps(rz + i, BoneMotionSelect(interpolate, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(z1, s0), _mm_mul_ps(z2, s1)), d), z1));
+        _mm_storeu_ps(rw + i, BoneMotionSelect(interpolate, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(w1, s0), _mm_mul_ps(w2, s1)), d), w1));
+    }
+#endif
+    for (; i < size; i++) {
+        const float dot = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i] + aw[i] * bw[i];
+        const float la = ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i] + aw[i] * aw[i];
+        const float lb = bx[i] * bx[i] + by[i] * by[i] + bz[i] * bz[i] + bw[i] * bw[i];
+        const float cosine = dot / btSqrt(la * lb);
+        const float theta = BoneMotionAcos(cosine > 1.0f ? 1.0f : cosine < -1.0f ? -1.0f : cosine);
+        const bool interpolate = theta != 0.0f;
+        const float d = 1.0f / (interpolate ? BoneMotionSin(theta) : 1.0f);
+        const float s0 = interpolate ? BoneMotionSin((1.0f - wr[i]) * theta) : 1.0f;
+        const float s1 = interpolate ? BoneMotionSin(wr[i] * theta) * (dot < 0 ? -1.0f : 1.0f) : 0.0f;
+        rx[i] = interpolate ? (ax[i] * s0 + bx[i] * s1) * d : ax[i];
+        ry[i] = interpolate ? (ay[i] * s0 + by[i] * s1) * d : ay[i];
+        rz[i] = interpolate ? (az[i] * s0 + bz[i] * s1) * d : az[i];
+        rw[i] = interpolate ? (aw[i] * s0 + bw[i] * s1) * d : aw[i];
+    }
+
+    // Scatter the results to the tracks
+    for (i = 0; i < size; i++) {
+        BoneMotionInternal *node = batch->nodes[i];
+        node->position.setValue(result[0][i], result[1][i], result[2][i]);
+        node->rotation.setValue(rx[i], ry[i], rz[i], rw[i]);
+    }
+}
+
 void BoneMotion::reset()
 {
     BaseMotion::reset();
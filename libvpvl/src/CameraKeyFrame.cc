@@ -67,6 +67,7 @@ CameraKeyFrame::CameraKeyFrame()
 {
     internal::zerofill(m_linear, sizeof(m_linear));
     internal::zerofill(m_interpolationTable, sizeof(m_interpolationTable));
+    internal::zerofill(m_rawInterpolationTable, sizeof(m_rawInterpolationTable));
 }
 
 CameraKeyFrame::~CameraKeyFrame() {
@@ -80,6 +81,7 @@ CameraKeyFrame::~CameraKeyFrame() {
         delete[] m_interpolationTable[i];
     internal::zerofill(m_linear, sizeof(m_linear));
     internal::zerofill(m_interpolationTable, sizeof(m_interpolationTable));
+    internal::zerofill(m_rawInterpolationTable, sizeof(m_rawInterpolationTable));
 }
 
 size_t CameraKeyFrame::stride() {
@@ -128,12 +130,26 @@ void CameraKeyFrame::write(uint8_t *data)
     chunk.position[2] = m_position.z();
 #endif
     internal::copyBytes(reinterpret_cast<uint8_t *>(chunk.interpolationTable),
-                        reinterpret_cast<uint8_t *>(m_interpolationTable),
+                        reinterpret_cast<const uint8_t *>(m_rawInterpolationTable),
                         sizeof(chunk.interpolationTable));
     internal::copyBytes(data, reinterpret_cast<const uint8_t *>(&chunk), sizeof(chunk));
 }
 
+void CameraKeyFrame::setDefaultInterpolationParameter()
+{
+    static const int8_t kLinear[] = { 20, 107, 20, 107 };
+    int8_t table[kTableSize];
+    for (int i = 0; i < kTableSize; i++)
+        table[i] = kLinear[i % 4];
+    setInterpolationTable(table);
+}
+
 void CameraKeyFrame::setInterpolationTable(const int8_t *table) {
+    for (int i = 0; i < 6; i++)
+        delete[] m_interpolationTable[i];
+    internal::copyBytes(reinterpret_cast<uint8_t *>(m_rawInterpolationTable),
+                        reinterpret_cast<const uint8_t *>(table),
+                        sizeof(m_rawInterpolationTable));
     for (int i = 0; i < 6; i++)
         m_linear[i] = ((table[4 * i] == table[4 * i + 2]) && (table[4 * i + 1] == table[4 * i + 3])) ? true : false;
     for (int i = 0; i < 6; i++) {
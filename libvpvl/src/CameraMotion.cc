@@ -80,6 +80,7 @@ CameraMotion::CameraMotion()
       m_angle(0.0f, 0.0f, 0.0f),
       m_distance(0.0f),
       m_fovy(0.0f),
+      m_source(0),
       m_lastIndex(0)
 {
 }
@@ -91,6 +92,7 @@ CameraMotion::~CameraMotion()
     m_angle.setZero();
     m_distance = 0.0f;
     m_fovy = 0.0f;
+    m_source = 0;
     m_lastIndex = 0;
 }
 
@@ -110,18 +112,94 @@ void CameraMotion::read(const uint8_t *data, uint32_t size)
     }
 }
 
+void CameraMotion::share(CameraMotion *motion)
+{
+    internal::clearAll(m_frames);
+    m_source = motion->m_source ? motion->m_source : motion;
+    m_maxFrame = m_source->m_maxFrame;
+}
+
+bool CameraMotion::addKeyFrame(CameraKeyFrame *frame)
+{
+    if (m_source || !frame)
+        return false;
+
+    const float frameIndex = frame->frameIndex();
+    const int index = internal::findKeyFrameIndex(m_frames, frameIndex);
+    if (index < m_frames.size() && m_frames[index]->frameIndex() == frameIndex)
+        return false;
+    internal::insertAt(m_frames, index, frame);
+    updateMaxFrame();
+    return true;
+}
+
+bool CameraMotion::removeKeyFrame(float frameIndex)
+{
+    if (m_source)
+        return false;
+
+    const int index = internal::findKeyFrameIndex(m_frames, frameIndex);
+    if (index >= m_frames.size() || m_frames[index]->frameIndex() != frameIndex)
+        return false;
+    delete m_frames[index];
+    internal::removeAt(m_frames, index);
+    updateMaxFrame();
+    return true;
+}
+
+bool CameraMotion::moveKeyFrame(float from, float to)
+{
+    if (m_source)
+        return false;
+
+    const int index = internal::findKeyFrameIndex(m_frames, from);
+    if (index >= m_frames.size() || m_frames[index]->frameIndex() != from)
+        return false;
+    const int destination = internal::findKeyFrameIndex(m_frames, to);
+    if (destination < m_frames.size() && m_frames[destination]->frameIndex() == to)
+        return false;
+
+    CameraKeyFrame *frame = m_frames[index];
+    internal::removeAt(m_frames, index);
+    frame->setFrameIndex(to);
+    internal::insertAt(m_frames, internal::findKeyFrameIndex(m_frames, to), frame);
+    updateMaxFrame();
+    return true;
+}
+
+CameraKeyFrame *CameraMotion::findKeyFrame(float frameIndex) const
+{
+    const CameraKeyFrameList &kframes = frames();
+    const int index = internal::findKeyFrameIndex(kframes, frameIndex);
+    if (index >= kframes.size() || kframes[index]->frameIndex() != frameIndex)
+        return 0;
+    return kframes[index];
+}
+
+void CameraMotion::updateMaxFrame()
+{
+    const int nFrames = m_frames.size();
+    m_maxFrame = nFrames > 0 ? m_frames[nFrames - 1]->frameIndex() : 0.0f;
+}
+
 void CameraMotion::seek(float frameAt)
 {
-    const uint32_t nFrames = m_frames.size();
-    CameraKeyFrame *lastKeyFrame = m_frames[nFrames - 1];
+    const CameraKeyFrameList &kframes = frames();
+    const uint32_t nFrames = kframes.size();
+    if (nFrames == 0)
+        return;
+    // Key frames may be removed after the last seek
+    if (m_lastIndex >= nFrames)
+        m_lastIndex = nFrames - 1;
+    CameraKeyFrame *lastKeyFrame = kframes[nFrames - 1];
     float currentFrame = frameAt;
     if (currentFrame > lastKeyFrame->frameIndex())
         currentFrame = lastKeyFrame->frameIndex();
 
     uint32_t k1 = 0, k2 = 0;
-    if (currentFrame >= m_frames[m_lastIndex]->frameIndex()) {
+    if (currentFrame >= kframes[m_lastIndex]->frameIndex()) {
         for (uint32_t i = m_lastIndex; i < nFrames; i++) {
-            if (currentFrame <= m_frames[i]->frameIndex()) {
+            if (currentFrame <= kframes[i]->frameIndex()) {
                 k2 = i;
                 break;
             }
@@ -129,7 +207,7 @@ void CameraMotion::seek(float frameAt)
     }
     else {
         for (uint32_t i = 0; i <= m_lastIndex && i < nFrames; i++) {
-            if (currentFrame <= m_frames[i]->frameIndex()) {
+            if (currentFrame <= kframes[i]->frameIndex()) {
                 k2 = i;
                 break;
             }
@@ -141,7 +219,7 @@ void CameraMotion::seek(float frameAt)
     k1 = k2 <= 1 ? 0 : k2 - 1;
     m_lastIndex = k1;
 
-    const CameraKeyFrame *keyFrameFrom = m_frames.at(k1), *keyFrameTo = m_frames.at(k2);
+    const CameraKeyFrame *keyFrameFrom = kframes.at(k1), *keyFrameTo = kframes.at(k2);
     CameraKeyFrame *keyFrameForInterpolation = const_cast<CameraKeyFrame *>(keyFrameTo);
     float frameIndexFrom = keyFrameFrom->frameIndex(), frameIndexTo = keyFrameTo->frameIndex();
     float distanceFrom = keyFrameFrom->distance(), fovyFrom = keyFrameFrom->fovy();
@@ -43,9 +43,29 @@ namespace vpvl
 
 const float FaceMotion::kStartingMarginFrame = 6.0f;
 
+struct FaceMotionTrack {
+    FaceKeyFrameList keyFrames;
+};
+
+/* the curve from the previous key frame is changed by editing the key frame at the index */
+static float FaceMotionPreviousFrameIndex(const FaceKeyFrameList &kframes, int index)
+{
+    return index > 0 ? kframes[index - 1]->frameIndex() : 0.0f;
+}
+
+/* the index of the key frame of the track at the frame or -1 if not found */
+static int FaceMotionFindKeyFrame(const FaceMotionTrack *const *ptr, float frameIndex)
+{
+    if (!ptr)
+        return -1;
+    const FaceKeyFrameList &kframes = (*ptr)->keyFrames;
+    const int index = internal::findKeyFrameIndex(kframes, frameIndex);
+    return index < kframes.size() && kframes[index]->frameIndex() == frameIndex ? index : -1;
+}
+
 struct FaceMotionInternal {
     Face *face;
-    FaceKeyFrameList keyFrames;
+    const FaceKeyFrameList *keyFrames;
     float weight;
     float snapWeight;
     uint32_t lastIndex;
@@ -61,22 +81,53 @@ public:
 
 FaceMotion::FaceMotion()
     : BaseMotion(kStartingMarginFrame),
-      m_model(0)
+      m_source(0),
+      m_model(0),
+      m_nSkippedKeyFrames(0),
+      m_revision(0),
+      m_boundRevision(0),
+      m_editedFrame(0.0f),
+      m_dirty(false)
 {
 }
 
 FaceMotion::~FaceMotion()
 {
     internal::clearAll(m_frames);
+    internal::clearAll(m_name2track);
     internal::clearAll(m_name2node);
+    m_source = 0;
     m_model = 0;
+    m_nSkippedKeyFrames = 0;
+    m_revision = 0;
+    m_boundRevision = 0;
+    m_editedFrame = 0.0f;
+    m_dirty = false;
 }
 
 void FaceMotion::read(const uint8_t *data, uint32_t size)
 {
+    read(data, size, 0);
+}
+
+void FaceMotion::read(const uint8_t *data, uint32_t size, const PMDModel *model)
+{
+    uint8_t name[FaceKeyFrame::kNameSize];
+    m_dirty = true;
+    markEdited(0.0f);
     uint8_t *ptr = const_cast<uint8_t *>(data);
-    m_frames.reserve(size);
+    if (!model)
+        m_frames.reserve(size);
     for (uint32_t i = 0; i < size; i++) {
+        // The name is placed at the head of the chunk
+        if (model) {
+            copyBytesSafe(name, ptr, sizeof(name));
+            if (!model->findFace(name)) {
+                ptr += FaceKeyFrame::stride();
+                m_nSkippedKeyFrames++;
+                continue;
+            }
+        }
         FaceKeyFrame *frame = new FaceKeyFrame();
         frame->read(ptr);
         ptr += FaceKeyFrame::stride();
@@ -86,10 +137,12 @@ void FaceMotion::read(const uint8_t *data, uint32_t size)
 
 void FaceMotion::seek(float frameAt)
 {
+    refreshTracks();
     const uint32_t nNodes = m_name2node.size();
     for (uint32_t i = 0; i < nNodes; i++) {
         FaceMotionInternal *node = *m_name2node.getAtIndex(i);
-        if (m_ignoreSingleMotion && node->keyFrames.size() <= 1)
+        const int nFrames = node->keyFrames->size();
+        if (nFrames == 0 || (m_ignoreSingleMotion && nFrames <= 1))
             continue;
         calculateFrames(frameAt, node);
         Face *face = node->face;
@@ -115,38 +168,249 @@ void FaceMotion::attachModel(PMDModel *model)
     if (m_model)
         return;
 
+    FaceMotion *motion = m_source ? m_source : this;
+    motion->buildTracks();
+    const btHashMap<btHashString, FaceMotionTrack *> &tracks = motion->m_name2track;
+    const uint32_t nTracks = tracks.size();
+    for (uint32_t i = 0; i < nTracks; i++) {
+        const FaceKeyFrameList &frames = (*tracks.getAtIndex(i))->keyFrames;
+        if (frames.size() > 0)
+            attachTrack(frames, model);
+    }
+
+    m_model = model;
+    m_boundRevision = motion->m_revision;
+}
+
+void FaceMotion::attachTrack(const FaceKeyFrameList &frames, PMDModel *model)
+{
+    const uint8_t *name = frames[0]->name();
+    Face *face = model->findFace(name);
+    if (face) {
+        FaceMotionInternal *node = new FaceMotionInternal();
+        node->keyFrames = &frames;
+        node->face = face;
+        node->lastIndex = 0;
+        node->weight = 0.0f;
+        node->snapWeight = 0.0f;
+        m_name2node.insert(btHashString(reinterpret_cast<const char *>(name)), node);
+        btSetMax(m_maxFrame, frames[frames.size() - 1]->frameIndex());
+    }
+}
+
+bool FaceMotion::addKeyFrame(FaceKeyFrame *frame)
+{
+    if (m_source || !frame)
+        return false;
+
+    buildTracks();
+    const btHashString key(reinterpret_cast<const char *>(frame->name()));
+    FaceMotionTrack **ptr = m_name2track.find(key), *track;
+    if (ptr) {
+        track = *ptr;
+    }
+    else {
+        track = new FaceMotionTrack();
+        m_name2track.insert(key, track);
+    }
+
+    FaceKeyFrameList &kframes = track->keyFrames;
+    const float frameIndex = frame->frameIndex();
+    const int index = internal::findKeyFrameIndex(kframes, frameIndex);
+    if (index < kframes.size() && kframes[index]->frameIndex() == frameIndex)
+        return false;
+    internal::insertAt(kframes, index, frame);
+    m_frames.push_back(frame);
+    markEdited(FaceMotionPreviousFrameIndex(kframes, index));
+
+    if (m_model) {
+        if (!m_name2node.find(key))
+            attachTrack(kframes, m_model);
+        else
+            btSetMax(m_maxFrame, frameIndex);
+    }
+    return true;
+}
+
+bool FaceMotion::removeKeyFrame(const uint8_t *name, float frameIndex)
+{
+    if (m_source)
+        return false;
+
+    buildTracks();
+    FaceMotionTrack **ptr = m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    if (!ptr)
+        return false;
+
+    // The empty track is kept because the nodes of the shared motions refer it
+    FaceKeyFrameList &kframes = (*ptr)->keyFrames;
+    const int index = internal::findKeyFrameIndex(kframes, frameIndex);
+    if (index >= kframes.size() || kframes[index]->frameIndex() != frameIndex)
+        return false;
+    markEdited(FaceMotionPreviousFrameIndex(kframes, index));
+    m_frames.remove(kframes[index]);
+    delete kframes[index];
+    internal::removeAt(kframes, index);
+
+    if (m_model && frameIndex >= m_maxFrame)
+        updateMaxFrame();
+    return true;
+}
+
+bool FaceMotion::moveKeyFrame(const uint8_t *name, float from, float to)
+{
+    if (m_source)
+        return false;
+
+    buildTracks();
+    FaceMotionTrack **ptr = m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    if (!ptr)
+        return false;
+
+    FaceKeyFrameList &kframes = (*ptr)->keyFrames;
+    const int index = internal::findKeyFrameIndex(kframes, from);
+    if (index >= kframes.size() || kframes[index]->frameIndex() != from)
+        return false;
+    const int destination = internal::findKeyFrameIndex(kframes, to);
+    if (destination < kframes.size() && kframes[destination]->frameIndex() == to)
+        return false;
+
+    FaceKeyFrame *frame = kframes[index];
+    const float previous = FaceMotionPreviousFrameIndex(kframes, index);
+    internal::removeAt(kframes, index);
+    frame->setFrameIndex(to);
+    const int inserted = internal::findKeyFrameIndex(kframes, to);
+    internal::insertAt(kframes, inserted, frame);
+    markEdited(btMin(previous, FaceMotionPreviousFrameIndex(kframes, inserted)));
+
+    if (m_model) {
+        if (to > m_maxFrame)
+            m_maxFrame = to;
+        else if (from >= m_maxFrame)
+            updateMaxFrame();
+    }
+    return true;
+}
+
+const FaceKeyFrame *FaceMotion::findKeyFrame(const uint8_t *name, float frameIndex) const
+{
+    const FaceMotion *motion = m_source ? m_source : this;
+    // The key frames edited by mutableFrames are searched as they are not grouped until the next edit or seek
+    if (motion->m_dirty) {
+        const FaceKeyFrameList &frames = motion->m_frames;
+        const int nFrames = frames.size();
+        for (int i = 0; i < nFrames; i++) {
+            const FaceKeyFrame *frame = frames[i];
+            if (frame->frameIndex() == frameIndex && internal::stringEquals(frame->name(), name, FaceKeyFrame::kNameSize))
+                return frame;
+        }
+        return 0;
+    }
+    const FaceMotionTrack *const *ptr = motion->m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    const int index = FaceMotionFindKeyFrame(ptr, frameIndex);
+    return index >= 0 ? (*ptr)->keyFrames[index] : 0;
+}
+
+FaceKeyFrame *FaceMotion::mutableKeyFrame(const uint8_t *name, float frameIndex)
+{
+    if (m_source)
+        return 0;
+
+    buildTracks();
+    FaceMotionTrack **ptr = m_name2track.find(btHashString(reinterpret_cast<const char *>(name)));
+    const int index = FaceMotionFindKeyFrame(ptr, frameIndex);
+    if (index < 0)
+        return 0;
+    // The returned key frame may be modified in place
+    const FaceKeyFrameList &kframes = (*ptr)->keyFrames;
+    markEdited(FaceMotionPreviousFrameIndex(kframes, index));
+    return kframes[index];
+}
+
+FaceKeyFrameList *FaceMotion::mutableFrames()
+{
+    m_dirty = true;
+    markEdited(0.0f);
+    return &m_frames;
+}
+
+void FaceMotion::share(FaceMotion *motion)
+{
+    if (m_model)
+        return;
+    internal::clearAll(m_frames);
+    internal::clearAll(m_name2track);
+    m_source = motion->m_source ? motion->m_source : motion;
+}
+
+void FaceMotion::buildTracks()
+{
+    if (!m_dirty)
+        return;
+
+    // The tracks are refilled in place because the nodes of the attached models and the shared motions refer them
+    const uint32_t nOldTracks = m_name2track.size();
+    for (uint32_t i = 0; i < nOldTracks; i++)
+        (*m_name2track.getAtIndex(i))->keyFrames.clear();
     const uint32_t nFrames = m_frames.size();
     for (uint32_t i = 0; i < nFrames; i++) {
         FaceKeyFrame *frame = m_frames.at(i);
         btHashString name(reinterpret_cast<const char *>(frame->name()));
-        FaceMotionInternal **ptr = m_name2node.find(name), *node;
+        FaceMotionTrack **ptr = m_name2track.find(name), *track;
         if (ptr) {
-            node = *ptr;
-            node->keyFrames.push_back(frame);
+            track = *ptr;
         }
         else {
-            Face *face = model->findFace(frame->name());
-            if (face) {
-                node = new FaceMotionInternal();
-                node->keyFrames.push_back(frame);
-                node->face = face;
-                node->lastIndex = 0;
-                node->weight = 0.0f;
-                node->snapWeight = 0.0f;
-                m_name2node.insert(name, node);
-            }
+            track = new FaceMotionTrack();
+            m_name2track.insert(name, track);
         }
+        track->keyFrames.push_back(frame);
+    }
+
+    const uint32_t nTracks = m_name2track.size();
+    for (uint32_t i = 0; i < nTracks; i++) {
+        FaceMotionTrack *track = *m_name2track.getAtIndex(i);
+        track->keyFrames.quickSort(FaceMotionKeyFramePredication());
+    }
+
+    m_dirty = false;
+}
+
+void FaceMotion::refreshTracks()
+{
+    // The key frames edited by mutableFrames are grouped again before evaluating them,
+    // the tracks are refilled in place so only the tracks of the new faces are bound
+    FaceMotion *motion = m_source ? m_source : this;
+    motion->buildTracks();
+    if (!m_model || m_boundRevision == motion->m_revision)
+        return;
+    const btHashMap<btHashString, FaceMotionTrack *> &tracks = motion->m_name2track;
+    const uint32_t nTracks = tracks.size();
+    for (uint32_t i = 0; i < nTracks; i++) {
+        const FaceKeyFrameList &frames = (*tracks.getAtIndex(i))->keyFrames;
+        if (frames.size() > 0 && !m_name2node.find(btHashString(reinterpret_cast<const char *>(frames[0]->name()))))
+            attachTrack(frames, m_model);
     }
+    updateMaxFrame();
+    m_boundRevision = motion->m_revision;
+}
+
+void FaceMotion::markEdited(float frameIndex)
+{
+    m_revision++;
+    m_editedFrame = frameIndex;
+}
 
+void FaceMotion::updateMaxFrame()
+{
+    m_maxFrame = 0.0f;
     const uint32_t nNodes = m_name2node.size();
     for (uint32_t i = 0; i < nNodes; i++) {
-        FaceMotionInternal *node = *m_name2node.getAtIndex(i);
-        FaceKeyFrameList &frames = node->keyFrames;
-        frames.quickSort(FaceMotionKeyFramePredication());
-        btSetMax(m_maxFrame, frames[frames.size() - 1]->frameIndex());
+        const FaceKeyFrameList &kframes = *(*m_name2node.getAtIndex(i))->keyFrames;
+        const int nFrames = kframes.size();
+        if (nFrames > 0)
+            btSetMax(m_maxFrame, kframes[nFrames - 1]->frameIndex());
     }
-
-    m_model = model;
 }
 
 void FaceMotion::reset()
@@ -161,7 +425,7 @@ void FaceMotion::reset()
 
 void FaceMotion::calculateFrames(float frameAt, FaceMotionInternal *node)
 {
-    FaceKeyFrameList &kframes = node->keyFrames;
+    const FaceKeyFrameList &kframes = *node->keyFrames;
     const uint32_t nFrames = kframes.size();
     FaceKeyFrame *lastKeyFrame = kframes.at(nFrames - 1);
     float currentFrame = frameAt;
@@ -169,6 +433,9 @@ void FaceMotion::calculateFrames(float frameAt, FaceMotionInternal *node)
         currentFrame = lastKeyFrame->frameIndex();
 
     uint32_t k1 = 0, k2 = 0;
+    // Key frames may be removed after the last seek
+    if (node->lastIndex >= nFrames)
+        node->lastIndex = nFrames - 1;
     if (currentFrame >= kframes.at(node->lastIndex)->frameIndex()) {
         for (uint32_t i = node->lastIndex; i < nFrames; i++) {
             if (currentFrame <= kframes.at(i)->frameIndex()) {
@@ -179,7 +446,7 @@ void FaceMotion::calculateFrames(float frameAt, FaceMotionInternal *node)
     }
     else {
         for (uint32_t i = 0; i <= node->lastIndex && i < nFrames; i++) {
-            if (currentFrame <= m_frames.at(i)->frameIndex()) {
+            if (currentFrame <= kframes.at(i)->frameIndex()) {
                 k2 = i;
                 break;
             }
@@ -0,0 +1,484 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "vpvl/vpvl.h"
+#include "vpvl/internal/util.h"
+
+namespace vpvl
+{
+
+const float MotionReducer::kDefaultPositionTolerance = 0.01f;
+const float MotionReducer::kDefaultRotationTolerance = 0.5f;
+const float MotionReducer::kDefaultFaceWeightTolerance = 0.005f;
+
+struct MotionReducerCandidate
+{
+    int8_t x1;
+    int8_t y1;
+    int8_t x2;
+    int8_t y2;
+    float table[BoneKeyFrame::kTableSize + 1];
+};
+
+/* control points of the candidate curves, the linear one is tried first separately */
+static const int8_t kCandidateValues[] = { 0, 25, 51, 76, 102, 127 };
+static const int kNCandidateValues = sizeof(kCandidateValues) / sizeof(kCandidateValues[0]);
+static const int8_t kLinearParameters[] = { 20, 20, 107, 107 };
+
+class MotionReducerBoneKeyFramePredication
+{
+public:
+    MotionReducerBoneKeyFramePredication(const BoneKeyFrameList &frames) : m_frames(frames) {}
+    bool operator()(const int left, const int right) const {
+        const BoneKeyFrame *l = m_frames[left], *r = m_frames[right];
+        int ret = strncmp(reinterpret_cast<const char *>(l->name()),
+                          reinterpret_cast<const char *>(r->name()),
+                          BoneKeyFrame::kNameSize);
+        if (ret != 0)
+            return ret < 0;
+        if (l->frameIndex() != r->frameIndex())
+            return l->frameIndex() < r->frameIndex();
+        return left < right;
+    }
+private:
+    const BoneKeyFrameList &m_frames;
+};
+
+class MotionReducerFaceKeyFramePredication
+{
+public:
+    MotionReducerFaceKeyFramePredication(const FaceKeyFrameList &frames) : m_frames(frames) {}
+    bool operator()(const int left, const int right) const {
+        const FaceKeyFrame *l = m_frames[left], *r = m_frames[right];
+        int ret = strncmp(reinterpret_cast<const char *>(l->name()),
+                          reinterpret_cast<const char *>(r->name()),
+                          FaceKeyFrame::kNameSize);
+        if (ret != 0)
+            return ret < 0;
+        if (l->frameIndex() != r->frameIndex())
+            return l->frameIndex() < r->frameIndex();
+        return left < right;
+    }
+private:
+    const FaceKeyFrameList &m_frames;
+};
+
+/* same as BoneMotion::weightValue to reproduce the result of playback */
+static inline float WeightValue(const float *v, float w)
+{
+    const uint16_t index = static_cast<int16_t>(w * BoneKeyFrame::kTableSize);
+    return v[index] + (v[index + 1] - v[index]) * (w * BoneKeyFrame::kTableSize - index);
+}
+
+static inline float RotationDifference(const btQuaternion &q1, const btQuaternion &q2)
+{
+    const float d = btFabs(q1.dot(q2)) / btSqrt(q1.length2() * q2.length2());
+    return d >= 1.0f ? 0.0f : 2.0f * btAcos(d);
+}
+
+static void SampleBoneTrack(const BoneKeyFrameList &frames,
+                            const btAlignedObjectArray<int> &indices,
+                            int from,
+                            int to,
+                            btAlignedObjectArray<btVector3> &positions,
+                            btAlignedObjectArray<btQuaternion> &rotations)
+{
+    const float base = frames[indices[from]]->frameIndex();
+    const int nSamples = static_cast<int>(frames[indices[to]]->frameIndex() - base) + 1;
+    positions.resize(nSamples);
+    rotations.resize(nSamples);
+    positions[0] = frames[indices[from]]->position();
+    rotations[0] = frames[indices[from]]->rotation();
+    for (int i = from; i < to; i++) {
+        const BoneKeyFrame *keyFrameFrom = frames[indices[i]], *keyFrameTo = frames[indices[i + 1]];
+        const float frameIndexFrom = keyFrameFrom->frameIndex(), frameIndexTo = keyFrameTo->frameIndex();
+        const btVector3 &positionFrom = keyFrameFrom->position(), &positionTo = keyFrameTo->position();
+        const btQuaternion &rotationFrom = keyFrameFrom->rotation(), &rotationTo = keyFrameTo->rotation();
+        const bool *linear = keyFrameTo->linear();
+        const float *const *tables = keyFrameTo->interpolationTable();
+        const int start = static_cast<int>(frameIndexFrom - base) + 1, end = static_cast<int>(frameIndexTo - base);
+        for (int j = start; j < end; j++) {
+            const float w = (j + base - frameIndexFrom) / (frameIndexTo - frameIndexFrom);
+            float values[3];
+            for (int k = 0; k < 3; k++) {
+                const float w2 = linear[k] ? w : WeightValue(tables[k], w);
+                values[k] = internal::lerp(positionFrom[k], positionTo[k], w2);
+            }
+            positions[j].setValue(values[0], values[1], values[2]);
+            const float w2 = linear[3] ? w : WeightValue(tables[3], w);
+            rotations[j] = rotationFrom.slerp(rotationTo, w2);
+        }
+        positions[end] = positionTo;
+        rotations[end] = rotationTo;
+    }
+}
+
+/* fits a segment of samples with interpolation parameters within tolerances */
+class MotionReducerSegmentFitter
+{
+public:
+    MotionReducerSegmentFitter(const btAlignedObjectArray<MotionReducerCandidate *> &candidates,
+                               const btAlignedObjectArray<btVector3> &positions,
+                               const btAlignedObjectArray<btQuaternion> &rotations,
+                               float positionTolerance,
+                               float rotationTolerance)
+        : m_candidates(candidates),
+          m_positions(positions),
+          m_rotations(rotations),
+          m_positionTolerance(positionTolerance),
+          m_rotationTolerance(rotationTolerance)
+    {
+    }
+    bool fit(int from, int to, const MotionReducerCandidate **parameters) const {
+        for (int i = 0; i < 3; i++) {
+            if (!fitPosition(from, to, i, parameters[i]))
+                return false;
+        }
+        return fitRotation(from, to, parameters[3]);
+    }
+
+private:
+    float positionError(int from, int to, int at, const float *table, float limit) const {
+        const float valueFrom = m_positions[from][at], valueTo = m_positions[to][at];
+        const float span = static_cast<float>(to - from);
+        float error = 0.0f;
+        for (int i = from + 1; i < to; i++) {
+            const float w = (i - from) / span;
+            const float value = internal::lerp(valueFrom, valueTo, table ? WeightValue(table, w) : w);
+            btSetMax(error, btFabs(value - m_positions[i][at]));
+            if (error > limit)
+                break;
+        }
+        return error;
+    }
+
+    float rotationError(int from, int to, const float *table, float limit) const {
+        const btQuaternion &rotationFrom = m_rotations[from], &rotationTo = m_rotations[to];
+        const float span = static_cast<float>(to - from);
+        float error = 0.0f;
+        for (int i = from + 1; i < to; i++) {
+            const float w = (i - from) / span;
+            const btQuaternion value = rotationFrom.slerp(rotationTo, table ? WeightValue(table, w) : w);
+            btSetMax(error, RotationDifference(value, m_rotations[i]));
+            if (error > limit)
+                break;
+        }
+        return error;
+    }
+
+    bool fitPosition(int from, int to, int at, const MotionReducerCandidate *&parameter) const {
+        parameter = 0;
+        float best = positionError(from, to, at, 0, m_positionTolerance);
+        if (best <= m_positionTolerance)
+            return true;
+        if (m_positions[from][at] == m_positions[to][at])
+            return false;
+        best = m_positionTolerance;
+        const int nCandidates = m_candidates.size();
+        for (int i = 0; i < nCandidates; i++) {
+            const MotionReducerCandidate *candidate = m_candidates[i];
+            float error = positionError(from, to, at, candidate->table, best);
+            if (error <= best) {
+                best = error;
+                parameter = candidate;
+            }
+        }
+        return parameter != 0;
+    }
+
+    bool fitRotation(int from, int to, const MotionReducerCandidate *&parameter) const {
+        parameter = 0;
+        if (rotationError(from, to, 0, m_rotationTolerance) <= m_rotationTolerance)
+            return true;
+        const btQuaternion &rotationFrom = m_rotations[from], &rotationTo = m_rotations[to];
+        const float theta = RotationDifference(rotationFrom, rotationTo);
+        if (theta == 0.0f)
+            return false;
+        /* choose a candidate by progress along the arc and verify it with slerp */
+        const float span = static_cast<float>(to - from);
+        const int nCandidates = m_candidates.size();
+        float best = m_rotationTolerance;
+        for (int i = 0; i < nCandidates; i++) {
+            const MotionReducerCandidate *candidate = m_candidates[i];
+            float error = 0.0f;
+            for (int j = from + 1; j < to; j++) {
+                const float progress = RotationDifference(rotationFrom, m_rotations[j]) / theta;
+                const float w = WeightValue(candidate->table, (j - from) / span);
+                btSetMax(error, btFabs(w - progress) * theta);
+                if (error > best)
+                    break;
+            }
+            if (error <= best) {
+                best = error;
+                parameter = candidate;
+            }
+        }
+        return parameter != 0
+                && rotationError(from, to, parameter->table, m_rotationTolerance) <= m_rotationTolerance;
+    }
+
+    const btAlignedObjectArray<MotionReducerCandidate *> &m_candidates;
+    const btAlignedObjectArray<btVector3> &m_positions;
+    const btAlignedObjectArray<btQuaternion> &m_rotations;
+    const float m_positionTolerance;
+    const float m_rotationTolerance;
+};
+
+MotionReducer::MotionReducer()
+    : m_positionTolerance(kDefaultPositionTolerance),
+      m_rotationTolerance(kDefaultRotationTolerance),
+      m_faceWeightTolerance(kDefaultFaceWeightTolerance),
+      m_nSourceKeyFrames(0),
+      m_nReducedKeyFrames(0)
+{
+}
+
+MotionReducer::~MotionReducer()
+{
+    internal::clearAll(m_candidates);
+    m_positionTolerance = 0.0f;
+    m_rotationTolerance = 0.0f;
+    m_faceWeightTolerance = 0.0f;
+    m_nSourceKeyFrames = 0;
+    m_nReducedKeyFrames = 0;
+}
+
+bool MotionReducer::reduce(VMDMotion *motion)
+{
+    if (motion->attachedModel())
+        return false;
+    BoneMotion *boneMotion = motion->mutableBone();
+    FaceMotion *faceMotion = motion->mutableFace();
+    m_nSourceKeyFrames = boneMotion->frames().size() + faceMotion->frames().size();
+    buildCandidates();
+    reduceBoneKeyFrames(boneMotion);
+    reduceFaceKeyFrames(faceMotion);
+    m_nReducedKeyFrames = boneMotion->frames().size() + faceMotion->frames().size();
+    return true;
+}
+
+void MotionReducer::buildCandidates()
+{
+    if (m_candidates.size() > 0)
+        return;
+    const float kDivision = 127.0f;
+    for (int i = 0; i < kNCandidateValues; i++) {
+        for (int j = 0; j < kNCandidateValues; j++) {
+            for (int k = 0; k < kNCandidateValues; k++) {
+                for (int l = 0; l < kNCandidateValues; l++) {
+                    const int8_t x1 = kCandidateValues[i], y1 = kCandidateValues[j];
+                    const int8_t x2 = kCandidateValues[k], y2 = kCandidateValues[l];
+                    /* treated as linear interpolation */
+                    if (x1 == y1 && x2 == y2)
+                        continue;
+                    MotionReducerCandidate *candidate = new MotionReducerCandidate();
+                    float *table = candidate->table;
+                    candidate->x1 = x1;
+                    candidate->y1 = y1;
+                    candidate->x2 = x2;
+                    candidate->y2 = y2;
+                    internal::buildInterpolationTable(x1 / kDivision, x2 / kDivision,
+                                                      y1 / kDivision, y2 / kDivision,
+                                                      BoneKeyFrame::kTableSize, table);
+                    m_candidates.push_back(candidate);
+                }
+            }
+        }
+    }
+}
+
+void MotionReducer::reduceBoneKeyFrames(BoneMotion *motion)
+{
+    BoneKeyFrameList *frames = motion->mutableFrames();
+    const int nFrames = frames->size();
+    const float rotationTolerance = m_rotationTolerance * static_cast<float>(SIMD_RADS_PER_DEG);
+    btAlignedObjectArray<int> indices;
+    btAlignedObjectArray<bool> keep;
+    btAlignedObjectArray<btVector3> positions;
+    btAlignedObjectArray<btQuaternion> rotations;
+    const MotionReducerCandidate *parameters[BoneKeyFrame::kMax], *bestParameters[BoneKeyFrame::kMax];
+    indices.resize(nFrames);
+    keep.resize(nFrames);
+    for (int i = 0; i < nFrames; i++) {
+        indices[i] = i;
+        keep[i] = true;
+    }
+    indices.quickSort(MotionReducerBoneKeyFramePredication(*frames));
+
+    int trackStart = 0;
+    while (trackStart < nFrames) {
+        /* a run of key frames that has same name and strictly increasing frame index */
+        const BoneKeyFrame *head = frames->at(indices[trackStart]);
+        int trackEnd = trackStart;
+        while (trackEnd + 1 < nFrames) {
+            const BoneKeyFrame *next = frames->at(indices[trackEnd + 1]);
+            if (!internal::stringEquals(head->name(), next->name(), BoneKeyFrame::kNameSize)
+                    || next->frameIndex() <= frames->at(indices[trackEnd])->frameIndex())
+                break;
+            trackEnd++;
+        }
+        if (trackEnd - trackStart < 2) {
+            trackStart = trackEnd + 1;
+            continue;
+        }
+        SampleBoneTrack(*frames, indices, trackStart, trackEnd, positions, rotations);
+        const float base = head->frameIndex();
+
+        const MotionReducerSegmentFitter fitter(m_candidates, positions, rotations,
+                                                m_positionTolerance, rotationTolerance);
+
+        int from = trackStart;
+        while (from < trackEnd) {
+            const int sampleFrom = static_cast<int>(frames->at(indices[from])->frameIndex() - base);
+            /* extends the segment exponentially and then finds the longest one by binary search */
+            int good = from + 1, bad = trackEnd + 1, step = 2;
+            while (good < trackEnd && bad - good > 1) {
+                const int to = bad > trackEnd ? btMin(from + step, trackEnd) : (good + bad) / 2;
+                const int sampleTo = static_cast<int>(frames->at(indices[to])->frameIndex() - base);
+                if (fitter.fit(sampleFrom, sampleTo, parameters)) {
+                    good = to;
+                    for (int i = 0; i < BoneKeyFrame::kMax; i++)
+                        bestParameters[i] = parameters[i];
+                }
+                else {
+                    bad = to;
+                }
+                step <<= 1;
+            }
+            /* the next key frame keeps its own parameters because nothing is removed */
+            if (good > from + 1) {
+                BoneKeyFrame *frame = frames->at(indices[good]);
+                for (int i = 0; i < BoneKeyFrame::kMax; i++) {
+                    const MotionReducerCandidate *c = bestParameters[i];
+                    const BoneKeyFrame::InterpolationType type = static_cast<BoneKeyFrame::InterpolationType>(i);
+                    if (c)
+                        frame->setInterpolationParameter(type, c->x1, c->y1, c->x2, c->y2);
+                    else
+                        frame->setInterpolationParameter(type, kLinearParameters[0], kLinearParameters[1],
+                                                         kLinearParameters[2], kLinearParameters[3]);
+                }
+                for (int i = from + 1; i < good; i++)
+                    keep[indices[i]] = false;
+            }
+            from = good;
+        }
+        trackStart = trackEnd + 1;
+    }
+
+    BoneKeyFrameList reduced;
+    for (int i = 0; i < nFrames; i++) {
+        BoneKeyFrame *frame = frames->at(i);
+        if (keep[i])
+            reduced.push_back(frame);
+        else
+            delete frame;
+    }
+    frames->clear();
+    for (int i = 0; i < reduced.size(); i++)
+        frames->push_back(reduced[i]);
+}
+
+void MotionReducer::reduceFaceKeyFrames(FaceMotion *motion)
+{
+    FaceKeyFrameList *frames = motion->mutableFrames();
+    const int nFrames = frames->size();
+    btAlignedObjectArray<int> indices;
+    btAlignedObjectArray<bool> keep;
+    indices.resize(nFrames);
+    keep.resize(nFrames);
+    for (int i = 0; i < nFrames; i++) {
+        indices[i] = i;
+        keep[i] = true;
+    }
+    indices.quickSort(MotionReducerFaceKeyFramePredication(*frames));
+
+    int trackStart = 0;
+    while (trackStart < nFrames) {
+        const FaceKeyFrame *head = frames->at(indices[trackStart]);
+        int trackEnd = trackStart;
+        while (trackEnd + 1 < nFrames) {
+            const FaceKeyFrame *next = frames->at(indices[trackEnd + 1]);
+            if (!internal::stringEquals(head->name(), next->name(), FaceKeyFrame::kNameSize)
+                    || next->frameIndex() <= frames->at(indices[trackEnd])->frameIndex())
+                break;
+            trackEnd++;
+        }
+        /*
+         * FaceMotion interpolates weights linearly, so checking the removed key frames
+         * is enough to bound the error of the whole segment.
+         */
+        int from = trackStart;
+        while (from < trackEnd) {
+            const FaceKeyFrame *keyFrameFrom = frames->at(indices[from]);
+            int to = from + 1;
+            while (to + 1 <= trackEnd) {
+                const FaceKeyFrame *keyFrameTo = frames->at(indices[to + 1]);
+                const float frameIndexFrom = keyFrameFrom->frameIndex(), span = keyFrameTo->frameIndex() - frameIndexFrom;
+                bool fit = true;
+                for (int i = from + 1; i <= to; i++) {
+                    const FaceKeyFrame *frame = frames->at(indices[i]);
+                    const float w = (frame->frameIndex() - frameIndexFrom) / span;
+                    const float value = internal::lerp(keyFrameFrom->weight(), keyFrameTo->weight(), w);
+                    if (btFabs(value - frame->weight()) > m_faceWeightTolerance) {
+                        fit = false;
+                        break;
+                    }
+                }
+                if (!fit)
+                    break;
+                to++;
+            }
+            for (int i = from + 1; i < to; i++)
+                keep[indices[i]] = false;
+            from = to;
+        }
+        trackStart = trackEnd + 1;
+    }
+
+    FaceKeyFrameList reduced;
+    for (int i = 0; i < nFrames; i++) {
+        FaceKeyFrame *frame = frames->at(i);
+        if (keep[i])
+            reduced.push_back(frame);
+        else
+            delete frame;
+    }
+    frames->clear();
+    for (int i = 0; i < reduced.size(); i++)
+        frames->push_back(reduced[i]);
+}
+
+} /* namespace vpvl */
@@ -46,14 +46,18 @@ namespace vpvl
 
 const float PMDModel::kMinBoneWeight = 0.0001f;
 const float PMDModel::kMinFaceWeight = 0.001f;
+const float PMDModel::kMinKinematicMoveDiff = 0.0001f;
 
-class VMDMotionPriorityPredication
+static const int kAnimationIntervals[] = { 1, 2, 4, 4 };
+
+static void PMDModelMergeEditedFrame(uint32_t revision, float frameIndex, uint32_t &lastRevision, float &edited)
 {
-public:
-    bool operator()(const VMDMotion *left, const VMDMotion *right) {
-        return left->priority() > right->priority();
+    if (revision != lastRevision) {
+        const float value = revision == lastRevision + 1 ? frameIndex : 0.0f;
+        edited = edited < 0.0f ? value : btMin(edited, value);
+        lastRevision = revision;
     }
-};
+}
 
 struct SkinVertex
 {
@@ -73,7 +77,6 @@ struct State
 PMDModel::PMDModel()
     : m_baseFace(0),
       m_orderedBones(0),
-      m_skinnedVertices(0),
       m_world(0),
       m_indicesPointer(0),
       m_edgeIndicesPointer(0),
@@ -82,8 +85,22 @@ PMDModel::PMDModel()
       m_boundingSphereStep(kBoundingSpherePointsMin),
       m_edgeOffset(0.03f),
       m_selfShadowDensityCoef(0.0f),
-      m_enableSimulation(false)
+      m_animationPriority(1.0f),
+      m_animationElapsed(0.0f),
+      m_animationSpan(0.0f),
+      m_animationLead(0.0f),
+      m_animationDelta(0.0f),
+      m_editedMotionFrame(-1.0f),
+      m_animationLevel(kFullAnimation),
+      m_nextAnimationLevel(kFullAnimation),
+      m_writeOutput(0),
+      m_readOutput(0),
+      m_enableSimulation(false),
+      m_enableBufferedOutput(false),
+      m_enableDeactivation(false),
+      m_enableSoftwareSkinning(true)
 {
+    internal::zerofill(m_skinnedVertices, sizeof(m_skinnedVertices));
     internal::zerofill(&m_name, sizeof(m_name));
     internal::zerofill(&m_comment, sizeof(m_comment));
     internal::zerofill(&m_englishName, sizeof(m_englishName));
@@ -99,11 +116,9 @@ PMDModel::~PMDModel()
 
 void PMDModel::prepare()
 {
-    m_skinningTransform.reserve(m_bones.size());
+    m_skinningTransform.resize(m_bones.size());
     int nVertices = m_vertices.size();
-    m_skinnedVertices = new SkinVertex[nVertices];
-    m_edgeVertices.reserve(nVertices);
-    m_toonTextureCoords.reserve(nVertices);
+    allocateOutputBuffer(0);
     m_edgeIndicesPointer = new uint16_t[m_indices.size()];
     uint16_t *from = m_indicesPointer, *to = m_edgeIndicesPointer;
     int nMaterials = m_materials.size();
@@ -118,11 +133,6 @@ void PMDModel::prepare()
         }
         from += nindices;
     }
-    // Therefore no updating texture coordinates, set texture coordinates here
-    for (int i = 0; i < nVertices; i++) {
-        const Vertex *vertex = m_vertices[i];
-        m_skinnedVertices[i].texureCoord.setValue(vertex->u(), vertex->v(), 0);
-    }
     const uint32_t nBones = m_bones.size();
     for (uint32_t i = 0; i < nBones; i++) {
         Bone *bone = m_bones[i];
@@ -136,17 +146,155 @@ void PMDModel::prepare()
     for (uint32_t i = 0; i < nIKs; i++) {
         m_isIKSimulated.push_back(m_IKs[i]->isSimulated());
     }
+    // The rigid bodies jointed each other are in the same group
+    const int nRigidBodies = m_rigidBodies.size(), nConstraints = m_constraints.size();
+    btAlignedObjectArray<btRigidBody *> bodies;
+    btAlignedObjectArray<int> groups;
+    bodies.resize(nRigidBodies);
+    groups.resize(nRigidBodies);
+    for (int i = 0; i < nRigidBodies; i++) {
+        bodies[i] = m_rigidBodies[i]->body();
+        groups[i] = i;
+    }
+    for (int i = 0; i < nConstraints; i++) {
+        const btTypedConstraint *constraint = m_constraints[i]->constraint();
+        int a = bodies.findLinearSearch(const_cast<btRigidBody *>(&constraint->getRigidBodyA()));
+        int b = bodies.findLinearSearch(const_cast<btRigidBody *>(&constraint->getRigidBodyB()));
+        if (a == nRigidBodies || b == nRigidBodies)
+            continue;
+        while (groups[a] != a)
+            a = groups[a];
+        while (groups[b] != b)
+            b = groups[b];
+        groups[btMax(a, b)] = btMin(a, b);
+    }
+    // The rigid bodies bound to the bones are synchronized by the flat arrays
+    for (int i = 0; i < nRigidBodies; i++) {
+        const RigidBody *rigidBody = m_rigidBodies[i];
+        btRigidBody *body = rigidBody->body();
+        Bone *bone = rigidBody->bone();
+        int group = i;
+        while (groups[group] != group)
+            group = groups[group];
+        if (!body || !bone)
+            continue;
+        if (rigidBody->type() == 0) {
+            m_kinematicBodies.push_back(body);
+            m_kinematicBones.push_back(bone);
+            m_kinematicTransforms.push_back(rigidBody->transform());
+            m_kinematicGroups.push_back(group);
+            continue;
+        }
+        if (!rigidBody->isNoBone()) {
+            m_simulatedBodies.push_back(body);
+            m_simulatedBones.push_back(bone);
+            m_simulatedTransforms.push_back(rigidBody->invertedTransform());
+        }
+        if (rigidBody->type() == 2) {
+            m_alignedBones.push_back(bone);
+            m_alignedOrigins.push_back(bone->localTransform().getOrigin());
+            m_alignedGroups.push_back(group);
+        }
+        m_dynamicBodies.push_back(body);
+        m_dynamicGroups.push_back(group);
+        if (m_enableDeactivation)
+            body->forceActivationState(ACTIVE_TAG);
+    }
+    m_wakingGroups.resize(nRigidBodies);
+    for (int i = 0; i < nRigidBodies; i++)
+        m_wakingGroups[i] = false;
+    updateBoundingRadius();
     m_boundingSphereStep = nVertices / kBoundingSpherePoints;
     uint32_t max = kBoundingSpherePointsMax;
     uint32_t min = kBoundingSpherePointsMin;
     btClamp(m_boundingSphereStep, max, min);
 }
 
+void PMDModel::setAnimationLevel(AnimationLevel value)
+{
+    if (value >= kFullAnimation && value < kMaxAnimationLevels)
+        m_nextAnimationLevel = value;
+}
+
+void PMDModel::setEnableDeactivation(bool value)
+{
+    const int nBodies = m_dynamicBodies.size();
+    for (int i = 0; i < nBodies; i++) {
+        btRigidBody *body = m_dynamicBodies[i];
+        body->forceActivationState(value ? ACTIVE_TAG : DISABLE_DEACTIVATION);
+        body->setDeactivationTime(0.0f);
+    }
+    m_enableDeactivation = value;
+}
+
+int PMDModel::countActiveRigidBodies() const
+{
+    return m_dynamicBodies.size() - countSleepingRigidBodies();
+}
+
+int PMDModel::countSleepingRigidBodies() const
+{
+    const int nBodies = m_dynamicBodies.size();
+    int nSleepingBodies = 0;
+    for (int i = 0; i < nBodies; i++) {
+        if (!m_dynamicBodies[i]->isActive())
+            nSleepingBodies++;
+    }
+    return nSleepingBodies;
+}
+
+void PMDModel::setEnableBufferedOutput(bool value)
+{
+    if (m_enableBufferedOutput == value)
+        return;
+    // Keep the output being read as the only buffer
+    if (!value && m_readOutput != 0) {
+        btSwap(m_skinnedVertices[0], m_skinnedVertices[m_readOutput]);
+        m_edgeVertices[0].copyFromArray(m_edgeVertices[m_readOutput]);
+        m_toonTextureCoords[0].copyFromArray(m_toonTextureCoords[m_readOutput]);
+        m_skinningMatrices[0].copyFromArray(m_skinningMatrices[m_readOutput]);
+        m_faceVertices[0].copyFromArray(m_faceVertices[m_readOutput]);
+    }
+    // Start from the latest result so that the first read buffer is valid
+    const int nVertices = m_vertices.size();
+    for (int i = 1; i < kMaxOutputBuffers; i++) {
+        if (value) {
+            allocateOutputBuffer(i);
+            if (nVertices > 0) {
+                memcpy(m_skinnedVertices[i], m_skinnedVertices[0], sizeof(SkinVertex) * nVertices);
+                m_edgeVertices[i].copyFromArray(m_edgeVertices[0]);
+                m_toonTextureCoords[i].copyFromArray(m_toonTextureCoords[0]);
+            }
+            m_skinningMatrices[i].copyFromArray(m_skinningMatrices[0]);
+            m_faceVertices[i].copyFromArray(m_faceVertices[0]);
+        }
+        else {
+            releaseOutputBuffer(i);
+        }
+    }
+    // The bones are read from the bones themselves while the output is not buffered
+    for (int i = 0; i < kMaxOutputBuffers; i++) {
+        if (value)
+            updateBoneTransforms(m_boneTransforms[i]);
+        else
+            m_boneTransforms[i].clear();
+    }
+    m_writeOutput = m_readOutput = 0;
+    m_enableBufferedOutput = value;
+}
+
 void PMDModel::addMotion(VMDMotion *motion)
 {
     motion->attachModel(this);
+    motion->mutableBone()->setPoseBuffer(&m_pose);
+    // Keep the motions ordered by priority and insertion, a motion is blended over the previous ones
+    int nMotions = m_motions.size(), index = nMotions;
+    while (index > 0 && m_motions[index - 1]->priority() > motion->priority())
+        index--;
     m_motions.push_back(motion);
-    m_motions.quickSort(VMDMotionPriorityPredication());
+    for (int i = nMotions; i > index; i--)
+        m_motions.swap(i, i - 1);
+    m_editedMotionFrame = 0.0f;
 }
 
 void PMDModel::joinWorld(::btDiscreteDynamicsWorld *world)
@@ -157,6 +305,7 @@ void PMDModel::joinWorld(::btDiscreteDynamicsWorld *world)
     for (uint32_t i = 0; i < nRigidBodies; i++) {
         RigidBody *rigidBody = m_rigidBodies[i];
         rigidBody->setKinematic(false);
+        rigidBody->body()->activate();
         world->addRigidBody(rigidBody->body(), rigidBody->groupID(), rigidBody->groupMask());
     }
     uint32_t nConstraints = m_constraints.size();
@@ -187,9 +336,56 @@ void PMDModel::leaveWorld(::btDiscreteDynamicsWorld *world)
     m_world = 0;
 }
 
+void PMDModel::saveSimulation(btAlignedObjectArray<RigidBodyState> &states) const
+{
+    const int offset = states.size(), nRigidBodies = m_rigidBodies.size();
+    states.resize(offset + nRigidBodies);
+    for (int i = 0; i < nRigidBodies; i++)
+        m_rigidBodies[i]->saveState(states[offset + i]);
+}
+
+void PMDModel::restoreSimulation(const RigidBodyState *states)
+{
+    const int nRigidBodies = m_rigidBodies.size();
+    for (int i = 0; i < nRigidBodies; i++) {
+        RigidBody *rigidBody = m_rigidBodies[i];
+        rigidBody->restoreState(states[i]);
+        btBroadphaseProxy *proxy = rigidBody->body()->getBroadphaseHandle();
+        if (m_world && proxy)
+            m_world->getBroadphase()->getOverlappingPairCache()->cleanProxyFromPairs(proxy, m_world->getDispatcher());
+    }
+}
+
 void PMDModel::removeMotion(VMDMotion *motion)
 {
-    m_motions.remove(motion);
+    if (motion->bone().poseBuffer() == &m_pose)
+        motion->mutableBone()->setPoseBuffer(0);
+    // btAlignedObjectArray#remove doesn't keep the order
+    const int nMotions = m_motions.size();
+    int index = m_motions.findLinearSearch(motion);
+    if (index < nMotions) {
+        for (int i = index; i < nMotions - 1; i++)
+            m_motions.swap(i, i + 1);
+        m_motions.pop_back();
+        m_editedMotionFrame = 0.0f;
+    }
+}
+
+float PMDModel::takeEditedMotionFrame()
+{
+    // The revisions of the bone and face motions are kept in the order of the motions
+    const int nMotions = m_motions.size();
+    float edited = m_editedMotionFrame;
+    m_motionRevisions.resize(nMotions * 2);
+    for (int i = 0; i < nMotions; i++) {
+        const VMDMotion *motion = m_motions[i];
+        const BoneMotion &bone = motion->bone();
+        const FaceMotion &face = motion->face();
+        PMDModelMergeEditedFrame(bone.revision(), bone.editedFrame(), m_motionRevisions[i * 2], edited);
+        PMDModelMergeEditedFrame(face.revision(), face.editedFrame(), m_motionRevisions[i * 2 + 1], edited);
+    }
+    m_editedMotionFrame = -1.0f;
+    return edited;
 }
 
 void PMDModel::discardState(State *&state) const
@@ -241,12 +437,20 @@ PMDModel::State *PMDModel::saveState() const
 
 void PMDModel::seekMotion(float deltaFrame)
 {
+    // Motions are evaluated into the pose buffer in order of priority, then written to the bones once
     uint32_t nMotions = m_motions.size();
+    m_pose.reset(m_bones.size());
     for (uint32_t i = 0; i < nMotions; i++)
         m_motions[i]->seek(deltaFrame);
+    m_pose.apply(&m_bones);
+    // Seeking always evaluates the motions and starts a new interval
+    m_animationLevel = m_nextAnimationLevel;
+    m_animationElapsed = m_animationSpan = m_animationLead = m_animationDelta = 0.0f;
     updateAllBones();
-    updateAllFaces();
+    if (m_animationLevel != kMinimumAnimation)
+        updateAllFaces();
     updateBoneFromSimulation();
+    updateSimulationFromBone();
 }
 
 void PMDModel::updateRootBone()
@@ -257,18 +461,64 @@ void PMDModel::updateRootBone()
 
 void PMDModel::updateMotion(float deltaFrame)
 {
+    // A motion evaluates the pose at its current frame and then advances it,
+    // so the displayed pose advances by the previous delta. All frames below
+    // are relative to the displayed frame where the interpolation started.
+    const float step = m_animationDelta;
+    const float elapsed = m_animationElapsed + step;
+    m_animationDelta = deltaFrame;
+    if (elapsed < m_animationSpan) {
+        m_animationElapsed = elapsed;
+        interpolateAnimation(elapsed / m_animationSpan);
+        updateBoneFromSimulation();
+        updateSimulationFromBone();
+        return;
+    }
+    // The motions evaluate the pose at the target frame chosen by the
+    // previous evaluation, which is ahead of the displayed frame at the
+    // reduced rate
+    m_animationLevel = m_nextAnimationLevel;
+    const int interval = kAnimationIntervals[m_animationLevel];
+    const float span = m_animationSpan - m_animationElapsed + m_animationLead;
+    const float remaining = span - step;
+    const float advance = interval > 1 ? deltaFrame * interval : btMax(deltaFrame - remaining, 0.0f);
+    const bool interpolate = remaining > 0.0f;
+    if (interpolate)
+        saveAnimation(m_fromPositions, m_fromRotations, m_fromWeights);
     uint32_t nMotions = m_motions.size();
+    m_pose.reset(m_bones.size());
     for (uint32_t i = 0; i < nMotions; i++)
-        m_motions[i]->update(deltaFrame);
+        m_motions[i]->update(advance);
+    m_pose.apply(&m_bones);
     updateAllBones();
-    updateAllFaces();
+    if (m_animationLevel != kMinimumAnimation)
+        updateAllFaces();
+    m_animationLead = advance;
+    if (interpolate) {
+        m_animationElapsed = step;
+        m_animationSpan = span;
+        saveAnimation(m_toPositions, m_toRotations, m_toWeights);
+        interpolateAnimation(step / span);
+    }
+    else {
+        m_animationElapsed = 0.0f;
+        m_animationSpan = remaining;
+    }
     updateBoneFromSimulation();
+    updateSimulationFromBone();
 }
 
 void PMDModel::updateSkins()
 {
-    updateSkinVertices();
-    updateToon(m_lightDirection);
+    if (m_enableSoftwareSkinning) {
+        updateSkinVertices();
+        updateToon(m_lightDirection);
+    }
+    else {
+        updateSkinningMatrices();
+    }
+    if (m_enableBufferedOutput)
+        updateBoneTransforms(m_boneTransforms[m_writeOutput]);
 }
 
 void PMDModel::updateAllBones()
@@ -276,31 +526,128 @@ void PMDModel::updateAllBones()
     const int nBones = m_bones.size(), nIKs = m_IKs.size();
     for (int i = 0; i < nBones; i++)
         m_orderedBones[i]->updateTransform();
-    if (m_enableSimulation) {
-        for (int i = 0; i < nIKs; i++) {
-            // Solve IK with physic engine instead of IK class if it's disabled
-            if (!m_isIKSimulated[i])
+    if (m_animationLevel < kQuarterRateAnimation) {
+        // IK is skipped at the low level of detail
+        if (m_enableSimulation) {
+            for (int i = 0; i < nIKs; i++) {
+                // Solve IK with physic engine instead of IK class if it's disabled
+                if (!m_isIKSimulated[i])
+                    m_IKs[i]->solve();
+            }
+        }
+        else {
+            for (int i = 0; i < nIKs; i++)
                 m_IKs[i]->solve();
         }
     }
-    else {
-        for (int i = 0; i < nIKs; i++)
-            m_IKs[i]->solve();
-    }
     int nRotatedBones = m_rotatedBones.size();
     for (int i = 0; i < nRotatedBones; i++)
         m_rotatedBones[i]->updateRotation();
 }
 
+void PMDModel::saveAnimation(btAlignedObjectArray<btVector3> &positions,
+                             btAlignedObjectArray<btQuaternion> &rotations,
+                             btAlignedObjectArray<float> &weights) const
+{
+    const int nBones = m_bones.size(), nFaces = m_faces.size();
+    positions.resize(nBones);
+    rotations.resize(nBones);
+    weights.resize(nFaces);
+    for (int i = 0; i < nBones; i++) {
+        const Bone *bone = m_bones[i];
+        positions[i] = bone->position();
+        rotations[i] = bone->rotation();
+    }
+    for (int i = 0; i < nFaces; i++)
+        weights[i] = m_faces[i]->weight();
+}
+
+void PMDModel::interpolateAnimation(float rate)
+{
+    const int nBones = m_bones.size(), nFaces = m_faces.size(), nRotatedBones = m_rotatedBones.size();
+    for (int i = 0; i < nBones; i++) {
+        Bone *bone = m_bones[i];
+        bone->setPosition(m_fromPositions[i].lerp(m_toPositions[i], rate));
+        bone->setRotation(m_fromRotations[i].slerp(m_toRotations[i], rate));
+    }
+    // The rotations solved by IK are interpolated, so IK is not solved here
+    for (int i = 0; i < nBones; i++)
+        m_orderedBones[i]->updateTransform();
+    for (int i = 0; i < nRotatedBones; i++)
+        m_rotatedBones[i]->updateRotation();
+    if (m_animationLevel != kMinimumAnimation) {
+        for (int i = 0; i < nFaces; i++)
+            m_faces[i]->setWeight(internal::lerp(m_fromWeights[i], m_toWeights[i], rate));
+        updateAllFaces();
+    }
+}
+
 void PMDModel::updateBoneFromSimulation()
 {
     if (m_enableSimulation) {
-        const int nRigidBodies = m_rigidBodies.size();
-        for (int i = 0; i < nRigidBodies; i++)
-            m_rigidBodies[i]->transformBone();
+        // The aligned bodies follow the origins of the bones only while they are active,
+        // so the group is woken up if the bone is moved before the sleeping body overwrites it
+        if (m_enableDeactivation) {
+            const int nAlignedBodies = m_alignedBones.size();
+            bool waking = false;
+            for (int i = 0; i < nAlignedBodies; i++) {
+                const btVector3 &origin = m_alignedBones[i]->localTransform().getOrigin();
+                if (m_alignedOrigins[i].distance2(origin) > kMinKinematicMoveDiff * kMinKinematicMoveDiff) {
+                    m_alignedOrigins[i] = origin;
+                    m_wakingGroups[m_alignedGroups[i]] = true;
+                    waking = true;
+                }
+            }
+            if (waking)
+                activateWakingGroups();
+        }
+        const int nBodies = m_simulatedBodies.size();
+        for (int i = 0; i < nBodies; i++)
+            m_simulatedBones[i]->setLocalTransform(m_simulatedBodies[i]->getCenterOfMassTransform() * m_simulatedTransforms[i]);
     }
 }
 
+void PMDModel::updateSimulationFromBone()
+{
+    // The kinematic bodies have no motion state, so the world uses the transforms set here
+    // and they follow the bones while the model is in the world even if the simulation is disabled
+    if (m_world) {
+        const int nBodies = m_kinematicBodies.size();
+        bool waking = false;
+        for (int i = 0; i < nBodies; i++) {
+            btRigidBody *body = m_kinematicBodies[i];
+            const btTransform transform = m_kinematicBones[i]->localTransform() * m_kinematicTransforms[i];
+            if (m_enableDeactivation) {
+                // Wake the group up if the kinematic body moves
+                const btTransform &current = body->getWorldTransform();
+                const btMatrix3x3 &from = current.getBasis(), &to = transform.getBasis();
+                const btScalar diff = kMinKinematicMoveDiff * kMinKinematicMoveDiff;
+                if (current.getOrigin().distance2(transform.getOrigin()) > diff
+                        || from[0].distance2(to[0]) > diff
+                        || from[1].distance2(to[1]) > diff
+                        || from[2].distance2(to[2]) > diff) {
+                    m_wakingGroups[m_kinematicGroups[i]] = true;
+                    waking = true;
+                }
+            }
+            body->setWorldTransform(transform);
+        }
+        if (waking)
+            activateWakingGroups();
+    }
+}
+
+void PMDModel::activateWakingGroups()
+{
+    const int nDynamicBodies = m_dynamicBodies.size(), nGroups = m_wakingGroups.size();
+    for (int i = 0; i < nDynamicBodies; i++) {
+        if (m_wakingGroups[m_dynamicGroups[i]])
+            m_dynamicBodies[i]->activate();
+    }
+    for (int i = 0; i < nGroups; i++)
+        m_wakingGroups[i] = false;
+}
+
 void PMDModel::updateAllFaces()
 {
     int nFaces = m_faces.size();
@@ -340,7 +687,7 @@ void PMDModel::updateSkinVertices()
     const int nVertices = m_vertices.size();
     for (int i = 0; i < nVertices; i++) {
         const Vertex *vertex = m_vertices[i];
-        SkinVertex &skin = m_skinnedVertices[i];
+        SkinVertex &skin = m_skinnedVertices[m_writeOutput][i];
         const float weight = vertex->weight();
         if (weight >= 1.0f - kMinBoneWeight) {
             const int16_t bone1 = vertex->bone1();
@@ -374,16 +721,55 @@ void PMDModel::updateSkinVertices()
 void PMDModel::updateToon(const btVector3 &lightDirection)
 {
     const int nVertices = m_vertices.size();
+    const SkinVertex *skinnedVertices = m_skinnedVertices[m_writeOutput];
+    btAlignedObjectArray<btVector3> &toonTextureCoords = m_toonTextureCoords[m_writeOutput];
+    btAlignedObjectArray<btVector3> &edgeVertices = m_edgeVertices[m_writeOutput];
     for (int i = 0; i < nVertices; i++) {
-        const SkinVertex &skin = m_skinnedVertices[i];
-        m_toonTextureCoords[i].setValue(0.0f, (1.0f - lightDirection.dot(skin.normal)) * 0.5f, 0.0f);
+        const SkinVertex &skin = skinnedVertices[i];
+        toonTextureCoords[i].setValue(0.0f, (1.0f - lightDirection.dot(skin.normal)) * 0.5f, 0.0f);
         if (!m_vertices[i]->isEdgeEnabled())
-            m_edgeVertices[i] = skin.position;
+            edgeVertices[i] = skin.position;
         else
-            m_edgeVertices[i] = skin.position + skin.normal * m_edgeOffset;
+            edgeVertices[i] = skin.position + skin.normal * m_edgeOffset;
+    }
+}
+
+void PMDModel::updateSkinningMatrices()
+{
+    const int nBones = m_bones.size();
+    btAlignedObjectArray<btVector4> &matrices = m_skinningMatrices[m_writeOutput];
+    matrices.resize(nBones * 3);
+    for (int i = 0; i < nBones; i++) {
+        btTransform &transform = m_skinningTransform[i];
+        m_bones[i]->getSkinTransform(transform);
+        const btMatrix3x3 &basis = transform.getBasis();
+        const btVector3 &origin = transform.getOrigin();
+        for (int j = 0; j < 3; j++) {
+            const btVector3 &row = basis.getRow(j);
+            matrices[i * 3 + j].setValue(row.x(), row.y(), row.z(), origin[j]);
+        }
+    }
+    if (m_baseFace) {
+        const btAlignedObjectArray<FaceVertex *> &vertices = m_baseFace->vertices();
+        btAlignedObjectArray<btVector3> &faceVertices = m_faceVertices[m_writeOutput];
+        const uint32_t nVertices = m_vertices.size();
+        const int nFaceVertices = vertices.size();
+        faceVertices.resize(nFaceVertices);
+        for (int i = 0; i < nFaceVertices; i++) {
+            const FaceVertex *fv = vertices[i];
+            faceVertices[i] = fv->id < nVertices ? m_vertices[fv->id]->position() : fv->position;
+        }
     }
 }
 
+void PMDModel::updateBoneTransforms(btAlignedObjectArray<btTransform> &transforms)
+{
+    const int nBones = m_bones.size();
+    transforms.resize(nBones);
+    for (int i = 0; i < nBones; i++)
+        transforms[i] = m_bones[i]->localTransform();
+}
+
 void PMDModel::updateImmediate()
 {
     updateRootBone();
@@ -414,7 +800,7 @@ float PMDModel::boundingSphereRange(btVector3 &center)
     btVector3 pos = bone->localTransform().getOrigin();
     const int nVertices = m_vertices.size();
     for (int i = 0; i < nVertices; i++) {
-        const float r2 = pos.distance2(m_skinnedVertices[i].position);
+        const float r2 = pos.distance2(m_skinnedVertices[m_writeOutput][i].position);
         if (max < r2)
             max = r2;
     }
@@ -423,6 +809,32 @@ float PMDModel::boundingSphereRange(btVector3 &center)
     return max;
 }
 
+void PMDModel::getBoundingBox(btVector3 &min, btVector3 &max) const
+{
+    float maxWeight = 1.0f;
+    const int nBones = m_bones.size(), nFaces = m_faces.size();
+    for (int i = 0; i < nFaces; i++)
+        btSetMax(maxWeight, m_faces[i]->weight());
+    min.setValue(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+    max.setValue(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+    for (int i = 0; i < nBones; i++) {
+        const float skinRadius = m_boneSkinRadius[i];
+        if (skinRadius < 0.0f)
+            continue;
+        // A rigid bone transform keeps the distance of a vertex from the bone
+        // and a blended vertex is in the hull of the spheres of its bones
+        const float radius = skinRadius + m_boneFaceRadius[i] * maxWeight;
+        const btVector3 &origin = m_bones[i]->localTransform().getOrigin();
+        const btVector3 extent(radius, radius, radius);
+        min.setMin(origin - extent);
+        max.setMax(origin + extent);
+    }
+    if (min.x() > max.x()) {
+        const btVector3 &origin = Bone::centerBone(&m_bones)->localTransform().getOrigin();
+        min = max = origin;
+    }
+}
+
 void PMDModel::smearAllBonesToDefault(float rate)
 {
     const int nBones = m_bones.size(), nFaces = m_faces.size();
@@ -853,24 +1265,109 @@ void PMDModel::release()
     m_indices.clear();
     m_motions.clear();
     m_skinningTransform.clear();
-    m_edgeVertices.clear();
-    m_toonTextureCoords.clear();
+    for (int i = 0; i < kMaxOutputBuffers; i++)
+        releaseOutputBuffer(i);
     m_shadowTextureCoords.clear();
+    m_boneSkinRadius.clear();
+    m_boneFaceRadius.clear();
+    m_fromPositions.clear();
+    m_toPositions.clear();
+    m_fromRotations.clear();
+    m_toRotations.clear();
+    m_fromWeights.clear();
+    m_toWeights.clear();
+    m_animationElapsed = m_animationSpan = m_animationLead = m_animationDelta = 0.0f;
     m_rotatedBones.clear();
     m_isIKSimulated.clear();
+    m_kinematicBodies.clear();
+    m_kinematicBones.clear();
+    m_kinematicTransforms.clear();
+    m_simulatedBodies.clear();
+    m_simulatedBones.clear();
+    m_simulatedTransforms.clear();
+    m_kinematicGroups.clear();
+    m_alignedBones.clear();
+    m_alignedOrigins.clear();
+    m_alignedGroups.clear();
+    m_dynamicBodies.clear();
+    m_dynamicGroups.clear();
+    m_wakingGroups.clear();
     delete[] m_orderedBones;
-    delete[] m_skinnedVertices;
     delete[] m_indicesPointer;
     delete[] m_edgeIndicesPointer;
     m_baseFace = 0;
     m_orderedBones = 0;
-    m_skinnedVertices = 0;
+    m_writeOutput = m_readOutput = 0;
+    m_enableBufferedOutput = false;
     m_indicesPointer = 0;
     m_edgeIndicesPointer = 0;
     m_edgeIndicesCount = 0;
     m_error = kNoError;
 }
 
+void PMDModel::updateBoundingRadius()
+{
+    const int nBones = m_bones.size(), nVertices = m_vertices.size(), nFaces = m_faces.size();
+    // Sum of the offsets of all faces is the farthest a vertex is morphed at weight 1
+    btAlignedObjectArray<float> faceRadius;
+    faceRadius.resize(nVertices, 0.0f);
+    for (int i = 0; i < nFaces; i++) {
+        const Face *face = m_faces[i];
+        if (face->type() == Face::kBase)
+            continue;
+        const btAlignedObjectArray<FaceVertex *> &vertices = face->vertices();
+        const int nFaceVertices = vertices.size();
+        for (int j = 0; j < nFaceVertices; j++) {
+            const FaceVertex *vertex = vertices[j];
+            if (vertex->id < static_cast<uint32_t>(nVertices))
+                faceRadius[vertex->id] += vertex->position.length();
+        }
+    }
+    m_boneSkinRadius.resize(nBones);
+    m_boneFaceRadius.resize(nBones);
+    for (int i = 0; i < nBones; i++) {
+        m_boneSkinRadius[i] = -1.0f;
+        m_boneFaceRadius[i] = 0.0f;
+    }
+    for (int i = 0; i < nVertices; i++) {
+        const Vertex *vertex = m_vertices[i];
+        const int16_t bones[] = { vertex->bone1(), vertex->bone2() };
+        for (int j = 0; j < 2; j++) {
+            const int16_t bone = bones[j];
+            if (bone < 0 || bone >= nBones)
+                continue;
+            const float distance = vertex->position().distance(m_bones[bone]->originPosition());
+            btSetMax(m_boneSkinRadius[bone], distance);
+            btSetMax(m_boneFaceRadius[bone], faceRadius[i]);
+        }
+    }
+}
+
+void PMDModel::allocateOutputBuffer(int index)
+{
+    const int nVertices = m_vertices.size();
+    SkinVertex *skinnedVertices = new SkinVertex[nVertices];
+    // Therefore no updating texture coordinates, set texture coordinates here
+    for (int i = 0; i < nVertices; i++) {
+        const Vertex *vertex = m_vertices[i];
+        skinnedVertices[i].texureCoord.setValue(vertex->u(), vertex->v(), 0);
+    }
+    delete[] m_skinnedVertices[index];
+    m_skinnedVertices[index] = skinnedVertices;
+    m_edgeVertices[index].resize(nVertices);
+    m_toonTextureCoords[index].resize(nVertices);
+}
+
+void PMDModel::releaseOutputBuffer(int index)
+{
+    delete[] m_skinnedVertices[index];
+    m_skinnedVertices[index] = 0;
+    m_edgeVertices[index].clear();
+    m_toonTextureCoords[index].clear();
+    m_skinningMatrices[index].clear();
+    m_faceVertices[index].clear();
+}
+
 void PMDModel::sortBones()
 {
     uint32_t nbones = m_bones.size();
@@ -928,27 +1425,45 @@ size_t PMDModel::stride(StrideType type) const
 
 const void *PMDModel::verticesPointer() const
 {
-    return &m_skinnedVertices[0].position;
+    return &m_skinnedVertices[m_readOutput][0].position;
 }
 
 const void *PMDModel::normalsPointer() const
 {
-    return &m_skinnedVertices[0].normal;
+    return &m_skinnedVertices[m_readOutput][0].normal;
 }
 
 const void *PMDModel::textureCoordsPointer() const
 {
-    return &m_skinnedVertices[0].texureCoord;
+    return &m_skinnedVertices[m_readOutput][0].texureCoord;
 }
 
 const void *PMDModel::toonTextureCoordsPointer() const
 {
-    return &m_toonTextureCoords[0];
+    return &m_toonTextureCoords[m_readOutput][0];
 }
 
 const void *PMDModel::edgeVerticesPointer() const
 {
-    return &m_edgeVertices[0];
+    return &m_edgeVertices[m_readOutput][0];
+}
+
+const void *PMDModel::skinningMatricesPointer() const
+{
+    const btAlignedObjectArray<btVector4> &matrices = m_skinningMatrices[m_readOutput];
+    return matrices.size() > 0 ? &matrices[0] : 0;
+}
+
+const void *PMDModel::faceVerticesPointer() const
+{
+    const btAlignedObjectArray<btVector3> &vertices = m_faceVertices[m_readOutput];
+    return vertices.size() > 0 ? &vertices[0] : 0;
+}
+
+const btTransform &PMDModel::boneTransform(int index) const
+{
+    const btAlignedObjectArray<btTransform> &transforms = m_boneTransforms[m_readOutput];
+    return index < transforms.size() ? transforms[index] : m_bones[index]->localTransform();
 }
 
 }
@@ -0,0 +1,105 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "vpvl/vpvl.h"
+#include "vpvl/internal/util.h"
+
+namespace vpvl
+{
+
+PoseBuffer::PoseBuffer()
+{
+}
+
+PoseBuffer::~PoseBuffer()
+{
+    m_positions.clear();
+    m_rotations.clear();
+    m_blended.clear();
+    m_blendedIndices.clear();
+}
+
+void PoseBuffer::reset(uint32_t nBones)
+{
+    if (static_cast<uint32_t>(m_blended.size()) != nBones) {
+        m_positions.resize(nBones);
+        m_rotations.resize(nBones);
+        m_blended.resize(nBones);
+        for (uint32_t i = 0; i < nBones; i++)
+            m_blended[i] = false;
+    }
+    else {
+        const int nBlended = m_blendedIndices.size();
+        for (int i = 0; i < nBlended; i++)
+            m_blended[m_blendedIndices[i]] = false;
+    }
+    m_blendedIndices.clear();
+}
+
+void PoseBuffer::blend(const Bone *bone, const btVector3 &position, const btQuaternion &rotation, float weight)
+{
+    const int index = bone->id();
+    if (index < 0 || index >= m_blended.size())
+        return;
+    // The first layer blends over the current value of the bone
+    if (!m_blended[index]) {
+        m_positions[index] = bone->position();
+        m_rotations[index] = bone->rotation();
+        m_blended[index] = true;
+        m_blendedIndices.push_back(index);
+    }
+    if (weight >= 1.0f) {
+        m_positions[index] = position;
+        m_rotations[index] = rotation;
+    }
+    else if (weight > 0.0f) {
+        m_positions[index] = m_positions[index].lerp(position, weight);
+        m_rotations[index] = m_rotations[index].slerp(rotation, weight);
+    }
+}
+
+void PoseBuffer::apply(BoneList *bones) const
+{
+    const int nBlended = m_blendedIndices.size();
+    for (int i = 0; i < nBlended; i++) {
+        const int index = m_blendedIndices[i];
+        Bone *bone = bones->at(index);
+        bone->setPosition(m_positions[index]);
+        bone->setRotation(m_rotations[index]);
+    }
+}
+
+} /* namespace vpvl */
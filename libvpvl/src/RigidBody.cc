@@ -240,7 +240,8 @@ void RigidBody::read(const uint8_t *data, BoneList *bones)
 
         switch (type) {
         case 0:
-            m_motionState = new KinematicMotionState(m_transform, bone);
+            // PMDModel moves the body to the bone before stepping the world
+            m_motionState = 0;
             m_kinematicMotionState = 0;
             break;
         case 1:
@@ -254,6 +255,7 @@ void RigidBody::read(const uint8_t *data, BoneList *bones)
         }
 
         btRigidBody::btRigidBodyConstructionInfo info(massValue, m_motionState, m_shape, localInertia);
+        info.m_startWorldTransform = startTransform;
         info.m_linearDamping = linearDamping;
         info.m_angularDamping = angularDamping;
         info.m_restitution = restitution;
@@ -294,4 +296,29 @@ void RigidBody::setKinematic(bool value)
     }
 }
 
+void RigidBody::saveState(RigidBodyState &state) const
+{
+    const btTransform &transform = m_body->getCenterOfMassTransform();
+    state.position = transform.getOrigin();
+    state.rotation = transform.getRotation();
+    state.linearVelocity = m_body->getLinearVelocity();
+    state.angularVelocity = m_body->getAngularVelocity();
+}
+
+void RigidBody::restoreState(const RigidBodyState &state)
+{
+    const btTransform transform(state.rotation, state.position);
+    // The interpolation transform is also reset to keep the kinematic velocity
+    m_body->setCenterOfMassTransform(transform);
+    m_body->setInterpolationWorldTransform(transform);
+    m_body->setLinearVelocity(state.linearVelocity);
+    m_body->setAngularVelocity(state.angularVelocity);
+    m_body->setInterpolationLinearVelocity(state.linearVelocity);
+    m_body->setInterpolationAngularVelocity(state.angularVelocity);
+    m_body->clearForces();
+    m_body->activate();
+    if (!m_body->isStaticOrKinematicObject())
+        m_motionState->setWorldTransform(transform);
+}
+
 }
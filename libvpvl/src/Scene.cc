@@ -41,9 +41,66 @@
 #include "vpvl/vpvl.h"
 #include "vpvl/internal/util.h"
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 namespace vpvl
 {
 
+#ifdef WIN32
+typedef CRITICAL_SECTION SceneOutputMutex;
+#else
+typedef pthread_mutex_t SceneOutputMutex;
+#endif
+
+/* a frame of the output that the renderer reads */
+struct SceneOutput
+{
+    btAlignedObjectArray<PMDModel *> models;
+    btAlignedObjectArray<PMDModel *> visibleModels;
+    float modelview[16];
+    float projection[16];
+};
+
+/*
+ * The updating thread owns the write buffer and the rendering thread owns
+ * the read buffer. Only the indices are exchanged under the mutex, so
+ * neither thread waits for the other to finish its frame.
+ */
+struct SceneOutputBuffer
+{
+    SceneOutput outputs[PMDModel::kMaxOutputBuffers];
+    SceneOutputMutex mutex;
+    int write;
+    int ready;
+    int read;
+    bool published;
+};
+
+/* the states of the rigid bodies of all models at a frame */
+struct SceneCheckpoint
+{
+    btAlignedObjectArray<PMDModel *> models;
+    btAlignedObjectArray<int> offsets;
+    btAlignedObjectArray<RigidBodyState> states;
+    float frameIndex;
+};
+
+#ifdef WIN32
+static void SceneOutputInitialize(SceneOutputBuffer *b) { InitializeCriticalSection(&b->mutex); }
+static void SceneOutputDestroy(SceneOutputBuffer *b) { DeleteCriticalSection(&b->mutex); }
+static void SceneOutputLock(SceneOutputBuffer *b) { EnterCriticalSection(&b->mutex); }
+static void SceneOutputUnlock(SceneOutputBuffer *b) { LeaveCriticalSection(&b->mutex); }
+#else
+static void SceneOutputInitialize(SceneOutputBuffer *b) { pthread_mutex_init(&b->mutex, 0); }
+static void SceneOutputDestroy(SceneOutputBuffer *b) { pthread_mutex_destroy(&b->mutex); }
+static void SceneOutputLock(SceneOutputBuffer *b) { pthread_mutex_lock(&b->mutex); }
+static void SceneOutputUnlock(SceneOutputBuffer *b) { pthread_mutex_unlock(&b->mutex); }
+#endif
+
 const float Scene::kFrustumNear = 0.5f;
 const float Scene::kFrustumFar = 8000.0f;
 const float Scene::kMinMoveDiff = 0.000001f;
@@ -54,24 +111,120 @@ const float Scene::kMinDistanceDiff = 0.1f;
 const float Scene::kDistanceSpeedRate = 0.9f;
 const float Scene::kMinFovyDiff = 0.01f;
 const float Scene::kFovySpeedRate = 0.9f;
+const float Scene::kMinDepthDiff = 0.1f;
+const float Scene::kHalfRateAnimationSize = 0.25f;
+const float Scene::kQuarterRateAnimationSize = 0.1f;
+const float Scene::kMinimumAnimationSize = 0.04f;
+
+static float SceneModelDepth(const btTransform &transform, const PMDModel *model)
+{
+    return (transform * Bone::centerBone(&model->bones())->localTransform().getOrigin()).z();
+}
+
+static void SceneStepWorld(btDiscreteDynamicsWorld *world, float deltaFrame, int fps)
+{
+    btScalar sec = deltaFrame / Scene::kFPS;
+    if (sec > 1.0f)
+        world->stepSimulation(sec, 1, sec);
+    else
+        world->stepSimulation(sec, fps, 1.0f / fps);
+}
+
+static bool SceneIsInsideFrustum(const float planes[6][4], const btVector3 &min, const btVector3 &max)
+{
+    for (int i = 0; i < 6; i++) {
+        // Test the corner of the box farthest along the plane normal
+        const float *plane = planes[i];
+        const float x = plane[0] > 0.0f ? max.x() : min.x();
+        const float y = plane[1] > 0.0f ? max.y() : min.y();
+        const float z = plane[2] > 0.0f ? max.z() : min.z();
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+class SceneModelTask : public IThreadPoolTask
+{
+public:
+    SceneModelTask()
+        : m_model(0),
+          m_planes(0),
+          m_frameIndex(0.0f),
+          m_seek(false),
+          m_skin(true),
+          m_visible(true) {
+    }
+    void set(PMDModel *model, const float (*planes)[4], float frameIndex, bool seek, bool skin) {
+        m_model = model;
+        m_planes = planes;
+        m_frameIndex = frameIndex;
+        m_seek = seek;
+        m_skin = skin;
+        m_visible = true;
+    }
+    void run() {
+        // Every stage touches only the model's own bones, faces and vertices
+        m_model->updateRootBone();
+        if (m_seek)
+            m_model->seekMotion(m_frameIndex);
+        else
+            m_model->updateMotion(m_frameIndex);
+        if (m_planes) {
+            btVector3 min, max;
+            m_model->getBoundingBox(min, max);
+#ifndef VPVL_COORDINATE_OPENGL
+            // Renderer flips Z axis of the models
+            const float minZ = min.z();
+            min.setZ(-max.z());
+            max.setZ(-minZ);
+#endif
+            m_visible = SceneIsInsideFrustum(m_planes, min, max);
+        }
+        if (m_visible && m_skin)
+            m_model->updateSkins();
+    }
+    PMDModel *model() const {
+        return m_model;
+    }
+    bool isVisible() const {
+        return m_visible;
+    }
+private:
+    PMDModel *m_model;
+    const float (*m_planes)[4];
+    float m_frameIndex;
+    bool m_seek;
+    bool m_skin;
+    bool m_visible;
+};
 
-class SceneModelDistancePredication
+class SceneWorldTask : public IThreadPoolTask
 {
 public:
-    SceneModelDistancePredication(const btTransform &transform)
-        : m_transform(transform) {
+    SceneWorldTask()
+        : m_world(0),
+          m_deltaFrame(0.0f),
+          m_fps(0) {
+    }
+    void set(btDiscreteDynamicsWorld *world, float deltaFrame, int fps) {
+        m_world = world;
+        m_deltaFrame = deltaFrame;
+        m_fps = fps;
     }
-    bool operator()(const PMDModel *left, const PMDModel *right) {
-        const btVector3 positionLeft = m_transform * Bone::centerBone(&left->bones())->localTransform().getOrigin();
-        const btVector3 positionRight = m_transform * Bone::centerBone(&right->bones())->localTransform().getOrigin();
-        return positionLeft.z() < positionRight.z();
+    void run() {
+        SceneStepWorld(m_world, m_deltaFrame, m_fps);
     }
 private:
-    const btTransform m_transform;
+    btDiscreteDynamicsWorld *m_world;
+    float m_deltaFrame;
+    int m_fps;
 };
 
 Scene::Scene(int width, int height, int fps)
     : m_world(0),
+      m_pool(0),
+      m_output(0),
       m_cameraMotion(0),
       m_currentRotation(0.0f, 0.0f, 0.0f, 1.0f),
       m_rotation(m_currentRotation),
@@ -90,9 +243,21 @@ Scene::Scene(int width, int height, int fps)
       m_viewMoveFovy(m_currentFovy),
       m_viewMoveTime(-1),
       m_currentFPS(fps),
+      m_maxCatchUpSteps(kDefaultMaxCatchUpSteps),
+      m_accumulatedTime(0.0f),
+      m_currentFrame(0.0f),
+      m_checkpointInterval(0.0f),
+      m_maxCheckpoints(kDefaultMaxCheckpoints),
+      m_activeRigidBodies(0),
+      m_sleepingRigidBodies(0),
+      m_concurrentWorlds(0),
       m_width(width),
-      m_height(height)
+      m_height(height),
+      m_enableFrustumCulling(false),
+      m_enableAnimationLOD(false),
+      m_staleSimulation(false)
 {
+    internal::zerofill(m_frustumPlanes, sizeof(m_frustumPlanes));
     updateProjectionMatrix();
     updateModelViewMatrix();
 }
@@ -100,8 +265,16 @@ Scene::Scene(int width, int height, int fps)
 Scene::~Scene()
 {
     internal::zerofill(m_projection, sizeof(m_projection));
+    const int nModels = m_models.size();
+    for (int i = 0; i < nModels; i++)
+        setIslandWorld(m_models[i], 0);
     setWorld(0);
+    setEnableBufferedOutput(false);
+    clearCheckpoints();
     m_models.clear();
+    m_modelDepths.clear();
+    m_visibleModels.clear();
+    m_pool = 0;
     m_cameraMotion = 0;
     m_currentRotation.setValue(0.0f, 0.0f, 0.0f, 1.0f);
     m_rotation.setValue(0.0f, 0.0f, 0.0f, 1.0f);
@@ -121,6 +294,12 @@ Scene::~Scene()
     m_viewMoveFovy = 0.0f;
     m_viewMoveTime = -1;
     m_currentFPS = 0;
+    m_maxCatchUpSteps = 0;
+    m_accumulatedTime = 0.0f;
+    m_currentFrame = 0.0f;
+    m_checkpointInterval = 0.0f;
+    m_activeRigidBodies = 0;
+    m_sleepingRigidBodies = 0;
     m_width = 0;
     m_height = 0;
 }
@@ -128,32 +307,172 @@ Scene::~Scene()
 void Scene::addModel(PMDModel *model)
 {
     m_models.push_back(model);
+    // Forces to put the new model in the rendering order
+    m_modelDepths.push_back(BT_LARGE_FLOAT);
     sortRenderingOrder();
+    // The model is visible until the next update tests it
+    m_visibleModels.copyFromArray(m_models);
     model->setLightDirection(m_lightDirection);
     model->joinWorld(m_world);
+    clearCheckpoints();
+    if (m_output) {
+        model->setEnableBufferedOutput(true);
+        model->setWriteOutputBuffer(m_output->write);
+        model->setReadOutputBuffer(m_output->read);
+    }
+}
+
+int Scene::advance(float seconds)
+{
+    const float step = 1.0f / m_currentFPS;
+    int nSteps = 0;
+    m_accumulatedTime += seconds;
+    while (m_accumulatedTime >= step && nSteps < m_maxCatchUpSteps) {
+        update(step * kFPS);
+        m_accumulatedTime -= step;
+        nSteps++;
+    }
+    // Dropping the time that could not catch up instead of spiraling into more steps
+    if (m_accumulatedTime >= step)
+        m_accumulatedTime = btFmod(m_accumulatedTime, step);
+    return nSteps;
+}
+
+PMDModel **Scene::getVisibleRenderingOrder(size_t &size)
+{
+    btAlignedObjectArray<PMDModel *> &models = m_output ? m_output->outputs[m_output->read].visibleModels : m_visibleModels;
+    size = models.size();
+    return size > 0 ? &models[0] : 0;
 }
 
 PMDModel **Scene::getRenderingOrder(size_t &size)
 {
-    size = m_models.size();
-    return &m_models[0];
+    btAlignedObjectArray<PMDModel *> &models = m_output ? m_output->outputs[m_output->read].models : m_models;
+    size = models.size();
+    return size > 0 ? &models[0] : 0;
 }
 
 void Scene::getModelViewMatrix(float matrix[]) const
 {
-    m_modelview.getOpenGLMatrix(matrix);
+    if (m_output)
+        memcpy(matrix, m_output->outputs[m_output->read].modelview, sizeof(m_output->outputs[0].modelview));
+    else
+        m_modelview.getOpenGLMatrix(matrix);
 }
 
 void Scene::getProjectionMatrix(float matrix[]) const
 {
-    memcpy(matrix, m_projection, sizeof(m_projection));
+    if (m_output)
+        memcpy(matrix, m_output->outputs[m_output->read].projection, sizeof(m_projection));
+    else
+        memcpy(matrix, m_projection, sizeof(m_projection));
+}
+
+void Scene::setEnableBufferedOutput(bool value)
+{
+    const int nModels = m_models.size();
+    if (value && !m_output) {
+        m_output = new SceneOutputBuffer();
+        SceneOutputInitialize(m_output);
+        m_output->write = 0;
+        m_output->ready = 1;
+        m_output->read = 2;
+        m_output->published = false;
+        // All buffers start from the current state so that rendering before
+        // the first publication reads a valid output
+        for (int i = 0; i < PMDModel::kMaxOutputBuffers; i++) {
+            SceneOutput &output = m_output->outputs[i];
+            output.models.copyFromArray(m_models);
+            output.visibleModels.copyFromArray(m_visibleModels);
+            m_modelview.getOpenGLMatrix(output.modelview);
+            memcpy(output.projection, m_projection, sizeof(m_projection));
+        }
+        for (int i = 0; i < nModels; i++) {
+            PMDModel *model = m_models[i];
+            model->setEnableBufferedOutput(true);
+            model->setWriteOutputBuffer(m_output->write);
+            model->setReadOutputBuffer(m_output->read);
+        }
+    }
+    else if (!value && m_output) {
+        // The models keep the latest published output
+        acquireOutput();
+        for (int i = 0; i < nModels; i++)
+            m_models[i]->setEnableBufferedOutput(false);
+        SceneOutputDestroy(m_output);
+        delete m_output;
+        m_output = 0;
+    }
+}
+
+void Scene::publishOutput()
+{
+    if (!m_output)
+        return;
+    // The write buffer is owned by this thread so it is filled without locking
+    SceneOutput &output = m_output->outputs[m_output->write];
+    output.models.copyFromArray(m_models);
+    output.visibleModels.copyFromArray(m_visibleModels);
+    m_modelview.getOpenGLMatrix(output.modelview);
+    memcpy(output.projection, m_projection, sizeof(m_projection));
+    SceneOutputLock(m_output);
+    btSwap(m_output->write, m_output->ready);
+    m_output->published = true;
+    SceneOutputUnlock(m_output);
+    const int write = m_output->write, nModels = m_models.size();
+    for (int i = 0; i < nModels; i++)
+        m_models[i]->setWriteOutputBuffer(write);
+}
+
+bool Scene::acquireOutput()
+{
+    if (!m_output)
+        return false;
+    bool acquired = false;
+    SceneOutputLock(m_output);
+    if (m_output->published) {
+        btSwap(m_output->read, m_output->ready);
+        m_output->published = false;
+        acquired = true;
+    }
+    SceneOutputUnlock(m_output);
+    if (acquired) {
+        const int read = m_output->read;
+        btAlignedObjectArray<PMDModel *> &models = m_output->outputs[read].models;
+        const int nModels = models.size();
+        for (int i = 0; i < nModels; i++)
+            models[i]->setReadOutputBuffer(read);
+    }
+    return acquired;
+}
+
+void Scene::clearCheckpoints()
+{
+    const int nCheckpoints = m_checkpoints.size();
+    for (int i = 0; i < nCheckpoints; i++)
+        delete m_checkpoints[i];
+    m_checkpoints.clear();
 }
 
 void Scene::removeModel(PMDModel *model)
 {
-    m_models.remove(model);
-    model->leaveWorld(m_world);
-    sortRenderingOrder();
+    // Removing the model keeps the rest in the rendering order
+    const int nModels = m_models.size();
+    const int index = m_models.findLinearSearch(model);
+    if (index == nModels)
+        return;
+    for (int i = index + 1; i < nModels; i++) {
+        m_models[i - 1] = m_models[i];
+        m_modelDepths[i - 1] = m_modelDepths[i];
+    }
+    m_models.pop_back();
+    m_modelDepths.pop_back();
+    model->leaveWorld(model->world());
+    updateIslandWorlds();
+    clearCheckpoints();
+    if (m_output)
+        model->setEnableBufferedOutput(false);
+    m_visibleModels.remove(model);
 }
 
 void Scene::resetCamera()
@@ -164,14 +483,24 @@ void Scene::resetCamera()
 void Scene::seek(float frameIndex)
 {
     sortRenderingOrder();
-    const uint32_t nModels = m_models.size();
-    // Updating model
-    for (uint32_t i = 0; i < nModels; i++) {
-        PMDModel *model = m_models[i];
-        model->updateRootBone();
-        model->seekMotion(frameIndex);
-        model->updateSkins();
+    invalidateCheckpoints();
+    // Finding the nearest checkpoint before the frame
+    const SceneCheckpoint *checkpoint = 0;
+    const int nCheckpoints = m_checkpoints.size();
+    for (int i = 0; i < nCheckpoints && m_checkpoints[i]->frameIndex <= frameIndex; i++)
+        checkpoint = m_checkpoints[i];
+    // Simulating only the frames from the checkpoint
+    if (checkpoint) {
+        restoreCheckpoint(checkpoint);
+        const float step = float(kFPS) / m_currentFPS;
+        // The poses of the frames between are only for the physics and not skinned
+        while (m_currentFrame + step <= frameIndex)
+            updateSimulation(step, false);
     }
+    // Updating model
+    updateModels(frameIndex, true, true);
+    m_currentFrame = frameIndex;
+    m_staleSimulation = false;
     // Updating camera motion
     if (m_cameraMotion) {
         CameraMotion *camera = m_cameraMotion->mutableCamera();
@@ -184,6 +513,20 @@ void Scene::seek(float frameIndex)
     }
 }
 
+void Scene::setCheckpointInterval(float value)
+{
+    m_checkpointInterval = btMax(value, 0.0f);
+    if (m_checkpointInterval == 0.0f)
+        clearCheckpoints();
+}
+
+void Scene::setMaxCheckpoints(int value)
+{
+    m_maxCheckpoints = btMax(value, 1);
+    while (m_checkpoints.size() > m_maxCheckpoints)
+        removeCheckpoint(0);
+}
+
 void Scene::setCameraPerspective(const btVector3 &position, const btVector3 &angle, float fovy, float distance)
 {
     if (!m_cameraMotion) {
@@ -211,6 +554,26 @@ void Scene::setLight(const btVector4 &color, const btVector4 &direction)
     }
 }
 
+void Scene::setEnableFrustumCulling(bool value)
+{
+    m_enableFrustumCulling = value;
+}
+
+void Scene::setEnableAnimationLOD(bool value)
+{
+    m_enableAnimationLOD = value;
+}
+
+void Scene::setMaxCatchUpSteps(int value)
+{
+    m_maxCatchUpSteps = btMax(value, 1);
+}
+
+void Scene::setThreadPool(ThreadPool *pool)
+{
+    m_pool = pool;
+}
+
 void Scene::setViewMove(int viewMoveTime)
 {
     if (viewMoveTime) {
@@ -226,41 +589,34 @@ void Scene::setWorld(::btDiscreteDynamicsWorld *world)
 {
     const uint32_t nModels = m_models.size();
     // Remove rigid bodies and constraints from the current world
-    // before setting the new world
-    if (m_world) {
-        for (uint32_t i = 0; i < nModels; i++) {
-            PMDModel *model = m_models[i];
+    // before setting the new world. The models in the island worlds stay.
+    for (uint32_t i = 0; i < nModels; i++) {
+        PMDModel *model = m_models[i];
+        if (model->world() == m_world) {
             model->leaveWorld(m_world);
-        }
-    }
-    if (world) {
-        for (uint32_t i = 0; i < nModels; i++) {
-            PMDModel *model = m_models[i];
             model->joinWorld(world);
         }
     }
     m_world = world;
+    updateIslandWorlds();
+    clearCheckpoints();
+}
+
+void Scene::setIslandWorld(PMDModel *model, ::btDiscreteDynamicsWorld *world)
+{
+    ::btDiscreteDynamicsWorld *to = world ? world : m_world;
+    if (model->world() == to || m_models.findLinearSearch(model) == m_models.size())
+        return;
+    model->leaveWorld(model->world());
+    model->joinWorld(to);
+    updateIslandWorlds();
+    clearCheckpoints();
 }
 
 void Scene::update(float deltaFrame)
 {
     sortRenderingOrder();
-    const uint32_t nModels = m_models.size();
-    // Updating model
-    for (uint32_t i = 0; i < nModels; i++) {
-        PMDModel *model = m_models[i];
-        model->updateRootBone();
-        model->updateMotion(deltaFrame);
-        model->updateSkins();
-    }
-    // Updating world simulation
-    if (m_world) {
-        btScalar sec = deltaFrame / kFPS;
-        if (sec > 1.0f)
-            m_world->stepSimulation(sec, 1, sec);
-        else
-            m_world->stepSimulation(sec, m_currentFPS, 1.0f / m_currentFPS);
-    }
+    updateSimulation(deltaFrame, true);
     // Updating camera motion
     if (m_cameraMotion) {
         bool reached = false;
@@ -324,7 +680,259 @@ void Scene::updateProjection(int ellapsedTimeForMove)
 
 void Scene::sortRenderingOrder()
 {
-    m_models.quickSort(SceneModelDistancePredication(m_modelview));
+    // The order is sorted again only when the depth of a model has changed
+    // enough. It's usually nearly sorted and cheap to fix up by insertion.
+    const int nModels = m_models.size();
+    bool changed = false;
+    for (int i = 0; i < nModels; i++) {
+        const float depth = SceneModelDepth(m_modelview, m_models[i]);
+        if (btFabs(depth - m_modelDepths[i]) >= kMinDepthDiff) {
+            m_modelDepths[i] = depth;
+            changed = true;
+        }
+    }
+    if (!changed)
+        return;
+    for (int i = 1; i < nModels; i++) {
+        PMDModel *model = m_models[i];
+        const float depth = m_modelDepths[i];
+        int j = i;
+        while (j > 0 && depth < m_modelDepths[j - 1]) {
+            m_models[j] = m_models[j - 1];
+            m_modelDepths[j] = m_modelDepths[j - 1];
+            j--;
+        }
+        m_models[j] = model;
+        m_modelDepths[j] = depth;
+    }
+}
+
+void Scene::updateSimulation(float deltaFrame, bool skin)
+{
+    invalidateCheckpoints();
+    // Updating model
+    if (m_enableAnimationLOD)
+        updateAnimationLevels();
+    updateModels(deltaFrame, false, skin);
+    // Updating world simulation (all models must be done before stepping the worlds)
+    stepWorlds(deltaFrame);
+    const int nModels = m_models.size();
+    m_activeRigidBodies = m_sleepingRigidBodies = 0;
+    for (int i = 0; i < nModels; i++) {
+        const PMDModel *model = m_models[i];
+        if (model->isSimulationEnabled()) {
+            m_activeRigidBodies += model->countActiveRigidBodies();
+            m_sleepingRigidBodies += model->countSleepingRigidBodies();
+        }
+    }
+    m_currentFrame += deltaFrame;
+    if (m_checkpointInterval > 0.0f && !m_staleSimulation)
+        recordCheckpoint();
+}
+
+void Scene::invalidateCheckpoints()
+{
+    // The edits are taken even without checkpoints not to remove the ones recorded later
+    const int nModels = m_models.size();
+    float edited = -1.0f;
+    for (int i = 0; i < nModels; i++) {
+        const float frameIndex = m_models[i]->takeEditedMotionFrame();
+        if (frameIndex >= 0.0f)
+            edited = edited < 0.0f ? frameIndex : btMin(edited, frameIndex);
+    }
+    if (edited < 0.0f)
+        return;
+    // The checkpoint at the frame is the state simulated with the pose at the frame
+    while (m_checkpoints.size() > 0 && m_checkpoints[m_checkpoints.size() - 1]->frameIndex >= edited)
+        removeCheckpoint(m_checkpoints.size() - 1);
+    // The current state is also simulated with the previous pose until the next seek
+    if (edited < m_currentFrame)
+        m_staleSimulation = true;
+}
+
+void Scene::recordCheckpoint()
+{
+    // The checkpoint is the state that the next update starts from
+    const int nCheckpoints = m_checkpoints.size();
+    if (nCheckpoints > 0 && m_currentFrame < m_checkpoints[nCheckpoints - 1]->frameIndex + m_checkpointInterval)
+        return;
+    const int nModels = m_models.size();
+    SceneCheckpoint *checkpoint = new SceneCheckpoint();
+    checkpoint->models.copyFromArray(m_models);
+    checkpoint->offsets.resize(nModels);
+    for (int i = 0; i < nModels; i++) {
+        checkpoint->offsets[i] = checkpoint->states.size();
+        m_models[i]->saveSimulation(checkpoint->states);
+    }
+    checkpoint->frameIndex = m_currentFrame;
+    m_checkpoints.push_back(checkpoint);
+    // Removing the checkpoint closest to its neighbors keeps the rest spread over the frames
+    const int nRecorded = m_checkpoints.size();
+    if (nRecorded > m_maxCheckpoints) {
+        int index = 0;
+        float minGap = BT_LARGE_FLOAT;
+        for (int i = 1; i < nRecorded - 1; i++) {
+            const float gap = m_checkpoints[i + 1]->frameIndex - m_checkpoints[i - 1]->frameIndex;
+            if (gap < minGap) {
+                minGap = gap;
+                index = i;
+            }
+        }
+        removeCheckpoint(index);
+    }
+}
+
+void Scene::removeCheckpoint(int index)
+{
+    delete m_checkpoints[index];
+    internal::removeAt(m_checkpoints, index);
+}
+
+void Scene::restoreCheckpoint(const SceneCheckpoint *checkpoint)
+{
+    // The models are the same as recording because adding or removing clears the checkpoints
+    const int nModels = checkpoint->models.size(), nStates = checkpoint->states.size();
+    for (int i = 0; i < nModels; i++) {
+        const int offset = checkpoint->offsets[i];
+        if (offset < nStates)
+            checkpoint->models[i]->restoreSimulation(&checkpoint->states[offset]);
+    }
+    // The motions are evaluated at the frame again by the next update as they were
+    updateModels(checkpoint->frameIndex, true, false);
+    m_currentFrame = checkpoint->frameIndex;
+    m_staleSimulation = false;
+}
+
+void Scene::updateModels(float frameIndex, bool seek, bool skin)
+{
+    const int nModels = m_models.size();
+    const float (*planes)[4] = 0;
+    if (m_enableFrustumCulling && skin) {
+        updateFrustumPlanes();
+        planes = m_frustumPlanes;
+    }
+    btAlignedObjectArray<SceneModelTask> tasks;
+    tasks.resize(nModels);
+    for (int i = 0; i < nModels; i++)
+        tasks[i].set(m_models[i], planes, frameIndex, seek, skin);
+    if (m_pool && nModels > 1) {
+        // Models are independent of each other so each one becomes a task
+        // and ThreadPool#run is the barrier before the physics step
+        btAlignedObjectArray<IThreadPoolTask *> taskPtrs;
+        taskPtrs.resize(nModels);
+        for (int i = 0; i < nModels; i++)
+            taskPtrs[i] = &tasks[i];
+        m_pool->run(&taskPtrs[0], nModels);
+    }
+    else {
+        for (int i = 0; i < nModels; i++)
+            tasks[i].run();
+    }
+    // The models not skinned keep the visibility tested last
+    if (!skin)
+        return;
+    // m_models is already sorted so the visible models are in rendering order
+    m_visibleModels.resize(0);
+    for (int i = 0; i < nModels; i++) {
+        const SceneModelTask &task = tasks[i];
+        if (task.isVisible())
+            m_visibleModels.push_back(task.model());
+    }
+}
+
+void Scene::updateAnimationLevels()
+{
+    const int nModels = m_models.size();
+    for (int i = 0; i < nModels; i++) {
+        PMDModel *model = m_models[i];
+        btVector3 min, max;
+        model->getBoundingBox(min, max);
+        btVector3 center = (min + max) * 0.5f;
+#ifndef VPVL_COORDINATE_OPENGL
+        center.setZ(-center.z());
+#endif
+        // Ratio of the projected radius to the half of the viewport height
+        const float radius = (max - min).length() * 0.5f;
+        const float depth = -(m_modelview * center).z();
+        const float size = depth > radius ? radius * m_projection[5] / depth : 1.0f;
+        const float weighted = size * model->animationPriority();
+        PMDModel::AnimationLevel level = PMDModel::kMinimumAnimation;
+        if (weighted >= kHalfRateAnimationSize)
+            level = PMDModel::kFullAnimation;
+        else if (weighted >= kQuarterRateAnimationSize)
+            level = PMDModel::kHalfRateAnimation;
+        else if (weighted >= kMinimumAnimationSize)
+            level = PMDModel::kQuarterRateAnimation;
+        model->setAnimationLevel(level);
+    }
+}
+
+void Scene::updateIslandWorlds()
+{
+    const int nModels = m_models.size();
+    m_islandWorlds.clear();
+    for (int i = 0; i < nModels; i++) {
+        btDiscreteDynamicsWorld *world = m_models[i]->world();
+        if (world && world != m_world && m_islandWorlds.findLinearSearch(world) == m_islandWorlds.size())
+            m_islandWorlds.push_back(world);
+    }
+}
+
+void Scene::stepWorlds(float deltaFrame)
+{
+    const int nIslands = m_islandWorlds.size();
+    m_concurrentWorlds = 0;
+#ifdef VPVL_ENABLE_CONCURRENT_ISLAND_WORLDS
+#ifndef BT_NO_PROFILE
+#error "VPVL_ENABLE_CONCURRENT_ISLAND_WORLDS requires Bullet Physics built with BT_NO_PROFILE"
+#endif
+    // The worlds share nothing but the statistics counters of Bullet Physics
+    // (gNumAlignedAllocs, gOverlappingPairs, gNumManifold and so on). They are
+    // incremented without synchronization and vpvl never reads them.
+    if (m_pool && nIslands > 0) {
+        btAlignedObjectArray<SceneWorldTask> tasks;
+        btAlignedObjectArray<IThreadPoolTask *> ptrs;
+        tasks.resize(nIslands + 1);
+        ptrs.reserve(nIslands + 1);
+        for (int i = 0; i < nIslands; i++) {
+            tasks[i].set(m_islandWorlds[i], deltaFrame, m_currentFPS);
+            ptrs.push_back(&tasks[i]);
+        }
+        if (m_world) {
+            tasks[nIslands].set(m_world, deltaFrame, m_currentFPS);
+            ptrs.push_back(&tasks[nIslands]);
+        }
+        m_pool->run(&ptrs[0], ptrs.size());
+        m_concurrentWorlds = ptrs.size();
+        return;
+    }
+#endif
+    if (m_world)
+        SceneStepWorld(m_world, deltaFrame, m_currentFPS);
+    for (int i = 0; i < nIslands; i++)
+        SceneStepWorld(m_islandWorlds[i], deltaFrame, m_currentFPS);
+}
+
+void Scene::updateFrustumPlanes()
+{
+    // Extract the planes from the rows of projection * modelview (Gribb and Hartmann)
+    float modelview[16], m[16];
+    m_modelview.getOpenGLMatrix(modelview);
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            float value = 0.0f;
+            for (int k = 0; k < 4; k++)
+                value += m_projection[k * 4 + j] * modelview[i * 4 + k];
+            m[i * 4 + j] = value;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        float *lower = m_frustumPlanes[i * 2], *upper = m_frustumPlanes[i * 2 + 1];
+        for (int j = 0; j < 4; j++) {
+            lower[j] = m[j * 4 + 3] + m[j * 4 + i];
+            upper[j] = m[j * 4 + 3] - m[j * 4 + i];
+        }
+    }
 }
 
 void Scene::updateModelViewMatrix()
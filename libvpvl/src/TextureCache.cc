@@ -0,0 +1,430 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+
+#include <LinearMath/btHashMap.h>
+#include "vpvl/vpvl.h"
+#include "vpvl/internal/util.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+namespace vpvl
+{
+
+/* identifies the content of a file by two hashes and the size, the same content of the other type is not shared */
+class TextureCacheContentKey
+{
+public:
+    TextureCacheContentKey()
+        : m_hash(0), m_secondHash(0), m_size(0), m_type(0)
+    {
+    }
+    TextureCacheContentKey(const btAlignedObjectArray<uint8_t> &bytes, int type)
+        : m_hash(2166136261u), m_secondHash(5381), m_size(bytes.size()), m_type(type)
+    {
+        for (uint32_t i = 0; i < m_size; i++) {
+            const uint8_t byte = bytes[i];
+            m_hash = (m_hash ^ byte) * 16777619u;
+            m_secondHash = m_secondHash * 33 + byte;
+        }
+    }
+
+    unsigned int getHash() const {
+        return m_hash;
+    }
+    bool equals(const TextureCacheContentKey &other) const {
+        return m_hash == other.m_hash && m_secondHash == other.m_secondHash
+                && m_size == other.m_size && m_type == other.m_type;
+    }
+
+private:
+    uint32_t m_hash;
+    uint32_t m_secondHash;
+    uint32_t m_size;
+    int m_type;
+};
+
+/* a requested path, the owner is the entry decoding the content and shares its texture with the others */
+struct TextureCacheEntry
+{
+    char *path;
+    TextureCache::TextureType type;
+    TextureCacheContentKey key;
+    uint32_t textureID;
+    int owner;
+    int nUsers;
+    int nReferences;
+    bool hasKey;
+    bool isDropped;
+};
+
+struct TextureCacheResult
+{
+    TextureCacheContentKey key;
+    TextureImage *image;
+    int handle;
+    int owner;
+    bool hasKey;
+};
+
+#ifdef WIN32
+typedef CRITICAL_SECTION TextureCacheMutex;
+typedef CONDITION_VARIABLE TextureCacheCondition;
+#else
+typedef pthread_mutex_t TextureCacheMutex;
+typedef pthread_cond_t TextureCacheCondition;
+#endif
+
+struct TextureCachePrivate
+{
+    /* guarded by the mutex */
+    TextureCacheMutex mutex;
+    TextureCacheCondition doneCondition;
+    btHashMap<TextureCacheContentKey, int> contents;
+    btAlignedObjectArray<TextureCacheResult> results;
+    int nRunning;
+    int nDecoded;
+    /* the rendering thread only */
+    btAlignedObjectArray<TextureCacheEntry> entries;
+    btAlignedObjectArray<TextureCacheResult> uploads;
+    btHashMap<btHashString, int> paths[TextureCache::kTextureTypeMax];
+};
+
+#ifdef WIN32
+static void TextureCacheLock(TextureCachePrivate *p) { EnterCriticalSection(&p->mutex); }
+static void TextureCacheUnlock(TextureCachePrivate *p) { LeaveCriticalSection(&p->mutex); }
+static void TextureCacheWait(TextureCachePrivate *p) { SleepConditionVariableCS(&p->doneCondition, &p->mutex, INFINITE); }
+static void TextureCacheWakeAll(TextureCachePrivate *p) { WakeAllConditionVariable(&p->doneCondition); }
+#else
+static void TextureCacheLock(TextureCachePrivate *p) { pthread_mutex_lock(&p->mutex); }
+static void TextureCacheUnlock(TextureCachePrivate *p) { pthread_mutex_unlock(&p->mutex); }
+static void TextureCacheWait(TextureCachePrivate *p) { pthread_cond_wait(&p->doneCondition, &p->mutex); }
+static void TextureCacheWakeAll(TextureCachePrivate *p) { pthread_cond_broadcast(&p->doneCondition); }
+#endif
+
+/* reads the file and decodes it unless the same content is already decoded by another entry */
+class TextureCacheTask : public IThreadPoolTask
+{
+public:
+    TextureCacheTask(TextureCachePrivate *p, ITextureDecoder *decoder, int handle)
+        : m_private(p),
+          m_decoder(decoder),
+          m_path(0),
+          m_type(p->entries[handle].type),
+          m_handle(handle)
+    {
+        const char *path = p->entries[handle].path;
+        const size_t size = strlen(path) + 1;
+        m_path = new char[size];
+        memcpy(m_path, path, size);
+    }
+    ~TextureCacheTask() {
+        delete[] m_path;
+    }
+
+    void run() {
+        btAlignedObjectArray<uint8_t> bytes;
+        TextureCacheResult result;
+        result.image = 0;
+        result.handle = m_handle;
+        result.owner = m_handle;
+        result.hasKey = false;
+        if (m_decoder->read(m_path, m_type, bytes)) {
+            TextureCacheContentKey key(bytes, m_type);
+            TextureCacheLock(m_private);
+            const int *owner = m_private->contents.find(key);
+            if (owner) {
+                result.owner = *owner;
+            }
+            else {
+                m_private->contents.insert(key, m_handle);
+                result.key = key;
+                result.hasKey = true;
+            }
+            TextureCacheUnlock(m_private);
+            if (result.owner == m_handle) {
+                TextureImage *image = new TextureImage();
+                if (m_decoder->decode(bytes, *image))
+                    result.image = image;
+                else
+                    delete image;
+            }
+        }
+        TextureCacheLock(m_private);
+        m_private->results.push_back(result);
+        if (result.image)
+            m_private->nDecoded++;
+        m_private->nRunning--;
+        TextureCacheWakeAll(m_private);
+        TextureCacheUnlock(m_private);
+        delete this;
+    }
+
+private:
+    TextureCachePrivate *m_private;
+    ITextureDecoder *m_decoder;
+    char *m_path;
+    TextureCache::TextureType m_type;
+    int m_handle;
+};
+
+TextureCache::TextureCache(ITextureDecoder *decoder)
+    : m_private(0),
+      m_decoder(decoder),
+      m_pool(0)
+{
+    m_private = new TextureCachePrivate();
+    m_private->nRunning = 0;
+    m_private->nDecoded = 0;
+#ifdef WIN32
+    InitializeCriticalSection(&m_private->mutex);
+    InitializeConditionVariable(&m_private->doneCondition);
+#else
+    pthread_mutex_init(&m_private->mutex, 0);
+    pthread_cond_init(&m_private->doneCondition, 0);
+#endif
+}
+
+TextureCache::~TextureCache()
+{
+    TextureCacheLock(m_private);
+    while (m_private->nRunning > 0)
+        TextureCacheWait(m_private);
+    TextureCacheUnlock(m_private);
+    const int nResults = m_private->results.size();
+    for (int i = 0; i < nResults; i++)
+        delete m_private->results[i].image;
+    const int nUploads = m_private->uploads.size();
+    for (int i = 0; i < nUploads; i++)
+        delete m_private->uploads[i].image;
+    const int nEntries = m_private->entries.size();
+    for (int i = 0; i < nEntries; i++)
+        delete[] m_private->entries[i].path;
+#ifdef WIN32
+    DeleteCriticalSection(&m_private->mutex);
+#else
+    pthread_cond_destroy(&m_private->doneCondition);
+    pthread_mutex_destroy(&m_private->mutex);
+#endif
+    delete m_private;
+    m_private = 0;
+    m_decoder = 0;
+    m_pool = 0;
+}
+
+void TextureCache::setThreadPool(ThreadPool *pool)
+{
+    m_pool = pool;
+}
+
+int TextureCache::request(const char *path, TextureType type)
+{
+    btAlignedObjectArray<TextureCacheEntry> &entries = m_private->entries;
+    btHashMap<btHashString, int> &paths = m_private->paths[type];
+    const int *found = paths.find(btHashString(path));
+    if (found) {
+        TextureCacheEntry &entry = entries[*found];
+        entry.nUsers++;
+        if (entry.owner >= 0)
+            entries[entry.owner].nReferences++;
+        return *found;
+    }
+    const size_t size = strlen(path) + 1;
+    TextureCacheEntry entry;
+    entry.path = new char[size];
+    memcpy(entry.path, path, size);
+    entry.type = type;
+    entry.textureID = 0;
+    entry.owner = -1;
+    entry.nUsers = 1;
+    entry.nReferences = 0;
+    entry.hasKey = false;
+    entry.isDropped = false;
+    const int handle = entries.size();
+    entries.push_back(entry);
+    // the key refers the path owned by the entry
+    paths.insert(btHashString(entry.path), handle);
+    enqueue(handle);
+    return handle;
+}
+
+uint32_t TextureCache::release(int handle)
+{
+    btAlignedObjectArray<TextureCacheEntry> &entries = m_private->entries;
+    if (handle < 0 || handle >= entries.size())
+        return 0;
+    TextureCacheEntry &entry = entries[handle];
+    if (entry.isDropped || entry.nUsers == 0)
+        return 0;
+    entry.nUsers--;
+    // the users of the entry not resolved yet are added to the owner in upload
+    if (entry.owner < 0)
+        return 0;
+    const int owner = entry.owner;
+    if (--entries[owner].nReferences > 0)
+        return 0;
+    const uint32_t textureID = entries[owner].textureID;
+    drop(owner);
+    return textureID;
+}
+
+uint32_t TextureCache::textureID(int handle) const
+{
+    const btAlignedObjectArray<TextureCacheEntry> &entries = m_private->entries;
+    if (handle < 0 || handle >= entries.size())
+        return 0;
+    const TextureCacheEntry &entry = entries[handle];
+    return entry.owner >= 0 && !entry.isDropped ? entries[entry.owner].textureID : 0;
+}
+
+int TextureCache::upload(ITextureUploader *uploader, size_t budget)
+{
+    btAlignedObjectArray<TextureCacheEntry> &entries = m_private->entries;
+    btAlignedObjectArray<TextureCacheResult> &uploads = m_private->uploads;
+    btAlignedObjectArray<TextureCacheResult> results;
+    TextureCacheLock(m_private);
+    results.copyFromArray(m_private->results);
+    m_private->results.resize(0);
+    TextureCacheUnlock(m_private);
+    int nResolved = 0;
+    const int nResults = results.size();
+    for (int i = 0; i < nResults; i++) {
+        const TextureCacheResult &result = results[i];
+        TextureCacheEntry &entry = entries[result.handle];
+        if (result.owner != result.handle) {
+            TextureCacheEntry &owner = entries[result.owner];
+            // read again to decode by itself as the owner was released while reading
+            if (owner.isDropped) {
+                enqueue(result.handle);
+                continue;
+            }
+            entry.owner = result.owner;
+            owner.nReferences += entry.nUsers;
+            nResolved++;
+        }
+        else {
+            entry.owner = result.handle;
+            entry.key = result.key;
+            entry.hasKey = result.hasKey;
+            entry.nReferences += entry.nUsers;
+            if (entry.nReferences == 0) {
+                delete result.image;
+                drop(result.handle);
+            }
+            else if (result.image) {
+                uploads.push_back(result);
+            }
+            else {
+                nResolved++;
+            }
+        }
+    }
+    // upload in the order of decoded and leave the rest to the next frame
+    size_t uploaded = 0;
+    int nUploaded = 0;
+    const int nUploads = uploads.size();
+    while (nUploaded < nUploads && (nUploaded == 0 || uploaded < budget)) {
+        const TextureCacheResult &result = uploads[nUploaded++];
+        TextureCacheEntry &entry = entries[result.handle];
+        if (!entry.isDropped) {
+            entry.textureID = uploader->upload(*result.image, entry.type);
+            uploaded += result.image->pixels.size();
+            nResolved++;
+        }
+        delete result.image;
+    }
+    for (int i = nUploaded; i < nUploads; i++)
+        uploads[i - nUploaded] = uploads[i];
+    uploads.resize(nUploads - nUploaded);
+    return nResolved;
+}
+
+int TextureCache::countPendingTextures() const
+{
+    TextureCacheLock(m_private);
+    const int nPending = m_private->nRunning + m_private->results.size();
+    TextureCacheUnlock(m_private);
+    return nPending + m_private->uploads.size();
+}
+
+int TextureCache::countDecodedTextures() const
+{
+    TextureCacheLock(m_private);
+    const int nDecoded = m_private->nDecoded;
+    TextureCacheUnlock(m_private);
+    return nDecoded;
+}
+
+void TextureCache::enqueue(int handle)
+{
+    TextureCacheTask *task = new TextureCacheTask(m_private, m_decoder, handle);
+    TextureCacheLock(m_private);
+    m_private->nRunning++;
+    TextureCacheUnlock(m_private);
+    // the task deletes itself after reporting the result
+    if (m_pool)
+        m_pool->enqueue(task);
+    else
+        task->run();
+}
+
+void TextureCache::drop(int owner)
+{
+    btAlignedObjectArray<TextureCacheEntry> &entries = m_private->entries;
+    if (entries[owner].hasKey) {
+        TextureCacheLock(m_private);
+        m_private->contents.remove(entries[owner].key);
+        TextureCacheUnlock(m_private);
+    }
+    // the dropped entries are requested as new entries next time
+    const int nEntries = entries.size();
+    for (int i = 0; i < nEntries; i++) {
+        TextureCacheEntry &entry = entries[i];
+        if (entry.owner == owner && !entry.isDropped) {
+            m_private->paths[entry.type].remove(btHashString(entry.path));
+            delete[] entry.path;
+            entry.path = 0;
+            entry.textureID = 0;
+            entry.isDropped = true;
+        }
+    }
+}
+
+}
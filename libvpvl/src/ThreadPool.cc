@@ -0,0 +1,273 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "vpvl/vpvl.h"
+#include "vpvl/internal/util.h"
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace vpvl
+{
+
+struct ThreadPoolBatch
+{
+    int remaining;
+};
+
+struct ThreadPoolEntry
+{
+    IThreadPoolTask *task;
+    ThreadPoolBatch *batch;
+};
+
+#ifdef WIN32
+typedef HANDLE ThreadPoolThread;
+typedef CRITICAL_SECTION ThreadPoolMutex;
+typedef CONDITION_VARIABLE ThreadPoolCondition;
+#else
+typedef pthread_t ThreadPoolThread;
+typedef pthread_mutex_t ThreadPoolMutex;
+typedef pthread_cond_t ThreadPoolCondition;
+#endif
+
+struct ThreadPoolPrivate
+{
+    ThreadPoolMutex mutex;
+    ThreadPoolCondition workCondition;
+    ThreadPoolCondition doneCondition;
+    btAlignedObjectArray<ThreadPoolEntry> queue;
+    btAlignedObjectArray<ThreadPoolThread> threads;
+    int head;
+    bool quit;
+};
+
+#ifdef WIN32
+static void ThreadPoolLock(ThreadPoolPrivate *p) { EnterCriticalSection(&p->mutex); }
+static void ThreadPoolUnlock(ThreadPoolPrivate *p) { LeaveCriticalSection(&p->mutex); }
+static void ThreadPoolWait(ThreadPoolPrivate *p, ThreadPoolCondition *c) { SleepConditionVariableCS(c, &p->mutex, INFINITE); }
+static void ThreadPoolWakeAll(ThreadPoolCondition *c) { WakeAllConditionVariable(c); }
+#else
+static void ThreadPoolLock(ThreadPoolPrivate *p) { pthread_mutex_lock(&p->mutex); }
+static void ThreadPoolUnlock(ThreadPoolPrivate *p) { pthread_mutex_unlock(&p->mutex); }
+static void ThreadPoolWait(ThreadPoolPrivate *p, ThreadPoolCondition *c) { pthread_cond_wait(c, &p->mutex); }
+static void ThreadPoolWakeAll(ThreadPoolCondition *c) { pthread_cond_broadcast(c); }
+#endif
+
+/* both must be called with the mutex locked */
+static bool ThreadPoolPop(ThreadPoolPrivate *p, ThreadPoolEntry &entry)
+{
+    if (p->head >= p->queue.size())
+        return false;
+    entry = p->queue[p->head++];
+    // Rewind the queue when it is drained instead of shifting the entries
+    if (p->head == p->queue.size()) {
+        p->queue.resize(0);
+        p->head = 0;
+    }
+    return true;
+}
+
+static void ThreadPoolFinish(ThreadPoolPrivate *p, const ThreadPoolEntry &entry)
+{
+    ThreadPoolBatch *batch = entry.batch;
+    if (batch && --batch->remaining == 0)
+        ThreadPoolWakeAll(&p->doneCondition);
+}
+
+static void ThreadPoolWork(ThreadPoolPrivate *p)
+{
+    ThreadPoolEntry entry;
+    ThreadPoolLock(p);
+    for (;;) {
+        if (ThreadPoolPop(p, entry)) {
+            ThreadPoolUnlock(p);
+            entry.task->run();
+            ThreadPoolLock(p);
+            ThreadPoolFinish(p, entry);
+        }
+        else if (p->quit) {
+            break;
+        }
+        else {
+            ThreadPoolWait(p, &p->workCondition);
+        }
+    }
+    ThreadPoolUnlock(p);
+}
+
+#ifdef WIN32
+static unsigned __stdcall ThreadPoolMain(void *data)
+{
+    ThreadPoolWork(static_cast<ThreadPoolPrivate *>(data));
+    return 0;
+}
+#else
+static void *ThreadPoolMain(void *data)
+{
+    ThreadPoolWork(static_cast<ThreadPoolPrivate *>(data));
+    return 0;
+}
+#endif
+
+ThreadPool::ThreadPool(int nThreads)
+    : m_private(0),
+      m_nThreads(nThreads < 0 ? countProcessors() - 1 : nThreads)
+{
+    m_private = new ThreadPoolPrivate();
+    m_private->head = 0;
+    m_private->quit = false;
+#ifdef WIN32
+    InitializeCriticalSection(&m_private->mutex);
+    InitializeConditionVariable(&m_private->workCondition);
+    InitializeConditionVariable(&m_private->doneCondition);
+#else
+    pthread_mutex_init(&m_private->mutex, 0);
+    pthread_cond_init(&m_private->workCondition, 0);
+    pthread_cond_init(&m_private->doneCondition, 0);
+#endif
+    for (int i = 0; i < m_nThreads; i++) {
+        ThreadPoolThread thread;
+#ifdef WIN32
+        thread = reinterpret_cast<HANDLE>(_beginthreadex(0, 0, ThreadPoolMain, m_private, 0, 0));
+        if (!thread)
+            break;
+#else
+        if (pthread_create(&thread, 0, ThreadPoolMain, m_private) != 0)
+            break;
+#endif
+        m_private->threads.push_back(thread);
+    }
+    // Fall back to the threads actually created
+    m_nThreads = m_private->threads.size();
+}
+
+ThreadPool::~ThreadPool()
+{
+    ThreadPoolLock(m_private);
+    m_private->quit = true;
+    ThreadPoolWakeAll(&m_private->workCondition);
+    ThreadPoolUnlock(m_private);
+    for (int i = 0; i < m_nThreads; i++) {
+        ThreadPoolThread thread = m_private->threads[i];
+#ifdef WIN32
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+#else
+        pthread_join(thread, 0);
+#endif
+    }
+#ifdef WIN32
+    DeleteCriticalSection(&m_private->mutex);
+#else
+    pthread_cond_destroy(&m_private->doneCondition);
+    pthread_cond_destroy(&m_private->workCondition);
+    pthread_mutex_destroy(&m_private->mutex);
+#endif
+    delete m_private;
+    m_private = 0;
+    m_nThreads = 0;
+}
+
+int ThreadPool::countProcessors()
+{
+#ifdef WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const int nProcessors = static_cast<int>(info.dwNumberOfProcessors);
+#else
+    const int nProcessors = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    return nProcessors > 0 ? nProcessors : 1;
+}
+
+void ThreadPool::run(IThreadPoolTask *const *tasks, int nTasks)
+{
+    if (m_nThreads == 0) {
+        for (int i = 0; i < nTasks; i++)
+            tasks[i]->run();
+        return;
+    }
+    if (nTasks <= 0)
+        return;
+
+    ThreadPoolBatch batch;
+    batch.remaining = nTasks;
+    ThreadPoolLock(m_private);
+    for (int i = 0; i < nTasks; i++) {
+        ThreadPoolEntry entry;
+        entry.task = tasks[i];
+        entry.batch = &batch;
+        m_private->queue.push_back(entry);
+    }
+    ThreadPoolWakeAll(&m_private->workCondition);
+    // Help the workers instead of sleeping while the queue has tasks
+    ThreadPoolEntry entry;
+    while (batch.remaining > 0) {
+        if (ThreadPoolPop(m_private, entry)) {
+            ThreadPoolUnlock(m_private);
+            entry.task->run();
+            ThreadPoolLock(m_private);
+            ThreadPoolFinish(m_private, entry);
+        }
+        else {
+            ThreadPoolWait(m_private, &m_private->doneCondition);
+        }
+    }
+    ThreadPoolUnlock(m_private);
+}
+
+void ThreadPool::enqueue(IThreadPoolTask *task)
+{
+    if (m_nThreads == 0) {
+        task->run();
+        return;
+    }
+    ThreadPoolEntry entry;
+    entry.task = task;
+    entry.batch = 0;
+    ThreadPoolLock(m_private);
+    m_private->queue.push_back(entry);
+    ThreadPoolWakeAll(&m_private->workCondition);
+    ThreadPoolUnlock(m_private);
+}
+
+}
@@ -45,8 +45,99 @@ namespace vpvl
 const float VMDMotion::kDefaultLoopAtFrame = 0.0f;
 const float VMDMotion::kDefaultPriority = 0.0f;
 
+static const uint8_t kSignature[30] = "Vocaloid Motion Data 0002";
+
+/* accumulates records in a fixed size buffer and passes them to the sink when full */
+class VMDMotionSinkBuffer
+{
+public:
+    static const size_t kBufferSize = 4096;
+
+    VMDMotionSinkBuffer(IVMDMotionSink *sink)
+        : m_sink(sink),
+          m_offset(0),
+          m_ok(true)
+    {
+    }
+    ~VMDMotionSinkBuffer() {
+        m_sink = 0;
+        m_offset = 0;
+        m_ok = false;
+    }
+
+    uint8_t *reserve(size_t size) {
+        assert(size <= kBufferSize);
+        if (m_offset + size > kBufferSize)
+            flush();
+        uint8_t *ptr = m_buffer + m_offset;
+        m_offset += size;
+        return ptr;
+    }
+    void append(const uint8_t *data, size_t size) {
+        internal::copyBytes(reserve(size), data, size);
+    }
+    bool flush() {
+        if (m_ok && m_offset > 0)
+            m_ok = m_sink->write(m_buffer, m_offset);
+        m_offset = 0;
+        return m_ok;
+    }
+
+private:
+    IVMDMotionSink *m_sink;
+    uint8_t m_buffer[kBufferSize];
+    size_t m_offset;
+    bool m_ok;
+};
+
+/* decodes a section of the motion, the sections don't share any states */
+class VMDMotionParseTask : public IThreadPoolTask
+{
+public:
+    enum Section
+    {
+        kBone,
+        kFace,
+        kCamera
+    };
+
+    VMDMotionParseTask(VMDMotion *motion, const VMDMotionDataInfo &info, const PMDModel *model, Section section)
+        : m_motion(motion),
+          m_info(info),
+          m_model(model),
+          m_section(section)
+    {
+    }
+    ~VMDMotionParseTask() {
+        m_motion = 0;
+        m_model = 0;
+    }
+
+    void run() {
+        switch (m_section) {
+        case kBone:
+            m_motion->mutableBone()->read(m_info.boneKeyFramePtr, m_info.boneKeyFrameCount,
+                                          m_model, m_motion->threadPool());
+            break;
+        case kFace:
+            m_motion->mutableFace()->read(m_info.faceKeyFramePtr, m_info.faceKeyFrameCount, m_model);
+            break;
+        case kCamera:
+            m_motion->mutableCamera()->read(m_info.cameraKeyFramePtr, m_info.cameraKeyFrameCount);
+            break;
+        }
+    }
+
+private:
+    VMDMotion *m_motion;
+    const VMDMotionDataInfo &m_info;
+    const PMDModel *m_model;
+    Section m_section;
+};
+
 VMDMotion::VMDMotion()
     : m_model(0),
+      m_pool(0),
       m_error(kNoError),
       m_status(kRunning),
       m_onEnd(2),
@@ -135,15 +226,30 @@ bool VMDMotion::preparse(const uint8_t *data, size_t size, VMDMotionDataInfo &in
 }
 
 bool VMDMotion::load(const uint8_t *data, size_t size)
+{
+    return load(data, size, 0);
+}
+
+bool VMDMotion::load(const uint8_t *data, size_t size, const PMDModel *model)
 {
     VMDMotionDataInfo info;
     internal::zerofill(&info, sizeof(info));
     if (preparse(data, size, info)) {
         release();
         parseHeader(info);
-        parseBoneFrames(info);
-        parseFaceFrames(info);
-        parseCameraFrames(info);
+        if (m_pool) {
+            // The bone section is the largest and is queued first to be split into chunks early
+            VMDMotionParseTask bone(this, info, model, VMDMotionParseTask::kBone);
+            VMDMotionParseTask face(this, info, model, VMDMotionParseTask::kFace);
+            VMDMotionParseTask camera(this, info, model, VMDMotionParseTask::kCamera);
+            IThreadPoolTask *tasks[] = { &bone, &face, &camera };
+            m_pool->run(tasks, sizeof(tasks) / sizeof(tasks[0]));
+        }
+        else {
+            parseBoneFrames(info, model);
+            parseFaceFrames(info, model);
+            parseCameraFrames(info);
+        }
         parseLightFrames(info);
         parseSelfShadowFrames(info);
         return true;
@@ -169,11 +275,11 @@ size_t VMDMotion::estimateSize()
 
 void VMDMotion::save(uint8_t *data)
 {
-    internal::copyBytes(data, reinterpret_cast<const uint8_t *>("Vocaloid Motion Data 0002"), 30);
-    data += 30;
+    internal::copyBytes(data, kSignature, sizeof(kSignature));
+    data += sizeof(kSignature);
     internal::copyBytes(data, m_name, sizeof(m_name));
     data += sizeof(m_name);
-    BoneKeyFrameList boneFrames = m_boneMotion.frames();
+    const BoneKeyFrameList &boneFrames = m_boneMotion.frames();
     uint32_t nBoneFrames = boneFrames.size();
     internal::copyBytes(data, reinterpret_cast<uint8_t *>(&nBoneFrames), sizeof(nBoneFrames));
     data += sizeof(nBoneFrames);
@@ -182,7 +288,7 @@ void VMDMotion::save(uint8_t *data)
         frame->write(data);
         data += BoneKeyFrame::stride();
     }
-    FaceKeyFrameList faceFrames = m_faceMotion.frames();
+    const FaceKeyFrameList &faceFrames = m_faceMotion.frames();
     uint32_t nFaceFrames = faceFrames.size();
     internal::copyBytes(data, reinterpret_cast<uint8_t *>(&nFaceFrames), sizeof(nFaceFrames));
     data += sizeof(nFaceFrames);
@@ -191,7 +297,7 @@ void VMDMotion::save(uint8_t *data)
         frame->write(data);
         data += FaceKeyFrame::stride();
     }
-    CameraKeyFrameList cameraFrames = m_cameraMotion.frames();
+    const CameraKeyFrameList &cameraFrames = m_cameraMotion.frames();
     uint32_t nCameraFrames = cameraFrames.size();
     internal::copyBytes(data, reinterpret_cast<uint8_t *>(&nCameraFrames), sizeof(nCameraFrames));
     data += sizeof(nCameraFrames);
@@ -207,6 +313,43 @@ void VMDMotion::save(uint8_t *data)
     data += sizeof(empty);
 }
 
+bool VMDMotion::save(IVMDMotionSink *sink)
+{
+    VMDMotionSinkBuffer buffer(sink);
+    buffer.append(kSignature, sizeof(kSignature));
+    buffer.append(m_name, sizeof(m_name));
+    const BoneKeyFrameList &boneFrames = m_boneMotion.frames();
+    const uint32_t nBoneFrames = boneFrames.size();
+    buffer.append(reinterpret_cast<const uint8_t *>(&nBoneFrames), sizeof(nBoneFrames));
+    for (uint32_t i = 0; i < nBoneFrames; i++)
+        boneFrames[i]->write(buffer.reserve(BoneKeyFrame::stride()));
+    const FaceKeyFrameList &faceFrames = m_faceMotion.frames();
+    const uint32_t nFaceFrames = faceFrames.size();
+    buffer.append(reinterpret_cast<const uint8_t *>(&nFaceFrames), sizeof(nFaceFrames));
+    for (uint32_t i = 0; i < nFaceFrames; i++)
+        faceFrames[i]->write(buffer.reserve(FaceKeyFrame::stride()));
+    const CameraKeyFrameList &cameraFrames = m_cameraMotion.frames();
+    const uint32_t nCameraFrames = cameraFrames.size();
+    buffer.append(reinterpret_cast<const uint8_t *>(&nCameraFrames), sizeof(nCameraFrames));
+    for (uint32_t i = 0; i < nCameraFrames; i++)
+        cameraFrames[i]->write(buffer.reserve(CameraKeyFrame::stride()));
+    const uint32_t empty = 0;
+    buffer.append(reinterpret_cast<const uint8_t *>(&empty), sizeof(empty));
+    buffer.append(reinterpret_cast<const uint8_t *>(&empty), sizeof(empty));
+    return buffer.flush();
+}
+
+void VMDMotion::share(VMDMotion *motion)
+{
+    if (m_model)
+        return;
+    copyBytesSafe(m_name, motion->m_name, sizeof(m_name));
+    m_boneMotion.share(&motion->m_boneMotion);
+    m_faceMotion.share(&motion->m_faceMotion);
+    m_cameraMotion.share(&motion->m_cameraMotion);
+    m_error = kNoError;
+}
+
 void VMDMotion::attachModel(PMDModel *model)
 {
     if (m_model)
@@ -314,14 +457,14 @@ void VMDMotion::parseHeader(const VMDMotionDataInfo &info)
     copyBytesSafe(m_name, info.namePtr, sizeof(m_name));
 }
 
-void VMDMotion::parseBoneFrames(const VMDMotionDataInfo &info)
+void VMDMotion::parseBoneFrames(const VMDMotionDataInfo &info, const PMDModel *model)
 {
-    m_boneMotion.read(info.boneKeyFramePtr, info.boneKeyFrameCount);
+    m_boneMotion.read(info.boneKeyFramePtr, info.boneKeyFrameCount, model);
 }
 
-void VMDMotion::parseFaceFrames(const VMDMotionDataInfo &info)
+void VMDMotion::parseFaceFrames(const VMDMotionDataInfo &info, const PMDModel *model)
 {
-    m_faceMotion.read(info.faceKeyFramePtr, info.faceKeyFrameCount);
+    m_faceMotion.read(info.faceKeyFramePtr, info.faceKeyFrameCount, model);
 }
 
 void VMDMotion::parseCameraFrames(const VMDMotionDataInfo &info)
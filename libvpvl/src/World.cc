@@ -0,0 +1,157 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+
+#include <btBulletDynamicsCommon.h>
+
+#include "vpvl/vpvl.h"
+#include "vpvl/internal/util.h"
+
+#ifdef VPVL_ENABLE_MULTITHREADED_PHYSICS
+#include <BulletMultiThreaded/btParallelConstraintSolver.h>
+#include <BulletMultiThreaded/SpuGatheringCollisionDispatcher.h>
+#include <BulletMultiThreaded/SpuNarrowPhaseCollisionTask/SpuGatheringCollisionTask.h>
+#ifdef WIN32
+#include <BulletMultiThreaded/Win32ThreadSupport.h>
+#else
+#define USE_PTHREADS
+#include <BulletMultiThreaded/PosixThreadSupport.h>
+#endif
+#endif
+
+namespace vpvl
+{
+
+const float World::kWorldExtent = 400.0f;
+const float World::kGravityFactor = 2.0f;
+
+struct WorldPrivate
+{
+    btDefaultCollisionConfiguration *config;
+    btCollisionDispatcher *dispatcher;
+    btBroadphaseInterface *broadphase;
+    btConstraintSolver *solver;
+#ifdef VPVL_ENABLE_MULTITHREADED_PHYSICS
+    btThreadSupportInterface *collisionThreads;
+    btThreadSupportInterface *solverThreads;
+#endif
+};
+
+#ifdef VPVL_ENABLE_MULTITHREADED_PHYSICS
+/* the size of the contact pool the parallel solver requires to be contiguous */
+static const int kWorldMaxPersistentManifolds = 32768;
+
+static btThreadSupportInterface *WorldCreateThreadSupport(const char *name,
+                                                          void (*threadFunc)(void *, void *),
+                                                          void *(*memoryFunc)(),
+                                                          int nThreads)
+{
+#ifdef WIN32
+    Win32ThreadSupport::Win32ThreadConstructionInfo info(name, threadFunc, memoryFunc, nThreads);
+    Win32ThreadSupport *support = new Win32ThreadSupport(info);
+    support->startSPU();
+#else
+    PosixThreadSupport::ThreadConstructionInfo info(name, threadFunc, memoryFunc, nThreads);
+    PosixThreadSupport *support = new PosixThreadSupport(info);
+#endif
+    return support;
+}
+#endif
+
+World::World(int fps, int nThreads)
+    : m_private(0),
+      m_world(0),
+      m_nThreads(nThreads < 0 ? ThreadPool::countProcessors() : nThreads)
+{
+    const btVector3 extent(kWorldExtent, kWorldExtent, kWorldExtent);
+    m_private = new WorldPrivate();
+    internal::zerofill(m_private, sizeof(*m_private));
+#ifdef VPVL_ENABLE_MULTITHREADED_PHYSICS
+    if (m_nThreads > 1) {
+        btDefaultCollisionConstructionInfo info;
+        info.m_defaultMaxPersistentManifoldPoolSize = kWorldMaxPersistentManifolds;
+        m_private->config = new btDefaultCollisionConfiguration(info);
+        // Narrowphase is processed in parallel by gathering the pairs into tasks
+        m_private->collisionThreads = WorldCreateThreadSupport("collision", processCollisionTask,
+                                                               createCollisionLocalStoreMemory, m_nThreads);
+        m_private->dispatcher = new SpuGatheringCollisionDispatcher(m_private->collisionThreads, m_nThreads,
+                                                                    m_private->config);
+        m_private->dispatcher->setDispatcherFlags(btCollisionDispatcher::CD_DISABLE_CONTACTPOOL_DYNAMIC_ALLOCATION);
+        m_private->solverThreads = WorldCreateThreadSupport("solver", SolverThreadFunc, SolverlsMemoryFunc, m_nThreads);
+        m_private->solver = new btParallelConstraintSolver(m_private->solverThreads);
+    }
+    else
+#endif
+    {
+        m_nThreads = 1;
+        m_private->config = new btDefaultCollisionConfiguration();
+        m_private->dispatcher = new btCollisionDispatcher(m_private->config);
+        m_private->solver = new btSequentialImpulseConstraintSolver();
+    }
+    m_private->broadphase = new btAxisSweep3(-extent, extent, 1024);
+    m_world = new btDiscreteDynamicsWorld(m_private->dispatcher, m_private->broadphase,
+                                          m_private->solver, m_private->config);
+    // Tweaks to match the simulation of MMD (see MMDME BulletPhysics)
+    m_world->setGravity(btVector3(0.0f, -9.8f * kGravityFactor, 0.0f));
+    m_world->getSolverInfo().m_numIterations = static_cast<int>(10.0f * 60.0f / fps);
+#ifdef VPVL_ENABLE_MULTITHREADED_PHYSICS
+    if (m_nThreads > 1) {
+        // The parallel solver solves all islands as a batch instead of one by one
+        m_world->getSimulationIslandManager()->setSplitIslands(false);
+        m_world->getSolverInfo().m_solverMode = SOLVER_SIMD | SOLVER_USE_WARMSTARTING;
+        m_world->getDispatchInfo().m_enableSPU = true;
+    }
+#endif
+}
+
+World::~World()
+{
+    delete m_world;
+    m_world = 0;
+    delete m_private->solver;
+    delete m_private->dispatcher;
+#ifdef VPVL_ENABLE_MULTITHREADED_PHYSICS
+    delete m_private->solverThreads;
+    delete m_private->collisionThreads;
+#endif
+    delete m_private->broadphase;
+    delete m_private->config;
+    delete m_private;
+    m_private = 0;
+    m_nThreads = 0;
+}
+
+}
@@ -34,6 +34,7 @@
 /* POSSIBILITY OF SUCH DAMAGE.                                       */
 /* ----------------------------------------------------------------- */
 
+#include <LinearMath/btHashMap.h>
 #include "vpvl/vpvl.h"
 #include "vpvl/internal/util.h"
 
@@ -60,6 +61,45 @@ struct XModelInternalMaterial {
     float power;
 };
 
+/* compares the attributes of the vertices by the bits so that the hash agrees with the equality */
+class XModelInternalVertexKey
+{
+public:
+    XModelInternalVertexKey(const XModelIndexedVertex &vertex)
+        : m_vertex(vertex)
+    {
+    }
+
+    unsigned int getHash() const {
+        const uint8_t *ptr = reinterpret_cast<const uint8_t *>(&m_vertex);
+        unsigned int hash = 2166136261u;
+        for (size_t i = 0; i < sizeof(m_vertex); i++) {
+            hash ^= ptr[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+    bool equals(const XModelInternalVertexKey &value) const {
+        return memcmp(&m_vertex, &value.m_vertex, sizeof(m_vertex)) == 0;
+    }
+
+private:
+    XModelIndexedVertex m_vertex;
+};
+
+/* returns the number of the indices of the triangles of the face, or 0 if the face is broken */
+static uint32_t XModelInternalCountFaceIndices(const XModelFaceIndex &face, uint32_t nVertices, uint32_t nMaterials)
+{
+    const uint32_t count = face.count == 4 ? 6 : 3;
+    if (face.index >= nMaterials)
+        return 0;
+    for (uint32_t i = 0; i < face.count && i < 4; i++) {
+        if (static_cast<uint32_t>(face.value[i]) >= nVertices)
+            return 0;
+    }
+    return count;
+}
+
 enum XModelInternalParseState
 {
     kNone,
@@ -567,6 +607,78 @@ void XModel::release()
     m_userData = 0;
 }
 
+void XModel::buildIndexedMesh(XModelIndexedMesh &mesh) const
+{
+    // the same triangles as the faces were drawn one by one
+    static const int kTriangles[] = { 1, 0, 2, 3, 2, 0 };
+    const uint32_t nFaces = m_faces.size(), nVertices = m_vertices.size(), nMaterials = m_materials.size();
+    const btMatrix3x3 &basis = m_transform.getBasis();
+    btHashMap<XModelInternalVertexKey, uint32_t> uniqueIndices;
+    btAlignedObjectArray<uint32_t> remap, offsets;
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.ranges.clear();
+    remap.resize(nVertices, ~0u);
+    offsets.resize(nMaterials, 0);
+    // count the indices of each material to lay out the ranges before filling them
+    for (uint32_t i = 0; i < nFaces; i++) {
+        const XModelFaceIndex &face = m_faces[i];
+        const uint32_t count = XModelInternalCountFaceIndices(face, nVertices, nMaterials);
+        if (count > 0)
+            offsets[face.index] += count;
+    }
+    uint32_t nIndices = 0;
+    for (uint32_t i = 0; i < nMaterials; i++) {
+        const uint32_t count = offsets[i];
+        if (count > 0) {
+            XModelIndexRange range;
+            range.materialIndex = i;
+            range.offset = nIndices;
+            range.count = count;
+            mesh.ranges.push_back(range);
+        }
+        offsets[i] = nIndices;
+        nIndices += count;
+    }
+    mesh.indices.resize(nIndices, 0);
+    for (uint32_t i = 0; i < nFaces; i++) {
+        const XModelFaceIndex &face = m_faces[i];
+        const uint32_t count = XModelInternalCountFaceIndices(face, nVertices, nMaterials);
+        for (uint32_t j = 0; j < count; j++) {
+            const uint32_t x = static_cast<uint32_t>(face.value[kTriangles[j]]);
+            uint32_t index = remap[x];
+            if (index == ~0u) {
+                XModelIndexedVertex vertex;
+                const btVector3 position = m_transform * m_vertices[x] * m_scale;
+                const btVector3 normal = static_cast<int>(x) < m_normals.size() ? basis * m_normals[x] : btVector3(0.0f, 0.0f, 0.0f);
+                const btVector3 coord = static_cast<int>(x) < m_coords.size() ? m_coords[x] : btVector3(0.0f, 0.0f, 0.0f);
+                const btVector4 color = static_cast<int>(x) < m_colors.size() ? m_colors[x] : btVector4(0.0f, 0.0f, 0.0f, 1.0f);
+                memset(&vertex, 0, sizeof(vertex));
+                for (int k = 0; k < 3; k++) {
+                    vertex.position[k] = position[k];
+                    vertex.normal[k] = normal[k];
+                }
+                vertex.textureCoord[0] = coord.x();
+                vertex.textureCoord[1] = coord.y();
+                for (int k = 0; k < 4; k++)
+                    vertex.color[k] = color[k];
+                const XModelInternalVertexKey key(vertex);
+                const uint32_t *found = uniqueIndices.find(key);
+                if (found) {
+                    index = *found;
+                }
+                else {
+                    index = mesh.vertices.size();
+                    mesh.vertices.push_back(vertex);
+                    uniqueIndices.insert(key, index);
+                }
+                remap[x] = index;
+            }
+            mesh.indices[offsets[face.index]++] = index;
+        }
+    }
+}
+
 size_t XModel::stride(StrideType type) const
 {
     switch (type) {
@@ -0,0 +1,111 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2011  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include <vpvl/vpvl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static bool slurpFile(const char *path, uint8_t *&data, size_t &size) {
+    FILE *fp = fopen(path, "rb");
+    if (fp) {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        data = new uint8_t[size];
+        size_t read = fread(data, size, 1, fp);
+        fclose(fp);
+        return read == 1;
+    }
+    return false;
+}
+
+static bool writeFile(const char *path, const uint8_t *data, size_t size) {
+    FILE *fp = fopen(path, "wb");
+    if (fp) {
+        size_t written = fwrite(data, size, 1, fp);
+        fclose(fp);
+        return written == 1;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s input.vmd output.vmd [position] [rotation(degree)] [face]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *data = 0;
+    size_t size = 0;
+    if (!slurpFile(argv[1], data, size)) {
+        fprintf(stderr, "Failed reading the motion: %s\n", argv[1]);
+        delete[] data;
+        return EXIT_FAILURE;
+    }
+    vpvl::VMDMotion motion;
+    if (!motion.load(data, size)) {
+        fprintf(stderr, "Failed parsing the motion: %s (error=%d)\n", argv[1], motion.error());
+        delete[] data;
+        return EXIT_FAILURE;
+    }
+    delete[] data;
+
+    vpvl::MotionReducer reducer;
+    if (argc > 3)
+        reducer.setPositionTolerance(static_cast<float>(atof(argv[3])));
+    if (argc > 4)
+        reducer.setRotationTolerance(static_cast<float>(atof(argv[4])));
+    if (argc > 5)
+        reducer.setFaceWeightTolerance(static_cast<float>(atof(argv[5])));
+    reducer.reduce(&motion);
+
+    size = motion.estimateSize();
+    data = new uint8_t[size];
+    motion.save(data);
+    bool ret = writeFile(argv[2], data, size);
+    delete[] data;
+    if (!ret) {
+        fprintf(stderr, "Failed writing the motion: %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "key frames: %u -> %u (%.1f%% reduced)\n",
+            reducer.countSourceKeyFrames(),
+            reducer.countReducedKeyFrames(),
+            reducer.reductionRatio() * 100.0f);
+    return EXIT_SUCCESS;
+}